@@ -0,0 +1,1573 @@
+// Runs the fix logic over the standard synthetic launches on SimulatedDesktopBackend,
+// and reports how long the fixes took on the virtual clock and how much CPU
+// time the scheduler spent for each start event. Then compares what finding
+// the main window costs in a large window tree with and without a window hint,
+// and, one table each, what the rest of the core costs under load: searching
+// processes with many threads and deep window trees, with and without the
+// search pool, looking up a process's threads among up to 100k of them,
+// telling helpers from main processes, nudging the taskbar button on each
+// monitor layout, start event storms, hundreds of rules, syscalls per window
+// enumeration, logging from many threads, display change storms, how much
+// sooner than the old polling loops a window gets fixed once it's shown,
+// reconciliation on machines with thousands of processes, session routing, the
+// stats block's reader/writer contention and what recording a window's style
+// costs per sample.
+// Name benchmarks after the repetitions to run only those.
+// Builds and runs anywhere.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FixScheduler.h"
+#include "Log.h"
+#include "ProcessClassifier.h"
+#include "ProcessThreadIndex.h"
+#include "Replay.h"
+#include "SessionRouter.h"
+#include "SimulatedDesktopBackend.h"
+#include "SpotifyFix.h"
+#include "StatsBlock.h"
+#include "StyleTimeline.h"
+#include "Trace.h"
+#include "WindowSearchPool.h"
+
+using namespace std;
+
+// Every allocation the program makes goes through these, its size in front of it:
+// the difference in live bytes is what something keeps.
+namespace
+{
+    constexpr size_t ALLOCATION_HEADER = alignof(std::max_align_t);
+    std::atomic<int64_t> liveHeapBytes{ 0 };
+}
+
+void* operator new(const size_t size)
+{
+    unsigned char* const p = static_cast<unsigned char*>(malloc(size + ALLOCATION_HEADER));
+    if (p == nullptr)
+        throw std::bad_alloc();
+    memcpy(p, &size, sizeof size);
+    liveHeapBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    return p + ALLOCATION_HEADER;
+}
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* const p) noexcept
+{
+    if (p == nullptr)
+        return;
+    unsigned char* const block = static_cast<unsigned char*>(p) - ALLOCATION_HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof size);
+    liveHeapBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+    free(block);
+}
+
+void operator delete[](void* const p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* const p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* const p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace
+{
+    constexpr int32_t SECONDARY_MONITOR_LEFT = 1920;
+
+    // Numerical Recipes' LCG: the same storms and scatterings every time
+    uint32_t Next(uint32_t& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    // One launch of Spotify, as it goes on a real desktop: the main process, its
+    // helpers a few ms apart, the marker and main window once it's idle, and the
+    // main window shown some time after that.
+    typedef struct {
+        uint64_t startAt;
+        uint32_t inputIdleMs;
+        uint32_t windowMs;
+        uint32_t visibleMs;
+        size_t helpers;
+        int32_t windowLeft;
+        // Started before the fix logic: found by reconciliation instead of start events
+        bool alreadyRunning;
+    } Launch;
+
+    typedef struct {
+        const char* name;
+        vector<Launch> launches;
+    } Scenario;
+
+    typedef struct {
+        size_t events;
+        size_t fixed;
+        size_t failed;
+        uint64_t dropped;
+        // From the first start event, or the reconciliation, to the last fix
+        uint64_t timeToFixMs;
+        // From a launch to its fix, for the launch that took the longest
+        uint64_t slowestFixMs;
+    } RunResult;
+
+    void AddMonitors(SimulatedDesktopBackend& desktop)
+    {
+        desktop.AddMonitor({ { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom });
+        desktop.AddMonitor({ { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1040 }, 96, false, TaskbarEdge::Bottom });
+    }
+
+    void AddLaunch(SimulatedDesktopBackend& desktop, const Launch& launch, const ProcessId rootProcessId, vector<ReplayStartEvent>& events)
+    {
+        const uint64_t start = launch.startAt;
+        const ThreadId uiThread = rootProcessId * 16 + 1;
+        const ThreadId gpuThread = rootProcessId * 16 + 2;
+
+        desktop.AddProcess(rootProcessId, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+        desktop.AddThread(rootProcessId, uiThread);
+        desktop.AddThread(rootProcessId, gpuThread);
+        desktop.SetInputIdleAt(start + launch.inputIdleMs, rootProcessId);
+
+        const uint64_t windowAt = start + launch.windowMs;
+        const WindowRect rect = { launch.windowLeft, 100, launch.windowLeft + 1200, 900 };
+        desktop.CreateWindowAt(windowAt, uiThread, NULL_WINDOW, L"GDI+ Hook Window Class", L"G", 0, { 0, 0, 0, 0 });
+        const WindowHandle hWnd = desktop.CreateWindowAt(windowAt, uiThread, NULL_WINDOW, L"Chrome_WidgetWin_0", L"Spotify Free", 0, rect);
+        desktop.CreateWindowAt(windowAt + 20, uiThread, hWnd, L"Chrome_RenderWidgetHostHWND", L"", STYLE_VISIBLE, rect);
+        desktop.SetStyleAt(start + launch.visibleMs, hWnd, STYLE_VISIBLE | STYLE_SYSMENU);
+
+        ReplayStartEvent root = {};
+        root.time = start;
+        root.event.processId = rootProcessId;
+        root.event.parentProcessId = 1;
+        wstring(L"Spotify.exe").copy(root.event.processName, PROCESS_NAME_LENGTH - 1);
+        if (!launch.alreadyRunning)
+            events.push_back(root);
+
+        // Renderer, GPU and utility processes, each with a window-less thread
+        for (size_t i = 0; i < launch.helpers; i++)
+        {
+            const ProcessId helperId = rootProcessId + 1 + static_cast<ProcessId>(i);
+            desktop.AddProcess(helperId, rootProcessId, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer");
+            desktop.AddThread(helperId, helperId * 16);
+            desktop.SetInputIdleAt(start + 10, helperId);
+
+            ReplayStartEvent helper = root;
+            helper.time = start + 5 + 3 * i;
+            helper.event.processId = helperId;
+            helper.event.parentProcessId = rootProcessId;
+            if (!launch.alreadyRunning)
+                events.push_back(helper);
+        }
+    }
+
+    RunResult Run(const Scenario& scenario, const RuleSet& rules, double* cpuUs)
+    {
+        SimulatedDesktopBackend desktop;
+        AddMonitors(desktop);
+
+        vector<ReplayStartEvent> events;
+        bool alreadyRunning = false;
+        for (size_t i = 0; i < scenario.launches.size(); i++)
+        {
+            AddLaunch(desktop, scenario.launches[i], static_cast<ProcessId>(1000 * (i + 1)), events);
+            alreadyRunning |= scenario.launches[i].alreadyRunning;
+        }
+        stable_sort(events.begin(), events.end(), [](const ReplayStartEvent& a, const ReplayStartEvent& b) { return a.time < b.time; });
+
+        RunResult result = { events.size(), 0, 0, 0, 0, 0 };
+        uint64_t startedAt = events.empty() ? 0 : events.front().time;
+        FixScheduler scheduler(desktop, desktop, rules);
+        scheduler.SetCompletionCallback([&](const FixJob& job)
+        {
+            if (job.Result() == FixResult::WindowMoved || job.Result() == FixResult::WindowInPlace)
+            {
+                result.fixed++;
+                result.timeToFixMs = max(result.timeToFixMs, desktop.Now() - startedAt);
+                const Launch& launch = scenario.launches[job.RootProcessId() / 1000 - 1];
+                if (!launch.alreadyRunning)
+                    result.slowestFixMs = max(result.slowestFixMs, desktop.Now() - launch.startAt);
+            }
+            else if (job.Result() == FixResult::MainWindowNotFound || job.Result() == FixResult::WindowNotVisible)
+                result.failed++;
+        });
+
+        const clock_t startedCpu = clock();
+        if (alreadyRunning)
+        {
+            startedAt = scenario.launches.front().visibleMs;
+            desktop.AdvanceTo(startedAt);
+            scheduler.Reconcile(SystemSnapshot::Take(desktop));
+            result.events = 1;
+        }
+        for (const ReplayStartEvent& event : events)
+        {
+            scheduler.RunUntil(event.time);
+            scheduler.Submit(event.event);
+        }
+        scheduler.RunUntilIdle();
+        *cpuUs = static_cast<double>(clock() - startedCpu) * 1e6 / CLOCKS_PER_SEC;
+        result.dropped = scheduler.DroppedEvents();
+        return result;
+    }
+
+    // A main process with many threads and windows, the main window on one of the last
+    // threads and the content window a few levels down, behind lots of other children.
+    // Returns the process's threads.
+    vector<ThreadId> AddLargeWindowTree(SimulatedDesktopBackend& desktop, const ProcessId processId)
+    {
+        constexpr size_t THREADS = 24;
+        constexpr size_t MAIN_THREAD = 17;
+        constexpr size_t OTHER_CHILDREN = 120;
+
+        desktop.AddProcess(processId, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+        vector<ThreadId> threads;
+        for (size_t i = 0; i < THREADS; i++)
+        {
+            const ThreadId threadId = processId * 64 + static_cast<ThreadId>(i);
+            desktop.AddThread(processId, threadId);
+            desktop.CreateWindowAt(0, threadId, NULL_WINDOW, L"IME", L"Default IME", 0, { 0, 0, 0, 0 });
+            desktop.CreateWindowAt(0, threadId, NULL_WINDOW, L"MSCTFIME UI", L"MSCTFIME UI", 0, { 0, 0, 0, 0 });
+            threads.push_back(threadId);
+        }
+
+        const WindowRect rect = { SECONDARY_MONITOR_LEFT, 100, SECONDARY_MONITOR_LEFT + 1200, 900 };
+        const ThreadId uiThread = threads[MAIN_THREAD];
+        desktop.CreateWindowAt(0, uiThread, NULL_WINDOW, L"GDI+ Hook Window Class", L"G", 0, { 0, 0, 0, 0 });
+        const WindowHandle hWnd = desktop.CreateWindowAt(0, uiThread, NULL_WINDOW, L"Chrome_WidgetWin_0", L"Spotify Free", STYLE_VISIBLE, rect);
+        for (size_t i = 0; i < OTHER_CHILDREN; i++)
+        {
+            const WindowHandle hChild = desktop.CreateWindowAt(0, uiThread, hWnd, L"Intermediate D3D Window", L"", 0, rect);
+            desktop.CreateWindowAt(0, uiThread, hChild, L"Chrome_WidgetWin_2", L"", 0, rect);
+        }
+        const WindowHandle hHost = desktop.CreateWindowAt(0, uiThread, hWnd, L"Chrome_WidgetWin_1", L"", STYLE_VISIBLE, rect);
+        const WindowHandle hView = desktop.CreateWindowAt(0, uiThread, hHost, L"ViewsHost", L"", STYLE_VISIBLE, rect);
+        desktop.CreateWindowAt(0, uiThread, hView, L"Chrome_RenderWidgetHostHWND", L"", STYLE_VISIBLE, rect);
+        return threads;
+    }
+
+    typedef struct {
+        const char* name;
+        // Null for the full search alone
+        const WindowHint* hint;
+        // The search as it used to be, see DiscoverEagerly
+        bool eager;
+    } DiscoveryCase;
+
+    typedef struct {
+        FindMainWindowResult result;
+        BackendCounters counters;
+        double cpuUs;
+    } DiscoveryResult;
+
+    // The search before it matched class atoms and only read titles when the class
+    // matched: class and title of every window on every thread, and of every child
+    // of every candidate main window. Only the current thread's enumeration stops.
+    void DiscoverEagerly(DesktopBackend& desktop, const vector<ThreadId>& threads, FindMainWindowResult* result)
+    {
+        *result = { NULL_WINDOW, NULL_WINDOW, false, 0 };
+        for (const ThreadId threadId : threads)
+        {
+            desktop.EnumThreadWindows(threadId, [&](const WindowHandle hWnd)
+            {
+                wchar_t title[256];
+                wchar_t className[256];
+                desktop.GetWindowTitle(hWnd, title, 256);
+                desktop.GetWindowClass(hWnd, className, 256);
+                if (WStrICmp(className, L"GDI+ Hook Window Class") == 0 && WStrICmp(title, L"G") == 0)
+                {
+                    result->isMainProcess = true;
+                    return true;
+                }
+                if (WStrICmp(className, L"Chrome_WidgetWin_0") != 0)
+                    return true;
+
+                result->isMainProcess = true;
+                WindowHandle content = NULL_WINDOW;
+                desktop.EnumChildWindows(hWnd, [&](const WindowHandle hChild)
+                {
+                    desktop.GetWindowTitle(hChild, title, 256);
+                    desktop.GetWindowClass(hChild, className, 256);
+                    if (WStrICmp(className, L"Chrome_RenderWidgetHostHWND") != 0)
+                        return true;
+                    content = hChild;
+                    return false;
+                });
+                if (content == NULL_WINDOW)
+                    return true;
+
+                result->hPWnd = hWnd;
+                result->hWnd = content;
+                result->threadId = threadId;
+                return false;
+            });
+        }
+    }
+
+    // What FixJob does: the hint first, if any, then the full search
+    DiscoveryResult Discover(const DiscoveryCase& discovery, const RuleSet& rules, const int repetitions)
+    {
+        SimulatedDesktopBackend desktop;
+        const vector<ThreadId> threads = AddLargeWindowTree(desktop, 1000);
+        const size_t app = rules.FindApp(L"Spotify.exe");
+
+        DiscoveryResult result = {};
+        const clock_t startedCpu = clock();
+        for (int i = 0; i < repetitions; i++)
+        {
+            // Every job has a class cache of its own
+            ClassAtomCache classes(rules);
+            desktop.ResetCounters();
+            if (discovery.eager)
+                DiscoverEagerly(desktop, threads, &result.result);
+            else if (discovery.hint == nullptr || !FindAppMainWindowByHint(desktop, classes, app, threads, *discovery.hint, &result.result))
+                FindAppMainWindow(desktop, classes, app, threads, &result.result);
+            result.counters = desktop.Counters();
+        }
+        result.cpuUs = static_cast<double>(clock() - startedCpu) * 1e6 / CLOCKS_PER_SEC / repetitions;
+        return result;
+    }
+
+    bool RunDiscoveryBenchmark(const RuleSet& rules, const int repetitions)
+    {
+        // Learned from a full search, like FixJob does
+        WindowHint learned = {};
+        {
+            SimulatedDesktopBackend desktop;
+            const vector<ThreadId> threads = AddLargeWindowTree(desktop, 1000);
+            ClassAtomCache classes(rules);
+            FindMainWindowResult result;
+            FindAppMainWindow(desktop, classes, rules.FindApp(L"Spotify.exe"), threads, &result);
+            if (!DescribeAppMainWindow(desktop, threads, result, &learned))
+                return false;
+        }
+
+        // From an older version, whose window tree was different
+        WindowHint stale = { 3, { L"Chrome_WidgetWin_1", L"Chrome_RenderWidgetHostHWND" } };
+
+        const DiscoveryCase cases[] = {
+            { "eager (before)", nullptr, true },
+            { "full search", nullptr, false },
+            { "hint hit", &learned, false },
+            { "hint miss", &stale, false },
+        };
+
+        printf("\n%-16s %8s %11s %13s\n", "Discovery", "syscalls", "cross-proc", "CPU/search");
+        bool ok = true;
+        WindowHandle expected = NULL_WINDOW;
+        for (const DiscoveryCase& discovery : cases)
+        {
+            const DiscoveryResult result = Discover(discovery, rules, repetitions);
+            printf("%-16s %8llu %11llu %10.1f us\n", discovery.name, static_cast<unsigned long long>(result.counters.syscalls),
+                   static_cast<unsigned long long>(result.counters.crossProcessMessages), result.cpuUs);
+
+            // Wherever it looks first, the search must end up with the same window
+            if (expected == NULL_WINDOW)
+                expected = result.result.hWnd;
+            ok &= result.result.hWnd != NULL_WINDOW && result.result.hWnd == expected;
+        }
+        return ok;
+    }
+
+    // =============================
+    //     WINDOW SEARCH SCALING
+    // =============================
+
+    // The simulated desktop, callable from several threads like the real one: every call
+    // holds a lock only while the simulator runs, and a call that sends a message to another
+    // process's window then blocks as long as that process takes to answer.
+    class LatentDesktopBackend final : public DesktopBackend
+    {
+    public:
+        LatentDesktopBackend(SimulatedDesktopBackend& inner, const uint32_t crossProcessUs) : inner(inner), crossProcessUs(crossProcessUs) {}
+
+        uint64_t Now() override { return Locked([&] { return inner.Now(); }); }
+        void Sleep(const uint32_t ms) override { Locked([&] { inner.Sleep(ms); return 0; }); }
+
+        bool GetProcessImageName(const ProcessId processId, wstring& imageName) override { return Locked([&] { return inner.GetProcessImageName(processId, imageName); }); }
+        bool GetProcessCommandLine(const ProcessId processId, wstring& commandLine) override { return Locked([&] { return inner.GetProcessCommandLine(processId, commandLine); }); }
+        bool GetProcessImageVersion(const ProcessId processId, wstring& version) override { return Locked([&] { return inner.GetProcessImageVersion(processId, version); }); }
+
+        bool WaitForInputIdle(const ProcessId processId, const uint32_t timeoutMs) override { return Locked([&] { return inner.WaitForInputIdle(processId, timeoutMs); }); }
+        void ReleaseProcess(const ProcessId processId) override { Locked([&] { inner.ReleaseProcess(processId); return 0; }); }
+        void EnumSystemThreads(const SystemThreadCallback& callback) override { Locked([&] { inner.EnumSystemThreads(callback); return 0; }); }
+        void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) override
+        {
+            Locked([&] { inner.EnumSystemProcesses(processCallback, threadCallback); return 0; });
+        }
+        void EnumWindowThreads(const ProcessId processId, const ThreadCallback& callback) override { Locked([&] { inner.EnumWindowThreads(processId, callback); return 0; }); }
+
+        // The callbacks call back in: they run on a copy of the list, outside the lock
+        void EnumThreadWindows(const ThreadId threadId, const WindowCallback& callback) override
+        {
+            vector<WindowHandle> windows;
+            Locked([&] { inner.EnumThreadWindows(threadId, [&](const WindowHandle hWnd) { windows.push_back(hWnd); return true; }); return 0; });
+            for (const WindowHandle hWnd : windows)
+            {
+                if (!callback(hWnd))
+                    return;
+            }
+        }
+        void EnumChildWindows(const WindowHandle hWnd, const WindowCallback& callback) override
+        {
+            vector<WindowHandle> children;
+            Locked([&] { inner.EnumChildWindows(hWnd, [&](const WindowHandle hChild) { children.push_back(hChild); return true; }); return 0; });
+            for (const WindowHandle hChild : children)
+            {
+                if (!callback(hChild))
+                    return;
+            }
+        }
+        WindowHandle FindChildWindow(const WindowHandle hParent, const wchar_t* const className) override { return Locked([&] { return inner.FindChildWindow(hParent, className); }); }
+        WindowHandle GetParentWindow(const WindowHandle hWnd) override { return Locked([&] { return inner.GetParentWindow(hWnd); }); }
+
+        ClassAtom GetClassAtom(const WindowHandle hWnd) override { return Locked([&] { return inner.GetClassAtom(hWnd); }); }
+        size_t GetWindowClass(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength) override { return Locked([&] { return inner.GetWindowClass(hWnd, buffer, bufferLength); }); }
+        size_t GetWindowTitle(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength) override { return Locked([&] { return inner.GetWindowTitle(hWnd, buffer, bufferLength); }); }
+
+        uint32_t GetStyle(const WindowHandle hWnd) override { return Locked([&] { return inner.GetStyle(hWnd); }); }
+        uint32_t GetExStyle(const WindowHandle hWnd) override { return Locked([&] { return inner.GetExStyle(hWnd); }); }
+
+        WindowRect GetWindowPosition(const WindowHandle hWnd) override { return Locked([&] { return inner.GetWindowPosition(hWnd); }); }
+        bool SetWindowPosition(const WindowHandle hWnd, const WindowMove& move) override { return Locked([&] { return inner.SetWindowPosition(hWnd, move); }); }
+
+        void EnumMonitors(const MonitorCallback& callback) override { Locked([&] { inner.EnumMonitors(callback); return 0; }); }
+
+        bool Concurrent() const override { return true; }
+
+        BackendCounters Counters() const override
+        {
+            lock_guard<mutex> lock(innerMutex);
+            return inner.Counters();
+        }
+        void ResetCounters() override { Locked([&] { inner.ResetCounters(); return 0; }); }
+
+    private:
+        template <typename Call>
+        auto Locked(Call call) -> decltype(call())
+        {
+            uint64_t messages;
+            auto result = [&]
+            {
+                lock_guard<mutex> lock(innerMutex);
+                const uint64_t before = inner.Counters().crossProcessMessages;
+                auto value = call();
+                messages = inner.Counters().crossProcessMessages - before;
+                return value;
+            }();
+            if (messages > 0)
+                this_thread::sleep_for(chrono::microseconds(crossProcessUs * messages));
+            return result;
+        }
+
+        SimulatedDesktopBackend& inner;
+        const uint32_t crossProcessUs;
+        mutable mutex innerMutex;
+    };
+
+    // A main process with `threadCount` threads, each with a hidden, untitled Chromium window
+    // whose title has to be read before it can be ruled out, and the main window on one of
+    // the last threads, its content window `depth` levels down, with a few siblings at each.
+    vector<ThreadId> AddWideWindowTree(SimulatedDesktopBackend& desktop, const ProcessId processId, const size_t threadCount, const size_t depth)
+    {
+        constexpr size_t SIBLINGS = 3;
+
+        desktop.AddProcess(processId, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+        vector<ThreadId> threads;
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            const ThreadId threadId = processId * 1024 + static_cast<ThreadId>(i);
+            desktop.AddThread(processId, threadId);
+            desktop.CreateWindowAt(0, threadId, NULL_WINDOW, L"IME", L"Default IME", 0, { 0, 0, 0, 0 });
+            desktop.CreateWindowAt(0, threadId, NULL_WINDOW, L"Chrome_WidgetWin_0", L"", 0, { 0, 0, 0, 0 });
+            threads.push_back(threadId);
+        }
+
+        const WindowRect rect = { SECONDARY_MONITOR_LEFT, 100, SECONDARY_MONITOR_LEFT + 1200, 900 };
+        const ThreadId uiThread = threads[threadCount * 3 / 4];
+        WindowHandle hParent = desktop.CreateWindowAt(0, uiThread, NULL_WINDOW, L"Chrome_WidgetWin_0", L"Spotify Free", STYLE_VISIBLE, rect);
+        for (size_t level = 0; level < depth; level++)
+        {
+            for (size_t i = 0; i < SIBLINGS; i++)
+                desktop.CreateWindowAt(0, uiThread, hParent, L"Intermediate D3D Window", L"", 0, rect);
+            hParent = desktop.CreateWindowAt(0, uiThread, hParent, L"Chrome_WidgetWin_1", L"", STYLE_VISIBLE, rect);
+        }
+        desktop.CreateWindowAt(0, uiThread, hParent, L"Chrome_RenderWidgetHostHWND", L"", STYLE_VISIBLE, rect);
+        return threads;
+    }
+
+    // How the search scales with the number of threads and the depth of the window tree,
+    // on the calling thread alone and with WindowSearchPool's workers
+    bool RunWindowSearchBenchmark(const RuleSet& rules, int)
+    {
+        constexpr uint32_t CROSS_PROCESS_US = 50;
+        constexpr int SEARCHES = 5;
+
+        WindowSearchPool pool;
+        pool.Start();
+        const size_t app = rules.FindApp(L"Spotify.exe");
+
+        printf("\n%-16s %6s %9s %12s %12s %8s\n", "Window search", "depth", "messages", "sequential", "pool", "speedup");
+        bool ok = true;
+        for (const size_t threadCount : { 8, 32, 128 })
+        {
+            for (const size_t depth : { 1, 16, 64 })
+            {
+                SimulatedDesktopBackend simulated;
+                const vector<ThreadId> threads = AddWideWindowTree(simulated, 1000, threadCount, depth);
+                LatentDesktopBackend desktop(simulated, CROSS_PROCESS_US);
+
+                uint64_t elapsedUs[2] = {};
+                FindMainWindowResult results[2] = {};
+                for (int i = 0; i < SEARCHES; i++)
+                {
+                    for (const bool pooled : { false, true })
+                    {
+                        ClassAtomCache classes(rules);
+                        desktop.ResetCounters();
+                        const uint64_t startedUs = Tracer::Now();
+                        if (pooled)
+                            pool.FindAppMainWindow(desktop, classes, app, threads, &results[1]);
+                        else
+                            FindAppMainWindow(desktop, classes, app, threads, &results[0]);
+                        elapsedUs[pooled ? 1 : 0] += Tracer::Now() - startedUs;
+                    }
+                }
+
+                const double sequentialMs = static_cast<double>(elapsedUs[0]) / SEARCHES / 1000;
+                const double pooledMs = static_cast<double>(elapsedUs[1]) / SEARCHES / 1000;
+                printf("%-16zu %6zu %9llu %9.2f ms %9.2f ms %7.1fx\n", threadCount, depth,
+                       static_cast<unsigned long long>(desktop.Counters().crossProcessMessages), sequentialMs, pooledMs,
+                       pooledMs > 0 ? sequentialMs / pooledMs : 0.0);
+
+                // The pool must find exactly what the sequential search finds
+                ok &= results[0].hWnd != NULL_WINDOW && results[0].hWnd == results[1].hWnd && results[0].hPWnd == results[1].hPWnd;
+            }
+        }
+        pool.Stop();
+        return ok;
+    }
+
+
+    // ====================
+    //     THREAD INDEX
+    // ====================
+
+    // A machine with `threads` threads, ten to a process, then lookups of the threads of
+    // processes picked all over it: with a system-wide snapshot for each, as before, and
+    // from the index, built once and refreshed for the process being looked up.
+    bool RunThreadIndexBenchmark(const RuleSet&, const int repetitions)
+    {
+        constexpr size_t THREADS_PER_PROCESS = 10;
+        constexpr size_t LOOKUPS = 200;
+
+        printf("\n%-16s %12s %12s %14s %14s\n", "Thread index", "build", "index size", "snapshot/look", "index/look");
+        bool ok = true;
+        for (const size_t threadCount : { 1000, 10000, 100000 })
+        {
+            SimulatedDesktopBackend desktop;
+            const size_t processCount = threadCount / THREADS_PER_PROCESS;
+            for (size_t i = 0; i < processCount; i++)
+            {
+                const ProcessId processId = static_cast<ProcessId>(4 * (i + 1));
+                desktop.AddProcess(processId, 1, L"svchost.exe", L"svchost.exe -k netsvcs");
+                for (size_t j = 0; j < THREADS_PER_PROCESS; j++)
+                    desktop.AddThread(processId, static_cast<ThreadId>(processId * 16 + j));
+            }
+
+            uint32_t random = 3;
+            vector<ProcessId> lookedUp;
+            for (size_t i = 0; i < LOOKUPS; i++)
+                lookedUp.push_back(static_cast<ProcessId>(4 * (Next(random) % processCount + 1)));
+
+            const int64_t heapBefore = liveHeapBytes;
+            const uint64_t buildStartedUs = Tracer::Now();
+            ProcessThreadIndex index;
+            index.Build(desktop);
+            const uint64_t buildUs = Tracer::Now() - buildStartedUs;
+            const int64_t indexBytes = liveHeapBytes - heapBefore;
+
+            size_t snapshotThreads = 0;
+            const clock_t snapshotStartedCpu = clock();
+            for (const ProcessId processId : lookedUp)
+            {
+                desktop.EnumSystemThreads([&](const ProcessId owner, ThreadId)
+                {
+                    if (owner == processId)
+                        snapshotThreads++;
+                });
+            }
+            const double snapshotUs = static_cast<double>(clock() - snapshotStartedCpu) * 1e6 / CLOCKS_PER_SEC / LOOKUPS;
+
+            // Too quick to time once
+            size_t indexThreads = 0;
+            const clock_t indexStartedCpu = clock();
+            for (int i = 0; i < repetitions; i++)
+            {
+                indexThreads = 0;
+                for (const ProcessId processId : lookedUp)
+                {
+                    index.Refresh(desktop, processId);
+                    indexThreads += index.ThreadsOf(processId).size();
+                }
+            }
+            const double indexUs = static_cast<double>(clock() - indexStartedCpu) * 1e6 / CLOCKS_PER_SEC / LOOKUPS / repetitions;
+
+            printf("%-16zu %9.1f ms %9lld KB %11.1f us %11.2f us\n", threadCount, static_cast<double>(buildUs) / 1000,
+                   static_cast<long long>(indexBytes / 1024), snapshotUs, indexUs);
+            ok &= index.ThreadCount() == threadCount && indexThreads == snapshotThreads;
+        }
+        return ok;
+    }
+
+
+    // ======================
+    //     CLASSIFICATION
+    // ======================
+
+    typedef struct {
+        const char* name;
+        ProcessId processId;
+        ProcessId parentProcessId;
+        // Told apart by its windows, as before: idle, a thread snapshot and a window search
+        bool byWindows;
+        ProcessRole expected;
+    } ClassificationCase;
+
+    // A warm Spotify tree on a desktop with a couple hundred other processes, and what it
+    // costs to tell each kind of start event apart
+    bool RunClassificationBenchmark(const RuleSet& rules, const int repetitions)
+    {
+        constexpr size_t OTHER_PROCESSES = 200;
+        constexpr size_t THREADS_PER_PROCESS = 10;
+        constexpr int EVENTS_PER_REPETITION = 100;
+
+        SimulatedDesktopBackend desktop;
+        for (size_t i = 0; i < OTHER_PROCESSES; i++)
+        {
+            const ProcessId processId = static_cast<ProcessId>(10000 + 4 * i);
+            desktop.AddProcess(processId, 1, L"svchost.exe", L"svchost.exe -k netsvcs");
+            for (size_t j = 0; j < THREADS_PER_PROCESS; j++)
+                desktop.AddThread(processId, static_cast<ThreadId>(processId * 16 + j));
+        }
+        vector<ReplayStartEvent> events;
+        AddLaunch(desktop, { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, false }, 1000, events);
+        desktop.AdvanceTo(1000);
+
+        const ClassificationCase cases[] = {
+            { "main", 1000, 1, false, ProcessRole::Main },
+            { "helper", 1001, 1000, false, ProcessRole::Helper },
+            // Gone, or not ours to look at: only its parent says what it is
+            { "helper, no cmd", 9001, 1000, false, ProcessRole::Helper },
+            { "helper (before)", 1001, 1000, true, ProcessRole::Helper },
+        };
+
+        const AppRule& spotify = rules.App(rules.FindApp(L"Spotify.exe"));
+        printf("\n%-16s %8s %8s %13s\n", "Classification", "role", "syscalls", "CPU/event");
+        bool ok = true;
+        for (const ClassificationCase& classification : cases)
+        {
+            ProcessStartEvent event = {};
+            event.processId = classification.processId;
+            event.parentProcessId = classification.parentProcessId;
+            wstring(L"Spotify.exe").copy(event.processName, PROCESS_NAME_LENGTH - 1);
+
+            ProcessRole role = ProcessRole::Unknown;
+            desktop.ResetCounters();
+            const clock_t startedCpu = clock();
+            for (int i = 0; i < repetitions * EVENTS_PER_REPETITION; i++)
+            {
+                if (!classification.byWindows)
+                {
+                    role = ClassifyProcess(desktop, event, spotify);
+                    continue;
+                }
+
+                desktop.WaitForInputIdle(event.processId, 0);
+                vector<ThreadId> threads;
+                desktop.EnumSystemThreads([&](const ProcessId owner, const ThreadId threadId)
+                {
+                    if (owner == event.processId)
+                        threads.push_back(threadId);
+                });
+                FindMainWindowResult result;
+                DiscoverEagerly(desktop, threads, &result);
+                role = result.isMainProcess ? ProcessRole::Main : ProcessRole::Helper;
+            }
+            const double eventCount = static_cast<double>(repetitions) * EVENTS_PER_REPETITION;
+            const double cpuUs = static_cast<double>(clock() - startedCpu) * 1e6 / CLOCKS_PER_SEC / eventCount;
+
+            const char* roleName = role == ProcessRole::Main ? "main" : role == ProcessRole::Helper ? "helper" : "unknown";
+            printf("%-16s %8s %8.0f %10.2f us\n", classification.name, roleName,
+                   static_cast<double>(desktop.Counters().syscalls) / eventCount, cpuUs);
+            ok &= role == classification.expected;
+        }
+        return ok;
+    }
+
+
+    vector<Scenario> StandardScenarios()
+    {
+        const Launch warm = { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, false };
+        const Launch cold = { 0, 800, 700, 4800, 12, SECONDARY_MONITOR_LEFT, false };
+
+        Launch primary = warm;
+        primary.windowLeft = 100;
+
+        Launch storm = warm;
+        storm.helpers = 200;
+
+        Launch running = warm;
+        running.alreadyRunning = true;
+
+        vector<Launch> overlapping;
+        for (uint64_t i = 0; i < 8; i++)
+        {
+            Launch launch = warm;
+            launch.startAt = i * 40;
+            overlapping.push_back(launch);
+        }
+
+        return {
+            { "warm start", { warm } },
+            { "cold start", { cold } },
+            { "primary monitor", { primary } },
+            { "helper storm", { storm } },
+            { "already running", { running } },
+            { "8 overlapping", overlapping },
+        };
+    }
+
+    bool RunScenarioBenchmark(const RuleSet& rules, const int repetitions)
+    {
+        printf("%-16s %7s %6s %7s %14s %13s\n", "Scenario", "events", "fixed", "failed", "time-to-fix", "CPU/event");
+        bool ok = true;
+        for (const Scenario& scenario : StandardScenarios())
+        {
+            RunResult result = {};
+            double totalCpuUs = 0;
+            for (int i = 0; i < repetitions; i++)
+            {
+                double cpuUs;
+                result = Run(scenario, rules, &cpuUs);
+                totalCpuUs += cpuUs;
+            }
+
+            const double cpuPerEvent = totalCpuUs / repetitions / static_cast<double>(result.events);
+            printf("%-16s %7zu %6zu %7zu %11llu ms %10.1f us\n", scenario.name, result.events, result.fixed, result.failed,
+                   static_cast<unsigned long long>(result.timeToFixMs), cpuPerEvent);
+            ok &= result.fixed == scenario.launches.size() && result.failed == 0;
+        }
+        return ok;
+    }
+
+
+    // =====================
+    //     TASKBAR NUDGE
+    // =====================
+
+    typedef struct {
+        const char* name;
+        vector<MonitorInfo> monitors;
+        int32_t windowLeft;
+        size_t expectedMoves;
+    } NudgeLayout;
+
+    // A warm launch on each monitor layout, fixed for real: the moves and repaints it cost,
+    // against the two repainting MoveWindow calls it always took before
+    bool RunNudgeBenchmark(const RuleSet& rules, int)
+    {
+        const MonitorInfo primary = { { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom };
+        const MonitorInfo secondary = { { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1040 }, 96, false, TaskbarEdge::Bottom };
+        MonitorInfo withoutTaskbar = secondary;
+        withoutTaskbar.taskbar = TaskbarEdge::None;
+        withoutTaskbar.workArea = withoutTaskbar.bounds;
+        const MonitorInfo highDpi = { { 1920, 0, 5760, 2160 }, { 1920, 0, 5760, 2100 }, 192, false, TaskbarEdge::Bottom };
+
+        const NudgeLayout layouts[] = {
+            { "single monitor", { primary }, 100, 0 },
+            { "on the primary", { primary, secondary }, 100, 0 },
+            { "secondary", { primary, secondary }, SECONDARY_MONITOR_LEFT, 2 },
+            { "no 2nd taskbar", { primary, withoutTaskbar }, SECONDARY_MONITOR_LEFT, 0 },
+            { "mixed DPIs", { primary, highDpi }, SECONDARY_MONITOR_LEFT, 2 },
+            { "no topology", {}, SECONDARY_MONITOR_LEFT, 2 },
+        };
+
+        printf("\n%-16s %14s %17s %15s\n", "Taskbar nudge", "result", "moves (before)", "repaints");
+        bool ok = true;
+        for (const NudgeLayout& layout : layouts)
+        {
+            SimulatedDesktopBackend desktop;
+            for (const MonitorInfo& monitor : layout.monitors)
+                desktop.AddMonitor(monitor);
+            vector<ReplayStartEvent> events;
+            AddLaunch(desktop, { 0, 150, 300, 450, 6, layout.windowLeft, false }, 1000, events);
+
+            FixResult result = FixResult::Pending;
+            FixScheduler scheduler(desktop, desktop, rules);
+            scheduler.SetCompletionCallback([&](const FixJob& job) { result = job.Result(); });
+            for (const ReplayStartEvent& event : events)
+            {
+                scheduler.RunUntil(event.time);
+                scheduler.Submit(event.event);
+            }
+            scheduler.RunUntilIdle();
+
+            const size_t moves = desktop.Moves().size();
+            const size_t repaints = static_cast<size_t>(count_if(desktop.Moves().begin(), desktop.Moves().end(),
+                                                                 [](const SimulatedDesktopBackend::MoveRecord& move) { return move.redraw; }));
+            const char* resultName = result == FixResult::WindowMoved ? "moved" : result == FixResult::WindowInPlace ? "in place" : "FAILED";
+            printf("%-16s %14s %8zu (%zu) %11zu (%zu)\n", layout.name, resultName, moves, static_cast<size_t>(2), repaints, static_cast<size_t>(2));
+            ok &= (result == FixResult::WindowMoved || result == FixResult::WindowInPlace) && moves == layout.expectedMoves && repaints == 0;
+        }
+        return ok;
+    }
+
+
+    // ====================
+    //     EVENT STORMS
+    // ====================
+
+    // Ten seconds of launches, one every `intervalMs`, each with a couple dozen helpers:
+    // at the fastest rate, more trees are waiting for their windows than there are job slots.
+    bool RunStressBenchmark(const RuleSet& rules, int)
+    {
+        constexpr uint64_t DURATION_MS = 10 * 1000;
+        constexpr size_t HELPERS = 24;
+
+        printf("\n%-16s %7s %6s %8s %14s %13s\n", "Start events/s", "events", "fixed", "dropped", "slowest fix", "CPU/event");
+        bool ok = true;
+        for (const uint64_t intervalMs : { 100, 50, 25 })
+        {
+            Scenario scenario = { "stress", {} };
+            for (uint64_t time = 0; time < DURATION_MS; time += intervalMs)
+                scenario.launches.push_back({ time, 150, 300, 450, HELPERS, SECONDARY_MONITOR_LEFT, false });
+
+            double cpuUs;
+            const RunResult result = Run(scenario, rules, &cpuUs);
+            const size_t perSecond = static_cast<size_t>(result.events * 1000 / DURATION_MS);
+            printf("%-16zu %7zu %6zu %8llu %11llu ms %10.1f us\n", perSecond, result.events, result.fixed,
+                   static_cast<unsigned long long>(result.dropped), static_cast<unsigned long long>(result.slowestFixMs),
+                   cpuUs / static_cast<double>(result.events));
+            ok &= result.fixed == scenario.launches.size() && result.dropped == 0;
+        }
+        return ok;
+    }
+
+
+    // =============
+    //     RULES
+    // =============
+
+    // `apps` made-up apps, and Spotify last, so that it's looked up past all of them
+    string ManyRules(const size_t apps)
+    {
+        string text;
+        for (size_t i = 0; i < apps; i++)
+        {
+            const string name = "App" + to_string(i);
+            text += "[" + name + "]\n";
+            text += "process = " + name + ".exe\n";
+            text += "process = " + name + "Helper.exe\n";
+            text += "marker  = " + name + " Marker | G\n";
+            text += "window  = " + name + "_Window | *\n";
+            text += "content = " + name + "_Content\n";
+        }
+        text += "[Spotify]\n"
+                "process = Spotify.exe\n"
+                "marker  = GDI+ Hook Window Class | G\n"
+                "marker  = Chrome_WidgetWin_0\n"
+                "window  = Chrome_WidgetWin_0 | *\n"
+                "content = Chrome_RenderWidgetHostHWND\n";
+        return text;
+    }
+
+    // Parsing and compiling hundreds of apps' rules, looking up window classes in them,
+    // and the standard warm start with all of them loaded
+    bool RunRulesBenchmark(const RuleSet&, const int repetitions)
+    {
+        constexpr size_t LOOKUPS = 1000 * 1000;
+        // The classes of the large window tree, and one of the made-up apps'
+        const wchar_t* const classes[] = {
+            L"IME", L"MSCTFIME UI", L"GDI+ Hook Window Class", L"Chrome_WidgetWin_0", L"Intermediate D3D Window",
+            L"Chrome_WidgetWin_2", L"Chrome_WidgetWin_1", L"ViewsHost", L"Chrome_RenderWidgetHostHWND", L"App7_Window",
+        };
+        const size_t classCount = sizeof classes / sizeof classes[0];
+        const Launch warm = { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, false };
+
+        printf("\n%-16s %10s %10s %12s %13s\n", "Rules (apps)", "parse", "WQL chars", "per lookup", "CPU/event");
+        bool ok = true;
+        for (const size_t apps : { 0, 10, 100, 500 })
+        {
+            const string text = ManyRules(apps);
+            RuleSet rules;
+            string error;
+            const uint64_t parseStartedUs = Tracer::Now();
+            ok &= rules.Parse(text, error);
+            const uint64_t parseUs = Tracer::Now() - parseStartedUs;
+
+            size_t matches = 0;
+            const uint64_t lookupsStartedUs = Tracer::Now();
+            for (size_t i = 0; i < LOOKUPS; i++)
+                matches += rules.MatchClass(classes[i % classCount]) != nullptr;
+            const double lookupNs = static_cast<double>(Tracer::Now() - lookupsStartedUs) * 1000 / LOOKUPS;
+
+            const Scenario scenario = { "rules", { warm } };
+            RunResult result = {};
+            double totalCpuUs = 0;
+            for (int i = 0; i < repetitions; i++)
+            {
+                double cpuUs;
+                result = Run(scenario, rules, &cpuUs);
+                totalCpuUs += cpuUs;
+            }
+
+            printf("%-16zu %7.2f ms %10zu %9.1f ns %10.1f us\n", apps + 1, static_cast<double>(parseUs) / 1000,
+                   rules.BuildWqlQuery().size(), lookupNs, totalCpuUs / repetitions / static_cast<double>(result.events));
+            ok &= rules.Apps().size() == apps + 1 && matches > 0 && result.fixed == 1;
+        }
+        return ok;
+    }
+
+
+    // ===============
+    //     LOGGING
+    // ===============
+
+    // Many threads logging at once, through the logger to a file, and the way it used to
+    // be done: formatting and writing the line under a lock, and flushing it.
+    bool RunLoggingBenchmark(const RuleSet&, int)
+    {
+        constexpr size_t LINES_PER_THREAD = 20000;
+        const string path = (filesystem::temp_directory_path() / "SpotifyTaskbarFixBenchmark.log").string();
+
+        printf("\n%-16s %8s %12s %9s\n", "Logging", "threads", "per call", "dropped");
+        for (const bool synchronous : { true, false })
+        {
+            for (const size_t threadCount : { 1, 2, 4, 8 })
+            {
+                filesystem::remove(path);
+                FILE* file = nullptr;
+                mutex fileMutex;
+                uint64_t droppedBefore = 0;
+                if (synchronous)
+                    file = fopen(path.c_str(), "a");
+                else
+                {
+                    Logger::Instance().Stop();
+                    const LogConfig config = { path, 1ull << 30, 0, false };
+                    Logger::Instance().Start(config);
+                    droppedBefore = Logger::Instance().DroppedLines();
+                }
+
+                atomic<uint64_t> totalNs{ 0 };
+                vector<thread> threads;
+                for (size_t t = 0; t < threadCount; t++)
+                {
+                    threads.emplace_back([&, t]
+                    {
+                        const uint64_t startedUs = Tracer::Now();
+                        for (size_t i = 0; i < LINES_PER_THREAD; i++)
+                        {
+                            const unsigned processId = static_cast<unsigned>(t * LINES_PER_THREAD + i);
+                            if (!synchronous)
+                            {
+                                Log(LogLevel::Info, "Spotify.exe started: process 0x%08X, parent 0x%08X", processId, 1u);
+                                continue;
+                            }
+
+                            lock_guard<mutex> lock(fileMutex);
+                            const time_t now = time(nullptr);
+                            char timestamp[32];
+                            strftime(timestamp, sizeof timestamp, "%Y-%m-%d %H:%M:%S", localtime(&now));
+                            fprintf(file, "%s Spotify.exe started: process 0x%08X, parent 0x%08X\n", timestamp, processId, 1u);
+                            fflush(file);
+                        }
+                        totalNs += (Tracer::Now() - startedUs) * 1000;
+                    });
+                }
+                for (thread& thread : threads)
+                    thread.join();
+
+                uint64_t dropped = 0;
+                if (synchronous)
+                    fclose(file);
+                else
+                {
+                    dropped = Logger::Instance().DroppedLines() - droppedBefore;
+                    Logger::Instance().Stop();
+                    const LogConfig quiet = {};
+                    Logger::Instance().Start(quiet);
+                }
+
+                const double lines = static_cast<double>(threadCount * LINES_PER_THREAD);
+                printf("%-16s %8zu %9.1f ns %8.1f%%\n", synchronous ? "locked + flush" : "Logger", threadCount,
+                       static_cast<double>(totalNs) / lines, 100.0 * static_cast<double>(dropped) / lines);
+            }
+        }
+        filesystem::remove(path);
+        return true;
+    }
+
+
+    // ============================
+    //     DISPLAY CHANGE STORMS
+    // ============================
+
+    // A fixed window in watch mode, and docking after docking: each one a burst of display and
+    // settings changes a few ms to a few hundred ms apart, then quiet. Every topology change
+    // must nudge the window once, and only once.
+    bool RunDisplayStormBenchmark(const RuleSet& rules, int)
+    {
+        constexpr size_t TOPOLOGY_CHANGES = 50;
+
+        SimulatedDesktopBackend desktop;
+        AddMonitors(desktop);
+        vector<ReplayStartEvent> events;
+        AddLaunch(desktop, { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, false }, 1000, events);
+
+        FixScheduler scheduler(desktop, desktop, rules);
+        scheduler.SetWatchMode(true);
+        for (const ReplayStartEvent& event : events)
+        {
+            scheduler.RunUntil(event.time);
+            scheduler.Submit(event.event);
+        }
+        scheduler.RunUntilIdle();
+
+        uint32_t random = 1;
+        size_t notifications = 0;
+        size_t maxMoves = 0;
+        uint64_t maxNudges = 0;
+        uint64_t time = desktop.Now() + 1000;
+        const clock_t startedCpu = clock();
+        for (size_t change = 0; change < TOPOLOGY_CHANGES; change++)
+        {
+            const size_t movesBefore = desktop.Moves().size();
+            const uint64_t nudgesBefore = scheduler.Renudges();
+
+            // Docked, the secondary monitor is a bigger one
+            const int32_t width = change % 2 == 0 ? 2560 : 1920;
+            const int32_t height = change % 2 == 0 ? 1440 : 1080;
+            desktop.RemoveMonitors();
+            desktop.AddMonitor({ { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom });
+            desktop.AddMonitor({ { SECONDARY_MONITOR_LEFT, 0, SECONDARY_MONITOR_LEFT + width, height },
+                                 { SECONDARY_MONITOR_LEFT, 0, SECONDARY_MONITOR_LEFT + width, height - 40 }, 96, false, TaskbarEdge::Bottom });
+
+            const size_t burst = 5 + Next(random) % 30;
+            for (size_t i = 0; i < burst; i++)
+            {
+                time += Next(random) % 300;
+                scheduler.RunUntil(time);
+                scheduler.NotifyDisplayChanged();
+            }
+            notifications += burst;
+            time += 3000;
+            scheduler.RunUntil(time);
+
+            maxMoves = max(maxMoves, desktop.Moves().size() - movesBefore);
+            maxNudges = max(maxNudges, scheduler.Renudges() - nudgesBefore);
+        }
+        const double cpuUs = static_cast<double>(clock() - startedCpu) * 1e6 / CLOCKS_PER_SEC;
+
+        printf("\n%-16s %13s %7s %8s %11s %14s\n", "Display storm", "notifications", "passes", "nudges", "max nudges", "CPU/notif.");
+        printf("%-16zu %13zu %7llu %8llu %11llu %11.1f us\n", TOPOLOGY_CHANGES, notifications,
+               static_cast<unsigned long long>(scheduler.DisplayPasses()), static_cast<unsigned long long>(scheduler.Renudges()),
+               static_cast<unsigned long long>(maxNudges), cpuUs / static_cast<double>(notifications));
+
+        // A nudge is the two moves of the round trip
+        return scheduler.Renudges() == TOPOLOGY_CHANGES && maxNudges == 1 && maxMoves == 2;
+    }
+
+
+    // ======================================
+    //     EVENTS VS. THE OLD POLLING LOOPS
+    // ======================================
+
+    // The fix as it was before FixJob, for one main process: wait for input idle (and half a
+    // second more if that was quick), search every 250 ms until the windows are there, check
+    // every 100 ms until the main window is visible, then the round trip. Returns when the
+    // window was fixed, or 0 if it gave up.
+    uint64_t FixByPolling(SimulatedDesktopBackend& desktop, const ProcessId processId)
+    {
+        const uint64_t startedAt = desktop.Now();
+        desktop.WaitForInputIdle(processId, 1000);
+        if (desktop.Now() - startedAt < 500)
+            desktop.Sleep(500);
+
+        // A thread snapshot for every search, like CreateToolhelp32Snapshot was
+        FindMainWindowResult result;
+        const auto search = [&]
+        {
+            vector<ThreadId> threads;
+            desktop.EnumSystemThreads([&](const ProcessId owner, const ThreadId threadId)
+            {
+                if (owner == processId)
+                    threads.push_back(threadId);
+            });
+            DiscoverEagerly(desktop, threads, &result);
+        };
+
+        search();
+        for (uint32_t waitedMs = 0; result.isMainProcess && result.hWnd == NULL_WINDOW && waitedMs < 5000; waitedMs += 250)
+        {
+            desktop.Sleep(250);
+            search();
+        }
+        if (result.hWnd == NULL_WINDOW)
+            return 0;
+
+        bool visible = false;
+        for (uint32_t waitedMs = 0; !visible && waitedMs < 10000; waitedMs += 100)
+        {
+            desktop.Sleep(100);
+            visible = HasFlag(desktop.GetStyle(result.hWnd), STYLE_VISIBLE) && HasFlag(desktop.GetStyle(result.hPWnd), STYLE_VISIBLE | STYLE_SYSMENU);
+        }
+        if (!visible)
+            return 0;
+
+        const WindowRect rect = desktop.GetWindowPosition(result.hPWnd);
+        desktop.SetWindowPosition(result.hPWnd, { { 0, 0, rect.right - rect.left, rect.bottom - rect.top }, true, true });
+        desktop.SetWindowPosition(result.hPWnd, { rect, true, true });
+        return desktop.Now();
+    }
+
+    typedef struct {
+        // Totals, over the launches that were fixed
+        uint64_t meanMs;
+        // From the main window being shown to the fix
+        uint64_t meanLagMs;
+        uint64_t worstLagMs;
+        size_t fixed;
+    } ReadinessResult;
+
+    void AddTimeToFix(ReadinessResult& result, const Launch& launch, const uint64_t fixedAt)
+    {
+        result.fixed++;
+        result.meanMs += fixedAt - launch.startAt;
+        result.meanLagMs += fixedAt - launch.startAt - launch.visibleMs;
+        result.worstLagMs = max(result.worstLagMs, fixedAt - launch.startAt - launch.visibleMs);
+    }
+
+    // One launch after another, each on a desktop of its own, the old way and through the scheduler
+    bool RunPollingBenchmark(const RuleSet& rules, const int repetitions)
+    {
+        const Launch warm = { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, false };
+        const Launch cold = { 0, 800, 700, 4800, 12, SECONDARY_MONITOR_LEFT, false };
+
+        // Idle, windows and visibility anywhere in the first few seconds; the windows within the
+        // identification timeout, or neither way would take the process for the main one
+        vector<Launch> scattered;
+        uint32_t random = 7;
+        for (int i = 0; i < repetitions; i++)
+        {
+            Launch launch = warm;
+            launch.inputIdleMs = 50 + Next(random) % 400;
+            launch.windowMs = launch.inputIdleMs + Next(random) % 400;
+            launch.visibleMs = launch.windowMs + 50 + Next(random) % 2000;
+            scattered.push_back(launch);
+        }
+
+        const Scenario scenarios[] = {
+            { "warm start", { warm } },
+            { "cold start", { cold } },
+            { "scattered", scattered },
+        };
+
+        printf("\n%-16s %9s %22s %22s %14s\n", "Readiness", "launches", "polling (before)", "events", "worst lag");
+        printf("%-16s %9s %22s %22s %14s\n", "", "", "fixed   mean / lag", "fixed   mean / lag", "poll / events");
+        bool ok = true;
+        for (const Scenario& scenario : scenarios)
+        {
+            ReadinessResult polling = {};
+            ReadinessResult events = {};
+            for (const Launch& launch : scenario.launches)
+            {
+                SimulatedDesktopBackend desktop;
+                AddMonitors(desktop);
+                vector<ReplayStartEvent> starts;
+                AddLaunch(desktop, launch, 1000, starts);
+                const uint64_t fixedAt = FixByPolling(desktop, 1000);
+                if (fixedAt != 0)
+                    AddTimeToFix(polling, launch, fixedAt);
+
+                double cpuUs;
+                const RunResult result = Run({ scenario.name, { launch } }, rules, &cpuUs);
+                if (result.fixed == 1)
+                    AddTimeToFix(events, launch, launch.startAt + result.slowestFixMs);
+            }
+
+            const size_t launches = scenario.launches.size();
+            const auto mean = [](const uint64_t total, const size_t count) { return static_cast<unsigned long long>(count > 0 ? total / count : 0); };
+            printf("%-16s %9zu %5zu %7llu / %3llu ms %5zu %7llu / %3llu ms %6llu / %3llu ms\n", scenario.name, launches,
+                   polling.fixed, mean(polling.meanMs, polling.fixed), mean(polling.meanLagMs, polling.fixed),
+                   events.fixed, mean(events.meanMs, events.fixed), mean(events.meanLagMs, events.fixed),
+                   static_cast<unsigned long long>(polling.worstLagMs), static_cast<unsigned long long>(events.worstLagMs));
+            ok &= polling.fixed == launches && events.fixed == launches && events.worstLagMs <= polling.worstLagMs;
+        }
+        return ok;
+    }
+
+
+    // ======================
+    //     RECONCILIATION
+    // ======================
+
+    // Spotify already running among thousands of other processes: one snapshot of the
+    // system, and the fix of the tree found in it
+    bool RunReconciliationBenchmark(const RuleSet& rules, int)
+    {
+        constexpr size_t THREADS_PER_PROCESS = 8;
+        constexpr ProcessId FIRST_OTHER_PROCESS = 100000;
+
+        printf("\n%-16s %8s %12s %10s %14s %6s\n", "Processes", "threads", "snapshot", "syscalls", "reconcile", "fixed");
+        bool ok = true;
+        for (const size_t processes : { 1000, 5000, 10000 })
+        {
+            SimulatedDesktopBackend desktop;
+            AddMonitors(desktop);
+            for (size_t i = 0; i < processes; i++)
+            {
+                const ProcessId processId = FIRST_OTHER_PROCESS + static_cast<ProcessId>(i);
+                desktop.AddProcess(processId, 4, i % 3 == 0 ? L"svchost.exe" : L"chrome.exe");
+                for (size_t t = 0; t < THREADS_PER_PROCESS; t++)
+                    desktop.AddThread(processId, processId * 16 + static_cast<ThreadId>(t));
+            }
+            vector<ReplayStartEvent> events;
+            AddLaunch(desktop, { 0, 150, 300, 450, 6, SECONDARY_MONITOR_LEFT, true }, 1000, events);
+            desktop.AdvanceTo(1000);
+
+            size_t fixed = 0;
+            FixScheduler scheduler(desktop, desktop, rules);
+            scheduler.SetCompletionCallback([&](const FixJob& job) { fixed += job.Result() == FixResult::WindowMoved; });
+
+            desktop.ResetCounters();
+            const clock_t startedCpu = clock();
+            const shared_ptr<const SystemSnapshot> snapshot = SystemSnapshot::Take(desktop);
+            const clock_t tookSnapshotCpu = clock();
+            const uint64_t snapshotSyscalls = desktop.Counters().syscalls;
+            scheduler.Reconcile(snapshot);
+            scheduler.RunUntilIdle();
+            const clock_t reconciledCpu = clock();
+
+            printf("%-16zu %8zu %9.1f ms %10llu %11.1f ms %6zu\n", processes + 7, (processes + 7) * THREADS_PER_PROCESS,
+                   static_cast<double>(tookSnapshotCpu - startedCpu) * 1000 / CLOCKS_PER_SEC, static_cast<unsigned long long>(snapshotSyscalls),
+                   static_cast<double>(reconciledCpu - tookSnapshotCpu) * 1000 / CLOCKS_PER_SEC, fixed);
+            ok &= fixed == 1 && scheduler.RunningProcesses() == 7;
+        }
+        return ok;
+    }
+
+
+    // ================
+    //     SESSIONS
+    // ================
+
+    // A worker that only counts: what's measured is the router and the worker it keeps
+    class CountingWorker final : public SessionWorker
+    {
+    public:
+        explicit CountingWorker(uint64_t& delivered) : delivered(delivered) {}
+        bool Deliver(const ProcessStartEvent&) override { delivered++; return true; }
+
+    private:
+        uint64_t& delivered;
+    };
+
+    class CountingSessionBackend final : public SessionBackend
+    {
+    public:
+        explicit CountingSessionBackend(const size_t sessions) : sessions(sessions) {}
+
+        SessionId SessionOf(const ProcessId processId) override { return static_cast<SessionId>(processId % sessions) + 1; }
+        std::unique_ptr<SessionWorker> StartWorker(SessionId) override { return std::make_unique<CountingWorker>(delivered); }
+
+        uint64_t Delivered() const { return delivered; }
+
+    private:
+        const size_t sessions;
+        uint64_t delivered = 0;
+    };
+
+    // Start events spread over more and more sessions, routed to their workers; then the
+    // sessions go quiet and their workers are retired
+    bool RunSessionBenchmark(const RuleSet&, int)
+    {
+        constexpr size_t EVENTS = 1000 * 1000;
+        constexpr uint32_t IDLE_TIMEOUT_MS = 60 * 1000;
+
+        printf("\n%-16s %12s %14s %14s\n", "Sessions", "per route", "bytes/session", "left once idle");
+        bool ok = true;
+        for (const size_t sessionCount : { 1, 10, 100, 1000 })
+        {
+            CountingSessionBackend backend(sessionCount);
+            const int64_t heapBefore = liveHeapBytes;
+            int64_t activeBytes = 0;
+            int64_t idleBytes = 0;
+            uint64_t routeNs = 0;
+            {
+                SessionRouter router(backend, IDLE_TIMEOUT_MS);
+
+                // The process IDs go round the sessions; their session comes from the backend
+                ProcessStartEvent event = {};
+                const uint64_t startedUs = Tracer::Now();
+                for (size_t i = 0; i < EVENTS; i++)
+                {
+                    event.processId = static_cast<ProcessId>(i);
+                    router.Route(event, i / 1000);
+                }
+                routeNs = (Tracer::Now() - startedUs) * 1000;
+                activeBytes = liveHeapBytes - heapBefore;
+                ok &= router.ActiveSessions() == sessionCount && router.Routed() == EVENTS;
+
+                // Everyone's quiet, but one: the others are retired on its next event
+                event.sessionId = 1;
+                router.Route(event, EVENTS / 1000 + IDLE_TIMEOUT_MS);
+                idleBytes = liveHeapBytes - heapBefore;
+                ok &= router.ActiveSessions() == 1;
+            }
+
+            printf("%-16zu %9.1f ns %14lld %14lld\n", sessionCount, static_cast<double>(routeNs) / EVENTS,
+                   static_cast<long long>(activeBytes / static_cast<int64_t>(sessionCount)), static_cast<long long>(idleBytes));
+            ok &= backend.Delivered() == EVENTS + 1;
+        }
+        return ok;
+    }
+
+
+    // ===================
+    //     STATS BLOCK
+    // ===================
+
+    // The instance updating its statistics as fast as it can, and more and more readers
+    // copying them at the same time
+    bool RunStatsBenchmark(const RuleSet&, int)
+    {
+        constexpr uint64_t DURATION_US = 200 * 1000;
+
+        printf("\n%-16s %14s %14s %12s %8s\n", "Stats readers", "updates/s", "reads/s", "retries/read", "failed");
+        bool ok = true;
+        for (const size_t readerCount : { 0, 1, 2, 4 })
+        {
+            unique_ptr<unsigned char[]> memory(new unsigned char[sizeof(StatsBlockLayout)]());
+            StatsWriter writer;
+            writer.Attach(memory.get(), 1);
+
+            atomic<bool> done{ false };
+            atomic<uint64_t> reads{ 0 };
+            atomic<uint64_t> retries{ 0 };
+            atomic<uint64_t> failed{ 0 };
+            atomic<uint64_t> torn{ 0 };
+            vector<thread> readers;
+            for (size_t r = 0; r < readerCount; r++)
+            {
+                readers.emplace_back([&]
+                {
+                    StatsReader reader;
+                    if (!reader.Attach(memory.get()))
+                    {
+                        failed++;
+                        return;
+                    }
+                    uint64_t count = 0;
+                    while (!done)
+                    {
+                        Statistics statistics;
+                        if (!reader.Read(&statistics))
+                            failed++;
+                        else if (statistics.eventsReceived != statistics.windowsMoved)
+                            torn++;
+                        count++;
+                    }
+                    reads += count;
+                    retries += reader.Retries();
+                });
+            }
+
+            uint64_t updates = 0;
+            const uint64_t startedUs = Tracer::Now();
+            uint64_t elapsedUs = 0;
+            while (elapsedUs < DURATION_US)
+            {
+                for (int i = 0; i < 100; i++)
+                    writer.Update([](Statistics& s) { s.eventsReceived++; s.windowsMoved++; });
+                updates += 100;
+                elapsedUs = Tracer::Now() - startedUs;
+            }
+            done = true;
+            for (thread& reader : readers)
+                reader.join();
+            writer.Detach();
+
+            const double seconds = static_cast<double>(elapsedUs) / 1e6;
+            printf("%-16zu %14.0f %14.0f %12.3f %8llu\n", readerCount, static_cast<double>(updates) / seconds,
+                   static_cast<double>(reads) / seconds, reads > 0 ? static_cast<double>(retries) / static_cast<double>(reads) : 0.0,
+                   static_cast<unsigned long long>(failed));
+            ok &= torn == 0;
+        }
+        return ok;
+    }
+
+
+
+    // ======================
+    //     STYLE TIMELINE
+    // ======================
+
+    // What the style sampler pays for each window on each tick, once it has the styles:
+    // the timeline's compare, and the encoding when a window did change. Twenty windows
+    // at 1 kHz, changing never to on every tick.
+    bool RunStyleTimelineBenchmark(const RuleSet&, int)
+    {
+        constexpr size_t WINDOWS = 20;
+        constexpr size_t TICKS = 50 * 1000;
+        constexpr size_t PATTERN_TICKS = 1024;
+        constexpr int ROUNDS = 5;
+        constexpr uint32_t EX_STYLE_APPWINDOW = 0x00040000;
+
+        printf("\n%-22s %12s %10s %14s %12s\n", "Style timeline", "per sample", "changes", "bytes/change", "1 kHz CPU");
+        bool ok = true;
+        // How many ticks apart a window's changes are; 0 for never
+        for (const size_t period : { 0, 64, 8, 1 })
+        {
+            // Worked out up front, so that only the timeline is timed
+            vector<uint32_t> styles(PATTERN_TICKS * WINDOWS);
+            for (size_t tick = 0; tick < PATTERN_TICKS; tick++)
+            {
+                for (size_t w = 0; w < WINDOWS; w++)
+                {
+                    const bool flipped = period > 0 && (tick / period) % 2 == 1;
+                    styles[tick * WINDOWS + w] = STYLE_VISIBLE | STYLE_SYSMENU | (flipped ? 0x01000000 : 0);
+                }
+            }
+
+            // Every window's first sample is a change too, from 0
+            size_t expected = 0;
+            for (size_t tick = 0; tick < TICKS; tick++)
+            {
+                const size_t previous = tick == 0 ? 0 : styles[((tick - 1) % PATTERN_TICKS) * WINDOWS];
+                expected += styles[(tick % PATTERN_TICKS) * WINDOWS] != previous ? WINDOWS : 0;
+            }
+
+            uint64_t bestUs = UINT64_MAX;
+            size_t changes = 0;
+            size_t bytes = 0;
+            uint64_t dropped = 0;
+            for (int round = 0; round < ROUNDS; round++)
+            {
+                StyleTimeline timeline;
+                uint16_t indices[WINDOWS];
+                for (size_t w = 0; w < WINDOWS; w++)
+                    indices[w] = timeline.AddWindow(0x1000 + w, 1000, L"Chrome_WidgetWin_0", 0);
+
+                const uint64_t startedUs = Tracer::Now();
+                for (size_t tick = 0; tick < TICKS; tick++)
+                {
+                    const uint32_t* const tickStyles = &styles[(tick % PATTERN_TICKS) * WINDOWS];
+                    for (size_t w = 0; w < WINDOWS; w++)
+                        timeline.Sample(tick * 1000, indices[w], tickStyles[w], EX_STYLE_APPWINDOW);
+                }
+                bestUs = min(bestUs, Tracer::Now() - startedUs);
+                changes = timeline.Changes();
+                bytes = timeline.EncodedBytes();
+                dropped = timeline.DroppedChanges();
+            }
+
+            const double sampleNs = static_cast<double>(bestUs) * 1000 / (TICKS * WINDOWS);
+            const double cpuPercent = sampleNs * WINDOWS * 1000 / 1e9 * 100;
+            char label[32];
+            snprintf(label, sizeof label, period == 0 ? "never changes" : "changes every %zu", period);
+            printf("%-22s %9.1f ns %10zu %14.1f %11.3f%%\n", label, sampleNs, changes,
+                   changes > 0 ? static_cast<double>(bytes) / static_cast<double>(changes) : 0.0, cpuPercent);
+            // Running at 1 kHz mustn't cost the machine more than a percent of a core
+            ok &= changes == expected && dropped == 0 && cpuPercent < 1;
+        }
+        return ok;
+    }
+
+    typedef struct {
+        const char* name;
+        bool (*run)(const RuleSet& rules, int repetitions);
+    } Benchmark;
+
+    const Benchmark BENCHMARKS[] = {
+        { "scenarios", RunScenarioBenchmark },
+        { "discovery", RunDiscoveryBenchmark },
+        { "search", RunWindowSearchBenchmark },
+        { "threads", RunThreadIndexBenchmark },
+        { "classification", RunClassificationBenchmark },
+        { "nudge", RunNudgeBenchmark },
+        { "stress", RunStressBenchmark },
+        { "rules", RunRulesBenchmark },
+        { "logging", RunLoggingBenchmark },
+        { "display", RunDisplayStormBenchmark },
+        { "polling", RunPollingBenchmark },
+        { "reconciliation", RunReconciliationBenchmark },
+        { "sessions", RunSessionBenchmark },
+        { "stats", RunStatsBenchmark },
+        { "timeline", RunStyleTimelineBenchmark },
+    };
+}
+
+int main(const int argc, char* argv[])
+{
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 200;
+    bool known = true;
+    for (int i = 2; i < argc; i++)
+    {
+        known &= any_of(begin(BENCHMARKS), end(BENCHMARKS), [&](const Benchmark& benchmark) { return strcmp(benchmark.name, argv[i]) == 0; });
+    }
+    if (repetitions <= 0 || !known)
+    {
+        fprintf(stderr, "usage: %s [repetitions] [benchmark...]\nbenchmarks:", argv[0]);
+        for (const Benchmark& benchmark : BENCHMARKS)
+            fprintf(stderr, " %s", benchmark.name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    // The fix logic logs every step; none of that is being measured
+    LogConfig quiet = {};
+    Logger::Instance().Start(quiet);
+
+    const RuleSet rules = RuleSet::Default();
+    bool ok = true;
+    for (const Benchmark& benchmark : BENCHMARKS)
+    {
+        bool selected = argc <= 2;
+        for (int i = 2; i < argc; i++)
+            selected |= strcmp(benchmark.name, argv[i]) == 0;
+        if (selected && !benchmark.run(rules, repetitions))
+        {
+            printf("%s: FAILED\n", benchmark.name);
+            ok = false;
+        }
+    }
+
+    Logger::Instance().Stop();
+    return ok ? 0 : 1;
+}
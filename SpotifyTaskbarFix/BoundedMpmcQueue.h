@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Fixed-capacity multi-producer multi-consumer queue (Dmitry Vyukov's design):
+// every cell carries a sequence number that says whose turn it is, so
+// producers and consumers only ever contend on one atomic index each and
+// nobody takes a lock. A full queue makes TryPush fail instead of waiting.
+// `Capacity` must be a power of two.
+template <typename T, size_t Capacity>
+class BoundedMpmcQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    BoundedMpmcQueue() : cells(new Cell[Capacity])
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+    bool TryPush(const T& value)
+    {
+        Cell* cell;
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[position & MASK];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        Cell* cell;
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[position & MASK];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = cell->value;
+        cell->sequence.store(position + MASK + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    typedef struct {
+        std::atomic<size_t> sequence;
+        T value;
+    } Cell;
+
+    std::unique_ptr<Cell[]> cells;
+
+    // On separate cache lines, so that producers and consumers don't slow each other down
+    alignas(64) std::atomic<size_t> enqueuePosition{ 0 };
+    alignas(64) std::atomic<size_t> dequeuePosition{ 0 };
+};
@@ -0,0 +1,55 @@
+#include "ClassAtomCache.h"
+
+const std::vector<WindowRule>* ClassAtomCache::Match(DesktopBackend& desktop, const WindowHandle hWnd)
+{
+    const ClassAtom atom = desktop.GetClassAtom(hWnd);
+
+    const size_t slot = Find(atom);
+    if (slot != CAPACITY && entries[slot].atom == atom)
+    {
+        hits++;
+        return entries[slot].rules;
+    }
+
+    misses++;
+    wchar_t className[256];
+    const size_t length = desktop.GetWindowClass(hWnd, className, 256);
+    const std::vector<WindowRule>* classRules = rules.MatchClass(className);
+
+    // Keep a free slot around, so that the probe above always terminates. A window
+    // that vanished in the meantime has no class name, which says nothing about its atom.
+    if (slot != CAPACITY && length > 0 && count < CAPACITY - 1)
+    {
+        entries[slot] = { atom, classRules };
+        count++;
+    }
+    return classRules;
+}
+
+void ClassAtomCache::Merge(const ClassAtomCache& other)
+{
+    for (const Entry& entry : other.entries)
+    {
+        if (entry.atom == NULL_ATOM || count >= CAPACITY - 1)
+            continue;
+
+        const size_t slot = Find(entry.atom);
+        if (slot != CAPACITY && entries[slot].atom == NULL_ATOM)
+        {
+            entries[slot] = entry;
+            count++;
+        }
+    }
+}
+
+size_t ClassAtomCache::Find(const ClassAtom atom) const
+{
+    if (atom == NULL_ATOM)
+        return CAPACITY;
+
+    for (size_t i = atom & (CAPACITY - 1);; i = (i + 1) & (CAPACITY - 1))
+    {
+        if (entries[i].atom == atom || entries[i].atom == NULL_ATOM)
+            return i;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DesktopBackend.h"
+#include "Rules.h"
+
+// Resolves a window to the rules for its class. The class name is read and
+// hashed only the first time an atom is seen; after that, telling a window
+// apart costs a single GetClassWord and no string is copied or compared.
+// The table is fixed-size and lives inline, so lookups never allocate; once
+// it's full, new classes are still matched, just not remembered.
+class ClassAtomCache
+{
+public:
+    explicit ClassAtomCache(const RuleSet& rules) : rules(rules) {}
+
+    // The rules (of any app) for the window's class, or nullptr.
+    const std::vector<WindowRule>* Match(DesktopBackend& desktop, WindowHandle hWnd);
+
+    // Learns the classes a copy of this cache (of the same rules) has seen since.
+    void Merge(const ClassAtomCache& other);
+
+    const RuleSet& Rules() const { return rules; }
+    uint64_t Hits() const { return hits; }
+    uint64_t Misses() const { return misses; }
+
+    static constexpr size_t CAPACITY = 64;
+
+private:
+    typedef struct {
+        ClassAtom atom;
+        const std::vector<WindowRule>* rules;
+    } Entry;
+
+    // The entry for `atom`, or the free slot it would go in; CAPACITY if neither.
+    size_t Find(ClassAtom atom) const;
+
+    const RuleSet& rules;
+
+    Entry entries[CAPACITY] = {};
+    size_t count = 0;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
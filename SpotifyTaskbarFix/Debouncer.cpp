@@ -0,0 +1,31 @@
+#include "Debouncer.h"
+
+#include <algorithm>
+
+void Debouncer::Trigger(const uint64_t now)
+{
+    if (!pending)
+    {
+        pending = true;
+        firstTrigger = now;
+    }
+    lastTrigger = now;
+    triggers++;
+}
+
+bool Debouncer::Fire(const uint64_t now)
+{
+    if (!pending || now < Deadline())
+        return false;
+
+    pending = false;
+    fired++;
+    return true;
+}
+
+uint64_t Debouncer::Deadline() const
+{
+    if (!pending)
+        return NEVER;
+    return std::min(lastTrigger + quietMs, firstTrigger + maxDelayMs);
+}
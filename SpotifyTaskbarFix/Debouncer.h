@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Turns a burst of triggers into a single action. The action is due once no
+// trigger came for `quietMs`, or `maxDelayMs` after the burst's first trigger
+// if it never quiets down. Time is whatever clock the caller uses, in ms.
+class Debouncer
+{
+public:
+    static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    Debouncer(uint32_t quietMs, uint32_t maxDelayMs) : quietMs(quietMs), maxDelayMs(maxDelayMs) {}
+
+    void Trigger(uint64_t now);
+
+    // True once per burst, when its action is due; that ends the burst.
+    bool Fire(uint64_t now);
+
+    // Forgets the burst in progress, if any; the counters stay.
+    void Reset() { pending = false; }
+
+    bool Pending() const { return pending; }
+    // When Fire will return true, if nothing else is triggered; NEVER if nothing is pending.
+    uint64_t Deadline() const;
+
+    uint64_t Triggers() const { return triggers; }
+    uint64_t Fired() const { return fired; }
+
+private:
+    const uint32_t quietMs;
+    const uint32_t maxDelayMs;
+
+    bool pending = false;
+    uint64_t firstTrigger = 0;
+    uint64_t lastTrigger = 0;
+
+    uint64_t triggers = 0;
+    uint64_t fired = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "Platform.h"
+
+typedef struct {
+    // Calls into the operating system
+    uint64_t syscalls;
+    // Of those, the ones that synchronously send a message to another process's window
+    uint64_t crossProcessMessages;
+} BackendCounters;
+
+// Which edge of its monitor a taskbar sits on.
+enum class TaskbarEdge : uint8_t
+{
+    None,
+    Bottom,
+    Top,
+    Left,
+    Right,
+};
+
+typedef struct {
+    // Virtual-screen coordinates, in physical pixels
+    WindowRect bounds;
+    // The bounds minus the taskbar and any other app bar
+    WindowRect workArea;
+    uint32_t dpi;
+    bool primary;
+    // None if the monitor has no taskbar of its own: its windows' buttons are on the primary one
+    TaskbarEdge taskbar;
+} MonitorInfo;
+
+typedef struct {
+    // In the parent's client coordinates, like GetWindowPosition
+    WindowRect rect;
+    // If false, only the position changes and the window keeps its current size
+    bool resize;
+    // If false, nothing gets invalidated; with desktop composition the window's
+    // content survives a move anyway, so this only saves the app a repaint.
+    bool redraw;
+} WindowMove;
+
+// Everything the fix logic needs to know about (and do to) the desktop.
+// Win32DesktopBackend talks to the real thing; SimulatedDesktopBackend is a
+// scriptable in-memory desktop with a virtual clock.
+class DesktopBackend
+{
+public:
+    // Return false to stop the enumeration.
+    typedef std::function<bool(WindowHandle)> WindowCallback;
+    typedef std::function<void(ThreadId)> ThreadCallback;
+    typedef std::function<void(ProcessId, ThreadId)> SystemThreadCallback;
+    // Process ID, parent process ID, image name (bare file name)
+    typedef std::function<void(ProcessId, ProcessId, const wchar_t*)> SystemProcessCallback;
+    typedef std::function<void(const MonitorInfo&)> MonitorCallback;
+
+    virtual ~DesktopBackend() = default;
+
+    // TIME
+    // Monotonic milliseconds; only differences are meaningful.
+    virtual uint64_t Now() = 0;
+    virtual void Sleep(uint32_t ms) = 0;
+
+    // PROCESSES & THREADS
+    // Both return false if the information is not available, e.g. because the process is gone.
+    // The image name is the bare file name, without the directory.
+    virtual bool GetProcessImageName(ProcessId processId, std::wstring& imageName) = 0;
+    virtual bool GetProcessCommandLine(ProcessId processId, std::wstring& commandLine) = 0;
+    // The file version of the process's executable, as "major.minor.build.revision".
+    virtual bool GetProcessImageVersion(ProcessId processId, std::wstring& version) = 0;
+
+    // Returns true if the process reached its idle state before the timeout.
+    virtual bool WaitForInputIdle(ProcessId processId, uint32_t timeoutMs) = 0;
+    // Done waiting on `processId`: whatever the backend kept open for WaitForInputIdle can go.
+    virtual void ReleaseProcess(ProcessId) {}
+    // Every thread on the system, from a single snapshot. Expensive: see ProcessThreadIndex.
+    virtual void EnumSystemThreads(const SystemThreadCallback& callback) = 0;
+    // Every process, then every thread, from the same single snapshot. See SystemSnapshot.
+    virtual void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) = 0;
+    // Only the threads of `processId` that currently own top-level windows; cheap.
+    virtual void EnumWindowThreads(ProcessId processId, const ThreadCallback& callback) = 0;
+
+    // WINDOWS
+    virtual void EnumThreadWindows(ThreadId threadId, const WindowCallback& callback) = 0;
+    virtual void EnumChildWindows(WindowHandle hWnd, const WindowCallback& callback) = 0;
+    // The first direct child (not any descendant) of `hParent` of class `className`, or NULL_WINDOW.
+    virtual WindowHandle FindChildWindow(WindowHandle hParent, const wchar_t* className) = 0;
+    // NULL_WINDOW for a top-level window.
+    virtual WindowHandle GetParentWindow(WindowHandle hWnd) = 0;
+
+    // Cheapest way to tell windows apart by class: no string is copied. NULL_ATOM if unavailable.
+    virtual ClassAtom GetClassAtom(WindowHandle hWnd) = 0;
+    // Both return the number of characters copied, excluding the terminator.
+    // The title of another process's window is a cross-process message (WM_GETTEXT).
+    virtual size_t GetWindowClass(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) = 0;
+    virtual size_t GetWindowTitle(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) = 0;
+
+    virtual uint32_t GetStyle(WindowHandle hWnd) = 0;
+    virtual uint32_t GetExStyle(WindowHandle hWnd) = 0;
+
+    // Window rectangle in its parent's client coordinates.
+    virtual WindowRect GetWindowPosition(WindowHandle hWnd) = 0;
+    virtual bool SetWindowPosition(WindowHandle hWnd, const WindowMove& move) = 0;
+
+    // MONITORS
+    // Every display monitor, with where its taskbar is, if it has one. See MonitorTopology.
+    virtual void EnumMonitors(const MonitorCallback& callback) = 0;
+
+    // THREADING
+    // Whether any method can be called from several threads at once.
+    virtual bool Concurrent() const = 0;
+
+    // DIAGNOSTICS
+    // Totals since construction or the last reset.
+    virtual BackendCounters Counters() const = 0;
+    virtual void ResetCounters() = 0;
+};
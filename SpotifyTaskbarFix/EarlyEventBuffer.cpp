@@ -0,0 +1,43 @@
+#include "EarlyEventBuffer.h"
+
+#include <algorithm>
+
+
+EarlyEventBuffer::EarlyEventBuffer(const size_t capacity) : capacity(capacity)
+{
+    events.reserve(capacity);
+}
+
+size_t EarlyEventBuffer::Submit(const ProcessStartEvent* const batch, const size_t count)
+{
+    // Checked again under the lock: the events that got in just before Open must go out with it
+    if (!open)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!open)
+        {
+            const size_t kept = std::min(count, capacity - events.size());
+            events.insert(events.end(), batch, batch + kept);
+            buffered += kept;
+            dropped += count - kept;
+            return kept;
+        }
+    }
+    return sink(batch, count);
+}
+
+size_t EarlyEventBuffer::Open(Sink handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (open)
+        return 0;
+
+    sink = std::move(handler);
+    const size_t count = events.size();
+    if (count > 0)
+        sink(events.data(), count);
+    events.clear();
+    events.shrink_to_fit();
+    open = true;
+    return count;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "ProcessStartEvent.h"
+
+// Sits between the event source and whatever handles its events, so that the
+// source can be subscribed before the handler is ready: until Open, start
+// events are kept here, in order; Open hands them over, and from then on they
+// go straight through. Holds at most `capacity` of them, allocated up front;
+// the ones past that are dropped and counted.
+class EarlyEventBuffer
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    // Returns how many of the `count` events it accepted, like the scheduler's Submit.
+    typedef std::function<size_t(const ProcessStartEvent* events, size_t count)> Sink;
+
+    explicit EarlyEventBuffer(size_t capacity = DEFAULT_CAPACITY);
+
+    EarlyEventBuffer(const EarlyEventBuffer&) = delete;
+    EarlyEventBuffer& operator=(const EarlyEventBuffer&) = delete;
+
+    // Thread-safe. Returns how many events were kept, or, once open, what the sink returned.
+    size_t Submit(const ProcessStartEvent* events, size_t count);
+    // Hands the buffered events to `sink`, on the calling thread, and returns how many there were.
+    size_t Open(Sink sink);
+
+    bool IsOpen() const { return open; }
+    // Kept until Open, and dropped for lack of room
+    uint64_t Buffered() const { return buffered; }
+    uint64_t Dropped() const { return dropped; }
+
+private:
+    const size_t capacity;
+    Sink sink;
+    std::mutex mutex;
+    std::vector<ProcessStartEvent> events;
+    std::atomic<bool> open{ false };
+
+    std::atomic<uint64_t> buffered{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+};
@@ -0,0 +1,100 @@
+#include "EpollEventLoop.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr int MAX_EVENTS = 16;
+
+    // epoll_event.data.u64 of the loop's own descriptors; watched handles use their index
+    constexpr uint64_t WAKE_KEY = UINT64_MAX;
+    constexpr uint64_t SIGNAL_KEY = UINT64_MAX - 1;
+
+    void Register(const int epollFd, const int fd, const uint64_t key)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = key;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+EpollEventLoop::EpollEventLoop()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signalFd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    Register(epollFd, wakeFd, WAKE_KEY);
+    Register(epollFd, signalFd, SIGNAL_KEY);
+}
+
+EpollEventLoop::~EpollEventLoop()
+{
+    for (const int fd : { signalFd, wakeFd, epollFd })
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+size_t EpollEventLoop::Wait()
+{
+    // Handles can only be watched before Run, but Run comes after the constructor
+    const std::vector<WatchedHandle>& handles = WatchedHandles();
+    for (; registeredHandles < handles.size(); registeredHandles++)
+        Register(epollFd, handles[registeredHandles].handle, registeredHandles);
+
+    epoll_event events[MAX_EVENTS];
+    const int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+    if (count < 0)
+        return 0;
+
+    size_t dispatched = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const uint64_t key = events[i].data.u64;
+        if (key == WAKE_KEY)
+        {
+            // Whoever woke us up posted something; that's what gets counted
+            uint64_t value;
+            while (read(wakeFd, &value, sizeof value) > 0)
+            {
+            }
+        }
+        else if (key == SIGNAL_KEY)
+        {
+            signalfd_siginfo info;
+            while (read(signalFd, &info, sizeof info) == sizeof info)
+                dispatched += Dispatch(SystemNotification::Shutdown);
+        }
+        else if (key < handles.size())
+        {
+            handles[key].handler();
+            dispatched++;
+        }
+    }
+    return dispatched;
+}
+
+void EpollEventLoop::Wake()
+{
+    const uint64_t one = 1;
+    while (write(wakeFd, &one, sizeof one) < 0 && errno == EINTR)
+    {
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "EventLoop.h"
+
+// EventLoop on epoll: an eventfd for wakeups and a signalfd that turns
+// SIGINT, SIGTERM and SIGHUP into Shutdown notifications. Those signals are
+// blocked in the constructor, so it must run before any other thread starts.
+// There's no such thing as a display or session change here.
+class EpollEventLoop final : public EventLoop
+{
+public:
+    EpollEventLoop();
+    ~EpollEventLoop() override;
+
+    EpollEventLoop(const EpollEventLoop&) = delete;
+    EpollEventLoop& operator=(const EpollEventLoop&) = delete;
+
+protected:
+    size_t Wait() override;
+    void Wake() override;
+
+private:
+    int epollFd = -1;
+    int wakeFd = -1;
+    int signalFd = -1;
+    size_t registeredHandles = 0;
+};
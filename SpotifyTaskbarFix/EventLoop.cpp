@@ -0,0 +1,76 @@
+#include "EventLoop.h"
+
+void EventLoop::On(const SystemNotification notification, Task handler)
+{
+    handlers[static_cast<size_t>(notification)] = std::move(handler);
+}
+
+void EventLoop::Watch(const NativeHandle handle, Task handler)
+{
+    watched.push_back({ handle, std::move(handler) });
+}
+
+void EventLoop::Run()
+{
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (quit && posted.empty())
+                return;
+        }
+
+        const size_t dispatched = Wait() + RunPosted();
+        wakeups++;
+        if (dispatched == 0)
+            idleWakeups++;
+    }
+}
+
+void EventLoop::Quit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    Wake();
+}
+
+void EventLoop::Post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.push_back(std::move(task));
+    }
+    Wake();
+}
+
+void EventLoop::Notify(const SystemNotification notification)
+{
+    Post([this, notification] { Dispatch(notification); });
+}
+
+size_t EventLoop::Dispatch(const SystemNotification notification)
+{
+    const Task& handler = handlers[static_cast<size_t>(notification)];
+    if (handler)
+        handler();
+    return 1;
+}
+
+size_t EventLoop::RunPosted()
+{
+    std::vector<Task> tasks;
+    bool quitting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.swap(posted);
+        quitting = quit;
+    }
+
+    for (const Task& task : tasks)
+        task();
+
+    // Quit makes the loop return; it wasn't for nothing
+    return tasks.size() + (quitting ? 1 : 0);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+typedef void* NativeHandle;
+#else
+typedef int NativeHandle;
+#endif
+
+// What the system tells the program, beyond process and window events.
+enum class SystemNotification : uint8_t
+{
+    DisplayChanged,
+    SessionChanged,
+    // Logoff, shutdown, console closed, Ctrl+C, SIGTERM...
+    Shutdown,
+
+    Count
+};
+
+// The main thread's reactor. Run blocks, without any timeout, until one of
+// the watched handles is signaled, a system notification arrives or a task
+// is posted, and dispatches it; nothing ever wakes it up periodically.
+// Platform loops only implement the blocking wait and the cross-thread wakeup.
+class EventLoop
+{
+public:
+    typedef std::function<void()> Task;
+
+    virtual ~EventLoop() = default;
+
+    // Both before Run. A watched handle's task has to consume whatever made it signaled.
+    void On(SystemNotification notification, Task handler);
+    void Watch(NativeHandle handle, Task handler);
+
+    // Returns once Quit has been called and everything posted before it has run.
+    void Run();
+
+    // Thread-safe.
+    void Quit();
+    void Post(Task task);
+    void Notify(SystemNotification notification);
+
+    // Times the loop woke up, and how many of those found nothing to do:
+    // on an idle system, both stay where they are.
+    uint64_t Wakeups() const { return wakeups; }
+    uint64_t IdleWakeups() const { return idleWakeups; }
+
+protected:
+    typedef struct {
+        NativeHandle handle;
+        Task handler;
+    } WatchedHandle;
+
+    // Blocks until something happens and dispatches it through Dispatch;
+    // returns how many things were dispatched. Wake makes it return from any thread.
+    virtual size_t Wait() = 0;
+    virtual void Wake() = 0;
+
+    size_t Dispatch(SystemNotification notification);
+    const std::vector<WatchedHandle>& WatchedHandles() const { return watched; }
+
+private:
+    size_t RunPosted();
+
+    Task handlers[static_cast<size_t>(SystemNotification::Count)];
+    std::vector<WatchedHandle> watched;
+
+    std::mutex mutex;
+    std::vector<Task> posted;
+    bool quit = false;
+
+    std::atomic<uint64_t> wakeups{ 0 };
+    std::atomic<uint64_t> idleWakeups{ 0 };
+};
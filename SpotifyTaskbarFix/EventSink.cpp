@@ -1,5 +1,73 @@
 #include "EventSink.h"
 
+#include "Trace.h"
+
+namespace
+{
+    constexpr long NO_HANDLE = -1;
+
+    // Cleared however the scope is left
+    class ScopedVariant
+    {
+    public:
+        ScopedVariant() { VariantInit(&value); }
+        ~ScopedVariant() { VariantClear(&value); }
+
+        ScopedVariant(const ScopedVariant&) = delete;
+        ScopedVariant& operator=(const ScopedVariant&) = delete;
+
+        // For IWbemClassObject::Get to fill in
+        VARIANT* Out() { return &value; }
+        const VARIANT* Get() const { return &value; }
+
+    private:
+        VARIANT value;
+    };
+
+    // WMI hands uint32 properties over as VT_I4, and uint64 ones as decimal strings,
+    // but nothing says it always will: every integer type is taken at face value.
+    bool ReadInteger(IWbemClassObject* const pObj, const wchar_t* const name, uint64_t& value)
+    {
+        ScopedVariant v;
+        if (FAILED(pObj->Get(name, 0, v.Out(), nullptr, nullptr)))
+            return false;
+
+        const VARIANT* const variant = v.Get();
+        switch (V_VT(variant))
+        {
+            case VT_UI1:
+                value = V_UI1(variant);
+                return true;
+            case VT_I2:
+                value = static_cast<uint16_t>(V_I2(variant));
+                return true;
+            case VT_UI2:
+                value = V_UI2(variant);
+                return true;
+            case VT_I4:
+                value = static_cast<uint32_t>(V_I4(variant));
+                return true;
+            case VT_UI4:
+                value = V_UI4(variant);
+                return true;
+            case VT_I8:
+                value = static_cast<uint64_t>(V_I8(variant));
+                return true;
+            case VT_UI8:
+                value = V_UI8(variant);
+                return true;
+            case VT_BSTR:
+                if (V_BSTR(variant) == nullptr)
+                    return false;
+                value = _wcstoui64(V_BSTR(variant), nullptr, 10);
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+
 ULONG EventSink::AddRef()
 {
     return InterlockedIncrement(&m_lRef);
@@ -27,19 +95,132 @@ HRESULT EventSink::QueryInterface(REFIID riid, void** ppv)
 
 HRESULT EventSink::Indicate(const long lObjectCount, IWbemClassObject** apObjArray)
 {
-    HRESULT hres = S_OK;
+    const uint64_t indicateStartUs = Tracer::Now();
 
-    for (int i = 0; i < lObjectCount; i++)
+    // TIME_CREATED is when the kernel saw the process start, as a FILETIME; WMI's delivery delay is the rest
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    const uint64_t nowTicks = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+
+    // The whole batch goes through at once; this only queues the events, the fixes run on the scheduler's thread
+    ProcessId firstProcessId = 0;
+    batcher.Ingest(lObjectCount > 0 ? static_cast<size_t>(lObjectCount) : 0, [&](const size_t i, ProcessStartEvent& event)
     {
-        VARIANT v;
-        if (SUCCEEDED(apObjArray[i]->Get(L"ProcessID", NULL, &v, nullptr, nullptr)))
-            callback(static_cast<DWORD>(V_UINT(&v)));
-    }
+        uint64_t createdTicks = 0;
+        if (apObjArray[i] == nullptr || !Extract(apObjArray[i], event, createdTicks))
+            return false;
+
+        if (createdTicks != 0 && createdTicks <= nowTicks)
+        {
+            const uint64_t delayUs = (nowTicks - createdTicks) / 10;
+            Tracer::Instance().Record(TracePhase::WmiDelivery, event.processId, indicateStartUs - delayUs, indicateStartUs);
+        }
+        if (firstProcessId == 0)
+            firstProcessId = event.processId;
+        return true;
+    });
 
+    Tracer::Instance().Record(TracePhase::Indicate, firstProcessId, indicateStartUs, Tracer::Now());
     return WBEM_S_NO_ERROR;
 }
 
-HRESULT EventSink::SetStatus(const LONG lFlags, const HRESULT hResult, BSTR strParam, IWbemClassObject __RPC_FAR* pObjParam)
+HRESULT EventSink::SetStatus(const LONG lFlags, const HRESULT hResult, BSTR, IWbemClassObject __RPC_FAR*)
 {
+    // With WBEM_FLAG_SEND_STATUS there are progress reports too. An event subscription never
+    // completes on its own: the final status is either our own cancellation or a failure.
+    if (lFlags != WBEM_STATUS_COMPLETE || hResult == WBEM_E_CALL_CANCELLED)
+        return WBEM_S_NO_ERROR;
+
+    failures++;
+    if (onFailure != nullptr)
+        onFailure(hResult);
     return WBEM_S_NO_ERROR;
 }
+
+bool EventSink::Extract(IWbemClassObject* const pObj, ProcessStartEvent& event, uint64_t& createdTicks)
+{
+    IWbemObjectAccess* pAccess = nullptr;
+    if (SUCCEEDED(pObj->QueryInterface(IID_IWbemObjectAccess, reinterpret_cast<void**>(&pAccess))))
+    {
+        const bool extracted = ExtractWithHandles(pAccess, event, createdTicks);
+        pAccess->Release();
+        if (extracted)
+            return true;
+    }
+
+    // Not a local object, or not the layout the handles were resolved for
+    return ExtractWithVariants(pObj, event, createdTicks);
+}
+
+bool EventSink::ExtractWithHandles(IWbemObjectAccess* const pAccess, ProcessStartEvent& event, uint64_t& createdTicks)
+{
+    if (!handles.resolved)
+        ResolveHandles(pAccess);
+
+    DWORD processId;
+    if (handles.processId == NO_HANDLE || pAccess->ReadDWORD(handles.processId, &processId) != WBEM_S_NO_ERROR)
+        return false;
+    event.processId = static_cast<ProcessId>(processId);
+
+    DWORD value;
+    if (handles.parentProcessId != NO_HANDLE && pAccess->ReadDWORD(handles.parentProcessId, &value) == WBEM_S_NO_ERROR)
+        event.parentProcessId = static_cast<ProcessId>(value);
+    if (handles.sessionId != NO_HANDLE && pAccess->ReadDWORD(handles.sessionId, &value) == WBEM_S_NO_ERROR)
+        event.sessionId = static_cast<SessionId>(value);
+
+    unsigned __int64 created;
+    if (handles.timeCreated != NO_HANDLE && pAccess->ReadQWORD(handles.timeCreated, &created) == WBEM_S_NO_ERROR)
+        createdTicks = created;
+
+    // Straight into the record, terminator included; a name that doesn't fit is left out
+    long bytesRead = 0;
+    if (handles.processName == NO_HANDLE ||
+        pAccess->ReadPropertyValue(handles.processName, static_cast<long>(sizeof event.processName), &bytesRead,
+                                   reinterpret_cast<byte*>(event.processName)) != WBEM_S_NO_ERROR ||
+        bytesRead < static_cast<long>(sizeof(wchar_t)))
+    {
+        event.processName[0] = L'\0';
+    }
+    event.processName[PROCESS_NAME_LENGTH - 1] = L'\0';
+    return true;
+}
+
+void EventSink::ResolveHandles(IWbemObjectAccess* const pAccess)
+{
+    // A handle is only good for the type it was resolved as
+    const auto resolve = [pAccess](const wchar_t* const name, const CIMTYPE expectedType)
+    {
+        CIMTYPE type;
+        long handle;
+        if (FAILED(pAccess->GetPropertyHandle(name, &type, &handle)) || type != expectedType)
+            return NO_HANDLE;
+        return handle;
+    };
+
+    handles.processId = resolve(L"ProcessID", CIM_UINT32);
+    handles.parentProcessId = resolve(L"ParentProcessID", CIM_UINT32);
+    handles.processName = resolve(L"ProcessName", CIM_STRING);
+    handles.sessionId = resolve(L"SessionID", CIM_UINT32);
+    handles.timeCreated = resolve(L"TIME_CREATED", CIM_UINT64);
+    handles.resolved = true;
+}
+
+bool EventSink::ExtractWithVariants(IWbemClassObject* const pObj, ProcessStartEvent& event, uint64_t& createdTicks)
+{
+    uint64_t value;
+    if (!ReadInteger(pObj, L"ProcessID", value))
+        return false;
+    event.processId = static_cast<ProcessId>(value);
+
+    if (ReadInteger(pObj, L"ParentProcessID", value))
+        event.parentProcessId = static_cast<ProcessId>(value);
+    if (ReadInteger(pObj, L"SessionID", value))
+        event.sessionId = static_cast<SessionId>(value);
+    if (ReadInteger(pObj, L"TIME_CREATED", value))
+        createdTicks = value;
+
+    ScopedVariant name;
+    if (SUCCEEDED(pObj->Get(L"ProcessName", 0, name.Out(), nullptr, nullptr)) && V_VT(name.Get()) == VT_BSTR && V_BSTR(name.Get()) != nullptr)
+        wcsncpy_s(event.processName, V_BSTR(name.Get()), _TRUNCATE);
+    return true;
+}
@@ -1,31 +1,29 @@
 #pragma once
 
 #define _WIN32_DCOM
-#include <iostream>
-using namespace std;
+#include <atomic>
 
 #include <comdef.h>
 #include <Wbemidl.h>
 
 #pragma comment(lib, "wbemuuid.lib")
 
+#include "ProcessEventBatcher.h"
+
+// The receiving end of the Win32_ProcessStartTrace subscription. Each Indicate
+// is ingested as a whole through a ProcessEventBatcher; only the properties a
+// ProcessStartEvent needs are read, through property handles (IWbemObjectAccess)
+// resolved once, so no VARIANT or BSTR is allocated per event. WMI only calls
+// SetStatus with a final status once the subscription is over: unless it was
+// cancelled, that means it failed, and the failure callback is told.
 class EventSink final : public IWbemObjectSink
 {
-    LONG m_lRef;
-    bool bDone;
-
-    void (*callback)(DWORD);
-
-protected:
-    ~EventSink() { bDone = true; }
-
 public:
-    explicit EventSink(void (*fn)(DWORD))
-    {
-        m_lRef = 0;
-        bDone = false;
-        callback = fn;
-    }
+    // Called on one of WMI's threads, like the batch callback: nothing in it may block.
+    typedef void (*FailureCallback)(HRESULT hResult);
+
+    EventSink(ProcessEventBatcher::BatchCallback callback, FailureCallback onFailure)
+        : batcher(std::move(callback)), onFailure(onFailure) {}
 
     ULONG STDMETHODCALLTYPE AddRef() override;
     ULONG STDMETHODCALLTYPE Release() override;
@@ -43,4 +41,36 @@ public:
         _In_ BSTR strParam,
         _In_ IWbemClassObject __RPC_FAR* pObjParam
     ) override;
+
+    const ProcessEventBatcher& Batcher() const { return batcher; }
+    // Waits for the events being delivered, and drops the ones after them until Open
+    void Close() { batcher.Close(); }
+    void Open() { batcher.Open(); }
+    uint64_t Failures() const { return failures; }
+
+private:
+    // Of Win32_ProcessStartTrace; every event has the same layout, so they're valid for all of them
+    typedef struct {
+        bool resolved;
+        long processId;
+        long parentProcessId;
+        long processName;
+        long sessionId;
+        long timeCreated;
+    } PropertyHandles;
+
+    ~EventSink() = default;
+
+    // Returns false if not even the process ID could be read. `createdTicks` is 0 if unknown.
+    bool Extract(IWbemClassObject* pObj, ProcessStartEvent& event, uint64_t& createdTicks);
+    bool ExtractWithHandles(IWbemObjectAccess* pAccess, ProcessStartEvent& event, uint64_t& createdTicks);
+    static bool ExtractWithVariants(IWbemClassObject* pObj, ProcessStartEvent& event, uint64_t& createdTicks);
+    void ResolveHandles(IWbemObjectAccess* pAccess);
+
+    LONG m_lRef = 0;
+    ProcessEventBatcher batcher;
+    FailureCallback onFailure;
+    // Only touched from inside the batcher, which serializes deliveries
+    PropertyHandles handles = {};
+    std::atomic<uint64_t> failures{ 0 };
 };
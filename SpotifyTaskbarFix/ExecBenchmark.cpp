@@ -0,0 +1,177 @@
+// Measures the kernel's process connector as a source of process starts: how
+// long after an exec its event arrives, and how much CPU the listener spends
+// per thousand execs while a build-machine-like storm of them goes on. Most
+// of the execs are of true(1), which no rule is about; one in ten is of a
+// copy of sleep(1) named like the app, which stays around for a moment the
+// way the app would. Linux only, and needs CAP_NET_ADMIN.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "ProcConnector.h"
+#include "Trace.h"
+
+extern char** environ;
+
+using namespace std;
+
+namespace
+{
+    constexpr char RULES[] =
+        "[Spotify]\n"
+        "process = spotify\n"
+        "window  = Spotify\n";
+
+    constexpr size_t MATCH_EVERY = 10;
+    // Long enough to still be there when its event is handled, even on a loaded machine
+    constexpr const char* MATCHING_LIFETIME = "0.5";
+
+    uint64_t ThreadCpuNs()
+    {
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+    }
+
+    bool CopyFile(const char* const from, const string& to)
+    {
+        FILE* const source = fopen(from, "rb");
+        FILE* const destination = fopen(to.c_str(), "wb");
+        bool ok = source != nullptr && destination != nullptr;
+
+        char buffer[65536];
+        size_t length;
+        while (ok && (length = fread(buffer, 1, sizeof buffer, source)) > 0)
+            ok = fwrite(buffer, 1, length, destination) == length;
+
+        if (source != nullptr)
+            fclose(source);
+        if (destination != nullptr)
+            ok &= fclose(destination) == 0;
+        return ok && chmod(to.c_str(), 0755) == 0;
+    }
+
+    pid_t Spawn(const char* const path, const char* const argument)
+    {
+        char* const argv[] = { const_cast<char*>(path), const_cast<char*>(argument), nullptr };
+        pid_t pid;
+        return posix_spawn(&pid, path, nullptr, nullptr, argv, environ) == 0 ? pid : -1;
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const int execCount = argc > 1 ? atoi(argv[1]) : 10000;
+    const int spawnerCount = argc > 2 ? atoi(argv[2]) : static_cast<int>(thread::hardware_concurrency());
+    if (execCount <= 0 || spawnerCount <= 0)
+    {
+        fprintf(stderr, "usage: %s [execs] [spawning threads]\n", argv[0]);
+        return 1;
+    }
+
+    LogConfig quiet = {};
+    Logger::Instance().Start(quiet);
+
+    RuleSet rules;
+    string error;
+    rules.Parse(RULES, error);
+
+    // A copy of sleep(1) whose executable is named like the app
+    char directory[] = "/tmp/ExecBenchmark.XXXXXX";
+    if (mkdtemp(directory) == nullptr)
+        return 1;
+    const string matching = string(directory) + "/spotify";
+    if (!CopyFile("/bin/sleep", matching))
+    {
+        fprintf(stderr, "Could not copy /bin/sleep to %s\n", matching.c_str());
+        rmdir(directory);
+        return 1;
+    }
+
+    atomic<size_t> received{ 0 };
+    ProcConnector connector(rules, [&](const ProcessStartEvent&) { received++; });
+    if (!connector.Start())
+    {
+        fprintf(stderr, "Could not subscribe to process events: %s (it takes CAP_NET_ADMIN)\n", strerror(errno));
+        unlink(matching.c_str());
+        rmdir(directory);
+        return 1;
+    }
+
+    // The listener, as the event loop would run it
+    atomic<bool> spawning{ true };
+    uint64_t listenerCpuNs = 0;
+    thread listener([&]
+    {
+        pollfd fd = { connector.Handle(), POLLIN, 0 };
+        while (spawning || poll(&fd, 1, 200) > 0)
+        {
+            if (spawning && poll(&fd, 1, 100) <= 0)
+                continue;
+
+            const uint64_t startedNs = ThreadCpuNs();
+            connector.Drain();
+            listenerCpuNs += ThreadCpuNs() - startedNs;
+        }
+    });
+
+    const uint64_t startedUs = Tracer::Now();
+    vector<thread> spawners;
+    atomic<int> next{ 0 };
+    for (int i = 0; i < spawnerCount; i++)
+    {
+        spawners.emplace_back([&]
+        {
+            vector<pid_t> sleeping;
+            for (int n = next++; n < execCount; n = next++)
+            {
+                if (n % MATCH_EVERY == 0)
+                {
+                    if (const pid_t pid = Spawn(matching.c_str(), MATCHING_LIFETIME); pid > 0)
+                        sleeping.push_back(pid);
+                }
+                else if (const pid_t pid = Spawn("/bin/true", nullptr); pid > 0)
+                    waitpid(pid, nullptr, 0);
+            }
+            for (const pid_t pid : sleeping)
+                waitpid(pid, nullptr, 0);
+        });
+    }
+    for (thread& spawner : spawners)
+        spawner.join();
+    const uint64_t elapsedUs = Tracer::Now() - startedUs;
+
+    spawning = false;
+    listener.join();
+    connector.Stop();
+    unlink(matching.c_str());
+    rmdir(directory);
+
+    const size_t expected = (static_cast<size_t>(execCount) + MATCH_EVERY - 1) / MATCH_EVERY;
+    const PhaseStats latency = Tracer::Instance().Stats(TracePhase::ExecDelivery);
+    printf("%d execs from %d threads in %.2f s (%.0f/s)\n", execCount, spawnerCount, elapsedUs / 1e6, execCount * 1e6 / elapsedUs);
+    printf("  received:      %llu execs (%llu of them by others), %zu of %zu matching, %llu overruns\n",
+           static_cast<unsigned long long>(connector.Execs()),
+           static_cast<unsigned long long>(connector.Execs() > static_cast<uint64_t>(execCount) ? connector.Execs() - execCount : 0),
+           received.load(), expected, static_cast<unsigned long long>(connector.Overruns()));
+    printf("  exec-to-event: p50 %llu us, p95 %llu us, p99 %llu us\n", static_cast<unsigned long long>(latency.p50),
+           static_cast<unsigned long long>(latency.p95), static_cast<unsigned long long>(latency.p99));
+    printf("  listener CPU:  %.1f us per 1000 execs\n", connector.Execs() > 0 ? listenerCpuNs / 1e3 / (connector.Execs() / 1000.0) : 0.0);
+
+    Logger::Instance().Stop();
+    return received == expected ? 0 : 1;
+}
@@ -0,0 +1,337 @@
+#include "FixJob.h"
+
+#include <algorithm>
+#include "Log.h"
+#include "TaskbarNudge.h"
+
+using namespace std;
+using namespace std::chrono;
+
+
+FixJob::FixJob(DesktopBackend& desktop, WindowEventSource* events, const RuleSet& rules, const size_t app, const ProcessId rootProcessId, const WaitSchedule& schedule)
+    : desktop(desktop), events(events), rules(rules), app(app), schedule(schedule), classes(rules)
+{
+    startedTime = system_clock::now();
+    startedTick = desktop.Now();
+    startedUs = Tracer::Now();
+    phaseStartedUs = startedUs;
+
+    members.push_back(rootProcessId);
+    candidates.push_back(rootProcessId);
+    if (events != nullptr)
+        events->Watch(rootProcessId);
+
+    EnterPhase(Phase::WaitInputIdle, startedTick, Schedule(Phase::WaitInputIdle).timeoutMs);
+}
+
+FixJob::~FixJob()
+{
+    // Only the root process is ever waited on
+    desktop.ReleaseProcess(RootProcessId());
+    if (events != nullptr)
+    {
+        for (const ProcessId processId : candidates)
+            events->Unwatch(processId);
+    }
+}
+
+void FixJob::AddMember(const ProcessId processId, const bool candidate)
+{
+    if (Contains(processId))
+        return;
+
+    members.push_back(processId);
+    if (snapshot != nullptr)
+        threadIndex.CopyFrom(snapshot->Threads(), processId);
+    if (!candidate)
+        return;
+
+    candidates.push_back(processId);
+    if (events != nullptr)
+        events->Watch(processId);
+}
+
+bool FixJob::Contains(const ProcessId processId) const
+{
+    return std::find(members.begin(), members.end(), processId) != members.end();
+}
+
+void FixJob::UseSnapshot(std::shared_ptr<const SystemSnapshot> systemSnapshot)
+{
+    snapshot = std::move(systemSnapshot);
+    for (const ProcessId processId : members)
+        threadIndex.CopyFrom(snapshot->Threads(), processId);
+}
+
+uint64_t FixJob::EventSequence() const
+{
+    if (events == nullptr)
+        return 0;
+
+    uint64_t sequence = 0;
+    for (const ProcessId processId : candidates)
+        sequence += events->Sequence(processId);
+    return sequence;
+}
+
+void FixJob::Cancel()
+{
+    if (phase != Phase::Done)
+        Finish(FixResult::Cancelled);
+}
+
+bool FixJob::Step()
+{
+    while (phase != Phase::Done)
+    {
+        const uint64_t now = desktop.Now();
+        switch (phase)
+        {
+            case Phase::WaitInputIdle:
+            {
+                const bool idle = desktop.WaitForInputIdle(RootProcessId(), 0);
+                if (!idle && now < phaseDeadline)
+                    return Wait(now);
+                EndWait(now, !idle);
+
+                // WaitForInputIdle can return long before the app creates any window. Give the
+                // process a little more time to reveal itself as the main process, but
+                // re-check as soon as any of its windows appears.
+                const uint64_t msToIdle = now - startedTick;
+                const uint32_t identificationTimeout = Schedule(Phase::IdentifyMainProcess).timeoutMs;
+                if (snapshot == nullptr)
+                    threadIndex.Build(desktop);
+                EnterPhase(Phase::IdentifyMainProcess, now, msToIdle < identificationTimeout ? identificationTimeout : 0);
+                break;
+            }
+
+            case Phase::IdentifyMainProcess:
+            {
+                for (const ProcessId processId : candidates)
+                {
+                    FindMainWindow(processId);
+                    if (spResult.isMainProcess)
+                    {
+                        mainProcessId = processId;
+                        break;
+                    }
+                }
+
+                if (!spResult.isMainProcess)
+                {
+                    if (now < phaseDeadline)
+                        return Wait(now);
+                    EndWait(now, true);
+                    return Finish(FixResult::NotMainProcess);
+                }
+                EndWait(now, false);
+
+                char localTime[32];
+                GetLocalTime(&startedTime, localTime, sizeof localTime);
+                Log(LogLevel::Info, "%ls process started at %s.", rules.App(app).name.c_str(), localTime);
+                Log(LogLevel::Info, "  | Process ID:    0x%08lX", static_cast<unsigned long>(mainProcessId));
+
+                // The main window might not be immediately available after the process starts;
+                // in case the main process is correctly identified, but it doesn't YET contain
+                // the main window, we wait for it to show up.
+                EnterPhase(Phase::FindMainWindow, now, Schedule(Phase::FindMainWindow).timeoutMs);
+                break;
+            }
+
+            case Phase::FindMainWindow:
+            {
+                if (spResult.hPWnd == NULL_WINDOW || spResult.hWnd == NULL_WINDOW)
+                    FindMainWindow(mainProcessId);
+
+                if (spResult.hPWnd == NULL_WINDOW || spResult.hWnd == NULL_WINDOW)
+                {
+                    if (now < phaseDeadline)
+                        return Wait(now);
+
+                    EndWait(now, true);
+                    Log(LogLevel::Warning, "%ls main window not found!", rules.App(app).name.c_str());
+                    return Finish(FixResult::MainWindowNotFound);
+                }
+
+                EndWait(now, false);
+                windowPosition = desktop.GetWindowPosition(spResult.hPWnd);
+                Log(LogLevel::Info, "  | Window handle: 0x%08llX", static_cast<unsigned long long>(spResult.hWnd));
+                Log(LogLevel::Info, "  | Window position: (%d, %d)", windowPosition.left, windowPosition.top);
+
+                EnterPhase(Phase::WaitVisible, now, Schedule(Phase::WaitVisible).timeoutMs);
+                break;
+            }
+
+            case Phase::WaitVisible:
+            {
+                const bool validWindowStyle = HasFlag(desktop.GetStyle(spResult.hWnd), STYLE_VISIBLE) &&
+                                              HasFlag(desktop.GetStyle(spResult.hPWnd), STYLE_VISIBLE | STYLE_SYSMENU);
+                if (!validWindowStyle)
+                {
+                    if (now < phaseDeadline)
+                        return Wait(now);
+
+                    EndWait(now, true);
+                    Log(LogLevel::Warning, "No visible window found!");
+                    return Finish(FixResult::WindowNotVisible);
+                }
+
+                EndWait(now, false);
+                return Finish(MoveWindow());
+            }
+
+            case Phase::Done:
+                break;
+        }
+    }
+    return true;
+}
+
+TracePhase FixJob::TracePhaseOf(const Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::WaitInputIdle:
+            return TracePhase::WaitInputIdle;
+        case Phase::IdentifyMainProcess:
+            return TracePhase::IdentifyMainProcess;
+        case Phase::FindMainWindow:
+            return TracePhase::FindMainWindow;
+        case Phase::WaitVisible:
+            return TracePhase::WaitVisible;
+        case Phase::Done:
+            break;
+    }
+    return TracePhase::Fix;
+}
+
+WaitPhase FixJob::WaitPhaseOf(const Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::WaitInputIdle:
+            return WaitPhase::InputIdle;
+        case Phase::IdentifyMainProcess:
+            return WaitPhase::MainProcess;
+        case Phase::FindMainWindow:
+            return WaitPhase::MainWindow;
+        case Phase::WaitVisible:
+        case Phase::Done:
+            break;
+    }
+    return WaitPhase::Visible;
+}
+
+void FixJob::EnterPhase(const Phase next, const uint64_t now, const uint32_t timeoutMs)
+{
+    if (next != phase)
+    {
+        const uint64_t nowUs = Tracer::Now();
+        Tracer::Instance().Record(TracePhaseOf(phase), RootProcessId(), phaseStartedUs, nowUs);
+        phaseStartedUs = nowUs;
+    }
+
+    phase = next;
+    phaseStartedTick = now;
+    phaseDeadline = now + timeoutMs;
+    wakeAt = now;
+}
+
+void FixJob::EndWait(const uint64_t now, const bool timedOut)
+{
+    waits[static_cast<size_t>(WaitPhaseOf(phase))] = { true, timedOut, static_cast<uint32_t>(now - phaseStartedTick) };
+}
+
+bool FixJob::Wait(const uint64_t now)
+{
+    // With an event source the poll interval is only an upper bound between re-checks,
+    // for state changes that don't raise an event (e.g. WS_SYSMENU).
+    const uint32_t pollInterval = PollInterval(Schedule(phase), static_cast<uint32_t>(now - phaseStartedTick));
+    wakeAt = std::min(now + pollInterval, phaseDeadline);
+    return false;
+}
+
+bool FixJob::Finish(const FixResult fixResult)
+{
+    const uint64_t nowUs = Tracer::Now();
+    Tracer::Instance().Record(TracePhaseOf(phase), RootProcessId(), phaseStartedUs, nowUs);
+    Tracer::Instance().Record(TracePhase::Fix, RootProcessId(), startedUs, nowUs);
+
+    phase = Phase::Done;
+    result = fixResult;
+    return true;
+}
+
+void FixJob::FindMainWindow(const ProcessId processId)
+{
+    TraceSpan span(TracePhase::WindowSearch, processId);
+
+    // The system-wide thread snapshot is taken once, when the process goes
+    // idle; every retry only refreshes the threads of the process being searched.
+    threadIndex.Refresh(desktop, processId);
+    const std::vector<ThreadId>& threads = threadIndex.ThreadsOf(processId);
+    if (FindMainWindowByHint(threads))
+        return;
+
+    if (windowSearchPool != nullptr)
+        windowSearchPool->FindAppMainWindow(desktop, classes, app, threads, &spResult);
+    else
+        FindAppMainWindow(desktop, classes, app, threads, &spResult);
+
+    // Next time, this version of the app gets looked for right where it was
+    WindowHint hint;
+    if (windowHints != nullptr && !windowHintRecorded && !imageVersion.empty() && DescribeAppMainWindow(desktop, threads, spResult, &hint))
+    {
+        windowHints->Miss(rules.App(app).name, imageVersion, hint);
+        windowHintRecorded = true;
+    }
+}
+
+bool FixJob::FindMainWindowByHint(const std::vector<ThreadId>& threads)
+{
+    if (windowHints == nullptr)
+        return false;
+
+    // Every process of the tree runs the same executable
+    if (!imageVersionQueried)
+    {
+        imageVersionQueried = true;
+        if (!desktop.GetProcessImageVersion(RootProcessId(), imageVersion))
+            imageVersion.clear();
+    }
+
+    WindowHint hint;
+    if (imageVersion.empty() || !windowHints->Find(rules.App(app).name, imageVersion, hint) ||
+        !FindAppMainWindowByHint(desktop, classes, app, threads, hint, &spResult))
+        return false;
+
+    if (!windowHintRecorded)
+        windowHints->Hit(rules.App(app).name, imageVersion);
+    windowHintRecorded = true;
+    return true;
+}
+
+FixResult FixJob::MoveWindow()
+{
+    Log(LogLevel::Info, "The window is visible.");
+
+    TaskbarNudge nudge;
+    {
+        TraceSpan span(TracePhase::MoveWindow, RootProcessId());
+
+        // Where the window is now that it's shown, which isn't necessarily where it was created
+        windowPosition = desktop.GetWindowPosition(spResult.hPWnd);
+        nudge = PlanTaskbarNudge(MonitorTopology::Query(desktop), windowPosition);
+        for (size_t i = 0; i < nudge.moveCount; i++)
+            desktop.SetWindowPosition(spResult.hPWnd, nudge.moves[i]);
+    }
+
+    if (nudge.moveCount == 0)
+    {
+        Log(LogLevel::Info, "The window is %s; no need to move it.", NudgeDecisionName(nudge.decision));
+        return FixResult::WindowInPlace;
+    }
+
+    Log(LogLevel::Info, "The window has been moved.");
+    return FixResult::WindowMoved;
+}
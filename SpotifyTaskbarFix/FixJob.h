@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ClassAtomCache.h"
+#include "DesktopBackend.h"
+#include "ProcessThreadIndex.h"
+#include "Rules.h"
+#include "SpotifyFix.h"
+#include "SystemSnapshot.h"
+#include "Trace.h"
+#include "WaitSchedule.h"
+#include "WindowEventSource.h"
+#include "WindowHintCache.h"
+#include "WindowSearchPool.h"
+
+// The taskbar fix for one process tree of one of the rule set's apps, as a resumable state machine.
+// Step never blocks: it advances through as many phases as the current state
+// of the desktop allows and then reports, through WakeAt, the latest time at
+// which it wants to be stepped again. Window events for any member of the
+// tree are a reason to step it earlier.
+class FixJob
+{
+public:
+    enum class Phase
+    {
+        WaitInputIdle,
+        IdentifyMainProcess,
+        FindMainWindow,
+        WaitVisible,
+        Done,
+    };
+
+    // How one of the waits ended, for the latency model
+    typedef struct {
+        bool observed;
+        bool timedOut;
+        uint32_t ms;
+    } PhaseWait;
+
+    FixJob(DesktopBackend& desktop, WindowEventSource* events, const RuleSet& rules, size_t app, ProcessId rootProcessId, const WaitSchedule& schedule);
+    ~FixJob();
+
+    FixJob(const FixJob&) = delete;
+    FixJob& operator=(const FixJob&) = delete;
+
+    // Adds another process of the same tree. Unless it's known to be a helper,
+    // it is also a candidate when looking for the main process.
+    void AddMember(ProcessId processId, bool candidate = true);
+    bool Contains(ProcessId processId) const;
+
+    // Right after construction, for a tree that was already running when `snapshot`
+    // was taken: the members' threads come from there instead of a snapshot of the
+    // job's own, and its waits say nothing about how long the app takes to start.
+    void UseSnapshot(std::shared_ptr<const SystemSnapshot> snapshot);
+    bool AlreadyRunning() const { return snapshot != nullptr; }
+
+    // Searches for the main window with `pool` instead of on the calling thread.
+    void SetWindowSearchPool(WindowSearchPool* pool) { windowSearchPool = pool; }
+    // Looks where `cache` says first, and tells it where the main window turned up.
+    void SetWindowHintCache(WindowHintCache* cache) { windowHints = cache; }
+    const std::vector<ProcessId>& Members() const { return members; }
+
+    // Returns true once the job is done.
+    bool Step();
+    void Cancel();
+
+    // Sum of the members' window event sequences; a change means Step is worth calling early.
+    uint64_t EventSequence() const;
+
+    size_t App() const { return app; }
+    Phase CurrentPhase() const { return phase; }
+    FixResult Result() const { return result; }
+    uint64_t WakeAt() const { return wakeAt; }
+    // On the desktop's clock
+    uint64_t StartedAt() const { return startedTick; }
+    ProcessId RootProcessId() const { return members.front(); }
+    ProcessId MainProcessId() const { return mainProcessId; }
+    // The window that gets moved; NULL_WINDOW until it's found.
+    WindowHandle MainWindow() const { return spResult.hPWnd; }
+    const PhaseWait& Waited(const WaitPhase waitPhase) const { return waits[static_cast<size_t>(waitPhase)]; }
+
+private:
+    static TracePhase TracePhaseOf(Phase phase);
+    static WaitPhase WaitPhaseOf(Phase phase);
+
+    const PhaseSchedule& Schedule(const Phase of) const { return schedule.phases[static_cast<size_t>(WaitPhaseOf(of))]; }
+    void EnterPhase(Phase next, uint64_t now, uint32_t timeoutMs);
+    void EndWait(uint64_t now, bool timedOut);
+    bool Wait(uint64_t now);
+    bool Finish(FixResult fixResult);
+    void FindMainWindow(ProcessId processId);
+    bool FindMainWindowByHint(const std::vector<ThreadId>& threads);
+    FixResult MoveWindow();
+
+    DesktopBackend& desktop;
+    WindowEventSource* events;
+    const RuleSet& rules;
+    const size_t app;
+    const WaitSchedule schedule;
+
+    std::vector<ProcessId> members;
+    std::vector<ProcessId> candidates;
+    ProcessId mainProcessId = 0;
+    ProcessThreadIndex threadIndex;
+    std::shared_ptr<const SystemSnapshot> snapshot;
+    ClassAtomCache classes;
+    WindowSearchPool* windowSearchPool = nullptr;
+    WindowHintCache* windowHints = nullptr;
+    // Of the root process's executable; empty if unknown, or until the first search
+    std::wstring imageVersion;
+    bool imageVersionQueried = false;
+    // One hit or one miss per job, however many times it searches
+    bool windowHintRecorded = false;
+    FindMainWindowResult spResult = { NULL_WINDOW, NULL_WINDOW, false, 0 };
+    WindowRect windowPosition = { 0, 0, 0, 0 };
+
+    std::chrono::system_clock::time_point startedTime;
+    uint64_t startedTick;
+    uint64_t startedUs;
+    uint64_t phaseStartedUs;
+    uint64_t phaseStartedTick = 0;
+    PhaseWait waits[WAIT_PHASE_COUNT] = {};
+
+    Phase phase = Phase::WaitInputIdle;
+    FixResult result = FixResult::Pending;
+    uint64_t phaseDeadline = 0;
+    uint64_t wakeAt = 0;
+};
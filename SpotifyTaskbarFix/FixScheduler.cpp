@@ -0,0 +1,510 @@
+#include "FixScheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#include "Log.h"
+#include "TaskbarNudge.h"
+
+FixScheduler::FixScheduler(DesktopBackend& desktop, WindowEventSource& events, const RuleSet& rules, const size_t maxJobs, const size_t maxQueuedEvents)
+    : desktop(desktop), events(events), rules(rules), maxJobs(maxJobs), maxQueuedEvents(maxQueuedEvents)
+{
+    // Never any bigger: however many events come through, queueing them allocates nothing
+    inbox.reserve(maxQueuedEvents);
+}
+
+FixScheduler::~FixScheduler()
+{
+    Stop();
+}
+
+void FixScheduler::Start()
+{
+    if (running.exchange(true))
+        return;
+
+    // A restart starts from scratch: whatever came in or was going on before the last Stop
+    // belongs to the scheduler that was stopped (the rules may have changed since)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inbox.clear();
+        cancellations.clear();
+        cancelAll = false;
+        inboxSnapshot.reset();
+        forgetSettled = false;
+        displayChanges = 0;
+    }
+    pending.clear();
+    snapshot.reset();
+    settledProcesses.clear();
+    settledExpiry = Debouncer::NEVER;
+    watchedWindows.clear();
+    watchedWindowCount = 0;
+    knownTopology = MonitorTopology();
+    displayDebouncer.Reset();
+    worker = std::thread(&FixScheduler::WorkerLoop, this);
+}
+
+void FixScheduler::Stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    CancelAll();
+    worker.join();
+}
+
+bool FixScheduler::Submit(const ProcessStartEvent& event)
+{
+    return Submit(&event, 1) == 1;
+}
+
+size_t FixScheduler::Submit(const ProcessStartEvent* const batch, const size_t count)
+{
+    size_t accepted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        accepted = std::min(count, maxQueuedEvents - std::min(inbox.size(), maxQueuedEvents));
+        inbox.insert(inbox.end(), batch, batch + accepted);
+    }
+    droppedEvents += count - accepted;
+    if (accepted > 0)
+        events.Interrupt();
+    return accepted;
+}
+
+void FixScheduler::Reconcile(std::shared_ptr<const SystemSnapshot> systemSnapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inboxSnapshot = std::move(systemSnapshot);
+    }
+    events.Interrupt();
+}
+
+void FixScheduler::Refix(std::shared_ptr<const SystemSnapshot> systemSnapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inboxSnapshot = std::move(systemSnapshot);
+        forgetSettled = true;
+    }
+    events.Interrupt();
+}
+
+void FixScheduler::Cancel(const ProcessId processId)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancellations.push_back(processId);
+    }
+    events.Interrupt();
+}
+
+void FixScheduler::CancelAll()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelAll = true;
+    }
+    events.Interrupt();
+}
+
+void FixScheduler::NotifyDisplayChanged()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        displayChanges++;
+    }
+    events.Interrupt();
+}
+
+void FixScheduler::SetCompletionCallback(CompletionCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    completionCallback = std::move(callback);
+}
+
+void FixScheduler::RunUntil(const uint64_t time)
+{
+    while (desktop.Now() < time)
+    {
+        const uint64_t sequence = events.GlobalSequence();
+
+        uint64_t nextWake;
+        RunOnce(&nextWake);
+        nextWake = std::min(nextWake, time);
+
+        const uint64_t now = desktop.Now();
+        if (nextWake > now)
+            events.WaitForAnyWindowEvent(sequence, static_cast<uint32_t>(nextWake - now));
+    }
+}
+
+void FixScheduler::RunUntilIdle()
+{
+    while (true)
+    {
+        const uint64_t sequence = events.GlobalSequence();
+
+        uint64_t nextWake;
+        if (!RunOnce(&nextWake))
+            return;
+
+        const uint64_t now = desktop.Now();
+        if (nextWake > now)
+            events.WaitForAnyWindowEvent(sequence, static_cast<uint32_t>(nextWake - now));
+    }
+}
+
+void FixScheduler::WorkerLoop()
+{
+    // An idle scheduler has no deadline; it only wakes up for new events.
+    constexpr uint32_t IDLE_WAIT = std::numeric_limits<uint32_t>::max();
+
+    while (running)
+    {
+        const uint64_t sequence = events.GlobalSequence();
+
+        uint64_t nextWake;
+        uint32_t wait = IDLE_WAIT;
+        if (RunOnce(&nextWake))
+        {
+            const uint64_t now = desktop.Now();
+            wait = static_cast<uint32_t>(std::min<uint64_t>(nextWake > now ? nextWake - now : 0, IDLE_WAIT));
+        }
+
+        if (running && wait > 0)
+            events.WaitForAnyWindowEvent(sequence, wait);
+    }
+
+    // Drain whatever was cancelled by Stop, so that completion callbacks run.
+    uint64_t nextWake;
+    RunOnce(&nextWake);
+}
+
+bool FixScheduler::RunOnce(uint64_t* const nextWake)
+{
+    std::vector<ProcessId> cancelled;
+    bool cancelEverything;
+    uint64_t newDisplayChanges;
+    bool refix;
+    bool inboxLeft;
+    std::shared_ptr<const SystemSnapshot> newSnapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        newSnapshot.swap(inboxSnapshot);
+        refix = forgetSettled;
+        forgetSettled = false;
+        // What doesn't fit stays in the inbox, where Submit drops what comes after it
+        const size_t taken = std::min(inbox.size(), maxQueuedEvents - std::min(pending.size(), maxQueuedEvents));
+        pending.insert(pending.end(), inbox.begin(), inbox.begin() + taken);
+        inbox.erase(inbox.begin(), inbox.begin() + taken);
+        inboxLeft = !inbox.empty();
+        cancelled.swap(cancellations);
+        cancelEverything = cancelAll;
+        cancelAll = false;
+        newDisplayChanges = displayChanges;
+        displayChanges = 0;
+    }
+
+    uint64_t now = desktop.Now();
+    if (refix)
+    {
+        settledProcesses.clear();
+        settledExpiry = Debouncer::NEVER;
+    }
+    PruneSettled(now);
+
+    // Cancellations
+    for (JobSlot& slot : jobs)
+    {
+        const bool cancel = cancelEverything || std::any_of(cancelled.begin(), cancelled.end(), [&](const ProcessId processId)
+        {
+            return slot.job->Contains(processId);
+        });
+        if (cancel)
+            slot.job->Cancel();
+    }
+    if (cancelEverything)
+    {
+        pending.clear();
+        newSnapshot.reset();
+    }
+
+    // The processes that were already running go before anything that started since
+    if (newSnapshot != nullptr)
+    {
+        snapshot = std::move(newSnapshot);
+        QueueRunningProcesses(*snapshot);
+    }
+
+    // New events; those that find no free job slot stay pending
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const ProcessStartEvent& event)
+    {
+        return Dispatch(event);
+    }), pending.end());
+    if (pending.empty())
+        snapshot.reset();
+
+    // Step every job that is due, or whose windows changed since the last step
+    for (JobSlot& slot : jobs)
+    {
+        FixJob& job = *slot.job;
+        const uint64_t eventSequence = job.EventSequence();
+        if (job.CurrentPhase() != FixJob::Phase::Done && (job.WakeAt() <= now || eventSequence != slot.lastEventSequence))
+        {
+            job.Step();
+            slot.lastEventSequence = eventSequence;
+            now = desktop.Now();
+        }
+    }
+
+    // Retire finished jobs
+    for (JobSlot& slot : jobs)
+    {
+        if (slot.job->CurrentPhase() == FixJob::Phase::Done)
+            Complete(slot, now);
+    }
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const JobSlot& slot) { return slot.job == nullptr; }), jobs.end());
+    activeJobs = jobs.size();
+
+    // Display changes; only the last of a burst does anything
+    if (watchMode && newDisplayChanges > 0)
+        displayDebouncer.Trigger(now);
+    if (displayDebouncer.Fire(now))
+        RenudgeWatchedWindows();
+
+    // Events still pending go as soon as there's a free slot, and those left in the inbox as
+    // soon as there's room for them; with every slot taken, the next job to finish frees one
+    *nextWake = displayDebouncer.Deadline();
+    if ((!pending.empty() && jobs.size() < maxJobs) || (inboxLeft && pending.size() < maxQueuedEvents))
+        *nextWake = now;
+    for (const JobSlot& slot : jobs)
+        *nextWake = std::min(*nextWake, slot.job->WakeAt());
+    return !jobs.empty() || displayDebouncer.Pending() || !pending.empty() || inboxLeft;
+}
+
+bool FixScheduler::Dispatch(const ProcessStartEvent& event)
+{
+    // Same tree as a job that already finished: nothing left to do
+    auto settled = settledProcesses.find(event.processId);
+    if (settled == settledProcesses.end())
+        settled = settledProcesses.find(event.parentProcessId);
+    if (settled != settledProcesses.end())
+    {
+        settledProcesses[event.processId] = settled->second;
+        coalescedEvents++;
+        return true;
+    }
+
+    const size_t app = FindApp(event);
+    if (app == RuleSet::NO_APP)
+    {
+        ignoredProcesses++;
+        return true;
+    }
+
+    const ProcessRole role = ClassifyProcess(desktop, event, rules.App(app));
+    if (role == ProcessRole::Helper)
+        rejectedHelpers++;
+
+    // Same tree as a job in progress: one more candidate for that job, unless it's a helper
+    for (JobSlot& slot : jobs)
+    {
+        FixJob& job = *slot.job;
+        if (job.Contains(event.processId) || job.Contains(event.parentProcessId))
+        {
+            job.AddMember(event.processId, role != ProcessRole::Helper);
+            coalescedEvents++;
+            return true;
+        }
+    }
+
+    // A helper of no tree we know of (e.g. its main process started before we did)
+    if (role == ProcessRole::Helper)
+        return true;
+
+    if (jobs.size() >= maxJobs)
+        return false;
+
+    const WaitSchedule schedule = latencyModel != nullptr ? latencyModel->Schedule(rules.App(app).name) : FixedWaitSchedule();
+    auto job = std::make_unique<FixJob>(desktop, &events, rules, app, event.processId, schedule);
+    if (snapshot != nullptr && snapshot->Find(event.processId) != nullptr)
+        job->UseSnapshot(snapshot);
+    job->SetWindowSearchPool(windowSearchPool);
+    job->SetWindowHintCache(windowHints);
+
+    jobs.push_back({ std::move(job), events.Sequence(event.processId) });
+    jobs.back().job->Step();
+    return true;
+}
+
+size_t FixScheduler::FindApp(const ProcessStartEvent& event)
+{
+    if (event.processName[0] != L'\0')
+        return rules.FindApp(event.processName);
+
+    // The WMI filter already matched one of the rules' process names, but events
+    // from elsewhere might not carry it.
+    std::wstring imageName;
+    if (!desktop.GetProcessImageName(event.processId, imageName))
+        return RuleSet::NO_APP;
+    return rules.FindApp(imageName.c_str());
+}
+
+void FixScheduler::Complete(JobSlot& slot, const uint64_t now)
+{
+    CompletionCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        callback = completionCallback;
+    }
+    Learn(*slot.job);
+    if (watchMode)
+        Watch(*slot.job);
+    if (callback)
+        callback(*slot.job);
+
+    // Only remember trees that actually were the app's; a lone helper that got
+    // rejected says nothing about its future siblings.
+    if (slot.job->Result() != FixResult::NotMainProcess && slot.job->Result() != FixResult::Cancelled)
+    {
+        for (const ProcessId processId : slot.job->Members())
+            settledProcesses[processId] = now + SETTLED_TREE_RETENTION;
+        settledExpiry = std::min(settledExpiry, now + SETTLED_TREE_RETENTION);
+    }
+
+    slot.job.reset();
+}
+
+void FixScheduler::Learn(const FixJob& job)
+{
+    // An app that was already running didn't have to start
+    if (latencyModel == nullptr || job.Result() == FixResult::Cancelled || job.AlreadyRunning())
+        return;
+
+    const std::wstring& app = rules.App(job.App()).name;
+    for (size_t i = 0; i < WAIT_PHASE_COUNT; i++)
+    {
+        const auto phase = static_cast<WaitPhase>(i);
+        const FixJob::PhaseWait& wait = job.Waited(phase);
+        if (!wait.observed)
+            continue;
+
+        // A helper never turns out to be the main process; its timeout is the expected outcome
+        if (phase == WaitPhase::MainProcess && job.Result() == FixResult::NotMainProcess)
+            continue;
+
+        if (wait.timedOut)
+            latencyModel->ObserveTimeout(app, phase);
+        else
+            latencyModel->Observe(app, phase, wait.ms);
+    }
+}
+
+void FixScheduler::QueueRunningProcesses(const SystemSnapshot& systemSnapshot)
+{
+    std::vector<ProcessStartEvent> alreadyRunning;
+    std::unordered_set<ProcessId> runningIds;
+    for (const SystemSnapshot::Process& process : systemSnapshot.Processes())
+    {
+        if (rules.FindApp(process.imageName.c_str()) == RuleSet::NO_APP)
+            continue;
+
+        ProcessStartEvent event = {};
+        event.processId = process.processId;
+        event.parentProcessId = process.parentProcessId;
+        process.imageName.copy(event.processName, PROCESS_NAME_LENGTH - 1);
+        alreadyRunning.push_back(event);
+        runningIds.insert(process.processId);
+    }
+    runningProcesses += alreadyRunning.size();
+
+    // Roots first, so that the rest of each tree joins their job instead of being taken for one
+    std::stable_partition(alreadyRunning.begin(), alreadyRunning.end(), [&](const ProcessStartEvent& event)
+    {
+        return runningIds.count(event.parentProcessId) == 0;
+    });
+    pending.insert(pending.begin(), alreadyRunning.begin(), alreadyRunning.end());
+}
+
+void FixScheduler::PruneSettled(const uint64_t now)
+{
+    // Runs on every pass; only worth going through the trees when one of them is due
+    if (now < settledExpiry)
+        return;
+
+    settledExpiry = Debouncer::NEVER;
+    for (auto it = settledProcesses.begin(); it != settledProcesses.end();)
+    {
+        if (it->second <= now)
+        {
+            it = settledProcesses.erase(it);
+            continue;
+        }
+        settledExpiry = std::min(settledExpiry, it->second);
+        ++it;
+    }
+}
+
+void FixScheduler::Watch(const FixJob& job)
+{
+    if (job.Result() != FixResult::WindowMoved && job.Result() != FixResult::WindowInPlace)
+        return;
+
+    const WindowHandle hWnd = job.MainWindow();
+    const bool known = std::any_of(watchedWindows.begin(), watchedWindows.end(), [&](const WatchedWindow& window) { return window.hWnd == hWnd; });
+    if (hWnd == NULL_WINDOW || known)
+        return;
+
+    // What a future display change will be compared against
+    if (watchedWindows.empty())
+        knownTopology = MonitorTopology::Query(desktop);
+
+    watchedWindows.push_back({ job.App(), hWnd });
+    watchedWindowCount = watchedWindows.size();
+}
+
+void FixScheduler::RenudgeWatchedWindows()
+{
+    if (watchedWindows.empty())
+        return;
+
+    displayPasses++;
+    const MonitorTopology topology = MonitorTopology::Query(desktop);
+    if (topology.SameAs(knownTopology))
+    {
+        Log(LogLevel::Info, "The display configuration changed back to what it was.");
+        return;
+    }
+    knownTopology = topology;
+
+    for (auto it = watchedWindows.begin(); it != watchedWindows.end();)
+    {
+        // A destroyed window has no style at all: the app was closed
+        const uint32_t style = desktop.GetStyle(it->hWnd);
+        if (style == 0)
+        {
+            it = watchedWindows.erase(it);
+            continue;
+        }
+
+        // Hidden (e.g. minimized to the tray), it has no taskbar button to misplace
+        if (HasFlag(style, STYLE_VISIBLE))
+        {
+            const TaskbarNudge nudge = PlanTaskbarNudge(topology, desktop.GetWindowPosition(it->hWnd));
+            for (size_t i = 0; i < nudge.moveCount; i++)
+                desktop.SetWindowPosition(it->hWnd, nudge.moves[i]);
+
+            if (nudge.moveCount > 0)
+            {
+                renudges++;
+                Log(LogLevel::Info, "The display configuration changed; %ls's window has been moved again.", rules.App(it->app).name.c_str());
+            }
+        }
+        ++it;
+    }
+    watchedWindowCount = watchedWindows.size();
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Debouncer.h"
+#include "DesktopBackend.h"
+#include "FixJob.h"
+#include "LatencyModel.h"
+#include "MonitorTopology.h"
+#include "ProcessClassifier.h"
+#include "ProcessStartEvent.h"
+#include "Rules.h"
+#include "SystemSnapshot.h"
+#include "WindowEventSource.h"
+#include "WindowHintCache.h"
+#include "WindowSearchPool.h"
+
+// Runs fix jobs off the event delivery thread. Submit only queues the event;
+// a single worker thread owns all jobs, rejects helper processes up front
+// (see ProcessClassifier), coalesces the start events of one process tree
+// (Chromium's renderer/GPU/utility children) into one job, and steps every
+// job when its deadline passes or one of its windows changes. Waiting
+// therefore costs no thread, no matter how many launches overlap.
+//
+// In watch mode it also keeps the windows it fixed, and nudges them again
+// when the monitor topology changes: docking or plugging in a monitor sends a
+// burst of display and settings changes, which is debounced into a single
+// pass over those windows once things have quieted down.
+class FixScheduler
+{
+public:
+    typedef std::function<void(const FixJob&)> CompletionCallback;
+
+    // `rules` must outlive the scheduler and stay unchanged while it runs.
+    FixScheduler(DesktopBackend& desktop, WindowEventSource& events, const RuleSet& rules, size_t maxJobs = DEFAULT_MAX_JOBS, size_t maxQueuedEvents = DEFAULT_MAX_QUEUED_EVENTS);
+    ~FixScheduler();
+
+    FixScheduler(const FixScheduler&) = delete;
+    FixScheduler& operator=(const FixScheduler&) = delete;
+
+    // Starting again after Stop starts over: the trees and windows of the previous
+    // run are forgotten, so the rules can be changed in between.
+    void Start();
+    void Stop();
+
+    // Thread-safe. Returns false if the event was dropped because the queue is full.
+    bool Submit(const ProcessStartEvent& event);
+    // Thread-safe. A whole batch for the price of one: returns how many of the events
+    // were queued; the rest, from the first that didn't fit on, were dropped.
+    size_t Submit(const ProcessStartEvent* batch, size_t count);
+
+    // Thread-safe. Fixes the apps that were already running when `snapshot` was
+    // taken, as if their processes had just started; they all share the snapshot.
+    void Reconcile(std::shared_ptr<const SystemSnapshot> snapshot);
+    // Thread-safe. Like Reconcile, but also for the trees it fixed already: every
+    // app in `snapshot` is fixed again.
+    void Refix(std::shared_ptr<const SystemSnapshot> snapshot);
+
+    // Thread-safe. Cancels the job of the tree `processId` belongs to, if any.
+    void Cancel(ProcessId processId);
+    void CancelAll();
+
+    // Called on the worker thread whenever a job finishes (including cancelled ones).
+    void SetCompletionCallback(CompletionCallback callback);
+
+    // Before Start. New jobs wait according to what the model learned, and every
+    // finished job teaches it; without a model, the fixed schedule is used.
+    void SetLatencyModel(LatencyModel* model) { latencyModel = model; }
+
+    // Before Start. Jobs search for windows with `pool`, if any.
+    void SetWindowSearchPool(WindowSearchPool* pool) { windowSearchPool = pool; }
+
+    // Before Start. Jobs look for the main window where `cache` says first, and keep it up to date.
+    void SetWindowHintCache(WindowHintCache* cache) { windowHints = cache; }
+
+    // Before Start.
+    void SetWatchMode(bool watch) { watchMode = watch; }
+    // Thread-safe. Something about the displays or the work areas changed.
+    void NotifyDisplayChanged();
+
+    // Drives the scheduler on the calling thread instead of the worker thread,
+    // until `time` or, with RunUntilIdle, until there is nothing left to do.
+    // Meant for SimulatedDesktopBackend, whose waits just move its clock.
+    void RunUntil(uint64_t time);
+    void RunUntilIdle();
+
+    size_t ActiveJobs() const { return activeJobs; }
+    uint64_t DroppedEvents() const { return droppedEvents; }
+    uint64_t CoalescedEvents() const { return coalescedEvents; }
+    uint64_t RejectedHelpers() const { return rejectedHelpers; }
+    uint64_t IgnoredProcesses() const { return ignoredProcesses; }
+    // The apps' processes found in reconciled snapshots
+    uint64_t RunningProcesses() const { return runningProcesses; }
+    size_t WatchedWindows() const { return watchedWindowCount; }
+    // Debounced passes over the watched windows, and the nudges they applied
+    uint64_t DisplayPasses() const { return displayPasses; }
+    uint64_t Renudges() const { return renudges; }
+
+    static constexpr size_t DEFAULT_MAX_JOBS = 16;
+    static constexpr size_t DEFAULT_MAX_QUEUED_EVENTS = 256;
+
+    // Children of a finished tree keep being recognized as such for this long.
+    static constexpr uint32_t SETTLED_TREE_RETENTION = 60 * 1000;
+
+    // A display change is acted upon once none came for this long, but never later than the max delay.
+    static constexpr uint32_t DISPLAY_CHANGE_QUIET_PERIOD = 750;
+    static constexpr uint32_t DISPLAY_CHANGE_MAX_DELAY = 5000;
+
+private:
+    typedef struct {
+        std::unique_ptr<FixJob> job;
+        uint64_t lastEventSequence;
+    } JobSlot;
+
+    typedef struct {
+        size_t app;
+        WindowHandle hWnd;
+    } WatchedWindow;
+
+    void WorkerLoop();
+
+    // Returns whether there is still work to do. Always sets `nextWake`: when to run
+    // again, or Debouncer::NEVER if only an event can bring more work.
+    bool RunOnce(uint64_t* nextWake);
+    bool Dispatch(const ProcessStartEvent& event);
+    size_t FindApp(const ProcessStartEvent& event);
+    void Complete(JobSlot& slot, uint64_t now);
+    void Learn(const FixJob& job);
+    void QueueRunningProcesses(const SystemSnapshot& systemSnapshot);
+    void PruneSettled(uint64_t now);
+    void Watch(const FixJob& job);
+    void RenudgeWatchedWindows();
+
+    DesktopBackend& desktop;
+    WindowEventSource& events;
+    const RuleSet& rules;
+    const size_t maxJobs;
+    const size_t maxQueuedEvents;
+    LatencyModel* latencyModel = nullptr;
+    WindowSearchPool* windowSearchPool = nullptr;
+    WindowHintCache* windowHints = nullptr;
+    bool watchMode = false;
+
+    std::thread worker;
+    std::atomic<bool> running{ false };
+
+    // Shared with producers
+    std::mutex mutex;
+    std::vector<ProcessStartEvent> inbox;
+    std::vector<ProcessId> cancellations;
+    bool cancelAll = false;
+    std::shared_ptr<const SystemSnapshot> inboxSnapshot;
+    bool forgetSettled = false;
+    uint64_t displayChanges = 0;
+    CompletionCallback completionCallback;
+
+    // Owned by whoever is driving the scheduler. Holds at most maxQueuedEvents from the
+    // inbox, plus the processes of a reconciled snapshot.
+    std::vector<ProcessStartEvent> pending;
+    // While some of `pending` comes from it
+    std::shared_ptr<const SystemSnapshot> snapshot;
+    std::vector<JobSlot> jobs;
+    std::unordered_map<ProcessId, uint64_t> settledProcesses;
+    // The earliest a settled tree is forgotten
+    uint64_t settledExpiry = Debouncer::NEVER;
+    std::vector<WatchedWindow> watchedWindows;
+    MonitorTopology knownTopology;
+    Debouncer displayDebouncer{ DISPLAY_CHANGE_QUIET_PERIOD, DISPLAY_CHANGE_MAX_DELAY };
+
+    std::atomic<size_t> activeJobs{ 0 };
+    std::atomic<uint64_t> droppedEvents{ 0 };
+    std::atomic<uint64_t> coalescedEvents{ 0 };
+    std::atomic<uint64_t> rejectedHelpers{ 0 };
+    std::atomic<uint64_t> ignoredProcesses{ 0 };
+    std::atomic<uint64_t> runningProcesses{ 0 };
+    std::atomic<size_t> watchedWindowCount{ 0 };
+    std::atomic<uint64_t> displayPasses{ 0 };
+    std::atomic<uint64_t> renudges{ 0 };
+};
@@ -0,0 +1,255 @@
+#include "LatencyModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "Utf8.h"
+
+namespace
+{
+    size_t BucketOf(const uint32_t ms)
+    {
+        for (size_t i = 0; i < LATENCY_BUCKET_COUNT - 1; i++)
+        {
+            if (ms < LATENCY_BUCKET_EDGES[i])
+                return i;
+        }
+        return LATENCY_BUCKET_COUNT - 1;
+    }
+
+    uint32_t LowerEdgeOf(const size_t bucket)
+    {
+        return bucket == 0 ? 0 : LATENCY_BUCKET_EDGES[bucket - 1];
+    }
+
+    void AddStep(PhaseSchedule& schedule, const uint32_t untilMs, const uint32_t intervalMs)
+    {
+        if (schedule.stepCount > 0 && schedule.steps[schedule.stepCount - 1].intervalMs == intervalMs)
+            schedule.steps[schedule.stepCount - 1].untilMs = untilMs;
+        else if (schedule.stepCount < MAX_POLL_STEPS)
+            schedule.steps[schedule.stepCount++] = { untilMs, intervalMs };
+    }
+
+    void Decay(LatencyCounts& latencies)
+    {
+        uint32_t total = latencies.timeouts;
+        for (const uint32_t count : latencies.counts)
+            total += count;
+        if (total < MAX_MODEL_SAMPLES)
+            return;
+
+        for (uint32_t& count : latencies.counts)
+            count /= 2;
+        latencies.timeouts /= 2;
+    }
+}
+
+LatencyCounts CountLatencies(const std::vector<uint32_t>& latenciesMs, const uint32_t timeoutMs)
+{
+    LatencyCounts latencies = {};
+    for (const uint32_t latency : latenciesMs)
+    {
+        if (latency > timeoutMs)
+            latencies.timeouts++;
+        else
+            latencies.counts[BucketOf(latency)]++;
+    }
+    return latencies;
+}
+
+PhaseSchedule DerivePhaseSchedule(const LatencyCounts& latencies, const PhaseSchedule& fallback)
+{
+    PhaseSchedule schedule = fallback;
+
+    // Waits that timed out only say the timeout was too short
+    if (latencies.timeouts > 0)
+        schedule.timeoutMs = std::max(std::min(fallback.timeoutMs << std::min<uint32_t>(latencies.timeouts, 2), MAX_PHASE_TIMEOUT), fallback.timeoutMs);
+
+    uint64_t total = 0;
+    for (const uint32_t count : latencies.counts)
+        total += count;
+    if (total < MIN_MODEL_SAMPLES)
+        return schedule;
+
+    size_t last = 0;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++)
+    {
+        cumulative += latencies.counts[i];
+        if (cumulative * 100 >= total * 99)
+        {
+            last = i;
+            break;
+        }
+    }
+
+    const uint32_t p99 = LATENCY_BUCKET_EDGES[last];
+    schedule.timeoutMs = std::min(std::max(schedule.timeoutMs, 2 * p99), std::max(MAX_PHASE_TIMEOUT, fallback.timeoutMs));
+
+    // Minimizing sum(p_i * interval_i / 2) over the buckets, for a fixed number of checks
+    // sum(width_i / interval_i), gives interval_i proportional to sqrt(width_i / p_i).
+    double weights[LATENCY_BUCKET_COUNT];
+    double totalWeight = 0.0;
+    for (size_t i = 0; i <= last; i++)
+    {
+        const double width = LATENCY_BUCKET_EDGES[i] - LowerEdgeOf(i);
+        weights[i] = std::sqrt(static_cast<double>(latencies.counts[i]) * width);
+        totalWeight += weights[i];
+    }
+
+    schedule.stepCount = 0;
+    for (size_t i = 0; i <= last; i++)
+    {
+        const uint32_t width = LATENCY_BUCKET_EDGES[i] - LowerEdgeOf(i);
+
+        uint32_t interval = width;
+        if (latencies.counts[i] > 0)
+            interval = static_cast<uint32_t>(width / (WAKEUP_BUDGET * weights[i] / totalWeight));
+        interval = std::min(std::max(interval, MIN_POLL_INTERVAL), MAX_POLL_INTERVAL);
+
+        AddStep(schedule, LATENCY_BUCKET_EDGES[i], interval);
+    }
+
+    // The tail: back off geometrically until the timeout
+    uint32_t until = schedule.steps[schedule.stepCount - 1].untilMs;
+    uint32_t interval = schedule.steps[schedule.stepCount - 1].intervalMs;
+    while (until < schedule.timeoutMs)
+    {
+        interval = std::min(interval * 2, MAX_POLL_INTERVAL);
+        until = std::min(until * 2, schedule.timeoutMs);
+        AddStep(schedule, until, interval);
+    }
+
+    return schedule;
+}
+
+
+// =====================
+//     LATENCY MODEL
+// =====================
+
+bool LatencyModel::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    AppLatencies* current = nullptr;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            current = &apps[line.substr(1, line.size() - 2)];
+            *current = {};
+            continue;
+        }
+        if (current == nullptr)
+            continue;
+
+        // <phase> <timeouts> <count per bucket>...
+        std::istringstream fields(line);
+        std::string phaseName;
+        LatencyCounts latencies = {};
+        fields >> phaseName >> latencies.timeouts;
+        for (uint32_t& count : latencies.counts)
+            fields >> count;
+        if (!fields)
+            continue;
+
+        for (size_t phase = 0; phase < WAIT_PHASE_COUNT; phase++)
+        {
+            if (phaseName == WaitPhaseName(static_cast<WaitPhase>(phase)))
+                current->phases[phase] = latencies;
+        }
+    }
+    return true;
+}
+
+bool LatencyModel::Save(const std::string& path) const
+{
+    std::ostringstream text;
+    text << "# Observed waits per app and phase: timeouts, then how many fell in each bucket (ms):\n#";
+    for (const uint32_t edge : LATENCY_BUCKET_EDGES)
+        text << " <" << edge;
+    text << "\n";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& app : apps)
+        {
+            text << "[" << app.first << "]\n";
+            for (size_t phase = 0; phase < WAIT_PHASE_COUNT; phase++)
+            {
+                const LatencyCounts& latencies = app.second.phases[phase];
+                text << WaitPhaseName(static_cast<WaitPhase>(phase)) << " " << latencies.timeouts;
+                for (const uint32_t count : latencies.counts)
+                    text << " " << count;
+                text << "\n";
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    file << text.str();
+    return static_cast<bool>(file);
+}
+
+void LatencyModel::Observe(const std::wstring& app, const WaitPhase phase, const uint32_t ms)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    LatencyCounts& latencies = Latencies(app).phases[static_cast<size_t>(phase)];
+    Decay(latencies);
+    latencies.counts[BucketOf(ms)]++;
+}
+
+void LatencyModel::ObserveTimeout(const std::wstring& app, const WaitPhase phase)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    LatencyCounts& latencies = Latencies(app).phases[static_cast<size_t>(phase)];
+    Decay(latencies);
+    latencies.timeouts++;
+}
+
+uint32_t LatencyModel::Samples(const std::wstring& app, const WaitPhase phase) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = apps.find(WideToUtf8(app));
+    if (it == apps.end())
+        return 0;
+
+    const LatencyCounts& latencies = it->second.phases[static_cast<size_t>(phase)];
+    uint32_t total = latencies.timeouts;
+    for (const uint32_t count : latencies.counts)
+        total += count;
+    return total;
+}
+
+WaitSchedule LatencyModel::Schedule(const std::wstring& app) const
+{
+    WaitSchedule schedule = FixedWaitSchedule();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = apps.find(WideToUtf8(app));
+    if (it == apps.end())
+        return schedule;
+
+    for (size_t phase = 0; phase < WAIT_PHASE_COUNT; phase++)
+        schedule.phases[phase] = DerivePhaseSchedule(it->second.phases[phase], schedule.phases[phase]);
+    return schedule;
+}
+
+LatencyModel::AppLatencies& LatencyModel::Latencies(const std::wstring& app)
+{
+    const auto it = apps.emplace(WideToUtf8(app), AppLatencies()).first;
+    return it->second;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WaitSchedule.h"
+
+// Upper bounds, in milliseconds, of the buckets observed waits are counted in;
+// anything longer goes in the last one.
+constexpr uint32_t LATENCY_BUCKET_EDGES[] = {
+    25, 50, 75, 100, 150, 200, 300, 400, 500, 750, 1000,
+    1500, 2000, 3000, 4000, 5000, 7500, 10000, 15000, 20000, 30000, 60000
+};
+constexpr size_t LATENCY_BUCKET_COUNT = sizeof LATENCY_BUCKET_EDGES / sizeof LATENCY_BUCKET_EDGES[0];
+
+// Once a phase has this many observations, every count is halved:
+// recent launches weigh more, and the model adapts when the machine changes.
+constexpr uint32_t MAX_MODEL_SAMPLES = 64;
+// Below this, the fixed schedule is kept.
+constexpr uint32_t MIN_MODEL_SAMPLES = 5;
+
+// Checks to spend, per wait, where the latencies are.
+constexpr uint32_t WAKEUP_BUDGET = 16;
+constexpr uint32_t MIN_POLL_INTERVAL = 10;
+constexpr uint32_t MAX_POLL_INTERVAL = 1000;
+constexpr uint32_t MAX_PHASE_TIMEOUT = 60 * 1000;
+
+typedef struct {
+    uint32_t counts[LATENCY_BUCKET_COUNT];
+    uint32_t timeouts;
+} LatencyCounts;
+
+// Counts `latenciesMs` as if they had been observed with `timeoutMs`: longer ones are timeouts.
+LatencyCounts CountLatencies(const std::vector<uint32_t>& latenciesMs, uint32_t timeoutMs);
+
+// The schedule that minimizes the expected delay between the awaited state
+// and the check that notices it, for WAKEUP_BUDGET checks: the interval in
+// each bucket is proportional to 1/sqrt(density), so checks are dense where
+// latencies are frequent. Past the 99th percentile, checks back off
+// geometrically. The timeout covers twice the 99th percentile and grows if
+// waits have been timing out; it never drops below `fallback`'s.
+PhaseSchedule DerivePhaseSchedule(const LatencyCounts& latencies, const PhaseSchedule& fallback);
+
+// How long each wait of a fix took on this machine, per app, persisted
+// between runs. A few hundred bytes per app; thread-safe.
+class LatencyModel
+{
+public:
+    // Returns false if the file could not be read. Lines it doesn't understand are skipped.
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    void Observe(const std::wstring& app, WaitPhase phase, uint32_t ms);
+    void ObserveTimeout(const std::wstring& app, WaitPhase phase);
+
+    uint32_t Samples(const std::wstring& app, WaitPhase phase) const;
+    WaitSchedule Schedule(const std::wstring& app) const;
+
+private:
+    typedef struct {
+        LatencyCounts phases[WAIT_PHASE_COUNT];
+    } AppLatencies;
+
+    AppLatencies& Latencies(const std::wstring& app);
+
+    mutable std::mutex mutex;
+    // Keyed by the app's name, in UTF-8, as in the file
+    std::unordered_map<std::string, AppLatencies> apps;
+};
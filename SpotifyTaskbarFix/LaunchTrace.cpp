@@ -0,0 +1,209 @@
+#include "LaunchTrace.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// =========================
+//     LaunchTraceWriter
+// =========================
+
+LaunchTraceRecord& LaunchTraceWriter::Add(const uint32_t time, const LaunchTraceRecordType type)
+{
+    LaunchTraceRecord record = {};
+    record.time = time;
+    record.type = type;
+    record.text = LAUNCH_TRACE_NO_STRING;
+    record.text2 = LAUNCH_TRACE_NO_STRING;
+    records.push_back(record);
+    return records.back();
+}
+
+uint32_t LaunchTraceWriter::AddString(const std::wstring& text)
+{
+    const auto it = stringOffsets.find(text);
+    if (it != stringOffsets.end())
+        return it->second;
+
+    const auto offset = static_cast<uint32_t>(strings.size());
+    for (const wchar_t c : text)
+    {
+        // wchar_t is UTF-32 outside of Windows
+        const auto codePoint = static_cast<uint32_t>(c);
+        if (codePoint > 0xFFFF)
+        {
+            strings.push_back(static_cast<uint16_t>(0xD800 + ((codePoint - 0x10000) >> 10)));
+            strings.push_back(static_cast<uint16_t>(0xDC00 + ((codePoint - 0x10000) & 0x3FF)));
+        }
+        else
+        {
+            strings.push_back(static_cast<uint16_t>(codePoint));
+        }
+    }
+    strings.push_back(0);
+
+    stringOffsets.emplace(text, offset);
+    return offset;
+}
+
+bool LaunchTraceWriter::Save(const std::string& path) const
+{
+    LaunchTraceHeader header = {};
+    std::memcpy(header.magic, LAUNCH_TRACE_MAGIC, sizeof header.magic);
+    header.version = LAUNCH_TRACE_VERSION;
+    header.recordCount = static_cast<uint32_t>(records.size());
+    header.stringCount = static_cast<uint32_t>(strings.size());
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path.c_str(), "wb") != 0)
+        return false;
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1;
+    if (ok && !records.empty())
+        ok = fwrite(records.data(), sizeof(LaunchTraceRecord), records.size(), file) == records.size();
+    if (ok && !strings.empty())
+        ok = fwrite(strings.data(), sizeof(uint16_t), strings.size(), file) == strings.size();
+
+    return fclose(file) == 0 && ok;
+}
+
+
+// =========================
+//     LaunchTraceReader
+// =========================
+
+LaunchTraceReader::~LaunchTraceReader()
+{
+    Close();
+}
+
+bool LaunchTraceReader::Open(const std::string& path, std::string& error)
+{
+    Close();
+
+#ifdef _WIN32
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    hFile = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(LaunchTraceHeader)))
+    {
+        error = "not a launch trace";
+        Close();
+        return false;
+    }
+    viewSize = static_cast<size_t>(size.QuadPart);
+
+    hMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    view = hMapping != nullptr ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(LaunchTraceHeader)))
+    {
+        close(fd);
+        error = "not a launch trace";
+        return false;
+    }
+    viewSize = static_cast<size_t>(st.st_size);
+
+    void* mapping = mmap(nullptr, viewSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    view = mapping != MAP_FAILED ? mapping : nullptr;
+#endif
+
+    if (view == nullptr)
+    {
+        error = "cannot map " + path;
+        Close();
+        return false;
+    }
+
+    const auto* bytes = static_cast<const uint8_t*>(view);
+    const auto* candidate = reinterpret_cast<const LaunchTraceHeader*>(bytes);
+    if (std::memcmp(candidate->magic, LAUNCH_TRACE_MAGIC, sizeof candidate->magic) != 0 || candidate->version != LAUNCH_TRACE_VERSION)
+    {
+        error = "not a launch trace, or an unsupported version";
+        Close();
+        return false;
+    }
+
+    const uint64_t expectedSize = sizeof(LaunchTraceHeader) + uint64_t{ candidate->recordCount } * sizeof(LaunchTraceRecord) +
+                                  uint64_t{ candidate->stringCount } * sizeof(uint16_t);
+    if (expectedSize > viewSize)
+    {
+        error = "truncated launch trace";
+        Close();
+        return false;
+    }
+
+    header = candidate;
+    records = reinterpret_cast<const LaunchTraceRecord*>(bytes + sizeof(LaunchTraceHeader));
+    strings = reinterpret_cast<const uint16_t*>(bytes + sizeof(LaunchTraceHeader) + header->recordCount * sizeof(LaunchTraceRecord));
+    return true;
+}
+
+void LaunchTraceReader::Close()
+{
+#ifdef _WIN32
+    if (view != nullptr)
+        UnmapViewOfFile(view);
+    if (hMapping != nullptr)
+        CloseHandle(hMapping);
+    if (hFile != nullptr)
+        CloseHandle(hFile);
+    hMapping = nullptr;
+    hFile = nullptr;
+#else
+    if (view != nullptr)
+        munmap(const_cast<void*>(view), viewSize);
+#endif
+
+    view = nullptr;
+    viewSize = 0;
+    header = nullptr;
+    records = nullptr;
+    strings = nullptr;
+}
+
+std::wstring LaunchTraceReader::String(const uint32_t offset) const
+{
+    std::wstring text;
+    if (header == nullptr || offset >= header->stringCount)
+        return text;
+
+    for (uint32_t i = offset; i < header->stringCount && strings[i] != 0; i++)
+    {
+        uint32_t codePoint = strings[i];
+        if (sizeof(wchar_t) > 2 && codePoint >= 0xD800 && codePoint < 0xDC00 && i + 1 < header->stringCount)
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (strings[++i] - 0xDC00);
+        text.push_back(static_cast<wchar_t>(codePoint));
+    }
+    return text;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Platform.h"
+
+// A recorded launch: everything the fix logic observed, in a flat binary
+// file that can be used in place (memory-mapped) without any parsing.
+//
+//   LaunchTraceHeader
+//   LaunchTraceRecord[recordCount]      ordered by time
+//   uint16_t strings[stringCount]       UTF-16, each string NUL-terminated
+//
+// Every field is little-endian and naturally aligned. Strings are referred
+// to by their offset, in UTF-16 code units, from the start of the table.
+
+constexpr char LAUNCH_TRACE_MAGIC[8] = { 'S', 'T', 'F', 'T', 'R', 'A', 'C', 'E' };
+constexpr uint32_t LAUNCH_TRACE_VERSION = 1;
+constexpr uint32_t LAUNCH_TRACE_NO_STRING = UINT32_MAX;
+
+enum class LaunchTraceRecordType : uint16_t
+{
+    // processId, value = parent process ID, text = process name
+    StartEvent,
+    // processId, text = image name or text2 = command line
+    Process,
+    // processId, threadId
+    Thread,
+    // processId reached its input-idle state
+    InputIdle,
+    // window first seen; threadId, window, parent (0 for a top-level window)
+    Window,
+    // window, text
+    WindowClass,
+    WindowTitle,
+    // window, value = style, value2 = extended style
+    WindowStyle,
+    // window, rect
+    WindowPosition,
+    // window, rect = where it was moved to, value = LAUNCH_TRACE_MOVE_* flags
+    Move,
+    // rect = bounds, value = DPI, value2 = LAUNCH_TRACE_MONITOR_PRIMARY | taskbar edge << 1
+    Monitor,
+    // rect = work area of the monitor in the preceding Monitor record
+    MonitorWorkArea,
+};
+
+constexpr uint32_t LAUNCH_TRACE_MOVE_RESIZE = 0x1;
+constexpr uint32_t LAUNCH_TRACE_MOVE_REDRAW = 0x2;
+constexpr uint32_t LAUNCH_TRACE_MONITOR_PRIMARY = 0x1;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t stringCount;
+    uint32_t reserved;
+} LaunchTraceHeader;
+
+typedef struct {
+    // Milliseconds since the recording started
+    uint32_t time;
+    LaunchTraceRecordType type;
+    uint16_t reserved;
+    uint32_t processId;
+    uint32_t threadId;
+    uint64_t window;
+    uint64_t parent;
+    uint32_t text;
+    uint32_t text2;
+    uint32_t value;
+    uint32_t value2;
+    int32_t rect[4];
+} LaunchTraceRecord;
+
+static_assert(sizeof(LaunchTraceHeader) == 24, "LaunchTraceHeader layout");
+static_assert(sizeof(LaunchTraceRecord) == 64, "LaunchTraceRecord layout");
+
+// Builds a trace in memory.
+class LaunchTraceWriter
+{
+public:
+    LaunchTraceRecord& Add(uint32_t time, LaunchTraceRecordType type);
+    uint32_t AddString(const std::wstring& text);
+
+    size_t RecordCount() const { return records.size(); }
+    bool Save(const std::string& path) const;
+
+private:
+    std::vector<LaunchTraceRecord> records;
+    std::vector<uint16_t> strings;
+    std::unordered_map<std::wstring, uint32_t> stringOffsets;
+};
+
+// A read-only view over a trace file, mapped into memory.
+class LaunchTraceReader
+{
+public:
+    LaunchTraceReader() = default;
+    ~LaunchTraceReader();
+
+    LaunchTraceReader(const LaunchTraceReader&) = delete;
+    LaunchTraceReader& operator=(const LaunchTraceReader&) = delete;
+
+    // Returns false, and describes the problem in `error`, if the file is not a valid trace.
+    bool Open(const std::string& path, std::string& error);
+    void Close();
+
+    uint32_t RecordCount() const { return header != nullptr ? header->recordCount : 0; }
+    const LaunchTraceRecord& Record(const uint32_t index) const { return records[index]; }
+    std::wstring String(uint32_t offset) const;
+
+private:
+    const LaunchTraceHeader* header = nullptr;
+    const LaunchTraceRecord* records = nullptr;
+    const uint16_t* strings = nullptr;
+
+    const void* view = nullptr;
+    size_t viewSize = 0;
+#ifdef _WIN32
+    void* hFile = nullptr;
+    void* hMapping = nullptr;
+#endif
+};
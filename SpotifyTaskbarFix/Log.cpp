@@ -0,0 +1,225 @@
+#include "Log.h"
+
+#include <chrono>
+#include <ctime>
+
+using namespace std::chrono;
+
+namespace
+{
+    const char* LevelPrefix(const LogLevel level)
+    {
+        switch (level)
+        {
+            case LogLevel::Warning:
+                return "WARNING: ";
+            case LogLevel::Error:
+                return "ERROR: ";
+            case LogLevel::Info:
+                break;
+        }
+        return "";
+    }
+
+    FILE* OpenForAppend(const std::string& path)
+    {
+        FILE* file = nullptr;
+#ifdef _WIN32
+        if (fopen_s(&file, path.c_str(), "ab") != 0)
+            return nullptr;
+#else
+        file = fopen(path.c_str(), "ab");
+#endif
+        return file;
+    }
+}
+
+
+Logger& Logger::Instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::~Logger()
+{
+    Stop();
+}
+
+bool Logger::Start(const LogConfig& logConfig)
+{
+    if (running)
+        return true;
+
+    config = logConfig;
+    if (!config.path.empty())
+    {
+        file = OpenForAppend(config.path);
+        if (file == nullptr)
+            return false;
+
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file);
+        fileBytes = size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+
+    running = true;
+    writer = std::thread(&Logger::WriterLoop, this);
+    return true;
+}
+
+void Logger::Stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+    writer.join();
+
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void Logger::Write(const LogLevel level, const char* const format, va_list args)
+{
+    Record record;
+    record.timeUs = static_cast<uint64_t>(duration_cast<microseconds>(system_clock::now().time_since_epoch()).count());
+    record.level = level;
+
+    const int length = vsnprintf(record.text, sizeof record.text, format, args);
+    record.length = static_cast<uint8_t>(length < 0 ? 0 : length < static_cast<int>(sizeof record.text) ? length : sizeof record.text - 1);
+
+    if (!running)
+    {
+        LogTimestamp stamp;
+        printf("[%s] %s%s\n", stamp.Format(record.timeUs), LevelPrefix(level), record.text);
+        return;
+    }
+
+    if (!queue.TryPush(record))
+    {
+        droppedLines++;
+        return;
+    }
+
+    // Either the writer sees the new count before it sleeps, or we see it waiting and wake it up
+    queuedLines++;
+    if (writerWaiting)
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+}
+
+void Logger::WriterLoop()
+{
+    Record record;
+    while (true)
+    {
+        const bool stopping = !running;
+
+        bool wrote = false;
+        while (queue.TryPop(record))
+        {
+            Emit(record);
+            writtenLines++;
+            wrote = true;
+        }
+
+        // One flush per batch, not per line
+        if (wrote)
+        {
+            if (file != nullptr)
+                fflush(file);
+            if (config.console)
+                fflush(stdout);
+        }
+
+        if (stopping)
+            return;
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        writerWaiting = true;
+        wake.wait(lock, [&] { return queuedLines != writtenLines || !running; });
+        writerWaiting = false;
+    }
+}
+
+void Logger::Emit(const Record& record)
+{
+    const char* const time = timestamp.Format(record.timeUs);
+    const char* const prefix = LevelPrefix(record.level);
+
+    if (config.console)
+        printf("[%s] %s%.*s\n", time, prefix, static_cast<int>(record.length), record.text);
+
+    if (file != nullptr)
+    {
+        const int written = fprintf(file, "[%s] %s%.*s\n", time, prefix, static_cast<int>(record.length), record.text);
+        if (written > 0)
+            fileBytes += static_cast<uint64_t>(written);
+        if (config.maxFileBytes > 0 && fileBytes >= config.maxFileBytes)
+            Rotate();
+    }
+}
+
+void Logger::Rotate()
+{
+    fclose(file);
+    file = nullptr;
+
+    // path.N-1 -> path.N, ..., path -> path.1
+    for (unsigned i = config.maxRotatedFiles; i > 0; i--)
+    {
+        const std::string target = config.path + "." + std::to_string(i);
+        const std::string source = i > 1 ? config.path + "." + std::to_string(i - 1) : config.path;
+        std::remove(target.c_str());
+        std::rename(source.c_str(), target.c_str());
+    }
+    if (config.maxRotatedFiles == 0)
+        std::remove(config.path.c_str());
+
+    file = OpenForAppend(config.path);
+    fileBytes = 0;
+}
+
+
+const char* LogTimestamp::Format(const uint64_t timeUs)
+{
+    const uint64_t currentSecond = timeUs / 1000000;
+    if (currentSecond != second)
+    {
+        const auto time = static_cast<time_t>(currentSecond);
+        struct tm ptm;
+#ifdef _WIN32
+        localtime_s(&ptm, &time);
+#else
+        localtime_r(&time, &ptm);
+#endif
+        length = std::strftime(text, sizeof text - 4, "%Y-%m-%d %H:%M:%S", &ptm) + 4;
+        text[length - 4] = '.';
+        text[length] = '\0';
+        second = currentSecond;
+    }
+
+    const auto ms = static_cast<unsigned>(timeUs / 1000 % 1000);
+    text[length - 3] = static_cast<char>('0' + ms / 100);
+    text[length - 2] = static_cast<char>('0' + ms / 10 % 10);
+    text[length - 1] = static_cast<char>('0' + ms % 10);
+    return text;
+}
+
+
+void Log(const LogLevel level, const char* const format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    Logger::Instance().Write(level, format, args);
+    va_end(args);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "BoundedMpmcQueue.h"
+
+enum class LogLevel : uint8_t
+{
+    Info,
+    Warning,
+    Error,
+};
+
+typedef struct {
+    // Empty: no log file
+    std::string path;
+    uint64_t maxFileBytes;
+    // Rotated files kept besides the current one: path.1 (newest) ... path.N
+    unsigned maxRotatedFiles;
+    bool console;
+} LogConfig;
+
+// "YYYY-MM-DD HH:MM:SS.mmm"; localtime + strftime only run when the second
+// changes, the milliseconds are patched in.
+class LogTimestamp
+{
+public:
+    const char* Format(uint64_t timeUs);
+
+private:
+    uint64_t second = UINT64_MAX;
+    size_t length = 0;
+    char text[32] = {};
+};
+
+// Asynchronous logger. Log formats the line on the caller's stack and
+// pushes it into a lock-free ring; a background thread timestamps it and
+// writes it to the console and/or a size-rotated file. Callers never wait
+// on I/O: if the writer falls behind and the ring fills up, lines are
+// dropped and counted instead. An idle writer sleeps without a timeout.
+// Until Start is called, lines are written synchronously to stdout.
+class Logger
+{
+public:
+    static constexpr size_t QUEUE_CAPACITY = 1024;
+    static constexpr size_t MAX_LINE_LENGTH = 240;
+
+    static Logger& Instance();
+
+    bool Start(const LogConfig& config);
+    // Writes whatever is still queued, then stops the writer thread.
+    void Stop();
+
+    void Write(LogLevel level, const char* format, va_list args);
+
+    uint64_t DroppedLines() const { return droppedLines; }
+
+private:
+    typedef struct {
+        uint64_t timeUs;
+        LogLevel level;
+        uint8_t length;
+        char text[MAX_LINE_LENGTH];
+    } Record;
+
+    Logger() = default;
+    ~Logger();
+
+    void WriterLoop();
+    void Emit(const Record& record);
+    void Rotate();
+
+    BoundedMpmcQueue<Record, QUEUE_CAPACITY> queue;
+    std::atomic<bool> running{ false };
+    std::atomic<uint64_t> droppedLines{ 0 };
+
+    std::thread writer;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    // Producers only take wakeMutex to notify when the writer is about to sleep
+    std::atomic<bool> writerWaiting{ false };
+    std::atomic<uint64_t> queuedLines{ 0 };
+
+    // Owned by the writer thread
+    uint64_t writtenLines = 0;
+    LogConfig config;
+    FILE* file = nullptr;
+    uint64_t fileBytes = 0;
+    LogTimestamp timestamp;
+};
+
+void Log(LogLevel level, const char* format, ...);
@@ -0,0 +1,87 @@
+#include "MonitorTopology.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    int64_t IntersectionArea(const WindowRect& a, const WindowRect& b)
+    {
+        const int64_t width = std::min(a.right, b.right) - std::max(a.left, b.left);
+        const int64_t height = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+        return width > 0 && height > 0 ? width * height : 0;
+    }
+
+    int64_t DistanceSquared(const WindowRect& a, const WindowRect& b)
+    {
+        const int64_t dx = std::max<int64_t>({ 0, static_cast<int64_t>(b.left) - a.right, static_cast<int64_t>(a.left) - b.right });
+        const int64_t dy = std::max<int64_t>({ 0, static_cast<int64_t>(b.top) - a.bottom, static_cast<int64_t>(a.top) - b.bottom });
+        return dx * dx + dy * dy;
+    }
+}
+
+bool SameMonitor(const MonitorInfo& a, const MonitorInfo& b)
+{
+    return std::memcmp(&a.bounds, &b.bounds, sizeof a.bounds) == 0 && std::memcmp(&a.workArea, &b.workArea, sizeof a.workArea) == 0 &&
+           a.dpi == b.dpi && a.primary == b.primary && a.taskbar == b.taskbar;
+}
+
+MonitorTopology MonitorTopology::Query(DesktopBackend& desktop)
+{
+    MonitorTopology topology;
+    desktop.EnumMonitors([&](const MonitorInfo& monitor)
+    {
+        topology.Add(monitor);
+    });
+    return topology;
+}
+
+void MonitorTopology::Add(const MonitorInfo& monitor)
+{
+    monitors.push_back(monitor);
+}
+
+bool MonitorTopology::SameAs(const MonitorTopology& other) const
+{
+    return monitors.size() == other.monitors.size() && std::equal(monitors.begin(), monitors.end(), other.monitors.begin(), SameMonitor);
+}
+
+size_t MonitorTopology::Primary() const
+{
+    for (size_t i = 0; i < monitors.size(); i++)
+    {
+        if (monitors[i].primary)
+            return i;
+    }
+    return NO_MONITOR;
+}
+
+size_t MonitorTopology::MonitorFromRect(const WindowRect& rect) const
+{
+    size_t best = NO_MONITOR;
+    int64_t bestArea = 0;
+    for (size_t i = 0; i < monitors.size(); i++)
+    {
+        const int64_t area = IntersectionArea(rect, monitors[i].bounds);
+        if (area > bestArea)
+        {
+            best = i;
+            bestArea = area;
+        }
+    }
+    if (best != NO_MONITOR)
+        return best;
+
+    int64_t bestDistance = std::numeric_limits<int64_t>::max();
+    for (size_t i = 0; i < monitors.size(); i++)
+    {
+        const int64_t distance = DistanceSquared(rect, monitors[i].bounds);
+        if (distance < bestDistance)
+        {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "DesktopBackend.h"
+
+// Every field the same: bounds, work area, DPI, primary flag and taskbar.
+bool SameMonitor(const MonitorInfo& a, const MonitorInfo& b);
+
+// A snapshot of the display monitors: bounds, work areas, DPI, which one is
+// primary and which ones have a taskbar. Plain data, so that it can be
+// built by hand as easily as queried from a backend.
+class MonitorTopology
+{
+public:
+    static constexpr size_t NO_MONITOR = static_cast<size_t>(-1);
+
+    static MonitorTopology Query(DesktopBackend& desktop);
+
+    void Add(const MonitorInfo& monitor);
+
+    const std::vector<MonitorInfo>& Monitors() const { return monitors; }
+    const MonitorInfo& Monitor(const size_t monitor) const { return monitors[monitor]; }
+    bool Empty() const { return monitors.empty(); }
+    // Same monitors, in the same order.
+    bool SameAs(const MonitorTopology& other) const;
+
+    // NO_MONITOR if none is flagged as primary.
+    size_t Primary() const;
+
+    // Like MonitorFromRect(MONITOR_DEFAULTTONEAREST): the monitor the largest
+    // part of `rect` is on, or the one closest to it. NO_MONITOR if there are none.
+    size_t MonitorFromRect(const WindowRect& rect) const;
+
+private:
+    std::vector<MonitorInfo> monitors;
+};
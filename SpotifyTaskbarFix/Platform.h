@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cwchar>
+
+// Portable stand-ins for the handful of Win32 types the fix logic works with,
+// so that it can be compiled and driven by a non-Windows backend.
+
+typedef uint32_t ProcessId;
+typedef uint32_t ThreadId;
+// A Terminal Services session, as in ProcessIdToSessionId. Session 0 only runs services.
+typedef uint32_t SessionId;
+typedef uintptr_t WindowHandle;
+// A registered window class, as in GetClassWord(GCW_ATOM); windows of the same class share it.
+typedef uint16_t ClassAtom;
+
+typedef struct {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+} WindowRect;
+
+constexpr WindowHandle NULL_WINDOW = 0;
+constexpr ClassAtom NULL_ATOM = 0;
+
+// Window style bits; values mirror the WS_* constants in WinUser.h.
+constexpr uint32_t STYLE_SYSMENU = 0x00080000L;
+constexpr uint32_t STYLE_VISIBLE = 0x10000000L;
+
+
+inline int WStrICmp(const wchar_t* a, const wchar_t* b)
+{
+#ifdef _WIN32
+    return _wcsicmp(a, b);
+#else
+    return wcscasecmp(a, b);
+#endif
+}
+
+inline bool HasFlag(const uint32_t bitfield, const uint32_t flag)
+{
+    return (bitfield & flag) != 0;
+}
@@ -0,0 +1,76 @@
+#include "PosixSharedMemory.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PosixSharedMemory::~PosixSharedMemory()
+{
+    Close();
+}
+
+bool PosixSharedMemory::Create(const char* name, const size_t size)
+{
+    Close();
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+
+    // A fresh region is all zeros
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    ownedName = name;
+    return Map(fd, size);
+}
+
+bool PosixSharedMemory::Open(const char* name, const size_t size)
+{
+    Close();
+
+    const int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size)
+    {
+        close(fd);
+        return false;
+    }
+    return Map(fd, size);
+}
+
+void PosixSharedMemory::Close()
+{
+    if (data != nullptr)
+        munmap(data, size);
+    if (!ownedName.empty())
+        shm_unlink(ownedName.c_str());
+
+    data = nullptr;
+    size = 0;
+    ownedName.clear();
+}
+
+bool PosixSharedMemory::Map(const int fd, const size_t mapSize)
+{
+    // The mapping keeps the region alive; the descriptor isn't needed anymore
+    void* mapped = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    data = mapped;
+    size = mapSize;
+    return true;
+}
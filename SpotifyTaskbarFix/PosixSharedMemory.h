@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include "SharedMemory.h"
+
+// SharedMemory on shm_open and mmap. Names are those of shm_open: a leading
+// '/' and no other. The creator unlinks the name when it closes the region.
+class PosixSharedMemory final : public SharedMemory
+{
+public:
+    PosixSharedMemory() = default;
+    ~PosixSharedMemory() override;
+
+    PosixSharedMemory(const PosixSharedMemory&) = delete;
+    PosixSharedMemory& operator=(const PosixSharedMemory&) = delete;
+
+    bool Create(const char* name, size_t size) override;
+    bool Open(const char* name, size_t size) override;
+    void Close() override;
+
+private:
+    bool Map(int fd, size_t size);
+
+    // Only set for the creator
+    std::string ownedName;
+};
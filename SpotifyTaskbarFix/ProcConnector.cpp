@@ -0,0 +1,190 @@
+#include "ProcConnector.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "ProcFs.h"
+#include "Trace.h"
+#include "Utf8.h"
+
+namespace
+{
+    // Room for a build machine's worth of execs between two Drains
+    constexpr int RECEIVE_BUFFER_BYTES = 4 * 1024 * 1024;
+    // Datagrams per recvmmsg, and room for each: an event is well under 128 bytes
+    constexpr size_t RECEIVE_BATCH = 64;
+    constexpr size_t MESSAGE_BYTES = 256;
+    // proc_event's `what` for an exec. Its enum moved out of proc_event in Linux 6.6's
+    // headers, so neither spelling builds everywhere; the value is part of the ABI.
+    constexpr uint32_t PROC_EVENT_EXEC_ID = 0x00000002;
+
+    // Not in older headers: since Linux 6.6, a listen request may carry a mask of the
+    // events to deliver. Older kernels ignore requests of that size altogether.
+    typedef struct {
+        uint32_t op;
+        uint32_t events;
+    } ProcInput;
+
+    bool KernelFiltersEvents()
+    {
+        utsname name;
+        unsigned major = 0;
+        unsigned minor = 0;
+        if (uname(&name) != 0 || sscanf(name.release, "%u.%u", &major, &minor) != 2)
+            return false;
+        return major > 6 || (major == 6 && minor >= 6);
+    }
+}
+
+
+ProcConnector::~ProcConnector()
+{
+    Stop();
+}
+
+bool ProcConnector::Start()
+{
+    socketFd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (socketFd < 0)
+        return false;
+
+    // Going past rmem_max takes CAP_NET_ADMIN, which subscribing does anyway
+    if (setsockopt(socketFd, SOL_SOCKET, SO_RCVBUFFORCE, &RECEIVE_BUFFER_BYTES, sizeof RECEIVE_BUFFER_BYTES) != 0)
+        setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER_BYTES, sizeof RECEIVE_BUFFER_BYTES);
+
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = CN_IDX_PROC;
+    if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 || !Subscribe(true))
+    {
+        const int error = errno;
+        close(socketFd);
+        socketFd = -1;
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+void ProcConnector::Stop()
+{
+    if (socketFd < 0)
+        return;
+
+    Subscribe(false);
+    close(socketFd);
+    socketFd = -1;
+}
+
+bool ProcConnector::Subscribe(const bool listen)
+{
+    const ProcInput input = { static_cast<uint32_t>(listen ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE), PROC_EVENT_EXEC_ID };
+    const size_t inputLength = KernelFiltersEvents() ? sizeof input : sizeof input.op;
+
+    alignas(nlmsghdr) char buffer[NLMSG_SPACE(sizeof(cn_msg) + sizeof(ProcInput))] = {};
+    nlmsghdr* const header = reinterpret_cast<nlmsghdr*>(buffer);
+    header->nlmsg_len = static_cast<uint32_t>(NLMSG_LENGTH(sizeof(cn_msg) + inputLength));
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = static_cast<uint32_t>(getpid());
+
+    cn_msg* const message = static_cast<cn_msg*>(NLMSG_DATA(header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = static_cast<uint16_t>(inputLength);
+    memcpy(message->data, &input, inputLength);
+
+    // Refused without CAP_NET_ADMIN
+    return send(socketFd, header, header->nlmsg_len, 0) == static_cast<ssize_t>(header->nlmsg_len);
+}
+
+size_t ProcConnector::Drain()
+{
+    const uint64_t matchesBefore = matches;
+
+    // One event per datagram: take them a batch per system call
+    alignas(nlmsghdr) static thread_local char buffers[RECEIVE_BATCH][MESSAGE_BYTES];
+    iovec vectors[RECEIVE_BATCH];
+    mmsghdr messages[RECEIVE_BATCH] = {};
+    for (size_t i = 0; i < RECEIVE_BATCH; i++)
+    {
+        vectors[i] = { buffers[i], MESSAGE_BYTES };
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (true)
+    {
+        const int received = recvmmsg(socketFd, messages, RECEIVE_BATCH, 0, nullptr);
+        if (received < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // Whatever was dropped is gone; the socket itself is fine
+            if (errno == ENOBUFS)
+            {
+                overruns++;
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < received; i++)
+        {
+            int remaining = static_cast<int>(messages[i].msg_len);
+            for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffers[i]); NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+            {
+                if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP)
+                    continue;
+
+                const cn_msg* const message = static_cast<const cn_msg*>(NLMSG_DATA(header));
+                if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC || message->len < sizeof(proc_event))
+                    continue;
+
+                proc_event event;
+                memcpy(&event, message->data, sizeof event);
+                if (event.what == PROC_EVENT_EXEC_ID)
+                    OnExec(static_cast<ProcessId>(event.event_data.exec.process_tgid), event.timestamp_ns);
+            }
+        }
+        if (received < static_cast<int>(RECEIVE_BATCH))
+            break;
+    }
+    return static_cast<size_t>(matches - matchesBefore);
+}
+
+void ProcConnector::OnExec(const ProcessId processId, const uint64_t execNs)
+{
+    execs++;
+
+    // The event is sent once the new image is in place, so /proc already has its name
+    std::string imageName;
+    if (!ReadProcessImageName(processId, imageName))
+        return;
+    const std::wstring processName = Utf8ToWide(imageName);
+    if (rules.FindApp(processName.c_str()) == RuleSet::NO_APP)
+        return;
+
+    matches++;
+    ProcessStartEvent event = {};
+    event.processId = processId;
+    ReadParentProcessId(processId, event.parentProcessId);
+    processName.copy(event.processName, PROCESS_NAME_LENGTH - 1);
+
+    // The kernel's timestamp is on the same monotonic clock as the tracer's
+    const uint64_t nowUs = Tracer::Now();
+    const uint64_t execUs = execNs / 1000;
+    if (execUs <= nowUs)
+        Tracer::Instance().Record(TracePhase::ExecDelivery, processId, execUs, nowUs);
+
+    callback(event);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "ProcessStartEvent.h"
+#include "Rules.h"
+
+// Process starts from the kernel's process events connector: a netlink socket
+// subscribed to CN_IDX_PROC gets every exec on the system the moment it
+// happens, instead of a WMI-style polled query or a scan of /proc. Execs are
+// filtered here, by the executable's name against the rules: the others cost
+// a recv and a readlink, and nothing more. Since Linux 6.6 the kernel drops
+// fork, exit and every other kind of event before they reach the socket.
+// Subscribing takes CAP_NET_ADMIN.
+//
+// The socket doesn't block: watch Handle() with the event loop and call Drain
+// whenever it's readable.
+class ProcConnector
+{
+public:
+    typedef std::function<void(const ProcessStartEvent&)> Callback;
+
+    ProcConnector(const RuleSet& rules, Callback callback) : rules(rules), callback(std::move(callback)) {}
+    ~ProcConnector();
+
+    ProcConnector(const ProcConnector&) = delete;
+    ProcConnector& operator=(const ProcConnector&) = delete;
+
+    // Returns false, with errno set, if the socket couldn't be opened or subscribed.
+    bool Start();
+    void Stop();
+
+    int Handle() const { return socketFd; }
+
+    // Reads every message that is waiting, and passes the matching execs on.
+    // Returns how many were passed on.
+    size_t Drain();
+
+    // Every exec received, and the ones that matched a rule
+    uint64_t Execs() const { return execs; }
+    uint64_t Matches() const { return matches; }
+    // Times the socket's buffer overflowed and the kernel dropped events: a start may have been missed.
+    uint64_t Overruns() const { return overruns; }
+
+private:
+    bool Subscribe(bool listen);
+    void OnExec(ProcessId processId, uint64_t execNs);
+
+    const RuleSet& rules;
+    Callback callback;
+    int socketFd = -1;
+
+    std::atomic<uint64_t> execs{ 0 };
+    std::atomic<uint64_t> matches{ 0 };
+    std::atomic<uint64_t> overruns{ 0 };
+};
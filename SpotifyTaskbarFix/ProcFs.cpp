@@ -0,0 +1,165 @@
+#include "ProcFs.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Of an image that was replaced or removed while the process kept running
+    constexpr char DELETED_SUFFIX[] = " (deleted)";
+    constexpr size_t DELETED_SUFFIX_LENGTH = sizeof DELETED_SUFFIX - 1;
+
+    // The whole file, up to `bufferLength` - 1 bytes; returns the number of bytes read, or -1.
+    ssize_t ReadSmallFile(const char* const path, char* const buffer, const size_t bufferLength)
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+
+        size_t length = 0;
+        while (length < bufferLength - 1)
+        {
+            const ssize_t count = read(fd, buffer + length, bufferLength - 1 - length);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;
+            length += static_cast<size_t>(count);
+        }
+        close(fd);
+        buffer[length] = '\0';
+        return static_cast<ssize_t>(length);
+    }
+
+    // The name and the parent out of /proc/<pid>/stat: "<pid> (<comm>) <state> <ppid> ..."
+    bool ReadStat(const ProcessId processId, std::string* const comm, ProcessId* const parentProcessId)
+    {
+        char path[32];
+        snprintf(path, sizeof path, "/proc/%u/stat", processId);
+
+        char stat[512];
+        if (ReadSmallFile(path, stat, sizeof stat) <= 0)
+            return false;
+
+        // The name may contain anything, parentheses and spaces included: the last ')' ends it
+        const char* nameBegin = strchr(stat, '(');
+        const char* nameEnd = strrchr(stat, ')');
+        if (nameBegin == nullptr || nameEnd == nullptr || nameEnd < nameBegin)
+            return false;
+
+        if (comm != nullptr)
+            comm->assign(nameBegin + 1, nameEnd);
+        if (parentProcessId != nullptr)
+        {
+            char state;
+            unsigned long ppid;
+            if (sscanf(nameEnd + 1, " %c %lu", &state, &ppid) != 2)
+                return false;
+            *parentProcessId = static_cast<ProcessId>(ppid);
+        }
+        return true;
+    }
+}
+
+
+bool ReadProcessImageName(const ProcessId processId, std::string& imageName)
+{
+    char path[32];
+    snprintf(path, sizeof path, "/proc/%u/exe", processId);
+
+    char target[PATH_MAX];
+    const ssize_t length = readlink(path, target, sizeof target - 1);
+    if (length <= 0)
+    {
+        // Kernel threads have no image, and other users' processes can't be looked into
+        return ReadStat(processId, &imageName, nullptr);
+    }
+
+    size_t end = static_cast<size_t>(length);
+    if (end > DELETED_SUFFIX_LENGTH && memcmp(target + end - DELETED_SUFFIX_LENGTH, DELETED_SUFFIX, DELETED_SUFFIX_LENGTH) == 0)
+        end -= DELETED_SUFFIX_LENGTH;
+
+    size_t begin = end;
+    while (begin > 0 && target[begin - 1] != '/')
+        begin--;
+    imageName.assign(target + begin, target + end);
+    return true;
+}
+
+bool ReadProcessCommandLine(const ProcessId processId, std::string& commandLine)
+{
+    char path[32];
+    snprintf(path, sizeof path, "/proc/%u/cmdline", processId);
+
+    // Chromium helpers have long command lines, but what matters comes early
+    char arguments[8192];
+    const ssize_t length = ReadSmallFile(path, arguments, sizeof arguments);
+    if (length < 0)
+        return false;
+
+    commandLine.clear();
+    for (const char* argument = arguments; argument < arguments + length; argument += strlen(argument) + 1)
+    {
+        if (!commandLine.empty())
+            commandLine.push_back(' ');
+
+        const bool quoted = strchr(argument, ' ') != nullptr;
+        if (quoted)
+            commandLine.push_back('"');
+        commandLine.append(argument);
+        if (quoted)
+            commandLine.push_back('"');
+    }
+    return true;
+}
+
+bool ReadParentProcessId(const ProcessId processId, ProcessId& parentProcessId)
+{
+    return ReadStat(processId, nullptr, &parentProcessId);
+}
+
+bool ReadProcessImageVersion(const ProcessId processId, std::string& version)
+{
+    char path[32];
+    snprintf(path, sizeof path, "/proc/%u/exe", processId);
+
+    // Follows the link to the executable itself
+    struct stat image;
+    if (stat(path, &image) != 0)
+        return false;
+
+    char text[48];
+    snprintf(text, sizeof text, "%lld.%lld", static_cast<long long>(image.st_mtime), static_cast<long long>(image.st_size));
+    version = text;
+    return true;
+}
+
+void EnumProcesses(const std::function<void(ProcessId, ProcessId, const std::string&)>& callback)
+{
+    DIR* const proc = opendir("/proc");
+    if (proc == nullptr)
+        return;
+
+    std::string imageName;
+    while (const dirent* entry = readdir(proc))
+    {
+        char* end;
+        const unsigned long processId = strtoul(entry->d_name, &end, 10);
+        if (*end != '\0' || processId == 0)
+            continue;
+
+        ProcessId parentProcessId;
+        if (ReadParentProcessId(static_cast<ProcessId>(processId), parentProcessId) &&
+            ReadProcessImageName(static_cast<ProcessId>(processId), imageName))
+            callback(static_cast<ProcessId>(processId), parentProcessId, imageName);
+    }
+    closedir(proc);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "Platform.h"
+
+// What Linux says about processes in /proc. Every function returns false if
+// the process is gone, or isn't the caller's to look at.
+
+// The executable's file name, without the directory, e.g. "spotify".
+bool ReadProcessImageName(ProcessId processId, std::string& imageName);
+// The arguments, separated by spaces; arguments with spaces in them are quoted, as on Windows.
+bool ReadProcessCommandLine(ProcessId processId, std::string& commandLine);
+bool ReadParentProcessId(ProcessId processId, ProcessId& parentProcessId);
+// The executable's modification time and size, as "<seconds>.<bytes>": ELF files have no
+// version resource, but both change whenever the app is updated.
+bool ReadProcessImageVersion(ProcessId processId, std::string& version);
+
+// Every process, from one pass over /proc: process ID, parent process ID, image name.
+void EnumProcesses(const std::function<void(ProcessId, ProcessId, const std::string&)>& callback);
@@ -0,0 +1,46 @@
+#include "ProcessClassifier.h"
+
+#include <cwctype>
+
+namespace
+{
+    constexpr wchar_t PROCESS_TYPE_SWITCH[] = L"--type=";
+    constexpr size_t PROCESS_TYPE_SWITCH_LENGTH = sizeof PROCESS_TYPE_SWITCH / sizeof PROCESS_TYPE_SWITCH[0] - 1;
+}
+
+
+ProcessRole ClassifyProcess(DesktopBackend& desktop, const ProcessStartEvent& event, const AppRule& app)
+{
+    // The command line is authoritative
+    std::wstring commandLine;
+    if (desktop.GetProcessCommandLine(event.processId, commandLine))
+        return HasProcessTypeSwitch(commandLine) ? ProcessRole::Helper : ProcessRole::Main;
+
+    // Otherwise, helpers are spawned by the main process, i.e. by one of the app's executables.
+    // That's only a fallback: a main process relaunched by its own updater would be
+    // misjudged, and a missing parent proves nothing either way.
+    std::wstring parentImageName;
+    if (event.parentProcessId != 0 && desktop.GetProcessImageName(event.parentProcessId, parentImageName))
+    {
+        for (const std::wstring& processName : app.processNames)
+        {
+            if (WStrICmp(parentImageName.c_str(), processName.c_str()) == 0)
+                return ProcessRole::Helper;
+        }
+    }
+
+    return ProcessRole::Unknown;
+}
+
+bool HasProcessTypeSwitch(const std::wstring& commandLine)
+{
+    // Switches are whitespace-separated; a quoted executable path might contain "--type=" but can't start with it.
+    size_t position = 0;
+    while ((position = commandLine.find(PROCESS_TYPE_SWITCH, position)) != std::wstring::npos)
+    {
+        if (position == 0 || std::iswspace(commandLine[position - 1]))
+            return true;
+        position += PROCESS_TYPE_SWITCH_LENGTH;
+    }
+    return false;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "DesktopBackend.h"
+#include "ProcessStartEvent.h"
+#include "Rules.h"
+
+enum class ProcessRole
+{
+    // Not enough information; the window search has to decide.
+    Unknown,
+    Main,
+    Helper,
+};
+
+// Decides whether a freshly started process is an application's main
+// process or one of its Chromium helpers (renderer, GPU, utility, ...) from
+// cheap data only: its command line, and its parent's image name. Costs a
+// couple of process queries, as opposed to the input-idle wait and window
+// enumeration needed to tell them apart by their windows.
+//
+// `app` is the rule set's app the process belongs to.
+ProcessRole ClassifyProcess(DesktopBackend& desktop, const ProcessStartEvent& event, const AppRule& app);
+
+// True if the command line has Chromium's `--type=<process type>` switch,
+// which every helper is started with and the browser/main process never is.
+bool HasProcessTypeSwitch(const std::wstring& commandLine);
@@ -0,0 +1,26 @@
+#include "ProcessEventBatcher.h"
+
+
+size_t ProcessEventBatcher::Flush(const size_t count)
+{
+    if (count == 0)
+        return 0;
+
+    batches++;
+    const size_t accepted = callback(pool.get(), count);
+    dropped += count - accepted;
+    return accepted;
+}
+
+void ProcessEventBatcher::Close()
+{
+    // Taking turns with the deliveries is all the waiting there is to do
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+}
+
+void ProcessEventBatcher::Open()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = false;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "ProcessStartEvent.h"
+
+// Turns a delivery of process start objects (one WMI Indicate, whatever its
+// object count) into ProcessStartEvents, and hands them on a batch at a time
+// instead of one by one. The records come from a pool allocated up front:
+// however long the program runs, ingesting an event allocates nothing.
+// Deliveries may come from several threads; they take turns on the pool.
+// Closing it drains it: whatever the callback reads can be changed safely
+// until it's opened again.
+class ProcessEventBatcher
+{
+public:
+    static constexpr size_t POOL_SIZE = 64;
+
+    // Returns how many of the `count` events it accepted; the others are counted as dropped.
+    typedef std::function<size_t(const ProcessStartEvent* events, size_t count)> BatchCallback;
+
+    explicit ProcessEventBatcher(BatchCallback callback) : callback(std::move(callback)), pool(new ProcessStartEvent[POOL_SIZE]) {}
+
+    ProcessEventBatcher(const ProcessEventBatcher&) = delete;
+    ProcessEventBatcher& operator=(const ProcessEventBatcher&) = delete;
+
+    // `extract(i, record)` fills in the record of the i-th of `count` objects, which
+    // starts out zeroed, and returns false if the object isn't usable. Returns how
+    // many events were handed on.
+    template <typename Extract>
+    size_t Ingest(const size_t count, Extract&& extract)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        received += count;
+        if (closed)
+        {
+            dropped += count;
+            return 0;
+        }
+
+        size_t delivered = 0;
+        size_t filled = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            ProcessStartEvent& record = pool[filled];
+            Clear(record);
+            if (!extract(i, record))
+            {
+                skipped++;
+                continue;
+            }
+
+            if (++filled == POOL_SIZE)
+            {
+                delivered += Flush(filled);
+                filled = 0;
+            }
+        }
+        return delivered + Flush(filled);
+    }
+
+    // Waits for the delivery in progress, if any, to be handed on; the ones after it are
+    // dropped until Open. Once it returns, the callback isn't running, and won't be.
+    void Close();
+    void Open();
+    bool IsOpen() const { return !closed; }
+
+    // Every object delivered, the ones that couldn't be read, and the events the callback didn't take
+    uint64_t Received() const { return received; }
+    uint64_t Skipped() const { return skipped; }
+    uint64_t Dropped() const { return dropped; }
+    uint64_t Batches() const { return batches; }
+
+private:
+    // Only what a record says, not the whole name buffer
+    static void Clear(ProcessStartEvent& record)
+    {
+        record.processId = 0;
+        record.parentProcessId = 0;
+        record.processName[0] = L'\0';
+        record.sessionId = 0;
+    }
+
+    size_t Flush(size_t count);
+
+    BatchCallback callback;
+    std::mutex mutex;
+    std::unique_ptr<ProcessStartEvent[]> pool;
+    std::atomic<bool> closed{ false };
+
+    std::atomic<uint64_t> received{ 0 };
+    std::atomic<uint64_t> skipped{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<uint64_t> batches{ 0 };
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Platform.h"
+
+constexpr size_t PROCESS_NAME_LENGTH = 260;
+
+// What we need to know about a Win32_ProcessStartTrace event.
+typedef struct {
+    ProcessId processId;
+    ProcessId parentProcessId;
+    // Executable file name, e.g. "Spotify.exe"; empty if the event didn't carry it.
+    wchar_t processName[PROCESS_NAME_LENGTH];
+    // 0 if the event didn't carry it
+    SessionId sessionId;
+} ProcessStartEvent;
@@ -0,0 +1,71 @@
+#include "ProcessThreadIndex.h"
+
+#include <algorithm>
+
+namespace
+{
+    const std::vector<ThreadId> NO_THREADS;
+}
+
+
+void ProcessThreadIndex::Build(DesktopBackend& desktop)
+{
+    threads.clear();
+    threadCount = 0;
+
+    desktop.EnumSystemThreads([this](const ProcessId processId, const ThreadId threadId)
+    {
+        Add(processId, threadId);
+    });
+}
+
+void ProcessThreadIndex::Add(const ProcessId processId, const ThreadId threadId)
+{
+    threads[processId].push_back(threadId);
+    threadCount++;
+}
+
+void ProcessThreadIndex::CopyFrom(const ProcessThreadIndex& snapshot, const ProcessId processId)
+{
+    Forget(processId);
+
+    const std::vector<ThreadId>& copied = snapshot.ThreadsOf(processId);
+    if (copied.empty())
+        return;
+
+    threads[processId] = copied;
+    threadCount += copied.size();
+}
+
+size_t ProcessThreadIndex::Refresh(DesktopBackend& desktop, const ProcessId processId)
+{
+    std::vector<ThreadId>& known = threads[processId];
+    const size_t before = known.size();
+
+    desktop.EnumWindowThreads(processId, [&](const ThreadId threadId)
+    {
+        // A process has a few dozen threads at most; a linear scan beats hashing here.
+        if (std::find(known.begin(), known.end(), threadId) == known.end())
+            known.push_back(threadId);
+    });
+
+    const size_t added = known.size() - before;
+    threadCount += added;
+    return added;
+}
+
+void ProcessThreadIndex::Forget(const ProcessId processId)
+{
+    const auto it = threads.find(processId);
+    if (it == threads.end())
+        return;
+
+    threadCount -= it->second.size();
+    threads.erase(it);
+}
+
+const std::vector<ThreadId>& ProcessThreadIndex::ThreadsOf(const ProcessId processId) const
+{
+    const auto it = threads.find(processId);
+    return it != threads.end() ? it->second : NO_THREADS;
+}
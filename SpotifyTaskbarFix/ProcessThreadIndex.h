@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "DesktopBackend.h"
+
+// PID -> thread IDs, built from one system-wide thread snapshot and then kept
+// up to date incrementally, one process at a time. Thread order is stable:
+// threads seen in the snapshot come first, newly discovered ones are appended.
+class ProcessThreadIndex
+{
+public:
+    // Replaces the whole index with a fresh system-wide snapshot.
+    void Build(DesktopBackend& desktop);
+
+    // Builds the index from a snapshot taken elsewhere, one thread at a time.
+    void Add(ProcessId processId, ThreadId threadId);
+    // Copies what `snapshot` knows about `processId`, replacing what this index knew.
+    void CopyFrom(const ProcessThreadIndex& snapshot, ProcessId processId);
+
+    // Adds the threads of `processId` that appeared since the snapshot, without
+    // touching any other process. Returns the number of newly added threads.
+    size_t Refresh(DesktopBackend& desktop, ProcessId processId);
+
+    void Forget(ProcessId processId);
+
+    const std::vector<ThreadId>& ThreadsOf(ProcessId processId) const;
+
+    size_t ProcessCount() const { return threads.size(); }
+    size_t ThreadCount() const { return threadCount; }
+
+private:
+    std::unordered_map<ProcessId, std::vector<ThreadId>> threads;
+    size_t threadCount = 0;
+};
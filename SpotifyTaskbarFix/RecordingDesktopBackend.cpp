@@ -0,0 +1,413 @@
+#include "RecordingDesktopBackend.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "MonitorTopology.h"
+
+void RecordingDesktopBackend::StartRecording()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    startTime = inner.Now();
+    recording = true;
+}
+
+bool RecordingDesktopBackend::Save(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return writer.Save(path);
+}
+
+void RecordingDesktopBackend::RecordStartEvent(const ProcessStartEvent& event)
+{
+    if (!recording)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::StartEvent);
+    record.processId = event.processId;
+    record.value = event.parentProcessId;
+    record.text = writer.AddString(event.processName);
+}
+
+uint32_t RecordingDesktopBackend::Time()
+{
+    return static_cast<uint32_t>(inner.Now() - startTime);
+}
+
+void RecordingDesktopBackend::SeeThread(const ProcessId processId, const ThreadId threadId)
+{
+    if (!recordedThreads.insert(threadId).second)
+        return;
+
+    LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Thread);
+    record.processId = processId;
+    record.threadId = threadId;
+}
+
+RecordingDesktopBackend::WindowState& RecordingDesktopBackend::SeeWindow(const WindowHandle hWnd, const ThreadId threadId, const WindowHandle parent)
+{
+    const auto it = windows.find(hWnd);
+    if (it != windows.end())
+        return it->second;
+
+    LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Window);
+    record.threadId = threadId;
+    record.window = hWnd;
+    record.parent = parent;
+
+    WindowState& state = windows[hWnd];
+    state.threadId = threadId;
+    state.classRecorded = false;
+    state.titleRecorded = false;
+    state.styleRecorded = false;
+    state.style = 0;
+    state.exStyle = 0;
+    state.positionRecorded = false;
+    state.position = { 0, 0, 0, 0 };
+    return state;
+}
+
+void RecordingDesktopBackend::RecordStyle(const WindowHandle hWnd, WindowState& state)
+{
+    LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::WindowStyle);
+    record.window = hWnd;
+    record.value = state.style;
+    record.value2 = state.exStyle;
+    state.styleRecorded = true;
+}
+
+
+// ======================
+//     DesktopBackend
+// ======================
+
+uint64_t RecordingDesktopBackend::Now()
+{
+    return inner.Now();
+}
+
+void RecordingDesktopBackend::Sleep(const uint32_t ms)
+{
+    inner.Sleep(ms);
+}
+
+bool RecordingDesktopBackend::GetProcessImageName(const ProcessId processId, std::wstring& imageName)
+{
+    const bool ok = inner.GetProcessImageName(processId, imageName);
+    if (ok && recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Process);
+        record.processId = processId;
+        record.text = writer.AddString(imageName);
+    }
+    return ok;
+}
+
+bool RecordingDesktopBackend::GetProcessCommandLine(const ProcessId processId, std::wstring& commandLine)
+{
+    const bool ok = inner.GetProcessCommandLine(processId, commandLine);
+    if (ok && recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Process);
+        record.processId = processId;
+        record.text2 = writer.AddString(commandLine);
+    }
+    return ok;
+}
+
+bool RecordingDesktopBackend::GetProcessImageVersion(const ProcessId processId, std::wstring& version)
+{
+    // Nothing to replay: without a version, a replay always takes the full window search
+    return inner.GetProcessImageVersion(processId, version);
+}
+
+bool RecordingDesktopBackend::WaitForInputIdle(const ProcessId processId, const uint32_t timeoutMs)
+{
+    const bool idle = inner.WaitForInputIdle(processId, timeoutMs);
+    if (idle && recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idleProcesses.insert(processId).second)
+            writer.Add(Time(), LaunchTraceRecordType::InputIdle).processId = processId;
+    }
+    return idle;
+}
+
+void RecordingDesktopBackend::EnumSystemThreads(const SystemThreadCallback& callback)
+{
+    if (!recording)
+    {
+        inner.EnumSystemThreads(callback);
+        return;
+    }
+
+    // Thousands of threads: only remember who owns them, and record the ones whose windows get enumerated
+    inner.EnumSystemThreads([&](const ProcessId processId, const ThreadId threadId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadOwners[threadId] = processId;
+        }
+        callback(processId, threadId);
+    });
+}
+
+void RecordingDesktopBackend::EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback)
+{
+    if (!recording)
+    {
+        inner.EnumSystemProcesses(processCallback, threadCallback);
+        return;
+    }
+
+    // Like EnumSystemThreads; the processes themselves are recorded as they get queried
+    inner.EnumSystemProcesses(processCallback, [&](const ProcessId processId, const ThreadId threadId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadOwners[threadId] = processId;
+        }
+        threadCallback(processId, threadId);
+    });
+}
+
+void RecordingDesktopBackend::EnumWindowThreads(const ProcessId processId, const ThreadCallback& callback)
+{
+    if (!recording)
+    {
+        inner.EnumWindowThreads(processId, callback);
+        return;
+    }
+
+    inner.EnumWindowThreads(processId, [&](const ThreadId threadId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threadOwners[threadId] = processId;
+            SeeThread(processId, threadId);
+        }
+        callback(threadId);
+    });
+}
+
+void RecordingDesktopBackend::EnumThreadWindows(const ThreadId threadId, const WindowCallback& callback)
+{
+    if (!recording)
+    {
+        inner.EnumThreadWindows(threadId, callback);
+        return;
+    }
+
+    inner.EnumThreadWindows(threadId, [&](const WindowHandle hWnd)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto owner = threadOwners.find(threadId);
+            if (owner != threadOwners.end())
+                SeeThread(owner->second, threadId);
+            SeeWindow(hWnd, threadId, NULL_WINDOW);
+        }
+        return callback(hWnd);
+    });
+}
+
+void RecordingDesktopBackend::EnumChildWindows(const WindowHandle hWnd, const WindowCallback& callback)
+{
+    if (!recording)
+    {
+        inner.EnumChildWindows(hWnd, callback);
+        return;
+    }
+
+    // EnumChildWindows walks all descendants; for the fix logic they might as well all be children of hWnd
+    inner.EnumChildWindows(hWnd, [&](const WindowHandle hChild)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto parent = windows.find(hWnd);
+            SeeWindow(hChild, parent != windows.end() ? parent->second.threadId : 0, hWnd);
+        }
+        return callback(hChild);
+    });
+}
+
+WindowHandle RecordingDesktopBackend::FindChildWindow(const WindowHandle hParent, const wchar_t* const className)
+{
+    const WindowHandle hChild = inner.FindChildWindow(hParent, className);
+    if (recording && hChild != NULL_WINDOW)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto parent = windows.find(hParent);
+        SeeWindow(hChild, parent != windows.end() ? parent->second.threadId : 0, hParent);
+    }
+    return hChild;
+}
+
+WindowHandle RecordingDesktopBackend::GetParentWindow(const WindowHandle hWnd)
+{
+    return inner.GetParentWindow(hWnd);
+}
+
+ClassAtom RecordingDesktopBackend::GetClassAtom(const WindowHandle hWnd)
+{
+    // Atoms are only meaningful within a session; a replay assigns its own
+    return inner.GetClassAtom(hWnd);
+}
+
+size_t RecordingDesktopBackend::GetWindowClass(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    const size_t length = inner.GetWindowClass(hWnd, buffer, bufferLength);
+    if (recording && length > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && !it->second.classRecorded)
+        {
+            LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::WindowClass);
+            record.window = hWnd;
+            record.text = writer.AddString(std::wstring(buffer, length));
+            it->second.classRecorded = true;
+        }
+    }
+    return length;
+}
+
+size_t RecordingDesktopBackend::GetWindowTitle(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    const size_t length = inner.GetWindowTitle(hWnd, buffer, bufferLength);
+    if (recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && (!it->second.titleRecorded || it->second.title.compare(0, std::wstring::npos, buffer, length) != 0))
+        {
+            it->second.title.assign(buffer, length);
+            it->second.titleRecorded = true;
+
+            LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::WindowTitle);
+            record.window = hWnd;
+            record.text = writer.AddString(it->second.title);
+        }
+    }
+    return length;
+}
+
+uint32_t RecordingDesktopBackend::GetStyle(const WindowHandle hWnd)
+{
+    const uint32_t style = inner.GetStyle(hWnd);
+    if (recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && (!it->second.styleRecorded || it->second.style != style))
+        {
+            it->second.style = style;
+            RecordStyle(hWnd, it->second);
+        }
+    }
+    return style;
+}
+
+uint32_t RecordingDesktopBackend::GetExStyle(const WindowHandle hWnd)
+{
+    const uint32_t exStyle = inner.GetExStyle(hWnd);
+    if (recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && (!it->second.styleRecorded || it->second.exStyle != exStyle))
+        {
+            it->second.exStyle = exStyle;
+            RecordStyle(hWnd, it->second);
+        }
+    }
+    return exStyle;
+}
+
+WindowRect RecordingDesktopBackend::GetWindowPosition(const WindowHandle hWnd)
+{
+    const WindowRect position = inner.GetWindowPosition(hWnd);
+    if (recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && (!it->second.positionRecorded || std::memcmp(&it->second.position, &position, sizeof position) != 0))
+        {
+            it->second.position = position;
+            it->second.positionRecorded = true;
+
+            LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::WindowPosition);
+            record.window = hWnd;
+            record.rect[0] = position.left;
+            record.rect[1] = position.top;
+            record.rect[2] = position.right;
+            record.rect[3] = position.bottom;
+        }
+    }
+    return position;
+}
+
+bool RecordingDesktopBackend::SetWindowPosition(const WindowHandle hWnd, const WindowMove& move)
+{
+    const bool ok = inner.SetWindowPosition(hWnd, move);
+    if (ok && recording)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Move);
+        record.window = hWnd;
+        record.value = (move.resize ? LAUNCH_TRACE_MOVE_RESIZE : 0) | (move.redraw ? LAUNCH_TRACE_MOVE_REDRAW : 0);
+        record.rect[0] = move.rect.left;
+        record.rect[1] = move.rect.top;
+        record.rect[2] = move.rect.right;
+        record.rect[3] = move.rect.bottom;
+
+        // Reading back the position we just set is no news
+        const auto it = windows.find(hWnd);
+        if (it != windows.end() && move.resize)
+            it->second.position = move.rect;
+    }
+    return ok;
+}
+
+void RecordingDesktopBackend::EnumMonitors(const MonitorCallback& callback)
+{
+    if (!recording)
+    {
+        inner.EnumMonitors(callback);
+        return;
+    }
+
+    std::vector<MonitorInfo> current;
+    inner.EnumMonitors([&](const MonitorInfo& monitor)
+    {
+        current.push_back(monitor);
+        callback(monitor);
+    });
+
+    // The whole topology again, but only when something changed
+    std::lock_guard<std::mutex> lock(mutex);
+    const bool changed = current.size() != monitors.size() || !std::equal(current.begin(), current.end(), monitors.begin(), SameMonitor);
+    if (!changed)
+        return;
+
+    monitors = current;
+    for (const MonitorInfo& monitor : monitors)
+    {
+        LaunchTraceRecord& record = writer.Add(Time(), LaunchTraceRecordType::Monitor);
+        record.value = monitor.dpi;
+        record.value2 = (monitor.primary ? LAUNCH_TRACE_MONITOR_PRIMARY : 0) | static_cast<uint32_t>(monitor.taskbar) << 1;
+        record.rect[0] = monitor.bounds.left;
+        record.rect[1] = monitor.bounds.top;
+        record.rect[2] = monitor.bounds.right;
+        record.rect[3] = monitor.bounds.bottom;
+
+        LaunchTraceRecord& workArea = writer.Add(Time(), LaunchTraceRecordType::MonitorWorkArea);
+        workArea.rect[0] = monitor.workArea.left;
+        workArea.rect[1] = monitor.workArea.top;
+        workArea.rect[2] = monitor.workArea.right;
+        workArea.rect[3] = monitor.workArea.bottom;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DesktopBackend.h"
+#include "LaunchTrace.h"
+#include "ProcessStartEvent.h"
+
+// Passes every call through to another backend and, while recording, writes
+// down what the fix logic got to see: processes, threads, windows as they
+// are first enumerated, and every change in their class, title, style and
+// position. Only changes are recorded, so a trace stays small no matter how
+// often the fix polls. See Replay.h for playing a trace back.
+// When not recording, the only overhead is one flag check per call.
+class RecordingDesktopBackend final : public DesktopBackend
+{
+public:
+    explicit RecordingDesktopBackend(DesktopBackend& inner) : inner(inner) {}
+
+    void StartRecording();
+    bool IsRecording() const { return recording; }
+    bool Save(const std::string& path);
+
+    // Start events don't go through the backend; whoever receives them has to pass them on.
+    void RecordStartEvent(const ProcessStartEvent& event);
+
+    uint64_t Now() override;
+    void Sleep(uint32_t ms) override;
+
+    bool GetProcessImageName(ProcessId processId, std::wstring& imageName) override;
+    bool GetProcessCommandLine(ProcessId processId, std::wstring& commandLine) override;
+    bool GetProcessImageVersion(ProcessId processId, std::wstring& version) override;
+
+    bool WaitForInputIdle(ProcessId processId, uint32_t timeoutMs) override;
+    void ReleaseProcess(ProcessId processId) override { inner.ReleaseProcess(processId); }
+    void EnumSystemThreads(const SystemThreadCallback& callback) override;
+    void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) override;
+    void EnumWindowThreads(ProcessId processId, const ThreadCallback& callback) override;
+
+    void EnumThreadWindows(ThreadId threadId, const WindowCallback& callback) override;
+    void EnumChildWindows(WindowHandle hWnd, const WindowCallback& callback) override;
+    WindowHandle FindChildWindow(WindowHandle hParent, const wchar_t* className) override;
+    WindowHandle GetParentWindow(WindowHandle hWnd) override;
+
+    ClassAtom GetClassAtom(WindowHandle hWnd) override;
+    size_t GetWindowClass(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+    size_t GetWindowTitle(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+
+    uint32_t GetStyle(WindowHandle hWnd) override;
+    uint32_t GetExStyle(WindowHandle hWnd) override;
+
+    WindowRect GetWindowPosition(WindowHandle hWnd) override;
+    bool SetWindowPosition(WindowHandle hWnd, const WindowMove& move) override;
+
+    void EnumMonitors(const MonitorCallback& callback) override;
+
+    bool Concurrent() const override { return inner.Concurrent(); }
+
+    BackendCounters Counters() const override { return inner.Counters(); }
+    void ResetCounters() override { inner.ResetCounters(); }
+
+private:
+    typedef struct {
+        ThreadId threadId;
+        bool classRecorded;
+        bool titleRecorded;
+        std::wstring title;
+        bool styleRecorded;
+        uint32_t style;
+        uint32_t exStyle;
+        bool positionRecorded;
+        WindowRect position;
+    } WindowState;
+
+    // All of these expect the mutex to be held
+    uint32_t Time();
+    void SeeThread(ProcessId processId, ThreadId threadId);
+    WindowState& SeeWindow(WindowHandle hWnd, ThreadId threadId, WindowHandle parent);
+    void RecordStyle(WindowHandle hWnd, WindowState& state);
+
+    DesktopBackend& inner;
+    std::atomic<bool> recording{ false };
+
+    std::mutex mutex;
+    uint64_t startTime = 0;
+    LaunchTraceWriter writer;
+
+    std::unordered_map<ThreadId, ProcessId> threadOwners;
+    std::unordered_set<ThreadId> recordedThreads;
+    std::unordered_set<ProcessId> idleProcesses;
+    std::unordered_map<WindowHandle, WindowState> windows;
+    std::vector<MonitorInfo> monitors;
+};
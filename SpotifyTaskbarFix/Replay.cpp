@@ -0,0 +1,251 @@
+#include "Replay.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#include "FixScheduler.h"
+
+namespace
+{
+    typedef struct {
+        ProcessId parentProcessId;
+        std::wstring imageName;
+        std::wstring commandLine;
+    } ReplayProcess;
+
+    typedef struct {
+        uint64_t time;
+        ThreadId threadId;
+        WindowHandle parent;
+        std::wstring className;
+        bool hasTitle;
+        std::wstring title;
+        bool hasStyle;
+        uint32_t style;
+        bool hasPosition;
+        WindowRect position;
+        WindowHandle replayed;
+    } ReplayWindow;
+
+    typedef struct {
+        uint64_t time;
+        WindowHandle window;
+        bool isTitle;
+        std::wstring title;
+        uint32_t style;
+    } ReplayChange;
+}
+
+
+std::vector<ReplayStartEvent> LoadLaunchTrace(const LaunchTraceReader& trace, SimulatedDesktopBackend& desktop)
+{
+    std::vector<ReplayStartEvent> events;
+
+    // Processes first: threads and windows need them to exist. Ordered maps keep the replay deterministic.
+    std::map<ProcessId, ReplayProcess> processes;
+    for (uint32_t i = 0; i < trace.RecordCount(); i++)
+    {
+        const LaunchTraceRecord& record = trace.Record(i);
+        switch (record.type)
+        {
+            case LaunchTraceRecordType::StartEvent:
+            {
+                ReplayProcess& process = processes[record.processId];
+                process.parentProcessId = record.value;
+                if (process.imageName.empty())
+                    process.imageName = trace.String(record.text);
+
+                ReplayStartEvent start = {};
+                start.time = record.time;
+                start.event.processId = record.processId;
+                start.event.parentProcessId = record.value;
+                const std::wstring processName = trace.String(record.text);
+                processName.copy(start.event.processName, PROCESS_NAME_LENGTH - 1);
+                events.push_back(start);
+                break;
+            }
+
+            case LaunchTraceRecordType::Process:
+            {
+                ReplayProcess& process = processes[record.processId];
+                if (record.text != LAUNCH_TRACE_NO_STRING)
+                    process.imageName = trace.String(record.text);
+                if (record.text2 != LAUNCH_TRACE_NO_STRING)
+                    process.commandLine = trace.String(record.text2);
+                break;
+            }
+
+            case LaunchTraceRecordType::Thread:
+            case LaunchTraceRecordType::InputIdle:
+                processes[record.processId];
+                break;
+
+            default:
+                break;
+        }
+    }
+    for (const auto& process : processes)
+        desktop.AddProcess(process.first, process.second.parentProcessId, process.second.imageName, process.second.commandLine);
+
+    // Then windows, each with the first state that was observed, and everything that changed later
+    std::unordered_map<uint64_t, ReplayWindow> windows;
+    std::vector<uint64_t> creationOrder;
+    std::vector<ReplayChange> changes;
+    std::set<ThreadId> threads;
+
+    // The simulator's monitors don't change; the topology first seen is the one replayed
+    std::vector<MonitorInfo> monitors;
+    bool monitorsComplete = false;
+
+    for (uint32_t i = 0; i < trace.RecordCount(); i++)
+    {
+        const LaunchTraceRecord& record = trace.Record(i);
+        const auto window = windows.find(record.window);
+        if (!monitors.empty() && record.type != LaunchTraceRecordType::Monitor && record.type != LaunchTraceRecordType::MonitorWorkArea)
+            monitorsComplete = true;
+
+        switch (record.type)
+        {
+            case LaunchTraceRecordType::Monitor:
+                if (!monitorsComplete)
+                {
+                    MonitorInfo monitor;
+                    monitor.bounds = { record.rect[0], record.rect[1], record.rect[2], record.rect[3] };
+                    monitor.workArea = monitor.bounds;
+                    monitor.dpi = record.value;
+                    monitor.primary = HasFlag(record.value2, LAUNCH_TRACE_MONITOR_PRIMARY);
+                    monitor.taskbar = static_cast<TaskbarEdge>(record.value2 >> 1);
+                    monitors.push_back(monitor);
+                }
+                break;
+
+            case LaunchTraceRecordType::MonitorWorkArea:
+                if (!monitorsComplete && !monitors.empty())
+                    monitors.back().workArea = { record.rect[0], record.rect[1], record.rect[2], record.rect[3] };
+                break;
+
+            case LaunchTraceRecordType::Thread:
+                if (threads.insert(record.threadId).second)
+                    desktop.AddThread(record.processId, record.threadId);
+                break;
+
+            case LaunchTraceRecordType::InputIdle:
+                desktop.SetInputIdleAt(record.time, record.processId);
+                break;
+
+            case LaunchTraceRecordType::Window:
+                if (window == windows.end())
+                {
+                    windows[record.window] = { record.time, record.threadId, static_cast<WindowHandle>(record.parent), std::wstring(),
+                                               false, std::wstring(), false, 0, false, { 0, 0, 0, 0 }, NULL_WINDOW };
+                    creationOrder.push_back(record.window);
+                }
+                break;
+
+            case LaunchTraceRecordType::WindowClass:
+                if (window != windows.end())
+                    window->second.className = trace.String(record.text);
+                break;
+
+            case LaunchTraceRecordType::WindowTitle:
+                if (window == windows.end())
+                    break;
+                if (!window->second.hasTitle)
+                {
+                    window->second.hasTitle = true;
+                    window->second.title = trace.String(record.text);
+                }
+                else
+                {
+                    changes.push_back({ record.time, record.window, true, trace.String(record.text), 0 });
+                }
+                break;
+
+            case LaunchTraceRecordType::WindowStyle:
+                if (window == windows.end())
+                    break;
+                if (!window->second.hasStyle)
+                {
+                    window->second.hasStyle = true;
+                    window->second.style = record.value;
+                }
+                else
+                {
+                    changes.push_back({ record.time, record.window, false, std::wstring(), record.value });
+                }
+                break;
+
+            case LaunchTraceRecordType::WindowPosition:
+                if (window != windows.end() && !window->second.hasPosition)
+                {
+                    window->second.hasPosition = true;
+                    window->second.position = { record.rect[0], record.rect[1], record.rect[2], record.rect[3] };
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    for (const MonitorInfo& monitor : monitors)
+        desktop.AddMonitor(monitor);
+
+    for (const uint64_t handle : creationOrder)
+    {
+        ReplayWindow& window = windows[handle];
+
+        WindowHandle parent = NULL_WINDOW;
+        if (window.parent != NULL_WINDOW)
+        {
+            const auto it = windows.find(window.parent);
+            if (it == windows.end() || it->second.replayed == NULL_WINDOW)
+                continue;
+            parent = it->second.replayed;
+        }
+
+        window.replayed = desktop.CreateWindowAt(window.time, window.threadId, parent, window.className, window.title, window.style, window.position);
+    }
+
+    for (const ReplayChange& change : changes)
+    {
+        const WindowHandle replayed = windows[change.window].replayed;
+        if (replayed == NULL_WINDOW)
+            continue;
+
+        if (change.isTitle)
+            desktop.SetTitleAt(change.time, replayed, change.title);
+        else
+            desktop.SetStyleAt(change.time, replayed, change.style);
+    }
+
+    return events;
+}
+
+ReplayResult ReplayLaunchTrace(const LaunchTraceReader& trace, const RuleSet& rules)
+{
+    SimulatedDesktopBackend desktop;
+    const std::vector<ReplayStartEvent> events = LoadLaunchTrace(trace, desktop);
+
+    ReplayResult result;
+    std::unordered_map<ProcessId, uint64_t> submitTimes;
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    scheduler.SetCompletionCallback([&](const FixJob& job)
+    {
+        result.fixes.push_back({ job.RootProcessId(), job.Result(), submitTimes[job.RootProcessId()], desktop.Now() });
+    });
+
+    for (const ReplayStartEvent& start : events)
+    {
+        scheduler.RunUntil(start.time);
+        submitTimes[start.event.processId] = desktop.Now();
+        scheduler.Submit(start.event);
+    }
+    scheduler.RunUntilIdle();
+
+    result.moves = desktop.Moves().size();
+    result.endTime = desktop.Now();
+    return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "LaunchTrace.h"
+#include "ProcessStartEvent.h"
+#include "Rules.h"
+#include "SimulatedDesktopBackend.h"
+#include "SpotifyFix.h"
+
+typedef struct {
+    uint64_t time;
+    ProcessStartEvent event;
+} ReplayStartEvent;
+
+typedef struct {
+    ProcessId processId;
+    FixResult result;
+    // Virtual milliseconds since the recording started
+    uint64_t startTime;
+    uint64_t endTime;
+} ReplayFix;
+
+typedef struct {
+    std::vector<ReplayFix> fixes;
+    size_t moves;
+    uint64_t endTime;
+} ReplayResult;
+
+// Rebuilds the desktop a trace was recorded on, as a timeline: each window
+// is created when the fix logic first saw it, with the class, title, style
+// and position it first saw, and every later change it observed is replayed
+// at the time it was observed. Returns the start events, in order.
+std::vector<ReplayStartEvent> LoadLaunchTrace(const LaunchTraceReader& trace, SimulatedDesktopBackend& desktop);
+
+// Runs the fix logic over a recorded launch on a virtual clock: deterministic,
+// and as fast as the CPU allows rather than as fast as the recording.
+ReplayResult ReplayLaunchTrace(const LaunchTraceReader& trace, const RuleSet& rules);
@@ -0,0 +1,310 @@
+#include "Rules.h"
+
+#include <cwctype>
+#include <fstream>
+#include <sstream>
+
+#include "Platform.h"
+#include "Utf8.h"
+
+namespace
+{
+    constexpr char DEFAULT_RULES[] =
+        "[Spotify]\n"
+        "process = Spotify.exe\n"
+        "marker  = GDI+ Hook Window Class | G\n"
+        "marker  = Chrome_WidgetWin_0\n"
+        "window  = Chrome_WidgetWin_0 | *\n"
+        "content = Chrome_RenderWidgetHostHWND\n";
+
+    std::wstring Trim(const std::wstring& text)
+    {
+        const size_t begin = text.find_first_not_of(L" \t");
+        if (begin == std::wstring::npos)
+            return std::wstring();
+
+        const size_t end = text.find_last_not_of(L" \t");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    std::wstring ToLower(const std::wstring& text)
+    {
+        std::wstring result(text);
+        for (wchar_t& c : result)
+            c = static_cast<wchar_t>(std::towlower(c));
+        return result;
+    }
+
+    std::wstring QuoteWql(const std::wstring& text)
+    {
+        std::wstring result(L"\"");
+        for (const wchar_t c : text)
+        {
+            if (c == L'"' || c == L'\\')
+                result.push_back(L'\\');
+            result.push_back(c);
+        }
+        result.push_back(L'"');
+        return result;
+    }
+}
+
+
+RuleSet RuleSet::Default()
+{
+    RuleSet rules;
+    std::string error;
+    rules.Parse(DEFAULT_RULES, error);
+    return rules;
+}
+
+bool RuleSet::LoadFile(const std::string& path, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+
+    std::string text = contents.str();
+    if (text.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        text.erase(0, 3);
+
+    return Parse(text, error);
+}
+
+bool RuleSet::Parse(const std::string& text, std::string& error)
+{
+    RuleSet parsed;
+
+    std::istringstream lines(text);
+    std::string rawLine;
+    for (int lineNumber = 1; std::getline(lines, rawLine); lineNumber++)
+    {
+        const auto fail = [&](const std::string& message)
+        {
+            error = "line " + std::to_string(lineNumber) + ": " + message;
+            return false;
+        };
+
+        std::wstring line = Utf8ToWide(rawLine);
+        if (!line.empty() && line.back() == L'\r')
+            line.pop_back();
+
+        // Inline comments need whitespace (a space or a tab) before the ';', so that it can still appear in names
+        for (size_t comment = line.find(L';'); comment != std::wstring::npos; comment = line.find(L';', comment + 1))
+        {
+            if (comment > 0 && (line[comment - 1] == L' ' || line[comment - 1] == L'\t'))
+            {
+                line.erase(comment);
+                break;
+            }
+        }
+        line = Trim(line);
+
+        if (line.empty() || line[0] == L'#' || line[0] == L';')
+            continue;
+
+        if (line.front() == L'[')
+        {
+            if (line.back() != L']' || line.size() < 3)
+                return fail("malformed section header");
+            parsed.apps.push_back({ Trim(line.substr(1, line.size() - 2)), {}, false });
+            continue;
+        }
+
+        const size_t equals = line.find(L'=');
+        if (equals == std::wstring::npos)
+            return fail("expected 'key = value'");
+        if (parsed.apps.empty())
+            return fail("rule outside of an [App] section");
+
+        const std::wstring key = ToLower(Trim(line.substr(0, equals)));
+        const std::wstring value = Trim(line.substr(equals + 1));
+        if (value.empty())
+            return fail("empty value");
+
+        const size_t app = parsed.apps.size() - 1;
+        if (key == L"process")
+        {
+            parsed.apps[app].processNames.push_back(value);
+            continue;
+        }
+
+        WindowRule rule = { app, WindowRole::Marker, TitleMatch::Any, std::wstring() };
+        if (key == L"marker")
+            rule.role = WindowRole::Marker;
+        else if (key == L"window")
+            rule.role = WindowRole::MainWindow;
+        else if (key == L"content")
+            rule.role = WindowRole::Content;
+        else
+            return fail("unknown key");
+
+        std::wstring className = value;
+        const size_t bar = value.find(L'|');
+        if (bar != std::wstring::npos)
+        {
+            className = Trim(value.substr(0, bar));
+            const std::wstring title = Trim(value.substr(bar + 1));
+            if (title == L"*")
+                rule.titleMatch = TitleMatch::NonEmpty;
+            else if (title == L"\"\"")
+                rule.titleMatch = TitleMatch::Empty;
+            else if (!title.empty())
+            {
+                rule.titleMatch = TitleMatch::Exact;
+                rule.title = title;
+            }
+        }
+        if (className.empty())
+            return fail("empty class name");
+
+        if (rule.role == WindowRole::Content)
+            parsed.apps[app].hasContentRule = true;
+        parsed.AddWindowRule(className, rule);
+    }
+
+    // Nothing to fix, and nothing to build a WMI query from
+    if (parsed.apps.empty())
+    {
+        error = "no [App] sections";
+        return false;
+    }
+
+    std::vector<bool> hasMainWindowRule(parsed.apps.size(), false);
+    for (const ClassEntry& entry : parsed.classes)
+    {
+        for (const WindowRule& rule : entry.rules)
+        {
+            if (rule.role == WindowRole::MainWindow)
+                hasMainWindowRule[rule.app] = true;
+        }
+    }
+
+    for (size_t app = 0; app < parsed.apps.size(); app++)
+    {
+        if (parsed.apps[app].processNames.empty() || !hasMainWindowRule[app])
+        {
+            std::string name;
+            for (const wchar_t c : parsed.apps[app].name)
+                name.push_back(c < 0x80 ? static_cast<char>(c) : '?');
+            error = "[" + name + "]: needs at least one 'process' and one 'window' rule";
+            return false;
+        }
+    }
+
+    parsed.Compile();
+    *this = std::move(parsed);
+    return true;
+}
+
+size_t RuleSet::FindApp(const wchar_t* const imageName) const
+{
+    const auto it = appByProcessName.find(ToLower(imageName));
+    return it != appByProcessName.end() ? it->second : NO_APP;
+}
+
+std::wstring RuleSet::BuildWqlQuery() const
+{
+    std::wstring query = L"SELECT * FROM Win32_ProcessStartTrace WHERE ";
+
+    bool first = true;
+    for (const AppRule& app : apps)
+    {
+        for (const std::wstring& processName : app.processNames)
+        {
+            if (!first)
+                query += L" OR ";
+            query += L"ProcessName = " + QuoteWql(processName);
+            first = false;
+        }
+    }
+    return query;
+}
+
+const std::vector<WindowRule>* RuleSet::MatchClass(const wchar_t* const className) const
+{
+    if (buckets.empty())
+        return nullptr;
+
+    const uint32_t hash = HashClassName(className);
+    const size_t mask = buckets.size() - 1;
+    for (size_t i = hash & mask; buckets[i].entry != EMPTY_BUCKET; i = (i + 1) & mask)
+    {
+        const Bucket& bucket = buckets[i];
+        if (bucket.hash == hash && WStrICmp(classes[bucket.entry].className.c_str(), className) == 0)
+            return &classes[bucket.entry].rules;
+    }
+    return nullptr;
+}
+
+bool RuleSet::MatchTitle(const WindowRule& rule, const wchar_t* const title)
+{
+    switch (rule.titleMatch)
+    {
+        case TitleMatch::Any:
+            return true;
+        case TitleMatch::Empty:
+            return title[0] == L'\0';
+        case TitleMatch::NonEmpty:
+            return title[0] != L'\0';
+        case TitleMatch::Exact:
+            return WStrICmp(title, rule.title.c_str()) == 0;
+    }
+    return false;
+}
+
+void RuleSet::AddWindowRule(const std::wstring& className, const WindowRule& rule)
+{
+    for (ClassEntry& entry : classes)
+    {
+        if (WStrICmp(entry.className.c_str(), className.c_str()) == 0)
+        {
+            entry.rules.push_back(rule);
+            return;
+        }
+    }
+    classes.push_back({ className, { rule } });
+}
+
+void RuleSet::Compile()
+{
+    appByProcessName.clear();
+    for (size_t app = 0; app < apps.size(); app++)
+    {
+        for (const std::wstring& processName : apps[app].processNames)
+            appByProcessName.emplace(ToLower(processName), app);
+    }
+
+    // Open addressing, at most half full
+    size_t size = 8;
+    while (size < classes.size() * 2)
+        size *= 2;
+
+    buckets.assign(size, { 0, EMPTY_BUCKET });
+    for (size_t entry = 0; entry < classes.size(); entry++)
+    {
+        const uint32_t hash = HashClassName(classes[entry].className.c_str());
+        size_t i = hash & (size - 1);
+        while (buckets[i].entry != EMPTY_BUCKET)
+            i = (i + 1) & (size - 1);
+        buckets[i] = { hash, static_cast<uint32_t>(entry) };
+    }
+}
+
+uint32_t RuleSet::HashClassName(const wchar_t* className)
+{
+    // FNV-1a over the lower-cased characters
+    uint32_t hash = 2166136261u;
+    for (; *className != L'\0'; className++)
+    {
+        hash ^= static_cast<uint32_t>(std::towlower(*className));
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Which applications to fix and how to recognize their windows.
+//
+// Rules file syntax (UTF-8, one app per section, '#' or ';' start a comment):
+//
+//   [Spotify]
+//   process = Spotify.exe                       ; any number of executables
+//   marker  = GDI+ Hook Window Class | G        ; top-level window that identifies the main process
+//   marker  = Chrome_WidgetWin_0
+//   window  = Chrome_WidgetWin_0 | *            ; the top-level window to fix
+//   content = Chrome_RenderWidgetHostHWND       ; child the window must contain to be ready
+//
+// Class names are case-insensitive. The optional title after '|' is matched
+// case-insensitively too, except for two special forms: '*' means any
+// non-empty title, '""' means an empty one. No title matches any title.
+//
+// All the rules are compiled into a single WMI filter and a single hashed
+// class-name table, so the number of apps costs neither extra subscriptions
+// nor extra passes over the windows.
+
+enum class TitleMatch : uint8_t
+{
+    Any,
+    Empty,
+    NonEmpty,
+    Exact,
+};
+
+enum class WindowRole : uint8_t
+{
+    Marker,
+    MainWindow,
+    Content,
+};
+
+typedef struct {
+    size_t app;
+    WindowRole role;
+    TitleMatch titleMatch;
+    std::wstring title;
+} WindowRule;
+
+typedef struct {
+    std::wstring name;
+    std::vector<std::wstring> processNames;
+    bool hasContentRule;
+} AppRule;
+
+class RuleSet
+{
+public:
+    static constexpr size_t NO_APP = static_cast<size_t>(-1);
+
+    // Spotify, exactly as the tool always recognized it.
+    static RuleSet Default();
+
+    // Both return false and describe the problem in `error` if the rules are malformed;
+    // the rule set is left untouched in that case.
+    bool Parse(const std::string& text, std::string& error);
+    bool LoadFile(const std::string& path, std::string& error);
+
+    const std::vector<AppRule>& Apps() const { return apps; }
+    const AppRule& App(const size_t app) const { return apps[app]; }
+
+    // Index of the app `imageName` belongs to, or NO_APP.
+    size_t FindApp(const wchar_t* imageName) const;
+
+    // e.g. SELECT * FROM Win32_ProcessStartTrace WHERE ProcessName = "A.exe" OR ProcessName = "B.exe"
+    std::wstring BuildWqlQuery() const;
+
+    // Every rule (of any app) for this window class, or nullptr. Never allocates.
+    const std::vector<WindowRule>* MatchClass(const wchar_t* className) const;
+
+    static bool MatchTitle(const WindowRule& rule, const wchar_t* title);
+
+private:
+    typedef struct {
+        std::wstring className;
+        std::vector<WindowRule> rules;
+    } ClassEntry;
+
+    typedef struct {
+        uint32_t hash;
+        uint32_t entry;
+    } Bucket;
+
+    static constexpr uint32_t EMPTY_BUCKET = UINT32_MAX;
+
+    void AddWindowRule(const std::wstring& className, const WindowRule& rule);
+    void Compile();
+    static uint32_t HashClassName(const wchar_t* className);
+
+    std::vector<AppRule> apps;
+    std::unordered_map<std::wstring, size_t> appByProcessName;
+
+    std::vector<ClassEntry> classes;
+    std::vector<Bucket> buckets;
+};
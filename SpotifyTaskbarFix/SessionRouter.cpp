@@ -0,0 +1,73 @@
+#include "SessionRouter.h"
+
+#include <algorithm>
+
+bool SessionRouter::Route(const ProcessStartEvent& event, const uint64_t now)
+{
+    const SessionId sessionId = event.sessionId != 0 ? event.sessionId : backend.SessionOf(event.processId);
+    if (sessionId == 0)
+    {
+        unroutable++;
+        return false;
+    }
+
+    RetireIdle(now);
+
+    auto session = Find(sessionId);
+    if (session == sessions.end() || session->sessionId != sessionId)
+        session = sessions.insert(session, { sessionId, now, nullptr });
+    session->lastEvent = now;
+
+    // A worker that died (or was never there) gets one replacement per event
+    if (session->worker != nullptr && session->worker->Deliver(event))
+    {
+        routed++;
+        return true;
+    }
+
+    session->worker = backend.StartWorker(sessionId);
+    if (session->worker != nullptr)
+    {
+        workersStarted++;
+        if (session->worker->Deliver(event))
+        {
+            routed++;
+            return true;
+        }
+    }
+
+    workerFailures++;
+    sessions.erase(session);
+    return false;
+}
+
+void SessionRouter::EndSession(const SessionId sessionId)
+{
+    const auto session = Find(sessionId);
+    if (session != sessions.end() && session->sessionId == sessionId)
+        sessions.erase(session);
+}
+
+void SessionRouter::EndAll()
+{
+    sessions.clear();
+}
+
+std::vector<SessionRouter::Session>::iterator SessionRouter::Find(const SessionId sessionId)
+{
+    return std::lower_bound(sessions.begin(), sessions.end(), sessionId, [](const Session& session, const SessionId id)
+    {
+        return session.sessionId < id;
+    });
+}
+
+void SessionRouter::RetireIdle(const uint64_t now)
+{
+    if (idleTimeoutMs == 0)
+        return;
+
+    sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [&](const Session& session)
+    {
+        return now - session.lastEvent >= idleTimeoutMs;
+    }), sessions.end());
+}
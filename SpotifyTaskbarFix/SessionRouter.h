@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ProcessStartEvent.h"
+
+// Fixes the windows of one session; in the service, a process of ours
+// running in that session, on that session's desktop.
+class SessionWorker
+{
+public:
+    virtual ~SessionWorker() = default;
+
+    // Returns false if the worker is gone.
+    virtual bool Deliver(const ProcessStartEvent& event) = 0;
+};
+
+// Where sessions and their workers come from. Win32SessionBackend starts a
+// copy of ourselves in the session; SimulatedSessionBackend only keeps score.
+class SessionBackend
+{
+public:
+    virtual ~SessionBackend() = default;
+
+    // 0 if the process is gone.
+    virtual SessionId SessionOf(ProcessId processId) = 0;
+    // nullptr if nobody is logged on to the session, or the worker couldn't be started.
+    virtual std::unique_ptr<SessionWorker> StartWorker(SessionId sessionId) = 0;
+};
+
+// The service's half of the fix: one WMI subscription for the whole machine,
+// and every start event handed to the worker of the session it happened in.
+// Workers are only started by the first event of their session, and stopped
+// on logoff or, without watch mode, once their session has been quiet for a
+// while; an idle session costs nothing but its entry here.
+//
+// Not thread-safe, and starting a worker blocks: the service drives it from
+// its event loop, never from the WMI thread.
+class SessionRouter
+{
+public:
+    // With `idleTimeoutMs` = 0, workers are only stopped by EndSession.
+    explicit SessionRouter(SessionBackend& backend, uint32_t idleTimeoutMs = 0) : backend(backend), idleTimeoutMs(idleTimeoutMs) {}
+
+    // `now` in ms, on any monotonic clock. Returns false if the event was dropped.
+    bool Route(const ProcessStartEvent& event, uint64_t now);
+
+    // Logoff: the session's worker, if any, is stopped.
+    void EndSession(SessionId sessionId);
+    void EndAll();
+
+    size_t ActiveSessions() const { return sessions.size(); }
+    uint64_t Routed() const { return routed; }
+    // Events from session 0, or from processes that were gone before we knew their session
+    uint64_t Unroutable() const { return unroutable; }
+    uint64_t WorkersStarted() const { return workersStarted; }
+    uint64_t WorkerFailures() const { return workerFailures; }
+
+private:
+    typedef struct {
+        SessionId sessionId;
+        uint64_t lastEvent;
+        std::unique_ptr<SessionWorker> worker;
+    } Session;
+
+    std::vector<Session>::iterator Find(SessionId sessionId);
+    void RetireIdle(uint64_t now);
+
+    SessionBackend& backend;
+    const uint32_t idleTimeoutMs;
+
+    // Sorted by session ID; there are only ever a handful
+    std::vector<Session> sessions;
+
+    uint64_t routed = 0;
+    uint64_t unroutable = 0;
+    uint64_t workersStarted = 0;
+    uint64_t workerFailures = 0;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+// A named region of memory that other processes can map too. The creator
+// owns the name: the region goes away with it, or with the last process that
+// still has it mapped. Platform regions only implement creating, opening and
+// unmapping it.
+class SharedMemory
+{
+public:
+    virtual ~SharedMemory() = default;
+
+    // Zero-filled. Fails if a region of that name already exists.
+    virtual bool Create(const char* name, size_t size) = 0;
+    // Read-write; fails if there's no such region, or if it's smaller than `size`.
+    virtual bool Open(const char* name, size_t size) = 0;
+    virtual void Close() = 0;
+
+    void* Data() const { return data; }
+    size_t Size() const { return size; }
+
+protected:
+    void* data = nullptr;
+    size_t size = 0;
+};
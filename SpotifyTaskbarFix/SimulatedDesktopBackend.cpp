@@ -0,0 +1,493 @@
+#include "SimulatedDesktopBackend.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+    size_t CopyString(const std::wstring& source, wchar_t* const buffer, const size_t bufferLength)
+    {
+        if (bufferLength == 0)
+            return 0;
+
+        const size_t length = std::min(source.size(), bufferLength - 1);
+        source.copy(buffer, length);
+        buffer[length] = L'\0';
+        return length;
+    }
+}
+
+
+// =================
+//     SCRIPTING
+// =================
+
+void SimulatedDesktopBackend::AddProcess(const ProcessId processId, const ProcessId parentProcessId, const std::wstring& imageName, const std::wstring& commandLine)
+{
+    Process& process = processes[processId];
+    process.parentProcessId = parentProcessId;
+    process.imageName = imageName;
+    process.commandLine = commandLine;
+    process.inputIdle = false;
+    process.windowEvents = 0;
+}
+
+void SimulatedDesktopBackend::AddThread(const ProcessId processId, const ThreadId threadId)
+{
+    processes[processId].threads.push_back(threadId);
+    threadOwners[threadId] = processId;
+}
+
+void SimulatedDesktopBackend::SetProcessVersion(const ProcessId processId, const std::wstring& version)
+{
+    processes[processId].version = version;
+}
+
+void SimulatedDesktopBackend::SetInputIdleAt(const uint64_t time, const ProcessId processId)
+{
+    Schedule(time, { ActionType::InputIdle, NULL_WINDOW, processId, 0, {} });
+}
+
+WindowHandle SimulatedDesktopBackend::CreateWindowAt(const uint64_t time, const ThreadId threadId, const WindowHandle parent,
+                                                     const std::wstring& className, const std::wstring& title,
+                                                     const uint32_t style, const WindowRect& rect)
+{
+    const WindowHandle hWnd = nextHandle;
+    nextHandle += 4;
+
+    Window& window = windows[hWnd];
+    window.threadId = threadId;
+    window.parent = parent;
+    window.className = className;
+    window.title = title;
+
+    std::wstring atomName(className);
+    for (wchar_t& c : atomName)
+        c = static_cast<wchar_t>(std::towlower(c));
+    // Like RegisterClass atoms, numbered from 0xC000
+    window.atom = classAtoms.emplace(atomName, static_cast<ClassAtom>(0xC000 + classAtoms.size())).first->second;
+
+    window.style = style;
+    window.exStyle = 0;
+    window.rect = rect;
+    window.created = false;
+
+    Schedule(time, { ActionType::Create, hWnd, 0, 0, {} });
+    return hWnd;
+}
+
+void SimulatedDesktopBackend::SetStyleAt(const uint64_t time, const WindowHandle hWnd, const uint32_t style)
+{
+    Schedule(time, { ActionType::SetStyle, hWnd, 0, style, {} });
+}
+
+void SimulatedDesktopBackend::SetTitleAt(const uint64_t time, const WindowHandle hWnd, const std::wstring& title)
+{
+    Schedule(time, { ActionType::SetTitle, hWnd, 0, 0, title });
+}
+
+void SimulatedDesktopBackend::AddMonitor(const MonitorInfo& monitor)
+{
+    monitors.push_back(monitor);
+}
+
+void SimulatedDesktopBackend::RemoveMonitors()
+{
+    monitors.clear();
+}
+
+void SimulatedDesktopBackend::AdvanceTo(const uint64_t time)
+{
+    while (!timeline.empty() && timeline.begin()->first <= time)
+    {
+        const auto it = timeline.begin();
+        now = std::max(now, it->first);
+        const Action action = it->second;
+        timeline.erase(it);
+        Apply(action);
+    }
+    now = std::max(now, time);
+}
+
+void SimulatedDesktopBackend::Schedule(const uint64_t time, const Action& action)
+{
+    if (time <= now)
+        Apply(action);
+    else
+        timeline.emplace(time, action);
+}
+
+void SimulatedDesktopBackend::Apply(const Action& action)
+{
+    switch (action.type)
+    {
+        case ActionType::Create:
+        {
+            Window* window = Find(action.hWnd);
+            if (window == nullptr || window->created)
+                break;
+
+            window->created = true;
+            if (window->parent == NULL_WINDOW)
+                topLevelWindows[window->threadId].push_back(action.hWnd);
+            else if (Window* parent = Find(window->parent))
+                parent->children.push_back(action.hWnd);
+            RaiseWindowEvent(*window);
+            break;
+        }
+
+        case ActionType::SetStyle:
+            if (Window* window = Find(action.hWnd))
+            {
+                window->style = action.value;
+                RaiseWindowEvent(*window);
+            }
+            break;
+
+        case ActionType::SetTitle:
+            if (Window* window = Find(action.hWnd))
+            {
+                window->title = action.text;
+                RaiseWindowEvent(*window);
+            }
+            break;
+
+        case ActionType::InputIdle:
+            processes[action.processId].inputIdle = true;
+            break;
+    }
+}
+
+SimulatedDesktopBackend::Window* SimulatedDesktopBackend::Find(const WindowHandle hWnd)
+{
+    const auto it = windows.find(hWnd);
+    return it != windows.end() ? &it->second : nullptr;
+}
+
+void SimulatedDesktopBackend::RaiseWindowEvent(const Window& window)
+{
+    if (!window.created)
+        return;
+
+    const auto owner = threadOwners.find(window.threadId);
+    if (owner != threadOwners.end())
+        processes[owner->second].windowEvents++;
+    windowEvents++;
+}
+
+
+// ======================
+//     DesktopBackend
+// ======================
+
+uint64_t SimulatedDesktopBackend::Now()
+{
+    return now;
+}
+
+void SimulatedDesktopBackend::Sleep(const uint32_t ms)
+{
+    counters.syscalls++;
+    AdvanceTo(now + ms);
+}
+
+bool SimulatedDesktopBackend::GetProcessImageName(const ProcessId processId, std::wstring& imageName)
+{
+    counters.syscalls += 3;
+    const auto process = processes.find(processId);
+    if (process == processes.end())
+        return false;
+
+    imageName = process->second.imageName;
+    return true;
+}
+
+bool SimulatedDesktopBackend::GetProcessCommandLine(const ProcessId processId, std::wstring& commandLine)
+{
+    counters.syscalls += 4;
+    const auto process = processes.find(processId);
+    if (process == processes.end())
+        return false;
+
+    commandLine = process->second.commandLine;
+    return true;
+}
+
+bool SimulatedDesktopBackend::GetProcessImageVersion(const ProcessId processId, std::wstring& version)
+{
+    // The image path, then GetFileVersionInfoSize, GetFileVersionInfo and VerQueryValue
+    counters.syscalls += 6;
+    const auto process = processes.find(processId);
+    if (process == processes.end() || process->second.version.empty())
+        return false;
+
+    version = process->second.version;
+    return true;
+}
+
+bool SimulatedDesktopBackend::WaitForInputIdle(const ProcessId processId, const uint32_t timeoutMs)
+{
+    counters.syscalls += 3;
+    const auto process = processes.find(processId);
+    if (process == processes.end())
+        return false;
+
+    const uint64_t deadline = now + timeoutMs;
+    while (!process->second.inputIdle && !timeline.empty() && timeline.begin()->first <= deadline)
+        AdvanceTo(timeline.begin()->first);
+
+    if (!process->second.inputIdle)
+        AdvanceTo(deadline);
+    return process->second.inputIdle;
+}
+
+void SimulatedDesktopBackend::EnumSystemThreads(const SystemThreadCallback& callback)
+{
+    counters.syscalls += 2;
+    for (const auto& process : processes)
+    {
+        for (const ThreadId threadId : process.second.threads)
+            callback(process.first, threadId);
+    }
+}
+
+void SimulatedDesktopBackend::EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback)
+{
+    counters.syscalls += 2;
+    for (const auto& process : processes)
+        processCallback(process.first, process.second.parentProcessId, process.second.imageName.c_str());
+    for (const auto& process : processes)
+    {
+        for (const ThreadId threadId : process.second.threads)
+            threadCallback(process.first, threadId);
+    }
+}
+
+void SimulatedDesktopBackend::EnumWindowThreads(const ProcessId processId, const ThreadCallback& callback)
+{
+    // EnumWindows, plus GetWindowThreadProcessId for every top-level window
+    counters.syscalls++;
+    for (const auto& threadWindows : topLevelWindows)
+        counters.syscalls += threadWindows.second.size();
+
+    const auto process = processes.find(processId);
+    if (process == processes.end())
+        return;
+
+    for (const ThreadId threadId : process->second.threads)
+    {
+        const auto it = topLevelWindows.find(threadId);
+        if (it != topLevelWindows.end() && !it->second.empty())
+            callback(threadId);
+    }
+}
+
+void SimulatedDesktopBackend::EnumThreadWindows(const ThreadId threadId, const WindowCallback& callback)
+{
+    counters.syscalls++;
+    const auto it = topLevelWindows.find(threadId);
+    if (it == topLevelWindows.end())
+        return;
+
+    // Copy: the callback is allowed to advance the clock, which may create windows.
+    const std::vector<WindowHandle> handles = it->second;
+    for (const WindowHandle hWnd : handles)
+    {
+        if (!callback(hWnd))
+            return;
+    }
+}
+
+void SimulatedDesktopBackend::EnumChildWindows(const WindowHandle hWnd, const WindowCallback& callback)
+{
+    counters.syscalls++;
+    if (const Window* window = Find(hWnd))
+        EnumChildWindowsRecursive(*window, callback);
+}
+
+bool SimulatedDesktopBackend::EnumChildWindowsRecursive(const Window& window, const WindowCallback& callback)
+{
+    // Like the real thing, this is a depth-first walk over all descendants.
+    const std::vector<WindowHandle> children = window.children;
+    for (const WindowHandle hChild : children)
+    {
+        if (!callback(hChild))
+            return false;
+
+        const Window* child = Find(hChild);
+        if (child != nullptr && !EnumChildWindowsRecursive(*child, callback))
+            return false;
+    }
+    return true;
+}
+
+WindowHandle SimulatedDesktopBackend::FindChildWindow(const WindowHandle hParent, const wchar_t* const className)
+{
+    counters.syscalls++;
+    const Window* parent = Find(hParent);
+    if (parent == nullptr)
+        return NULL_WINDOW;
+
+    // Class names compare like atoms do, regardless of case
+    std::wstring atomName(className);
+    for (wchar_t& c : atomName)
+        c = static_cast<wchar_t>(std::towlower(c));
+    const auto atom = classAtoms.find(atomName);
+    if (atom == classAtoms.end())
+        return NULL_WINDOW;
+
+    for (const WindowHandle hChild : parent->children)
+    {
+        const Window* child = Find(hChild);
+        if (child != nullptr && child->atom == atom->second)
+            return hChild;
+    }
+    return NULL_WINDOW;
+}
+
+WindowHandle SimulatedDesktopBackend::GetParentWindow(const WindowHandle hWnd)
+{
+    counters.syscalls++;
+    const Window* window = Find(hWnd);
+    return window != nullptr && window->created ? window->parent : NULL_WINDOW;
+}
+
+ClassAtom SimulatedDesktopBackend::GetClassAtom(const WindowHandle hWnd)
+{
+    counters.syscalls++;
+    const Window* window = Find(hWnd);
+    return window != nullptr && window->created ? window->atom : NULL_ATOM;
+}
+
+size_t SimulatedDesktopBackend::GetWindowClass(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    counters.syscalls++;
+    const Window* window = Find(hWnd);
+    return CopyString(window != nullptr && window->created ? window->className : std::wstring(), buffer, bufferLength);
+}
+
+size_t SimulatedDesktopBackend::GetWindowTitle(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    counters.syscalls++;
+    counters.crossProcessMessages++;
+    const Window* window = Find(hWnd);
+    return CopyString(window != nullptr && window->created ? window->title : std::wstring(), buffer, bufferLength);
+}
+
+uint32_t SimulatedDesktopBackend::GetStyle(const WindowHandle hWnd)
+{
+    counters.syscalls++;
+    const Window* window = Find(hWnd);
+    return window != nullptr && window->created ? window->style : 0;
+}
+
+uint32_t SimulatedDesktopBackend::GetExStyle(const WindowHandle hWnd)
+{
+    counters.syscalls++;
+    const Window* window = Find(hWnd);
+    return window != nullptr && window->created ? window->exStyle : 0;
+}
+
+WindowRect SimulatedDesktopBackend::GetWindowPosition(const WindowHandle hWnd)
+{
+    counters.syscalls += 3;
+    const Window* window = Find(hWnd);
+    return window != nullptr ? window->rect : WindowRect{ 0, 0, 0, 0 };
+}
+
+bool SimulatedDesktopBackend::SetWindowPosition(const WindowHandle hWnd, const WindowMove& move)
+{
+    counters.syscalls++;
+    counters.crossProcessMessages++;
+    Window* window = Find(hWnd);
+    if (window == nullptr || !window->created)
+        return false;
+
+    WindowRect rect = move.rect;
+    if (!move.resize)
+    {
+        rect.right = rect.left + (window->rect.right - window->rect.left);
+        rect.bottom = rect.top + (window->rect.bottom - window->rect.top);
+    }
+
+    window->rect = rect;
+    moves.push_back({ now, hWnd, rect, move.redraw });
+    return true;
+}
+
+void SimulatedDesktopBackend::EnumMonitors(const MonitorCallback& callback)
+{
+    // EnumDisplayMonitors, plus GetMonitorInfo and GetDpiForMonitor per monitor
+    counters.syscalls += 1 + 2 * monitors.size();
+    for (const MonitorInfo& monitor : monitors)
+        callback(monitor);
+}
+
+BackendCounters SimulatedDesktopBackend::Counters() const
+{
+    return counters;
+}
+
+void SimulatedDesktopBackend::ResetCounters()
+{
+    counters = { 0, 0 };
+}
+
+
+// =========================
+//     WindowEventSource
+// =========================
+
+void SimulatedDesktopBackend::Watch(ProcessId)
+{
+    // Events are always tracked for every simulated process.
+}
+
+void SimulatedDesktopBackend::Unwatch(ProcessId)
+{
+}
+
+uint64_t SimulatedDesktopBackend::Sequence(const ProcessId processId)
+{
+    const auto process = processes.find(processId);
+    return process != processes.end() ? process->second.windowEvents : 0;
+}
+
+uint64_t SimulatedDesktopBackend::GlobalSequence()
+{
+    return windowEvents;
+}
+
+bool SimulatedDesktopBackend::WaitForWindowEvent(const ProcessId processId, const uint64_t sequence, const uint32_t timeoutMs)
+{
+    const uint64_t deadline = now + timeoutMs;
+    while (Sequence(processId) == sequence && !timeline.empty() && timeline.begin()->first <= deadline)
+        AdvanceTo(timeline.begin()->first);
+
+    if (Sequence(processId) != sequence)
+        return true;
+
+    AdvanceTo(deadline);
+    return false;
+}
+
+bool SimulatedDesktopBackend::WaitForAnyWindowEvent(const uint64_t sequence, const uint32_t timeoutMs)
+{
+    if (windowEvents != sequence)
+        return true;
+
+    const uint64_t deadline = now + timeoutMs;
+    while (windowEvents == sequence && !timeline.empty() && timeline.begin()->first <= deadline)
+        AdvanceTo(timeline.begin()->first);
+
+    if (windowEvents != sequence)
+        return true;
+
+    AdvanceTo(deadline);
+    return false;
+}
+
+void SimulatedDesktopBackend::Interrupt()
+{
+    // Single-threaded: there is never anyone else waiting.
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DesktopBackend.h"
+#include "WindowEventSource.h"
+
+// A deterministic, in-memory desktop. Processes, threads and windows are
+// scripted up front; window creation, style changes and input-idle are
+// placed on a timeline and applied as the virtual clock advances. Nothing
+// here ever blocks: Sleep and the various waits simply move the clock.
+// It is its own window event source: creating a window or changing its
+// style or title counts as an event for the owning process.
+// Its counters charge every call the way Win32DesktopBackend would.
+class SimulatedDesktopBackend final : public DesktopBackend, public WindowEventSource
+{
+public:
+    typedef struct {
+        uint64_t time;
+        WindowHandle hWnd;
+        WindowRect rect;
+        bool redraw;
+    } MoveRecord;
+
+    // SCRIPTING
+    void AddProcess(ProcessId processId, ProcessId parentProcessId, const std::wstring& imageName, const std::wstring& commandLine = L"");
+    void AddThread(ProcessId processId, ThreadId threadId);
+    // Without one, the version of the process's executable is unknown.
+    void SetProcessVersion(ProcessId processId, const std::wstring& version);
+    void SetInputIdleAt(uint64_t time, ProcessId processId);
+
+    // Windows are created hidden-or-not according to `style`; a parent of NULL_WINDOW makes a top-level window.
+    WindowHandle CreateWindowAt(uint64_t time, ThreadId threadId, WindowHandle parent,
+                                const std::wstring& className, const std::wstring& title,
+                                uint32_t style, const WindowRect& rect);
+    void SetStyleAt(uint64_t time, WindowHandle hWnd, uint32_t style);
+    void SetTitleAt(uint64_t time, WindowHandle hWnd, const std::wstring& title);
+
+    // Without any monitor, the topology is unknown to the fix logic.
+    void AddMonitor(const MonitorInfo& monitor);
+    // Unplugs them all; together with AddMonitor, a docking station.
+    void RemoveMonitors();
+
+    // Moves the clock forward, applying every timeline entry scheduled up to `time`.
+    void AdvanceTo(uint64_t time);
+
+    const std::vector<MoveRecord>& Moves() const { return moves; }
+
+    // DesktopBackend
+    uint64_t Now() override;
+    void Sleep(uint32_t ms) override;
+
+    bool GetProcessImageName(ProcessId processId, std::wstring& imageName) override;
+    bool GetProcessCommandLine(ProcessId processId, std::wstring& commandLine) override;
+    bool GetProcessImageVersion(ProcessId processId, std::wstring& version) override;
+
+    bool WaitForInputIdle(ProcessId processId, uint32_t timeoutMs) override;
+    void EnumSystemThreads(const SystemThreadCallback& callback) override;
+    void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) override;
+    void EnumWindowThreads(ProcessId processId, const ThreadCallback& callback) override;
+
+    void EnumThreadWindows(ThreadId threadId, const WindowCallback& callback) override;
+    void EnumChildWindows(WindowHandle hWnd, const WindowCallback& callback) override;
+    WindowHandle FindChildWindow(WindowHandle hParent, const wchar_t* className) override;
+    WindowHandle GetParentWindow(WindowHandle hWnd) override;
+
+    ClassAtom GetClassAtom(WindowHandle hWnd) override;
+    size_t GetWindowClass(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+    size_t GetWindowTitle(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+
+    uint32_t GetStyle(WindowHandle hWnd) override;
+    uint32_t GetExStyle(WindowHandle hWnd) override;
+
+    WindowRect GetWindowPosition(WindowHandle hWnd) override;
+    bool SetWindowPosition(WindowHandle hWnd, const WindowMove& move) override;
+
+    void EnumMonitors(const MonitorCallback& callback) override;
+
+    // A single timeline, scripted and driven from one thread
+    bool Concurrent() const override { return false; }
+
+    BackendCounters Counters() const override;
+    void ResetCounters() override;
+
+    // WindowEventSource
+    void Watch(ProcessId processId) override;
+    void Unwatch(ProcessId processId) override;
+
+    uint64_t Sequence(ProcessId processId) override;
+    uint64_t GlobalSequence() override;
+
+    bool WaitForWindowEvent(ProcessId processId, uint64_t sequence, uint32_t timeoutMs) override;
+    bool WaitForAnyWindowEvent(uint64_t sequence, uint32_t timeoutMs) override;
+
+    void Interrupt() override;
+
+private:
+    typedef struct {
+        ProcessId parentProcessId;
+        std::wstring imageName;
+        std::wstring commandLine;
+        std::wstring version;
+        std::vector<ThreadId> threads;
+        bool inputIdle;
+        uint64_t windowEvents;
+    } Process;
+
+    typedef struct {
+        ThreadId threadId;
+        WindowHandle parent;
+        std::wstring className;
+        ClassAtom atom;
+        std::wstring title;
+        uint32_t style;
+        uint32_t exStyle;
+        WindowRect rect;
+        bool created;
+        std::vector<WindowHandle> children;
+    } Window;
+
+    enum class ActionType { Create, SetStyle, SetTitle, InputIdle };
+
+    typedef struct {
+        ActionType type;
+        WindowHandle hWnd;
+        ProcessId processId;
+        uint32_t value;
+        std::wstring text;
+    } Action;
+
+    void Schedule(uint64_t time, const Action& action);
+    void Apply(const Action& action);
+    Window* Find(WindowHandle hWnd);
+    void RaiseWindowEvent(const Window& window);
+    bool EnumChildWindowsRecursive(const Window& window, const WindowCallback& callback);
+
+    uint64_t now = 0;
+    uint64_t windowEvents = 0;
+    WindowHandle nextHandle = 0x10000;
+
+    std::unordered_map<ProcessId, Process> processes;
+    std::unordered_map<ThreadId, ProcessId> threadOwners;
+    std::unordered_map<WindowHandle, Window> windows;
+    std::unordered_map<ThreadId, std::vector<WindowHandle>> topLevelWindows;
+
+    // Ordered by time, then by insertion order for entries with equal time.
+    std::multimap<uint64_t, Action> timeline;
+
+    std::vector<MoveRecord> moves;
+    std::vector<MonitorInfo> monitors;
+
+    // Keyed by the lower-cased class name, like the system's atom table
+    std::unordered_map<std::wstring, ClassAtom> classAtoms;
+    BackendCounters counters = { 0, 0 };
+};
@@ -0,0 +1,79 @@
+#include "SimulatedSessionBackend.h"
+
+namespace
+{
+    const std::vector<ProcessStartEvent> NO_EVENTS;
+}
+
+class SimulatedSessionBackend::Worker final : public SessionWorker
+{
+public:
+    Worker(SimulatedSessionBackend& backend, const SessionId sessionId)
+        : backend(backend), sessionId(sessionId), generation(backend.sessions[sessionId].generation)
+    {
+        backend.runningWorkers++;
+    }
+
+    ~Worker() override
+    {
+        backend.runningWorkers--;
+    }
+
+    bool Deliver(const ProcessStartEvent& event) override
+    {
+        Session& session = backend.sessions[sessionId];
+        if (!session.loggedOn || session.generation != generation)
+            return false;
+
+        session.delivered.push_back(event);
+        return true;
+    }
+
+private:
+    SimulatedSessionBackend& backend;
+    const SessionId sessionId;
+    const uint32_t generation;
+};
+
+
+void SimulatedSessionBackend::SetSession(const ProcessId processId, const SessionId sessionId)
+{
+    processSessions[processId] = sessionId;
+}
+
+void SimulatedSessionBackend::LogOn(const SessionId sessionId)
+{
+    sessions[sessionId].loggedOn = true;
+}
+
+void SimulatedSessionBackend::LogOff(const SessionId sessionId)
+{
+    Session& session = sessions[sessionId];
+    session.loggedOn = false;
+    session.generation++;
+}
+
+void SimulatedSessionBackend::KillWorker(const SessionId sessionId)
+{
+    sessions[sessionId].generation++;
+}
+
+const std::vector<ProcessStartEvent>& SimulatedSessionBackend::Delivered(const SessionId sessionId) const
+{
+    const auto it = sessions.find(sessionId);
+    return it != sessions.end() ? it->second.delivered : NO_EVENTS;
+}
+
+SessionId SimulatedSessionBackend::SessionOf(const ProcessId processId)
+{
+    const auto it = processSessions.find(processId);
+    return it != processSessions.end() ? it->second : 0;
+}
+
+std::unique_ptr<SessionWorker> SimulatedSessionBackend::StartWorker(const SessionId sessionId)
+{
+    const auto it = sessions.find(sessionId);
+    if (it == sessions.end() || !it->second.loggedOn)
+        return nullptr;
+    return std::make_unique<Worker>(*this, sessionId);
+}
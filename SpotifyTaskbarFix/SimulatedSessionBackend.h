@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "SessionRouter.h"
+
+// In-memory sessions for SessionRouter: which process runs where, who's
+// logged on, and what every session's workers have been handed.
+class SimulatedSessionBackend final : public SessionBackend
+{
+public:
+    // SCRIPTING
+    void SetSession(ProcessId processId, SessionId sessionId);
+    void LogOn(SessionId sessionId);
+    void LogOff(SessionId sessionId);
+    // Kills the session's current worker: its next delivery fails.
+    void KillWorker(SessionId sessionId);
+
+    // Everything delivered to the session's workers, in order.
+    const std::vector<ProcessStartEvent>& Delivered(SessionId sessionId) const;
+    size_t RunningWorkers() const { return runningWorkers; }
+
+    // SessionBackend
+    SessionId SessionOf(ProcessId processId) override;
+    std::unique_ptr<SessionWorker> StartWorker(SessionId sessionId) override;
+
+private:
+    typedef struct {
+        bool loggedOn;
+        // Bumped by KillWorker; workers of an older generation are dead
+        uint32_t generation;
+        std::vector<ProcessStartEvent> delivered;
+    } Session;
+
+    class Worker;
+
+    std::unordered_map<ProcessId, SessionId> processSessions;
+    std::unordered_map<SessionId, Session> sessions;
+    size_t runningWorkers = 0;
+};
@@ -0,0 +1,308 @@
+// Feeds millions of synthetic process start events through the same ingestion
+// path as WMI's (ProcessEventBatcher, then the scheduler's batched Submit) into
+// FixScheduler on SimulatedDesktopBackend, the virtual clock running for more than a day.
+// Checks that memory and handle counts stay flat once it's warmed up: live heap
+// allocations, resident memory and open handles are sampled every 10% of the run.
+// Builds and runs anywhere.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "Psapi.lib")
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "FixScheduler.h"
+#include "Log.h"
+#include "ProcessEventBatcher.h"
+#include "SimulatedDesktopBackend.h"
+
+using namespace std;
+
+// Every allocation the program makes goes through these: the difference is what's still alive.
+namespace
+{
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> deallocations{ 0 };
+}
+
+void* operator new(const size_t size)
+{
+    void* const p = malloc(size > 0 ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return p;
+}
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* const p) noexcept
+{
+    if (p == nullptr)
+        return;
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    free(p);
+}
+
+void operator delete[](void* const p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* const p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* const p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+namespace
+{
+    constexpr ProcessId MAIN_PROCESS_ID = 1000;
+    constexpr size_t HELPERS = 64;
+    // Deliveries are 1 to this many objects, like an Indicate under load
+    constexpr size_t MAX_DELIVERY = 64;
+    // Virtual time between two deliveries: with the default event count, more than a day goes by
+    constexpr uint32_t DELIVERY_INTERVAL_MS = 2000;
+    constexpr int SAMPLES = 10;
+
+    // How much growth is tolerated past warm-up. Heap allocations: none but a
+    // few hash table buckets; resident memory: a little allocator slack.
+    constexpr int64_t MAX_LIVE_ALLOCATION_GROWTH = 64;
+    constexpr int64_t MAX_RESIDENT_GROWTH_BYTES = 1024 * 1024;
+
+    // What the sink would find in one of WMI's objects
+    typedef struct {
+        ProcessId processId;
+        ProcessId parentProcessId;
+        const wchar_t* processName;
+        SessionId sessionId;
+        // Without a ProcessID, say; it gets skipped
+        bool readable;
+    } SyntheticObject;
+
+    typedef struct {
+        uint64_t events;
+        int64_t liveAllocations;
+        int64_t residentBytes;
+        int64_t handles;
+    } Sample;
+
+    // Numerical Recipes' LCG: deterministic, and no allocation
+    uint32_t Next(uint32_t& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    int64_t ResidentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof counters))
+            return 0;
+        return static_cast<int64_t>(counters.PrivateUsage);
+#else
+        FILE* const statm = fopen("/proc/self/statm", "r");
+        if (statm == nullptr)
+            return 0;
+        long size = 0;
+        long resident = 0;
+        const bool read = fscanf(statm, "%ld %ld", &size, &resident) == 2;
+        fclose(statm);
+        return read ? static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE) : 0;
+#endif
+    }
+
+    int64_t Handles()
+    {
+#ifdef _WIN32
+        DWORD count = 0;
+        GetProcessHandleCount(GetCurrentProcess(), &count);
+        return count;
+#else
+        // The directory's own descriptor included, every time
+        DIR* const fds = opendir("/proc/self/fd");
+        if (fds == nullptr)
+            return 0;
+        int64_t count = 0;
+        while (readdir(fds) != nullptr)
+            count++;
+        closedir(fds);
+        return count;
+#endif
+    }
+
+    Sample TakeSample(const uint64_t events)
+    {
+        const int64_t live = static_cast<int64_t>(allocations.load() - deallocations.load());
+        return { events, live, ResidentBytes(), Handles() };
+    }
+
+    // One Spotify that's already up, its window on the primary monitor so that every
+    // fix leaves it in place, and a pool of helpers whose process IDs keep coming back.
+    void AddSpotify(SimulatedDesktopBackend& desktop)
+    {
+        desktop.AddMonitor({ { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom });
+        desktop.AddMonitor({ { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1040 }, 96, false, TaskbarEdge::Bottom });
+
+        const ThreadId uiThread = MAIN_PROCESS_ID * 16 + 1;
+        desktop.AddProcess(MAIN_PROCESS_ID, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+        desktop.AddThread(MAIN_PROCESS_ID, uiThread);
+        desktop.SetInputIdleAt(0, MAIN_PROCESS_ID);
+
+        const WindowRect rect = { 100, 100, 1300, 900 };
+        desktop.CreateWindowAt(0, uiThread, NULL_WINDOW, L"GDI+ Hook Window Class", L"G", 0, { 0, 0, 0, 0 });
+        const WindowHandle hWnd = desktop.CreateWindowAt(0, uiThread, NULL_WINDOW, L"Chrome_WidgetWin_0", L"Spotify Free", STYLE_VISIBLE | STYLE_SYSMENU, rect);
+        desktop.CreateWindowAt(0, uiThread, hWnd, L"Chrome_RenderWidgetHostHWND", L"", STYLE_VISIBLE, rect);
+
+        for (size_t i = 0; i < HELPERS; i++)
+        {
+            const ProcessId helperId = MAIN_PROCESS_ID + 1 + static_cast<ProcessId>(i);
+            desktop.AddProcess(helperId, MAIN_PROCESS_ID, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer");
+            desktop.AddThread(helperId, helperId * 16);
+        }
+        desktop.AdvanceTo(1);
+    }
+
+    // Mostly helpers, which are rejected or join the settled tree; now and then the main
+    // process again, which is fixed once its previous fix has been forgotten; a few
+    // processes of no app, and a few objects that can't be read.
+    void FillDelivery(uint32_t& random, SyntheticObject* const objects, const size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            SyntheticObject& object = objects[i];
+            const uint32_t kind = Next(random) % 1000;
+            object.sessionId = 1;
+            object.readable = kind >= 20;
+            object.processName = L"Spotify.exe";
+            object.parentProcessId = MAIN_PROCESS_ID;
+            if (kind < 22)
+            {
+                object.processId = MAIN_PROCESS_ID;
+                object.parentProcessId = 1;
+            }
+            else if (kind < 60)
+            {
+                object.processId = 50000 + Next(random) % 10000;
+                object.processName = L"chrome.exe";
+                object.parentProcessId = 1;
+            }
+            else
+            {
+                object.processId = MAIN_PROCESS_ID + 1 + Next(random) % HELPERS;
+            }
+        }
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const long long requested = argc > 1 ? atoll(argv[1]) : 2000000;
+    if (requested <= 0)
+    {
+        fprintf(stderr, "usage: %s [events]\n", argv[0]);
+        return 1;
+    }
+    const uint64_t totalEvents = static_cast<uint64_t>(requested);
+
+    // The fix logic logs every step; none of that is being measured
+    LogConfig quiet = {};
+    Logger::Instance().Start(quiet);
+
+    const RuleSet rules = RuleSet::Default();
+    SimulatedDesktopBackend desktop;
+    AddSpotify(desktop);
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    uint64_t fixes = 0;
+    scheduler.SetCompletionCallback([&](const FixJob& job)
+    {
+        if (job.Result() == FixResult::WindowMoved || job.Result() == FixResult::WindowInPlace)
+            fixes++;
+    });
+
+    ProcessEventBatcher batcher([&](const ProcessStartEvent* const events, const size_t count) { return scheduler.Submit(events, count); });
+
+    SyntheticObject objects[MAX_DELIVERY];
+    uint32_t random = 1;
+    uint64_t delivered = 0;
+    uint64_t deliveries = 0;
+    // The first sample is the baseline, taken once every kind of event has been seen many times over
+    Sample samples[SAMPLES];
+    int sampleCount = 0;
+    const uint64_t sampleInterval = max<uint64_t>(totalEvents / SAMPLES, 1);
+    uint64_t nextSampleAt = sampleInterval;
+
+    const clock_t startedCpu = clock();
+    while (delivered < totalEvents)
+    {
+        const size_t count = static_cast<size_t>(min<uint64_t>(1 + Next(random) % MAX_DELIVERY, totalEvents - delivered));
+        FillDelivery(random, objects, count);
+        batcher.Ingest(count, [&](const size_t i, ProcessStartEvent& record)
+        {
+            const SyntheticObject& object = objects[i];
+            if (!object.readable)
+                return false;
+            record.processId = object.processId;
+            record.parentProcessId = object.parentProcessId;
+            record.sessionId = object.sessionId;
+            size_t length = 0;
+            for (; object.processName[length] != L'\0' && length < PROCESS_NAME_LENGTH - 1; length++)
+                record.processName[length] = object.processName[length];
+            record.processName[length] = L'\0';
+            return true;
+        });
+        delivered += count;
+        deliveries++;
+        scheduler.RunUntil(desktop.Now() + DELIVERY_INTERVAL_MS);
+
+        if (delivered >= nextSampleAt && sampleCount < SAMPLES)
+        {
+            samples[sampleCount++] = TakeSample(delivered);
+            nextSampleAt += sampleInterval;
+        }
+    }
+    scheduler.RunUntilIdle();
+    const double cpuUs = static_cast<double>(clock() - startedCpu) * 1e6 / CLOCKS_PER_SEC;
+
+    printf("%llu events in %llu deliveries, %.1f virtual hours: %llu fixes, %llu skipped, %llu dropped, %llu helpers rejected\n",
+           static_cast<unsigned long long>(delivered), static_cast<unsigned long long>(deliveries), static_cast<double>(desktop.Now()) / 3600000.0,
+           static_cast<unsigned long long>(fixes), static_cast<unsigned long long>(batcher.Skipped()), static_cast<unsigned long long>(batcher.Dropped()),
+           static_cast<unsigned long long>(scheduler.RejectedHelpers()));
+    printf("CPU: %.2f us per event\n", cpuUs / static_cast<double>(delivered));
+    printf("%12s %16s %14s %8s\n", "events", "live allocations", "resident", "handles");
+    for (int i = 0; i < sampleCount; i++)
+    {
+        printf("%12llu %16lld %11lld KB %8lld\n", static_cast<unsigned long long>(samples[i].events), static_cast<long long>(samples[i].liveAllocations),
+               static_cast<long long>(samples[i].residentBytes / 1024), static_cast<long long>(samples[i].handles));
+    }
+
+    const Sample& baseline = samples[0];
+    const Sample& last = samples[sampleCount - 1];
+    const bool flatHeap = last.liveAllocations - baseline.liveAllocations <= MAX_LIVE_ALLOCATION_GROWTH;
+    const bool flatResident = last.residentBytes - baseline.residentBytes <= MAX_RESIDENT_GROWTH_BYTES;
+    const bool flatHandles = last.handles == baseline.handles;
+    printf("heap %s, resident memory %s, handles %s\n", flatHeap ? "flat" : "GROWING", flatResident ? "flat" : "GROWING", flatHandles ? "flat" : "GROWING");
+
+    Logger::Instance().Stop();
+    return flatHeap && flatResident && flatHandles && fixes > 0 ? 0 : 1;
+}
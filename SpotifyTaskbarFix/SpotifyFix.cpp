@@ -0,0 +1,215 @@
+#include "SpotifyFix.h"
+#include "FixJob.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+using namespace std;
+using namespace std::chrono;
+
+
+FixResult FixTaskbarIssue(DesktopBackend& desktop, WindowEventSource* events, const RuleSet& rules, const size_t app, const ProcessId processId)
+{
+    FixJob job(desktop, events, rules, app, processId, FixedWaitSchedule());
+    while (true)
+    {
+        const uint64_t sequence = events != nullptr ? events->GlobalSequence() : 0;
+        if (job.Step())
+            return job.Result();
+
+        const uint64_t now = desktop.Now();
+        const auto wait = static_cast<uint32_t>(job.WakeAt() > now ? job.WakeAt() - now : 0);
+        if (events != nullptr)
+            events->WaitForAnyWindowEvent(sequence, wait);
+        else
+            desktop.Sleep(wait);
+    }
+}
+
+void FindAppMainWindow(DesktopBackend& desktop, ClassAtomCache& classes, const size_t app, const std::vector<ThreadId>& threads, FindMainWindowResult* const result)
+{
+    result->hPWnd = NULL_WINDOW;
+    result->hWnd = NULL_WINDOW;
+    result->isMainProcess = false;
+    result->threadId = 0;
+
+    // Enumerate each of the process's threads' windows, until one of them has the main window
+    for (const ThreadId threadId : threads)
+    {
+        ThreadWindowsResult threadResult;
+        FindAppMainWindowOfThread(desktop, classes, app, threadId, nullptr, nullptr, &threadResult);
+        result->isMainProcess |= threadResult.isMainProcess;
+        if (threadResult.hPWnd != NULL_WINDOW)
+        {
+            result->hPWnd = threadResult.hPWnd;
+            result->hWnd = threadResult.hWnd;
+            result->threadId = threadId;
+            break;
+        }
+    }
+}
+
+bool FindAppMainWindowByHint(DesktopBackend& desktop, ClassAtomCache& classes, const size_t app, const std::vector<ThreadId>& threads,
+                             const WindowHint& hint, FindMainWindowResult* const result)
+{
+    if (hint.threadOrdinal >= threads.size())
+        return false;
+
+    ThreadWindowsResult threadResult;
+    FindAppMainWindowOfThread(desktop, classes, app, threads[hint.threadOrdinal], &hint, nullptr, &threadResult);
+    if (threadResult.hPWnd == NULL_WINDOW || threadResult.hWnd == NULL_WINDOW)
+        return false;
+
+    result->hPWnd = threadResult.hPWnd;
+    result->hWnd = threadResult.hWnd;
+    result->isMainProcess = true;
+    result->threadId = threads[hint.threadOrdinal];
+    return true;
+}
+
+bool DescribeAppMainWindow(DesktopBackend& desktop, const std::vector<ThreadId>& threads, const FindMainWindowResult& result, WindowHint* const hint)
+{
+    const auto thread = std::find(threads.begin(), threads.end(), result.threadId);
+    if (result.hPWnd == NULL_WINDOW || result.hWnd == NULL_WINDOW || thread == threads.end())
+        return false;
+
+    hint->threadOrdinal = static_cast<uint32_t>(thread - threads.begin());
+    hint->classPath.clear();
+
+    // Up from the content window, which may be the main window itself
+    for (WindowHandle hWnd = result.hWnd; hWnd != result.hPWnd; hWnd = desktop.GetParentWindow(hWnd))
+    {
+        wchar_t className[256];
+        if (hWnd == NULL_WINDOW || hint->classPath.size() == MAX_HINT_DEPTH || desktop.GetWindowClass(hWnd, className, 256) == 0)
+            return false;
+        hint->classPath.emplace_back(className);
+    }
+    std::reverse(hint->classPath.begin(), hint->classPath.end());
+    return true;
+}
+
+void FindAppMainWindowOfThread(DesktopBackend& desktop, ClassAtomCache& classes, const size_t app, const ThreadId threadId,
+                               const WindowHint* const hint, const std::function<bool()>* const abandon, ThreadWindowsResult* const result)
+{
+    result->hPWnd = NULL_WINDOW;
+    result->hWnd = NULL_WINDOW;
+    result->isMainProcess = false;
+    result->abandoned = false;
+
+    const bool hasContentRule = classes.Rules().App(app).hasContentRule;
+
+    // The title is fetched at most once per window, and only once a rule needs it
+    typedef struct {
+        wchar_t text[256];
+        bool fetched;
+    } LazyTitle;
+
+    const auto matchTitle = [&](const WindowHandle hWnd, const WindowRule& rule, LazyTitle& title)
+    {
+        if (rule.titleMatch == TitleMatch::Any)
+            return true;
+
+        if (!title.fetched)
+        {
+            desktop.GetWindowTitle(hWnd, title.text, 256);
+            title.fetched = true;
+        }
+        return RuleSet::MatchTitle(rule, title.text);
+    };
+
+    const auto abandoned = [&]
+    {
+        if (abandon != nullptr && (*abandon)())
+            result->abandoned = true;
+        return result->abandoned;
+    };
+
+    // Built once, rather than once per EnumChildWindows call
+    const DesktopBackend::WindowCallback enumChildWindows = [&](const WindowHandle hWnd)
+    {
+        if (abandoned())
+            return false;
+
+        const std::vector<WindowRule>* classRules = classes.Match(desktop, hWnd);
+        if (classRules == nullptr)
+            return true;
+
+        LazyTitle title;
+        title.fetched = false;
+        for (const WindowRule& rule : *classRules)
+        {
+            if (rule.app == app && rule.role == WindowRole::Content && matchTitle(hWnd, rule, title))
+            {
+                result->hWnd = hWnd;
+                return false;
+            }
+        }
+        return true;
+    };
+
+    desktop.EnumThreadWindows(threadId, [&](const WindowHandle hWnd)
+    {
+        if (abandoned())
+            return false;
+
+        const std::vector<WindowRule>* classRules = classes.Match(desktop, hWnd);
+        if (classRules == nullptr)
+            return true;
+
+        LazyTitle title;
+        title.fetched = false;
+        for (const WindowRule& rule : *classRules)
+        {
+            if (rule.app != app || rule.role == WindowRole::Content || !matchTitle(hWnd, rule, title))
+                continue;
+
+            result->isMainProcess = true;
+            if (rule.role != WindowRole::MainWindow)
+                continue;
+
+            // Without a content rule the top-level window is all there is to wait for
+            if (!hasContentRule)
+                result->hWnd = hWnd;
+            else if (hint == nullptr)
+                desktop.EnumChildWindows(hWnd, enumChildWindows);
+            else if (!hint->classPath.empty())
+            {
+                WindowHandle hChild = hWnd;
+                for (size_t level = 0; level < hint->classPath.size() && hChild != NULL_WINDOW; level++)
+                    hChild = desktop.FindChildWindow(hChild, hint->classPath[level].c_str());
+                if (hChild != NULL_WINDOW)
+                    enumChildWindows(hChild);
+            }
+
+            if (result->hWnd != NULL_WINDOW)
+            {
+                result->hPWnd = hWnd;
+                return false;
+            }
+            if (result->abandoned)
+                return false;
+        }
+        return true;
+    });
+}
+
+
+// =================
+//     FUNCTIONS
+// =================
+
+void GetLocalTime(const system_clock::time_point* const tp, char* const buffer, size_t bufferLength)
+{
+    const auto time = system_clock::to_time_t(*tp);
+    struct tm ptm;
+#ifdef _WIN32
+    localtime_s(&ptm, &time);
+#else
+    localtime_r(&time, &ptm);
+#endif
+
+    const size_t length = std::strftime(buffer, bufferLength, "%H:%M:%S", &ptm);
+    const auto ms = static_cast<unsigned>((tp->time_since_epoch() - duration_cast<seconds>(tp->time_since_epoch())) / milliseconds(1));
+    snprintf(buffer + length, bufferLength - length, ".%03u", ms);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "ClassAtomCache.h"
+#include "DesktopBackend.h"
+#include "Rules.h"
+#include "WaitSchedule.h"
+#include "WindowEventSource.h"
+#include "WindowHintCache.h"
+
+typedef struct {
+    WindowHandle hPWnd;
+    WindowHandle hWnd;
+    bool isMainProcess;
+    // Owns hPWnd; 0 until it's found
+    ThreadId threadId;
+} FindMainWindowResult;
+
+typedef struct {
+    WindowHandle hPWnd;
+    WindowHandle hWnd;
+    // One of the thread's windows marks the app's main process
+    bool isMainProcess;
+    // The search gave up before it was over; the rest says nothing
+    bool abandoned;
+} ThreadWindowsResult;
+
+enum class FixResult
+{
+    Pending,
+    Cancelled,
+    NotMainProcess,
+    MainWindowNotFound,
+    WindowNotVisible,
+    WindowMoved,
+    // Visible, but where its taskbar button can't be wrong
+    WindowInPlace,
+};
+
+
+// Runs a FixJob for a process of the rule set's `app` to completion on the calling thread, with the fixed wait schedule.
+// `events` may be null, in which case every wait falls back to polling.
+FixResult FixTaskbarIssue(DesktopBackend&, WindowEventSource*, const RuleSet&, size_t app, ProcessId);
+
+// A single pass over the threads' top-level windows: each window is matched by class atom
+// first, and its title (a cross-process WM_GETTEXT) is only read if a rule for that class
+// cares about it. Nothing is allocated per window.
+void FindAppMainWindow(DesktopBackend&, ClassAtomCache&, size_t app, const std::vector<ThreadId>&, FindMainWindowResult* const);
+
+// One thread's share of FindAppMainWindow, for WindowSearchPool. `abandon`, if not null,
+// is asked before every window whether the search is still worth finishing. With a `hint`,
+// the content window is only looked for down its class path, one FindChildWindow per level,
+// instead of among every descendant.
+void FindAppMainWindowOfThread(DesktopBackend&, ClassAtomCache&, size_t app, ThreadId, const WindowHint* hint,
+                               const std::function<bool()>* abandon, ThreadWindowsResult* const);
+
+// FindAppMainWindow, but only where `hint` says the windows were: one thread, one path
+// down to the content window. Returns false if they're not both there, in which case
+// `result` says nothing and it takes the full search.
+bool FindAppMainWindowByHint(DesktopBackend&, ClassAtomCache&, size_t app, const std::vector<ThreadId>&, const WindowHint&, FindMainWindowResult* const);
+
+// The hint that leads straight to `result`'s windows among `threads`.
+// Returns false if there's none, e.g. because the content window is too deep.
+bool DescribeAppMainWindow(DesktopBackend&, const std::vector<ThreadId>&, const FindMainWindowResult&, WindowHint* const);
+
+void GetLocalTime(const std::chrono::system_clock::time_point* const, char* const, size_t);
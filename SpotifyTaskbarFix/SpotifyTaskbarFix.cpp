@@ -1,48 +1,175 @@
-#include <chrono>
+#include <atomic>
 #include <csignal>
 #include <iostream>
 #include <iomanip>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <Windows.h>
 #include <WbemIdl.h>
 #include <comutil.h>
-#include <tlhelp32.h>
+#include <timeapi.h>
+#include <WtsApi32.h>
 
+#include "EarlyEventBuffer.h"
 #include "EventSink.h"
+#include "FixScheduler.h"
+#include "LatencyModel.h"
+#include "Log.h"
+#include "RecordingDesktopBackend.h"
+#include "Replay.h"
+#include "SessionRouter.h"
+#include "SpotifyFix.h"
+#include "StartupPipeline.h"
+#include "StatsBlock.h"
+#include "StyleSampler.h"
+#include "SystemSnapshot.h"
+#include "Trace.h"
+#include "Win32DesktopBackend.h"
+#include "Win32EventLoop.h"
+#include "Win32SessionBackend.h"
+#include "Win32SharedMemory.h"
+#include "Win32WindowEventSource.h"
+#include "WindowHintCache.h"
+#include "WindowSearchPool.h"
+
+#pragma comment(lib, "Winmm.lib")
 
 using namespace std;
-using namespace std::chrono;
 
 
-typedef struct {
-    HWND hPWnd;
-    HWND hWnd;
-    bool isMainProcess;
-} FindSpotifyMainWindowResult;
+// ====================
+//     DECLARATIONS
+// ====================
 
+// Console: one desktop, ours. Service: no desktop at all, in session 0; routes
+// process events to a SessionWorker started in the session of each process.
+enum class RunMode { Console, Service, SessionWorker };
 
-constexpr auto WAIT_FOR_INPUT_IDLE_TIMEOUT = 1 * 1000;
-constexpr auto FIND_SPOTIFY_WINDOW_RETRY_TIMEOUT = 5 * 1000;
-constexpr auto WINDOW_VISIBLE_TIMEOUT = 10 * 1000;
+constexpr const wchar_t* SERVICE_NAME = L"SpotifyTaskbarFix";
+constexpr DWORD SERVICE_WAIT_HINT = 5000;
+// Without -watch, a worker that has had nothing to do for this long is stopped
+constexpr uint32_t SESSION_WORKER_IDLE_TIMEOUT = 10 * 60 * 1000;
 
+// One console instance per session; the service's covers the whole machine, console instances included
+constexpr const wchar_t* INSTANCE_MUTEX_NAME = L"SpotifyTaskbarFix-{150F0728-6840-4C9D-B2EE-DE289EAFE29F}";
+constexpr const wchar_t* SERVICE_MUTEX_NAME = L"Global\\SpotifyTaskbarFix-{150F0728-6840-4C9D-B2EE-DE289EAFE29F}";
 
-// ====================
-//     DECLARATIONS
-// ====================
+// Per session, like the instance that publishes them
+constexpr const char* STATS_BLOCK_NAME = "Local\\SpotifyTaskbarFix-Stats";
+constexpr const char* CONTROL_EVENT_NAME = "Local\\SpotifyTaskbarFix-Control";
+constexpr DWORD CONTROL_COMMAND_TIMEOUT = 2000;
+
+// After WMI drops the subscription, the first attempt to make it again, and the longest wait between attempts
+constexpr uint32_t RESUBSCRIBE_MIN_DELAY = 1000;
+constexpr uint32_t RESUBSCRIBE_MAX_DELAY = 60 * 1000;
+
+// The scheduler's own counters, as of the last statistics update
+typedef struct {
+    uint64_t droppedEvents;
+    uint64_t rejectedHelpers;
+    uint64_t renudges;
+    uint64_t windowHintHits;
+    uint64_t windowHintMisses;
+} SchedulerTotals;
 
 // GLOBAL VARIABLES
 HANDLE hMutex;
 HWND hConsoleWindow;
+RunMode runMode = RunMode::Console;
 bool showConsole = false;
+bool watch = false;
+const char* rulesPath = nullptr;
+const char* tracePath = nullptr;
+const char* logPath = nullptr;
+const char* recordPath = nullptr;
+const char* timelinePath = nullptr;
+Win32DesktopBackend desktop;
+RecordingDesktopBackend recorder(desktop);
+Win32WindowEventSource windowEvents;
+RuleSet rules;
+WindowSearchPool windowSearch;
+LatencyModel latencyModel;
+string latencyPath;
+WindowHintCache windowHints;
+string windowHintsPath;
+// Set by the scheduler's worker after a fix, cleared by whoever writes it all out
+std::atomic<bool> fixDataDirty{ false };
+FixScheduler scheduler(recorder, windowEvents, rules);
+StyleSampler styleSampler(desktop);
+Win32EventLoop eventLoop;
+Win32SessionBackend sessions;
+std::unique_ptr<SessionRouter> router;
+SERVICE_STATUS_HANDLE hServiceStatus;
+
+Win32SharedMemory statsMemory;
+StatsWriter stats;
+SchedulerTotals schedulerTotals = {};
+// Received on the WMI thread, not yet in the statistics
+std::atomic<uint64_t> uncountedEvents{ 0 };
+HANDLE hControlEvent;
+
+// Start events that come in while the fix engine is still starting up
+EarlyEventBuffer earlyEvents;
+uint64_t timeToReadyUs = 0;
+bool comInitialized = false;
+// Whether this startup thread joined COM's apartment, and so has to leave it
+thread_local bool startupThreadInApartment = false;
+IWbemLocator* pLoc = nullptr;
+IWbemServices* pSvc = nullptr;
+IUnsecuredApartment* pUnsecApp = nullptr;
+EventSink* pSink = nullptr;
+IUnknown* pStubUnk = nullptr;
+IWbemObjectSink* pStubSink = nullptr;
+HANDLE hResubscribeTimer = nullptr;
+uint32_t resubscribeDelay = RESUBSCRIBE_MIN_DELAY;
+// Reconciles what started while there was no subscription
+thread recovery;
 
 // FUNCTIONS
-void FixSpotifyTaskbarIssue(DWORD);
-void FindSpotifyMainWindow(const DWORD, FindSpotifyMainWindowResult* const);
-
-void GetLocalTime(const system_clock::time_point* const, char* const, size_t);
-RECT GetWindowPosition(const HWND);
-void PrintWindowStyles(const LONG, const LONG, const LONG, const LONG);
+int Run();
+bool StartProcessEvents();
+bool InitializeCom();
+bool CreateLocator();
+bool ConnectWmi();
+bool CreateSinkStub();
+bool SubscribeProcessEvents();
+void StopProcessEvents();
+void ReleaseProcessEvents();
+void OnProcessEventsFailed(HRESULT hResult);
+void ScheduleResubscription();
+void Resubscribe();
+void WINAPI ServiceMain(DWORD, LPWSTR*);
+DWORD WINAPI ServiceControlHandler(DWORD, DWORD, LPVOID, LPVOID);
+void ReportServiceStatus(DWORD state, DWORD exitCode = NO_ERROR);
+void RouteRunningProcesses();
+wstring WorkerCommandLine();
+void ReadSessionEvents();
+void StartStatistics();
+void StopStatistics();
+void AddSchedulerCounters(Statistics&);
+void OnControlCommand();
+void ReloadRules();
+int PrintStatistics();
+int SendControlCommand(const char* name);
+string ExecutableDirectory();
+string DataDirectory();
+bool StartLogging();
+bool LoadRules(const char* path, RuleSet& loaded);
+int Replay(const char* path);
+int PrintSchedules();
+int ShowTimeline(const char* path);
+void StopTimeline();
+void EnterStartupThread();
+void LeaveStartupThread();
+void OnProcessStarted(const ProcessStartEvent&);
+size_t OnEarlyProcessesStarted(const ProcessStartEvent* events, size_t count);
+size_t OnProcessesStarted(const ProcessStartEvent* events, size_t count);
+void CountReceivedEvents();
+void OnFixCompleted(const FixJob&);
+void SaveFixData();
 
 // INLINE FUNCTIONS
 inline void HideConsole()
@@ -75,11 +202,6 @@ inline void ReadLine()
     getchar();
 }
 
-inline bool HasFlag(LONG bitfield, LONG flag)
-{
-    return (bitfield & flag) != 0;
-}
-
 
 // ============
 //     MAIN
@@ -88,440 +210,1147 @@ inline bool HasFlag(LONG bitfield, LONG flag)
 int main(const int argc, char* argv[]) // NOLINT
 {
     // Parse arguments
+    const char* replayPath = nullptr;
+    const char* controlCommand = nullptr;
+    const char* showTimelinePath = nullptr;
+    bool printSchedules = false;
+    bool printStatistics = false;
     for (int i = 0; i < argc; i++)
     {
         if (strcmp(argv[i], "-w") == 0)
             showConsole = true;
+        else if (strcmp(argv[i], "-rules") == 0 && i + 1 < argc)
+            rulesPath = argv[++i];
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc)
+            logPath = argv[++i];
+        else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (strcmp(argv[i], "-timeline") == 0 && i + 1 < argc)
+            timelinePath = argv[++i];
+        else if (strcmp(argv[i], "-show-timeline") == 0 && i + 1 < argc)
+            showTimelinePath = argv[++i];
+        else if (strcmp(argv[i], "-schedule") == 0)
+            printSchedules = true;
+        else if (strcmp(argv[i], "-stats") == 0)
+            printStatistics = true;
+        else if (strcmp(argv[i], "-control") == 0 && i + 1 < argc)
+            controlCommand = argv[++i];
+        else if (strcmp(argv[i], "-watch") == 0)
+            watch = true;
+        else if (strcmp(argv[i], "-service") == 0)
+            runMode = RunMode::Service;
+        else if (strcmp(argv[i], "-session-worker") == 0)
+            runMode = RunMode::SessionWorker;
+    }
+
+    // Talking to the instance that is already running in this session
+    if (printStatistics)
+        return PrintStatistics();
+    if (controlCommand != nullptr)
+        return SendControlCommand(controlCommand);
+
+    // Decoding a style timeline happens offline, long after it was recorded
+    if (showTimelinePath != nullptr)
+        return ShowTimeline(showTimelinePath);
+
+    // Replaying a recorded launch doesn't touch the desktop: no mutex, no WMI
+    if (replayPath != nullptr)
+    {
+        if (!LoadRules(rulesPath, rules))
+            return 1;
+        return Replay(replayPath);
+    }
+
+    // What the latency model learned so far, and how learned schedules fare against fixed ones
+    latencyPath = DataDirectory() + "SpotifyTaskbarFix.latency";
+    latencyModel.Load(latencyPath);
+    windowHintsPath = DataDirectory() + "SpotifyTaskbarFix.hints";
+    windowHints.Load(windowHintsPath);
+    if (printSchedules)
+    {
+        if (!LoadRules(rulesPath, rules))
+            return 1;
+        return PrintSchedules();
+    }
+
+    // The service control manager runs ServiceMain on a thread of its own, and returns once it's stopped
+    if (runMode == RunMode::Service)
+    {
+        SERVICE_TABLE_ENTRYW serviceTable[] = {
+            { const_cast<LPWSTR>(SERVICE_NAME), ServiceMain },
+            { nullptr, nullptr },
+        };
+        if (!StartServiceCtrlDispatcherW(serviceTable))
+        {
+            cout << "ERROR: -service is for the service control manager; see the README." << endl;
+            return 1;
+        }
+        return 0;
     }
 
     hConsoleWindow = GetConsoleWindow();
     if (!showConsole)
         HideConsole();
 
-    // Signal handling
-    signal(SIGABRT, Abort);
-    signal(SIGINT, Abort);
-    signal(SIGTERM, Abort);
-
-    // Mutex
-    hMutex = CreateMutex(nullptr, TRUE, L"SpotifyTaskbarFix-{150F0728-6840-4C9D-B2EE-DE289EAFE29F}");
-    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    try
     {
-        cout << "ERROR: Program is already running!" << endl;
+        return Run();
+    }
+    catch (const std::exception& e)
+    {
+        cout << "ERROR: Unhandled exception\n    " << e.what() << endl;
         ReadLine();
-        return 1;
+        Abort(1);
     }
+}
 
-    try
+int Run()
+{
+    // Signal handling; Ctrl+C, closing the console and logging off go through the event loop
+    signal(SIGABRT, Abort);
+
+    // Mutex; there's one worker per session, and the service makes sure of that. Unprefixed,
+    // the name is per session: the service's has to be global to be the only one on the machine.
+    if (runMode != RunMode::SessionWorker)
     {
-        // Initialize COM
-        HRESULT hres = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
-        if (FAILED(hres))
+        // With the service running, its worker already fixes this session's windows
+        if (runMode == RunMode::Console)
         {
-            cout << "Failed to initialize COM library. Error code = 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
+            const HANDLE hServiceMutex = OpenMutex(SYNCHRONIZE, FALSE, SERVICE_MUTEX_NAME);
+            if (hServiceMutex != nullptr)
+            {
+                CloseHandle(hServiceMutex);
+                cout << "ERROR: Program is already running as a service!" << endl;
+                ReadLine();
+                return 1;
+            }
         }
 
-        // Set general COM security levels
-        hres = CoInitializeSecurity(
-            nullptr,
-            -1,
-            nullptr,
-            nullptr,
-            RPC_C_AUTHN_LEVEL_DEFAULT,
-            RPC_C_IMP_LEVEL_IMPERSONATE,
-            nullptr,
-            EOAC_NONE,
-            nullptr);
-        if (FAILED(hres))
+        hMutex = CreateMutex(nullptr, TRUE, runMode == RunMode::Service ? SERVICE_MUTEX_NAME : INSTANCE_MUTEX_NAME);
+        if (GetLastError() == ERROR_ALREADY_EXISTS)
         {
-            CoUninitialize();
-
-            cout << "Failed to initialize security. Error code = 0x" << hex << hres << endl;
+            cout << "ERROR: Program is already running!" << endl;
             ReadLine();
             return 1;
         }
+    }
 
-        // Obtain the initial locator to WMI
-        IWbemLocator* pLoc = nullptr;
-        hres = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER, IID_IWbemLocator,
-                                reinterpret_cast<LPVOID*>(&pLoc));
-        if (FAILED(hres))
-        {
-            CoUninitialize();
+    if (!StartLogging())
+        Log(LogLevel::Warning, "Could not open the log file; logging to the console only.");
 
-            cout << "Failed to create IWbemLocator object. Error code = 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
-        }
+    if (!LoadRules(rulesPath, rules))
+    {
+        ReadLine();
+        return 1;
+    }
 
-        // Connect to WMI through the IWbemLocator::ConnectServer method
-        IWbemServices* pSvc = nullptr;
-        hres = pLoc->ConnectServer(_bstr_t(L"ROOT\\CIMV2"), nullptr, nullptr, nullptr, NULL, nullptr, nullptr, &pSvc);
-        if (FAILED(hres))
+    // The service has no desktop to fix anything on: its session workers do the fixing
+    if (runMode == RunMode::Service)
+    {
+        sessions.SetWorkerCommandLine(WorkerCommandLine());
+        router = std::make_unique<SessionRouter>(sessions, watch ? 0 : SESSION_WORKER_IDLE_TIMEOUT);
+    }
+
+    // A session worker gets its events from the service, through its standard input
+    thread eventSource;
+    if (runMode == RunMode::SessionWorker)
+        eventSource = thread(ReadSessionEvents);
+
+    // The rest comes up side by side, the event source first: an app that starts
+    // meanwhile is held in earlyEvents until the fix engine is ready for it, rather
+    // than missed. COM and the event loop belong to this thread.
+    StartupPipeline startup;
+    startup.SetThreadHooks(EnterStartupThread, LeaveStartupThread);
+    vector<StartupPipeline::StepId> engine;
+    if (runMode != RunMode::Service)
+    {
+        // Window events let the fix react as soon as the app's window is ready; without them we just poll
+        engine.push_back(startup.Add("window hooks", []
         {
-            pLoc->Release();
-            CoUninitialize();
+            if (!windowEvents.Start())
+                Log(LogLevel::Warning, "Could not hook window events; falling back to polling.");
+            return true;
+        }));
+        engine.push_back(startup.Add("fix engine", []
+        {
+            scheduler.SetCompletionCallback(OnFixCompleted);
+            scheduler.SetLatencyModel(&latencyModel);
+            scheduler.SetWatchMode(watch);
+            windowSearch.Start();
+            scheduler.SetWindowSearchPool(&windowSearch);
+            scheduler.SetWindowHintCache(&windowHints);
+            scheduler.Start();
+            if (recordPath != nullptr)
+                recorder.StartRecording();
+
+            // Sampling at 1 kHz needs the system timer to tick that often too
+            if (timelinePath != nullptr)
+            {
+                timeBeginPeriod(1);
+                styleSampler.Start();
+            }
+            return true;
+        }));
 
-            cout << "Could not connect. Error code = 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
-        }
+        // Live statistics, for -stats and -control
+        engine.push_back(startup.AddOnCallingThread("statistics", [] { StartStatistics(); return true; }));
+    }
 
-        // Set security levels on the proxy
-        hres = CoSetProxyBlanket(
-            pSvc,
-            RPC_C_AUTHN_WINNT,
-            RPC_C_AUTHZ_NONE,
-            nullptr,
-            RPC_C_AUTHN_LEVEL_CALL,
-            RPC_C_IMP_LEVEL_IMPERSONATE,
-            nullptr,
-            EOAC_NONE);
-        if (FAILED(hres))
-        {
-            pSvc->Release();
-            pLoc->Release();
-            CoUninitialize();
+    StartupPipeline::StepId subscription = 0;
+    if (runMode != RunMode::SessionWorker)
+    {
+        const StartupPipeline::StepId com = startup.AddOnCallingThread("COM", InitializeCom);
+        const StartupPipeline::StepId locator = startup.Add("WMI locator", CreateLocator, { com });
+        const StartupPipeline::StepId connection = startup.Add("WMI connection", ConnectWmi, { locator });
+        const StartupPipeline::StepId sinkStub = startup.Add("event sink", CreateSinkStub, { com });
+        subscription = startup.Add("subscription", SubscribeProcessEvents, { connection, sinkStub });
+    }
 
-            cout << "Could not set proxy blanket. Error code = 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
+    // Nothing to do until the system says something
+    engine.push_back(startup.AddOnCallingThread("event loop", []
+    {
+        if (!eventLoop.Open())
+            Log(LogLevel::Warning, "Could not create the event loop's window; display and session changes will go unnoticed.");
+        eventLoop.On(SystemNotification::DisplayChanged, [] { scheduler.NotifyDisplayChanged(); });
+        eventLoop.On(SystemNotification::SessionChanged, [] { Log(LogLevel::Info, "Session state changed."); });
+        eventLoop.On(SystemNotification::Shutdown, [] { eventLoop.Quit(); });
+
+        // Armed whenever WMI drops the subscription
+        if (runMode != RunMode::SessionWorker)
+        {
+            hResubscribeTimer = CreateWaitableTimerW(nullptr, FALSE, nullptr);
+            if (hResubscribeTimer != nullptr)
+                eventLoop.Watch(hResubscribeTimer, Resubscribe);
         }
+        return true;
+    }));
 
-        // Receive event notifications
-        IUnsecuredApartment* pUnsecApp = nullptr;
-        hres = CoCreateInstance(CLSID_UnsecuredApartment, nullptr, CLSCTX_LOCAL_SERVER, IID_IUnsecuredApartment,
-                                reinterpret_cast<void**>(&pUnsecApp));
-        if (FAILED(hres))
+    const StartupPipeline::StepId engineReady = startup.Add("early events", []
+    {
+        const size_t count = earlyEvents.Open(OnProcessesStarted);
+        if (count > 0)
+            Log(LogLevel::Info, "%zu process event(s) came in during startup.", count);
+        return true;
+    }, engine);
+
+    // Apps that started before we did. The snapshot is taken only now that the
+    // subscription is in place, so that no process can slip between the two
+    // (one seen by both just joins its job), but off the startup path. A session
+    // worker's service already did that for it.
+    thread reconciliation;
+    if (runMode != RunMode::SessionWorker)
+    {
+        startup.Add("reconciliation", [&reconciliation]
         {
-            pSvc->Release();
-            pLoc->Release();
-            pUnsecApp->Release();
-            CoUninitialize();
+            if (runMode == RunMode::Service)
+                reconciliation = thread(RouteRunningProcesses);
+            else
+                reconciliation = thread([] { scheduler.Reconcile(SystemSnapshot::Take(recorder)); });
+            return true;
+        }, { subscription, engineReady });
+    }
 
-            cout << "CoCreateInstance failed with error: 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
+    const bool started = startup.Run();
+    startup.LogSummary();
+    if (!started)
+    {
+        Log(LogLevel::Error, "Could not start: the %s step failed.", startup.FailedStep());
+        if (eventSource.joinable())
+        {
+            CancelSynchronousIo(eventSource.native_handle());
+            eventSource.join();
         }
+        if (reconciliation.joinable())
+            reconciliation.join();
+        scheduler.Stop();
+        SaveFixData();
+        windowSearch.Stop();
+        StopTimeline();
+        windowEvents.Stop();
+        ReleaseProcessEvents();
+        StopStatistics();
+        eventLoop.Close();
+        if (hResubscribeTimer != nullptr)
+            CloseHandle(hResubscribeTimer);
+        ReadLine();
+        return 1;
+    }
+
+    timeToReadyUs = startup.ElapsedUs();
+    stats.Update([](Statistics& s) { s.timeToReadyUs = timeToReadyUs; });
+    Log(LogLevel::Info, "READY! (%.1f ms)", static_cast<double>(timeToReadyUs) / 1000);
+    ReportServiceStatus(SERVICE_RUNNING);
+    eventLoop.Run();
+    Log(LogLevel::Info, "Shutting down...");
+
+    // No more process events, then no more fixes, then no more window events
+    if (runMode == RunMode::SessionWorker)
+        CancelSynchronousIo(eventSource.native_handle());
+    else
+        StopProcessEvents();
+    if (eventSource.joinable())
+        eventSource.join();
+    if (reconciliation.joinable())
+        reconciliation.join();
+    if (recovery.joinable())
+        recovery.join();
+    if (router != nullptr)
+        router->EndAll();
+    scheduler.Stop();
+    SaveFixData();
+    windowSearch.Stop();
+    StopTimeline();
+    windowEvents.Stop();
+    ReleaseProcessEvents();
+    StopStatistics();
+
+    Log(LogLevel::Info, "Event loop woke up %llu times, %llu of which for nothing.",
+        static_cast<unsigned long long>(eventLoop.Wakeups()), static_cast<unsigned long long>(eventLoop.IdleWakeups()));
+    Logger::Instance().Stop();
+
+    if (hMutex != nullptr)
+    {
+        ReleaseMutex(hMutex);
+        CloseHandle(hMutex);
+    }
+    eventLoop.Close();
+    if (hResubscribeTimer != nullptr)
+        CloseHandle(hResubscribeTimer);
+    return 0;
+}
+
+bool StartProcessEvents()
+{
+    // The same steps as at startup, one after the other
+    if (InitializeCom() && CreateLocator() && ConnectWmi() && CreateSinkStub() && SubscribeProcessEvents())
+        return true;
 
-        EventSink* pSink = new EventSink(FixSpotifyTaskbarIssue);
-        pSink->AddRef();
+    ReleaseProcessEvents();
+    return false;
+}
 
-        IUnknown* pStubUnk = nullptr;
-        pUnsecApp->CreateObjectStub(pSink, &pStubUnk);
+bool InitializeCom()
+{
+    // Initialize COM
+    HRESULT hres = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Failed to initialize the COM library (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+    comInitialized = true;
+
+    // Set general COM security levels; only the first time around, if we're subscribing again
+    hres = CoInitializeSecurity(
+        nullptr,
+        -1,
+        nullptr,
+        nullptr,
+        RPC_C_AUTHN_LEVEL_DEFAULT,
+        RPC_C_IMP_LEVEL_IMPERSONATE,
+        nullptr,
+        EOAC_NONE,
+        nullptr);
+    if (FAILED(hres) && hres != RPC_E_TOO_LATE)
+    {
+        Log(LogLevel::Error, "Failed to initialize COM security (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+    return true;
+}
 
-        IWbemObjectSink* pStubSink = nullptr;
-        pStubUnk->QueryInterface(IID_IWbemObjectSink, reinterpret_cast<void**>(&pStubSink));
+bool CreateLocator()
+{
+    // Obtain the initial locator to WMI
+    const HRESULT hres = CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER, IID_IWbemLocator,
+                                          reinterpret_cast<LPVOID*>(&pLoc));
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Failed to create the IWbemLocator object (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+    return true;
+}
 
-        // The ExecNotificationQueryAsync method will call the EventQuery::Indicate method when an event occurs
-        hres = pSvc->ExecNotificationQueryAsync(
-            _bstr_t("WQL"),
-            _bstr_t("SELECT * FROM Win32_ProcessStartTrace WHERE ProcessName = \"Spotify.exe\""),
-            WBEM_FLAG_SEND_STATUS, nullptr, pStubSink);
-        if (FAILED(hres))
-        {
-            pSvc->Release();
-            pLoc->Release();
-            pUnsecApp->Release();
-            pStubUnk->Release();
-            pSink->Release();
-            pStubSink->Release();
-            CoUninitialize();
-
-            cout << "ExecNotificationQueryAsync failed with error: 0x" << hex << hres << endl;
-            ReadLine();
-            return 1;
-        }
+bool ConnectWmi()
+{
+    // Connect to WMI through the IWbemLocator::ConnectServer method; by far the slowest
+    // step at login, when the WMI service may not even be running yet
+    HRESULT hres = pLoc->ConnectServer(_bstr_t(L"ROOT\\CIMV2"), nullptr, nullptr, nullptr, NULL, nullptr, nullptr, &pSvc);
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Could not connect to WMI (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+
+    // Set security levels on the proxy
+    hres = CoSetProxyBlanket(
+        pSvc,
+        RPC_C_AUTHN_WINNT,
+        RPC_C_AUTHZ_NONE,
+        nullptr,
+        RPC_C_AUTHN_LEVEL_CALL,
+        RPC_C_IMP_LEVEL_IMPERSONATE,
+        nullptr,
+        EOAC_NONE);
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Could not set the WMI proxy blanket (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+    return true;
+}
+
+bool CreateSinkStub()
+{
+    // Receive event notifications; this doesn't need the connection, so it's made while it's being established
+    const HRESULT hres = CoCreateInstance(CLSID_UnsecuredApartment, nullptr, CLSCTX_LOCAL_SERVER, IID_IUnsecuredApartment,
+                                          reinterpret_cast<void**>(&pUnsecApp));
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Failed to create the unsecured apartment (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+
+    pSink = new EventSink(OnEarlyProcessesStarted, OnProcessEventsFailed);
+    pSink->AddRef();
+
+    if (FAILED(pUnsecApp->CreateObjectStub(pSink, &pStubUnk)) ||
+        FAILED(pStubUnk->QueryInterface(IID_IWbemObjectSink, reinterpret_cast<void**>(&pStubSink))))
+    {
+        Log(LogLevel::Error, "Could not create the event sink's stub.");
+        return false;
+    }
+    return true;
+}
+
+bool SubscribeProcessEvents()
+{
+    // The ExecNotificationQueryAsync method will call the EventQuery::Indicate method when an event occurs;
+    // a single subscription covers the processes of every app in the rules
+    const HRESULT hres = pSvc->ExecNotificationQueryAsync(
+        _bstr_t("WQL"),
+        _bstr_t(rules.BuildWqlQuery().c_str()),
+        WBEM_FLAG_SEND_STATUS, nullptr, pStubSink);
+    if (FAILED(hres))
+    {
+        Log(LogLevel::Error, "Could not subscribe to process events: ExecNotificationQueryAsync failed (0x%08lX).", static_cast<unsigned long>(hres));
+        return false;
+    }
+    return true;
+}
+
+void StopProcessEvents()
+{
+    if (pSvc != nullptr && pStubSink != nullptr)
+        pSvc->CancelAsyncCall(pStubSink);
+}
+
+void ReleaseProcessEvents()
+{
+    // Whatever the steps that ran got to create; they may have stopped anywhere
+    if (pStubSink != nullptr)
+        pStubSink->Release();
+    if (pStubUnk != nullptr)
+        pStubUnk->Release();
+    if (pSink != nullptr)
+        pSink->Release();
+    if (pUnsecApp != nullptr)
+        pUnsecApp->Release();
+    if (pSvc != nullptr)
+        pSvc->Release();
+    if (pLoc != nullptr)
+        pLoc->Release();
+    if (comInitialized)
+        CoUninitialize();
+
+    pStubSink = nullptr;
+    pStubUnk = nullptr;
+    pSink = nullptr;
+    pUnsecApp = nullptr;
+    pSvc = nullptr;
+    pLoc = nullptr;
+    comInitialized = false;
+}
+
+void EnterStartupThread()
+{
+    // Interfaces made on one of the startup threads are used from the others, and from the
+    // main thread after it's gone: they all share the multithreaded apartment, which stays
+    // up as long as the main thread is in it.
+    startupThreadInApartment = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+}
+
+void LeaveStartupThread()
+{
+    if (startupThreadInApartment)
+        CoUninitialize();
+    startupThreadInApartment = false;
+}
+
+void OnProcessEventsFailed(const HRESULT hResult)
+{
+    // On one of WMI's threads; the event loop does the rest
+    Log(LogLevel::Error, "The process events subscription failed (0x%08lX); subscribing again.", static_cast<unsigned long>(hResult));
+    eventLoop.Post([]
+    {
+        stats.Update([](Statistics& s) { s.subscriptionFailures++; });
+        ScheduleResubscription();
+    });
+}
+
+void ScheduleResubscription()
+{
+    if (hResubscribeTimer == nullptr)
+        return;
+
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -10000LL * resubscribeDelay;
+    SetWaitableTimer(hResubscribeTimer, &dueTime, 0, nullptr, nullptr, FALSE);
+}
 
-        cout << "READY!" << endl;
-        while (true)
+void Resubscribe()
+{
+    // The connection to WMI may have outlived the subscription; if it didn't
+    // (e.g. the service was restarted), it has to be made again too.
+    if (pSvc == nullptr || !SubscribeProcessEvents())
+    {
+        ReleaseProcessEvents();
+        if (!StartProcessEvents())
         {
-            Sleep(1500);
+            Log(LogLevel::Warning, "Could not subscribe to process events; trying again in %u s.", resubscribeDelay / 1000);
+            ScheduleResubscription();
+            resubscribeDelay = resubscribeDelay < RESUBSCRIBE_MAX_DELAY / 2 ? resubscribeDelay * 2 : RESUBSCRIBE_MAX_DELAY;
+            return;
         }
     }
-    catch (const std::exception& e)
+    resubscribeDelay = RESUBSCRIBE_MIN_DELAY;
+    Log(LogLevel::Info, "Subscribed to process events again.");
+
+    // Whatever started in between is only in a snapshot now
+    if (recovery.joinable())
+        recovery.join();
+    if (runMode == RunMode::Service)
+        recovery = thread(RouteRunningProcesses);
+    else
+        recovery = thread([] { scheduler.Reconcile(SystemSnapshot::Take(recorder)); });
+}
+
+
+// ==================
+//     STATISTICS
+// ==================
+
+void StartStatistics()
+{
+    // Another instance in this session (e.g. a session worker next to a console
+    // instance) already publishes its own: that's the one -stats will read.
+    if (!statsMemory.Create(STATS_BLOCK_NAME, sizeof(StatsBlockLayout)))
     {
-        cout << "ERROR: Unhandled exception\n    " << e.what() << endl;
-        ReadLine();
-        Abort(1);
+        Log(LogLevel::Warning, "Could not create the statistics block; -stats and -control won't see this instance.");
+        return;
     }
+    stats.Attach(statsMemory.Data(), GetCurrentProcessId());
+
+    hControlEvent = CreateEventA(nullptr, FALSE, FALSE, CONTROL_EVENT_NAME);
+    if (hControlEvent != nullptr)
+        eventLoop.Watch(hControlEvent, OnControlCommand);
+}
+
+void StopStatistics()
+{
+    stats.Detach();
+    statsMemory.Close();
+    if (hControlEvent != nullptr)
+        CloseHandle(hControlEvent);
+}
+
+void AddSchedulerCounters(Statistics& s)
+{
+    // They only ever grow, and the statistics may have been reset since they started
+    const SchedulerTotals totals = {
+        scheduler.DroppedEvents(), scheduler.RejectedHelpers(), scheduler.Renudges(), windowHints.Hits(), windowHints.Misses()
+    };
+    s.eventsDropped += totals.droppedEvents - schedulerTotals.droppedEvents;
+    s.helpersRejected += totals.rejectedHelpers - schedulerTotals.rejectedHelpers;
+    s.renudges += totals.renudges - schedulerTotals.renudges;
+    s.windowHintHits += totals.windowHintHits - schedulerTotals.windowHintHits;
+    s.windowHintMisses += totals.windowHintMisses - schedulerTotals.windowHintMisses;
+    schedulerTotals = totals;
+
+    s.activeJobs = scheduler.ActiveJobs();
+    s.watchedWindows = scheduler.WatchedWindows();
 }
 
-void FixSpotifyTaskbarIssue(const DWORD processId)
+void OnControlCommand()
 {
-    const auto startedTime = system_clock::now();
+    // On the event loop: the event is auto-reset, and the block holds one command at a time
+    const ControlCommand command = stats.TakeCommand();
+    if (command == ControlCommand::None)
+        return;
 
-    const HANDLE hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, processId);
-    WaitForInputIdle(hProcess, WAIT_FOR_INPUT_IDLE_TIMEOUT);
-    CloseHandle(hProcess);
+    Log(LogLevel::Info, "Received the %s command.", ControlCommandName(command));
+    stats.Update([](Statistics& s)
+    {
+        s.commandsReceived++;
+        AddSchedulerCounters(s);
+    });
 
-    const auto idleTime = system_clock::now();
-    const long long msToIdle = duration_cast<milliseconds>(idleTime.time_since_epoch() - startedTime.time_since_epoch()).count();
+    switch (command)
+    {
+        case ControlCommand::ReloadRules:
+            ReloadRules();
+            break;
+
+        case ControlCommand::Refix:
+            scheduler.Refix(SystemSnapshot::Take(recorder));
+            break;
+
+        case ControlCommand::ResetStatistics:
+            // Not a counter: it stays
+            stats.Reset();
+            stats.Update([](Statistics& s) { s.timeToReadyUs = timeToReadyUs; });
+            break;
+
+        default:
+            break;
+    }
+}
 
-    if (msToIdle < 500)
-        Sleep(500);
+void ReloadRules()
+{
+    // The rules can't change under a running scheduler, and the subscription is built
+    // from them. A session worker's events are filtered by the service's rules, though.
+    RuleSet reloaded;
+    if (!LoadRules(rulesPath, reloaded))
+    {
+        Log(LogLevel::Warning, "Could not reload the rules; keeping the previous ones.");
+        return;
+    }
 
-    FindSpotifyMainWindowResult spResult;
-    FindSpotifyMainWindow(processId, &spResult);
+    // Cancelling the call doesn't wait for the events WMI is delivering right now: their
+    // thread reads the rules too, so the sink is drained before they're swapped
+    StopProcessEvents();
+    if (pSink != nullptr)
+        pSink->Close();
+    scheduler.Stop();
+    rules = std::move(reloaded);
+    scheduler.Start();
+    if (pSink != nullptr)
+        pSink->Open();
+    if (runMode == RunMode::Console && !SubscribeProcessEvents())
+        Log(LogLevel::Error, "Could not subscribe to process events with the new rules!");
+
+    // Stopping the scheduler forgot every window it fixed
+    scheduler.Refix(SystemSnapshot::Take(recorder));
+}
 
-    if (spResult.isMainProcess)
+int PrintStatistics()
+{
+    Win32SharedMemory memory;
+    StatsReader reader;
+    Statistics s;
+    if (!memory.Open(STATS_BLOCK_NAME, sizeof(StatsBlockLayout)) || !reader.Attach(memory.Data()) || !reader.Read(&s))
     {
-        char localTime[32];
-        GetLocalTime(&startedTime, localTime, sizeof localTime);
-        printf("[%s] Spotify process started.\n", localTime);
-        printf("  | Process ID:    0x%08lX\n", processId);
+        cout << "SpotifyTaskbarFix isn't running in this session." << endl;
+        return 1;
+    }
 
-        // The main window might not be immediately available after the process starts;
-        // in case the main process is correctly identified, but it doesn't YET contain
-        // the main window, we wait for a bit and look for it again.
+    printf("SpotifyTaskbarFix (process %lu)\n", static_cast<unsigned long>(reader.ProcessId()));
+    printf("  Events received:   %llu (%llu dropped)\n", static_cast<unsigned long long>(s.eventsReceived), static_cast<unsigned long long>(s.eventsDropped));
+    printf("  Subscription lost: %llu time(s)\n", static_cast<unsigned long long>(s.subscriptionFailures));
+    printf("  Time to READY:     %.1f ms\n", static_cast<double>(s.timeToReadyUs) / 1000);
+    printf("  Helpers rejected:  %llu\n", static_cast<unsigned long long>(s.helpersRejected));
+    printf("  Windows moved:     %llu (%llu already in place, %llu not found)\n", static_cast<unsigned long long>(s.windowsMoved),
+           static_cast<unsigned long long>(s.windowsInPlace), static_cast<unsigned long long>(s.fixesFailed));
+    printf("  Moved again:       %llu\n", static_cast<unsigned long long>(s.renudges));
+    printf("  Window hints:      %llu hit, %llu missed\n", static_cast<unsigned long long>(s.windowHintHits),
+           static_cast<unsigned long long>(s.windowHintMisses));
+    printf("  Active jobs:       %llu\n", static_cast<unsigned long long>(s.activeJobs));
+    printf("  Watched windows:   %llu\n", static_cast<unsigned long long>(s.watchedWindows));
+    printf("  Commands received: %llu\n", static_cast<unsigned long long>(s.commandsReceived));
+
+    // One column per bucket that has anything in it, in any row
+    const auto printHistogram = [](const char* name, const uint64_t* buckets, const uint64_t timeouts)
+    {
+        printf("  %-14s", name);
+        for (size_t i = 0; i < STATS_LATENCY_BUCKET_COUNT; i++)
+            printf(" %6llu", static_cast<unsigned long long>(buckets[i]));
+        if (timeouts != UINT64_MAX)
+            printf("  timed out: %llu", static_cast<unsigned long long>(timeouts));
+        printf("\n");
+    };
+    printf("\n  %-14s", "ms <");
+    for (size_t i = 0; i < STATS_LATENCY_BUCKET_COUNT - 1; i++)
+        printf(" %6llu", 1ull << i);
+    printf("   more\n");
+    printHistogram("Fix", s.fixLatency, UINT64_MAX);
+    for (size_t phase = 0; phase < WAIT_PHASE_COUNT; phase++)
+        printHistogram(WaitPhaseName(static_cast<WaitPhase>(phase)), s.waitLatency[phase], s.timeouts[phase]);
+    return 0;
+}
 
-        long ms = 0;
-        while ((spResult.hPWnd == nullptr || spResult.hWnd == nullptr) && ms < FIND_SPOTIFY_WINDOW_RETRY_TIMEOUT)
+int SendControlCommand(const char* name)
+{
+    const ControlCommand command = ParseControlCommand(name);
+    if (command == ControlCommand::None)
+    {
+        cout << "ERROR: Unknown command " << name << "; expected reload, refix or reset." << endl;
+        return 1;
+    }
+
+    Win32SharedMemory memory;
+    StatsReader reader;
+    const HANDLE hEvent = OpenEventA(EVENT_MODIFY_STATE, FALSE, CONTROL_EVENT_NAME);
+    if (hEvent == nullptr || !memory.Open(STATS_BLOCK_NAME, sizeof(StatsBlockLayout)) || !reader.Attach(memory.Data()))
+    {
+        if (hEvent != nullptr)
+            CloseHandle(hEvent);
+        cout << "SpotifyTaskbarFix isn't running in this session." << endl;
+        return 1;
+    }
+
+    const uint64_t serial = reader.Post(command);
+    if (serial != 0)
+        SetEvent(hEvent);
+    CloseHandle(hEvent);
+    if (serial == 0)
+    {
+        cout << "ERROR: The previous command hasn't been taken yet." << endl;
+        return 1;
+    }
+
+    // Taken means it's being carried out, not that it's done
+    const ULONGLONG deadline = GetTickCount64() + CONTROL_COMMAND_TIMEOUT;
+    while (!reader.Acknowledged(serial))
+    {
+        if (GetTickCount64() >= deadline)
         {
-            Sleep(250);
-            FindSpotifyMainWindow(processId, &spResult);
-            ms += 250;
+            cout << "ERROR: SpotifyTaskbarFix didn't take the command." << endl;
+            return 1;
         }
+        Sleep(10);
+    }
+    return 0;
+}
 
-        if (spResult.hPWnd != nullptr && spResult.hWnd != nullptr)
-        {
-            const RECT wPos = GetWindowPosition(spResult.hPWnd);
-            const SIZE wSz = { wPos.right - wPos.left, wPos.bottom - wPos.top };
-            const RECT zero = { 0, 0, wSz.cx, wSz.cy };
-
-            printf("  | Window handle: 0x%08lX\n", reinterpret_cast<unsigned long>(spResult.hWnd));
-            printf("  | Window position: (%d, %d)\n", wPos.left, wPos.top);
-
-            long ms = 0;
-            //LONG prevStyles = 0;
-            //LONG prevExStyles = 0;
-            //while (ms < 5 * 1000)
-            //{
-            //    const LONG styles = GetWindowLongA(spResult.hWnd, GWL_STYLE);
-            //    const LONG exStyles = GetWindowLongA(spResult.hWnd, GWL_EXSTYLE);
-            //    PrintWindowStyles(styles, prevStyles, exStyles, prevExStyles);
-            //    prevStyles = styles;
-            //    prevExStyles = exStyles;
-
-            //    Sleep(250); 
-            //    ms += 250;
-            //}
-            bool validWindowStyle = false;
-            while (!validWindowStyle && ms < WINDOW_VISIBLE_TIMEOUT)
-            {
-                Sleep(100);
-                ms += 100;
-                validWindowStyle = HasFlag(GetWindowLongA(spResult.hWnd, GWL_STYLE), WS_VISIBLE) && HasFlag(GetWindowLongA(spResult.hPWnd, GWL_STYLE), WS_VISIBLE | WS_SYSMENU);
-            }
 
-            if (validWindowStyle)
-            {
-                char localTime[32];
+// ===============
+//     SERVICE
+// ===============
 
-                const auto visibleTime = system_clock::now();
-                GetLocalTime(&visibleTime, localTime, sizeof localTime);
-                printf("[%s] The window is visible.\n", localTime);
+void WINAPI ServiceMain(DWORD, LPWSTR*)
+{
+    hServiceStatus = RegisterServiceCtrlHandlerExW(SERVICE_NAME, ServiceControlHandler, nullptr);
+    if (hServiceStatus == nullptr)
+        return;
 
-                MoveWindow(spResult.hPWnd, zero.left, zero.top, wSz.cx, wSz.cy, TRUE);
-                MoveWindow(spResult.hPWnd, wPos.left, wPos.top, wSz.cx, wSz.cy, TRUE);
+    ReportServiceStatus(SERVICE_START_PENDING);
+    const int exitCode = Run();
+    ReportServiceStatus(SERVICE_STOPPED, exitCode);
+}
 
-                const auto doneTime = system_clock::now();
-                GetLocalTime(&doneTime, localTime, sizeof localTime);
-                printf("[%s] The window has been moved.\n\n", localTime);
-            }
-            else
+DWORD WINAPI ServiceControlHandler(const DWORD control, const DWORD eventType, const LPVOID eventData, LPVOID)
+{
+    switch (control)
+    {
+        case SERVICE_CONTROL_STOP:
+        case SERVICE_CONTROL_SHUTDOWN:
+            ReportServiceStatus(SERVICE_STOP_PENDING);
+            eventLoop.Notify(SystemNotification::Shutdown);
+            return NO_ERROR;
+
+        case SERVICE_CONTROL_SESSIONCHANGE:
+            if (eventType == WTS_SESSION_LOGOFF)
             {
-                cout << "No visible window found!" << endl;
+                const SessionId sessionId = static_cast<const WTSSESSION_NOTIFICATION*>(eventData)->dwSessionId;
+                eventLoop.Post([sessionId] { router->EndSession(sessionId); });
             }
-        }
-        else
+            return NO_ERROR;
+
+        case SERVICE_CONTROL_INTERROGATE:
+            return NO_ERROR;
+
+        default:
+            return ERROR_CALL_NOT_IMPLEMENTED;
+    }
+}
+
+void ReportServiceStatus(const DWORD state, const DWORD exitCode)
+{
+    if (hServiceStatus == nullptr)
+        return;
+
+    SERVICE_STATUS status = {};
+    status.dwServiceType = SERVICE_WIN32_OWN_PROCESS;
+    status.dwCurrentState = state;
+    status.dwControlsAccepted = state == SERVICE_RUNNING ? SERVICE_ACCEPT_STOP | SERVICE_ACCEPT_SHUTDOWN | SERVICE_ACCEPT_SESSIONCHANGE : 0;
+    status.dwWin32ExitCode = exitCode;
+    status.dwWaitHint = state == SERVICE_RUNNING || state == SERVICE_STOPPED ? 0 : SERVICE_WAIT_HINT;
+    SetServiceStatus(hServiceStatus, &status);
+}
+
+void RouteRunningProcesses()
+{
+    // Like FixScheduler::Reconcile, except that every process goes to its session's worker
+    const std::shared_ptr<const SystemSnapshot> snapshot = SystemSnapshot::Take(desktop);
+    for (const SystemSnapshot::Process& process : snapshot->Processes())
+    {
+        if (rules.FindApp(process.imageName.c_str()) == RuleSet::NO_APP)
+            continue;
+
+        ProcessStartEvent event = {};
+        event.processId = process.processId;
+        event.parentProcessId = process.parentProcessId;
+        process.imageName.copy(event.processName, PROCESS_NAME_LENGTH - 1);
+        OnProcessStarted(event);
+    }
+}
+
+wstring WorkerCommandLine()
+{
+    wchar_t modulePath[MAX_PATH];
+    const DWORD length = GetModuleFileNameW(nullptr, modulePath, MAX_PATH);
+
+    wstring commandLine = L"\"" + wstring(modulePath, length) + L"\" -session-worker";
+    if (watch)
+        commandLine += L" -watch";
+    if (rulesPath != nullptr)
+    {
+        wchar_t widePath[MAX_PATH];
+        if (MultiByteToWideChar(CP_ACP, 0, rulesPath, -1, widePath, MAX_PATH) > 0)
+            commandLine += L" -rules \"" + wstring(widePath) + L"\"";
+    }
+    return commandLine;
+}
+
+void ReadSessionEvents()
+{
+    // Whole events, but a pipe may hand them over in pieces
+    const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+    ProcessStartEvent event;
+    while (true)
+    {
+        DWORD total = 0;
+        while (total < sizeof event)
         {
-            cout << "Spotify main window not found!" << endl;
+            DWORD read = 0;
+            if (!ReadFile(hInput, reinterpret_cast<char*>(&event) + total, sizeof event - total, &read, nullptr) || read == 0)
+                break;
+            total += read;
         }
+        if (total < sizeof event)
+            break;
+
+        OnEarlyProcessesStarted(&event, 1);
     }
+
+    // The service closed the pipe: it's stopping, or the user is logging off
+    eventLoop.Notify(SystemNotification::Shutdown);
 }
 
-BOOL FindSpotifyMainWindow_EnumChildWindows(const HWND hWnd, const LPARAM lparam)
+string ExecutableDirectory()
 {
-    if (hWnd == INVALID_HANDLE_VALUE)
-        return TRUE;
+    char modulePath[MAX_PATH];
+    const DWORD length = GetModuleFileNameA(nullptr, modulePath, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH)
+        return string();
 
-    auto result = (FindSpotifyMainWindowResult* const)lparam;
+    const string path(modulePath, length);
+    return path.substr(0, path.find_last_of('\\') + 1);
+}
 
-    WCHAR title[256], className[256];
-    GetWindowText(hWnd, title, 256);
-    GetClassName(hWnd, className, 256);
+string DataDirectory()
+{
+    // A session worker runs as the user, who can't necessarily write next to the executable
+    if (runMode != RunMode::SessionWorker)
+        return ExecutableDirectory();
+
+    char tempPath[MAX_PATH + 1];
+    const DWORD length = GetTempPathA(MAX_PATH + 1, tempPath);
+    if (length == 0 || length > MAX_PATH)
+        return ExecutableDirectory();
+    return string(tempPath, length);
+}
 
-    //printf("##       0x%08lX: \"%ls\" \"%ls\"\n", hWnd, className, title);
+bool StartLogging()
+{
+    // Without -log, SpotifyTaskbarFix.log next to the executable (a session worker's
+    // goes to the user's temp directory): with the console hidden, that's the only
+    // place the output can go.
+    LogConfig config;
+    config.path = logPath != nullptr ? logPath : DataDirectory() + "SpotifyTaskbarFix.log";
+    config.maxFileBytes = 1024 * 1024;
+    config.maxRotatedFiles = 3;
+    config.console = showConsole;
+    if (Logger::Instance().Start(config))
+        return true;
+
+    config.path.clear();
+    config.console = true;
+    Logger::Instance().Start(config);
+    return false;
+}
+
+bool LoadRules(const char* path, RuleSet& loaded)
+{
+    // Without -rules, use SpotifyTaskbarFix.rules next to the executable if there is one
+    string defaultPath;
+    if (path == nullptr)
+    {
+        defaultPath = ExecutableDirectory() + "SpotifyTaskbarFix.rules";
+        if (GetFileAttributesA(defaultPath.c_str()) != INVALID_FILE_ATTRIBUTES)
+            path = defaultPath.c_str();
+    }
+
+    if (path == nullptr)
+    {
+        loaded = RuleSet::Default();
+        return true;
+    }
 
-    if (_wcsicmp(className, L"Chrome_RenderWidgetHostHWND") == 0)
+    string error;
+    if (!loaded.LoadFile(path, error))
     {
-        result->hWnd = hWnd;
-        return FALSE;
+        cout << "ERROR: Invalid rules file " << path << "\n    " << error << endl;
+        return false;
     }
-    return TRUE;
+
+    Log(LogLevel::Info, "Loaded %zu app(s) from %s", loaded.Apps().size(), path);
+    return true;
 }
 
-BOOL FindSpotifyMainWindow_EnumThreadWindows(const HWND hWnd, const LPARAM lparam)
+int Replay(const char* path)
 {
-    if (hWnd == INVALID_HANDLE_VALUE)
-        return TRUE;
+    LaunchTraceReader trace;
+    string error;
+    if (!trace.Open(path, error))
+    {
+        cout << "ERROR: Invalid launch trace " << path << "\n    " << error << endl;
+        return 1;
+    }
 
-    auto result = (FindSpotifyMainWindowResult* const)lparam;
+    const uint64_t startedUs = Tracer::Now();
+    const ReplayResult result = ReplayLaunchTrace(trace, rules);
+    const uint64_t elapsedUs = Tracer::Now() - startedUs;
 
-    WCHAR title[256], className[256];
-    GetWindowText(hWnd, title, 256);
-    GetClassName(hWnd, className, 256);
+    static const char* const RESULT_NAMES[] = { "pending", "cancelled", "not the main process", "main window not found", "window not visible", "window moved",
+                                                "window already in place" };
+    for (const ReplayFix& fix : result.fixes)
+    {
+        printf("Process 0x%08lX: %s after %llu ms\n", static_cast<unsigned long>(fix.processId), RESULT_NAMES[static_cast<int>(fix.result)],
+               static_cast<unsigned long long>(fix.endTime - fix.startTime));
+    }
+    printf("%zu move(s); %u record(s) replayed in %llu us (%llu ms of launch)\n", result.moves, trace.RecordCount(),
+           static_cast<unsigned long long>(elapsedUs), static_cast<unsigned long long>(result.endTime));
+    return 0;
+}
 
-    //printf("##    0x%08lX: \"%ls\" \"%ls\"\n", hWnd, className, title);
+void PrintPhaseSchedule(const char* name, const PhaseSchedule& schedule)
+{
+    printf("  %-12s timeout %5u ms, poll", name, schedule.timeoutMs);
+    for (uint32_t i = 0; i < schedule.stepCount; i++)
+        printf(" %u/<%u", schedule.steps[i].intervalMs, schedule.steps[i].untilMs);
+    printf("\n");
+}
 
-    if (_wcsicmp(className, L"GDI+ Hook Window Class") == 0 && _wcsicmp(title, L"G") == 0)
+int ShowTimeline(const char* path)
+{
+    StyleTimeline timeline;
+    string error;
+    if (!timeline.Load(path, error))
     {
-        result->isMainProcess = true;
+        cout << "ERROR: Invalid style timeline " << path << "\n    " << error << endl;
+        return 1;
     }
-    else if (_wcsicmp(className, L"Chrome_WidgetWin_0") == 0)
+
+    PrintStyleTimeline(timeline, stdout);
+    return 0;
+}
+
+void StopTimeline()
+{
+    if (timelinePath == nullptr)
+        return;
+
+    styleSampler.Stop();
+    timeEndPeriod(1);
+
+    const StyleTimeline& timeline = styleSampler.Timeline();
+    Log(LogLevel::Info, "Sampled the styles of %zu window(s) %llu times: %zu changes in %zu bytes, %llu late ticks.",
+        timeline.WindowCount(), static_cast<unsigned long long>(timeline.Samples()), timeline.Changes(), timeline.EncodedBytes(),
+        static_cast<unsigned long long>(styleSampler.Overruns()));
+    if (!timeline.Save(timelinePath))
+        Log(LogLevel::Warning, "Could not write the style timeline to %s", timelinePath);
+}
+
+int PrintSchedules()
+{
+    for (const AppRule& app : rules.Apps())
     {
-        result->isMainProcess = true;
-        if (_wcsicmp(title, L"") != 0)
+        printf("%ls:\n", app.name.c_str());
+        const WaitSchedule schedule = latencyModel.Schedule(app.name);
+        for (size_t phase = 0; phase < WAIT_PHASE_COUNT; phase++)
         {
-            // Enumerate child windows
-            EnumChildWindows(hWnd, FindSpotifyMainWindow_EnumChildWindows, lparam);
-            if (result->hWnd != nullptr)
+            char name[32];
+            snprintf(name, sizeof name, "%s (%u)", WaitPhaseName(static_cast<WaitPhase>(phase)), latencyModel.Samples(app.name, static_cast<WaitPhase>(phase)));
+            PrintPhaseSchedule(name, schedule.phases[phase]);
+        }
+    }
+
+    // Learn from 200 synthetic launches, score against 2000 others, polling only
+    typedef struct {
+        const char* name;
+        uint32_t medianMs;
+        double sigma;
+    } Distribution;
+    static const Distribution DISTRIBUTIONS[] = { { "fast", 120, 0.4 }, { "typical", 600, 0.5 }, { "cold boot", 6000, 0.6 } };
+
+    const WaitSchedule fixed = FixedWaitSchedule();
+    printf("\nSynthetic launches          fixed: delay  wakeups  failed | learned: delay  wakeups  failed\n");
+    for (const Distribution& distribution : DISTRIBUTIONS)
+    {
+        const vector<uint32_t> training = SyntheticLatencies(distribution.medianMs, distribution.sigma, 200, 1);
+        const vector<uint32_t> test = SyntheticLatencies(distribution.medianMs, distribution.sigma, 2000, 2);
+        for (const WaitPhase phase : { WaitPhase::MainWindow, WaitPhase::Visible })
+        {
+            const PhaseSchedule& fixedPhase = fixed.phases[static_cast<size_t>(phase)];
+            const PhaseSchedule learned = DerivePhaseSchedule(CountLatencies(training, fixedPhase.timeoutMs), fixedPhase);
+            const ScheduleScore before = ScoreSchedule(fixedPhase, test);
+            const ScheduleScore after = ScoreSchedule(learned, test);
+            printf("  %-9s %-12s %9.0f ms %8.1f %6.1f%% | %11.0f ms %8.1f %6.1f%%\n", distribution.name, WaitPhaseName(phase),
+                   before.meanDelayMs, before.meanWakeups, before.failureRate * 100, after.meanDelayMs, after.meanWakeups, after.failureRate * 100);
+        }
+    }
+    return 0;
+}
+
+void OnProcessStarted(const ProcessStartEvent& event)
+{
+    OnProcessesStarted(&event, 1);
+}
+
+size_t OnEarlyProcessesStarted(const ProcessStartEvent* const events, const size_t count)
+{
+    // Straight through, once startup is over
+    const size_t accepted = earlyEvents.Submit(events, count);
+    if (accepted < count)
+        Log(LogLevel::Warning, "Too many process events during startup; dropped %zu.", count - accepted);
+    return accepted;
+}
+
+size_t OnProcessesStarted(const ProcessStartEvent* const events, const size_t count)
+{
+    // Called on the WMI thread, a whole Indicate at a time: nothing here may block
+    if (runMode == RunMode::Service)
+    {
+        // Starting a worker does block, so that's for the event loop to do
+        for (size_t i = 0; i < count; i++)
+        {
+            eventLoop.Post([event = events[i]]
             {
-                result->hPWnd = hWnd;
-                return FALSE;
-            }
+                if (!router->Route(event, GetTickCount64()))
+                    Log(LogLevel::Warning, "No session worker for process 0x%08lX", static_cast<unsigned long>(event.processId));
+            });
         }
+        return count;
     }
-    return TRUE;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        recorder.RecordStartEvent(events[i]);
+        if (timelinePath != nullptr)
+            styleSampler.Watch(events[i].processId);
+    }
+    const size_t accepted = scheduler.Submit(events, count);
+    if (accepted < count)
+        Log(LogLevel::Warning, "Too many pending process events; dropped %zu, from process 0x%08lX on", count - accepted, static_cast<unsigned long>(events[accepted].processId));
+    // The statistics block's lock is the worker's too: they're counted on the event loop
+    if (uncountedEvents.fetch_add(count) == 0)
+        eventLoop.Post(CountReceivedEvents);
+    return accepted;
 }
 
-void FindSpotifyMainWindow(const DWORD processId, FindSpotifyMainWindowResult *const result)
+void CountReceivedEvents()
 {
-    //printf("## Process ID: 0x%08lX\n", processId);
-    result->hPWnd = nullptr;
-    result->hWnd = nullptr;
-    result->isMainProcess = false;
+    const uint64_t count = uncountedEvents.exchange(0);
+    stats.Update([count](Statistics& s)
+    {
+        s.eventsReceived += count;
+        AddSchedulerCounters(s);
+    });
+}
 
-    const HANDLE hSnapshotThread = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, NULL);
-    if (hSnapshotThread != INVALID_HANDLE_VALUE)
+void OnFixCompleted(const FixJob& job)
+{
+    const uint64_t fixMs = desktop.Now() - job.StartedAt();
+    stats.Update([&](Statistics& s)
     {
-        THREADENTRY32 thread;
-        thread.dwSize = sizeof thread;
+        switch (job.Result())
+        {
+            case FixResult::NotMainProcess:
+                s.helpersRejected++;
+                break;
+            case FixResult::WindowMoved:
+                s.windowsMoved++;
+                break;
+            case FixResult::WindowInPlace:
+                s.windowsInPlace++;
+                break;
+            case FixResult::MainWindowNotFound:
+            case FixResult::WindowNotVisible:
+                s.fixesFailed++;
+                break;
+            default:
+                break;
+        }
 
-        // Enumerate this process's threads
-        if (Thread32First(hSnapshotThread, &thread))
+        // An app that was already running says nothing about how long apps take to start
+        const bool fixed = job.Result() == FixResult::WindowMoved || job.Result() == FixResult::WindowInPlace;
+        if (fixed && !job.AlreadyRunning())
+            s.fixLatency[LatencyBucket(fixMs)]++;
+        for (size_t phase = 0; phase < WAIT_PHASE_COUNT && !job.AlreadyRunning(); phase++)
         {
-            do
-            {
-                if (thread.th32OwnerProcessID != processId)
-                    continue;
-                if (thread.dwSize < FIELD_OFFSET(THREADENTRY32, th32OwnerProcessID) + sizeof thread.th32OwnerProcessID)
-                    continue;
-
-                // Enumerate this thread's windows
-                EnumThreadWindows(thread.th32ThreadID, FindSpotifyMainWindow_EnumThreadWindows, (LPARAM)result);
-            } while (Thread32Next(hSnapshotThread, &thread));
+            const FixJob::PhaseWait& wait = job.Waited(static_cast<WaitPhase>(phase));
+            if (!wait.observed)
+                continue;
+            if (wait.timedOut)
+                s.timeouts[phase]++;
+            else
+                s.waitLatency[phase][LatencyBucket(wait.ms)]++;
         }
-        CloseHandle(hSnapshotThread);
-    }
-}
-
-
-// =================
-//     FUNCTIONS
-// =================
-
-void GetLocalTime(const system_clock::time_point *const tp, char *const buffer, size_t bufferLength)
-{
-    const auto time = system_clock::to_time_t(*tp);
-    struct tm ptm;
-    localtime_s(&ptm, &time);
-
-    std::strftime(buffer, bufferLength, "%H:%M:%S", &ptm);
-    const auto ms = static_cast<unsigned>((tp->time_since_epoch() - duration_cast<seconds>(tp->time_since_epoch())) / milliseconds(1));
-    snprintf(buffer, bufferLength, "%s.%d", buffer, ms);
-}
-
-RECT GetWindowPosition(const HWND hWnd)
-{
-    RECT rect;
-    GetWindowRect(hWnd, &rect);
-    MapWindowPoints(HWND_DESKTOP, GetParent(hWnd), reinterpret_cast<LPPOINT>(&rect), 2);
-    return rect;
-}
-
-void PrintWindowStyle(const LONG current, const LONG previous, LONG flag, const char* name)
-{
-    bool has = HasFlag(current, flag);
-    bool had = HasFlag(previous, flag);
-
-    if (has && !had)
-        printf("  + %s\n", name);
-    else if (!has && had)
-        printf("  - %s\n", name);
-}
-
-void PrintWindowStyles(const LONG styles, const LONG prevStyles, const LONG exStyles, const LONG prevExStyles)
-{
-    printf("Window styles:\n");
-
-    PrintWindowStyle(styles, prevStyles, WS_BORDER, "WS_BORDER");
-    PrintWindowStyle(styles, prevStyles, WS_CAPTION, "WS_CAPTION");
-    PrintWindowStyle(styles, prevStyles, WS_CHILD, "WS_CHILD");
-    PrintWindowStyle(styles, prevStyles, WS_CHILDWINDOW, "WS_CHILDWINDOW");
-    PrintWindowStyle(styles, prevStyles, WS_CLIPCHILDREN, "WS_CLIPCHILDREN");
-    PrintWindowStyle(styles, prevStyles, WS_CLIPSIBLINGS, "WS_CLIPSIBLINGS");
-    PrintWindowStyle(styles, prevStyles, WS_DISABLED, "WS_DISABLED");
-    PrintWindowStyle(styles, prevStyles, WS_DLGFRAME, "WS_DLGFRAME");
-    PrintWindowStyle(styles, prevStyles, WS_GROUP, "WS_GROUP");
-    PrintWindowStyle(styles, prevStyles, WS_HSCROLL, "WS_HSCROLL");
-    PrintWindowStyle(styles, prevStyles, WS_ICONIC, "WS_ICONIC");
-    PrintWindowStyle(styles, prevStyles, WS_MAXIMIZE, "WS_MAXIMIZE");
-    PrintWindowStyle(styles, prevStyles, WS_MAXIMIZEBOX, "WS_MAXIMIZEBOX");
-    PrintWindowStyle(styles, prevStyles, WS_MINIMIZE, "WS_MINIMIZE");
-    PrintWindowStyle(styles, prevStyles, WS_MINIMIZEBOX, "WS_MINIMIZEBOX");
-    PrintWindowStyle(styles, prevStyles, WS_OVERLAPPED, "WS_OVERLAPPED");
-    PrintWindowStyle(styles, prevStyles, WS_OVERLAPPEDWINDOW, "WS_OVERLAPPEDWINDOW");
-    PrintWindowStyle(styles, prevStyles, WS_POPUP, "WS_POPUP");
-    PrintWindowStyle(styles, prevStyles, WS_POPUPWINDOW, "WS_POPUPWINDOW");
-    PrintWindowStyle(styles, prevStyles, WS_SIZEBOX, "WS_SIZEBOX");
-    PrintWindowStyle(styles, prevStyles, WS_SYSMENU, "WS_SYSMENU");
-    PrintWindowStyle(styles, prevStyles, WS_TABSTOP, "WS_TABSTOP");
-    PrintWindowStyle(styles, prevStyles, WS_THICKFRAME, "WS_THICKFRAME");
-    PrintWindowStyle(styles, prevStyles, WS_TILED, "WS_TILED");
-    PrintWindowStyle(styles, prevStyles, WS_TABSTOP, "WS_TABSTOP");
-    PrintWindowStyle(styles, prevStyles, WS_TILEDWINDOW, "WS_TILEDWINDOW");
-    PrintWindowStyle(styles, prevStyles, WS_VISIBLE, "WS_VISIBLE");
-    PrintWindowStyle(styles, prevStyles, WS_VSCROLL, "WS_VSCROLL");
-
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_ACCEPTFILES, "WS_EX_ACCEPTFILES");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_APPWINDOW, "WS_EX_APPWINDOW");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_CLIENTEDGE, "WS_EX_CLIENTEDGE");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_COMPOSITED, "WS_EX_COMPOSITED");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_CONTEXTHELP, "WS_EX_CONTEXTHELP");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_CONTROLPARENT, "WS_EX_CONTROLPARENT");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_DLGMODALFRAME, "WS_EX_DLGMODALFRAME");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_LAYERED, "WS_EX_LAYERED");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_LAYOUTRTL, "WS_EX_LAYOUTRTL");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_LEFT, "WS_EX_LEFT");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_LEFTSCROLLBAR, "WS_EX_LEFTSCROLLBAR");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_LTRREADING, "WS_EX_LTRREADING");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_MDICHILD, "WS_EX_MDICHILD");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_NOACTIVATE, "WS_EX_NOACTIVATE");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_NOINHERITLAYOUT, "WS_EX_NOINHERITLAYOUT");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_NOPARENTNOTIFY, "WS_EX_NOPARENTNOTIFY");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_NOREDIRECTIONBITMAP, "WS_EX_NOREDIRECTIONBITMAP");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_OVERLAPPEDWINDOW, "WS_EX_OVERLAPPEDWINDOW");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_PALETTEWINDOW, "WS_EX_PALETTEWINDOW");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_RIGHT, "WS_EX_RIGHT");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_RIGHTSCROLLBAR, "WS_EX_RIGHTSCROLLBAR");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_RTLREADING, "WS_EX_RTLREADING");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_STATICEDGE, "WS_EX_STATICEDGE");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_TOOLWINDOW, "WS_EX_TOOLWINDOW");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_TOPMOST, "WS_EX_TOPMOST");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_TRANSPARENT, "WS_EX_TRANSPARENT");
-    PrintWindowStyle(exStyles, prevExStyles, WS_EX_WINDOWEDGE, "WS_EX_WINDOWEDGE");
+        AddSchedulerCounters(s);
+    });
+
+    // Helpers rejected by their windows would only drown the numbers of actual fixes
+    if (job.Result() == FixResult::NotMainProcess || job.Result() == FixResult::Cancelled)
+        return;
+
+    // Called on the scheduler's worker, which has the next fix to get to: the files get
+    // written on the event loop's thread, once for however many fixes finish meanwhile
+    if (!fixDataDirty.exchange(true))
+        eventLoop.Post(SaveFixData);
+}
+
+void SaveFixData()
+{
+    if (!fixDataDirty.exchange(false))
+        return;
+
+    if (!latencyModel.Save(latencyPath))
+        Log(LogLevel::Warning, "Could not save the latency model to %s", latencyPath.c_str());
+    if (!windowHints.Save(windowHintsPath))
+        Log(LogLevel::Warning, "Could not save the window hints to %s", windowHintsPath.c_str());
+
+    Tracer::Instance().LogSummary();
+    if (tracePath != nullptr && !Tracer::Instance().WriteChromeTrace(tracePath))
+        Log(LogLevel::Warning, "Could not write the trace to %s", tracePath);
+
+    // Rewritten soon after every fix, so the file is complete whenever the program gets killed
+    if (recordPath != nullptr && !recorder.Save(recordPath))
+        Log(LogLevel::Warning, "Could not write the launch recording to %s", recordPath);
 }
@@ -0,0 +1,357 @@
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "EpollEventLoop.h"
+#include "FixScheduler.h"
+#include "LatencyModel.h"
+#include "Log.h"
+#include "ProcConnector.h"
+#include "SpotifyFix.h"
+#include "StartupPipeline.h"
+#include "SystemSnapshot.h"
+#include "Trace.h"
+#include "WindowEventHub.h"
+#include "WindowHintCache.h"
+#include "WindowSearchPool.h"
+#include "X11DesktopBackend.h"
+
+using namespace std;
+
+
+// ====================
+//     DECLARATIONS
+// ====================
+
+// Spotify as Linux packages it: a "spotify" executable whose main window has the WM_CLASS "Spotify".
+constexpr const char* LINUX_DEFAULT_RULES =
+    "[Spotify]\n"
+    "process = spotify\n"
+    "window  = Spotify\n";
+
+// FUNCTIONS
+int Run();
+bool Lock();
+void OnProcessEventsReadable();
+string ExecutableDirectory();
+string DataDirectory();
+bool StartLogging();
+bool LoadRules(const char* path);
+void OnProcessStarted(const ProcessStartEvent&);
+void OnFixCompleted(const FixJob&);
+void SaveFixData();
+
+// GLOBAL VARIABLES
+// First: it blocks the shutdown signals, which only works before any other thread exists
+EpollEventLoop eventLoop;
+bool watch = false;
+const char* rulesPath = nullptr;
+const char* tracePath = nullptr;
+const char* logPath = nullptr;
+const char* displayName = nullptr;
+int lockFd = -1;
+X11DesktopBackend desktop;
+// No X extension tells who owns a new window, so the fix polls
+WindowEventHub windowEvents;
+RuleSet rules;
+WindowSearchPool windowSearch;
+LatencyModel latencyModel;
+string latencyPath;
+WindowHintCache windowHints;
+string windowHintsPath;
+// Set by the scheduler's worker after a fix, cleared by whoever writes it all out
+std::atomic<bool> fixDataDirty{ false };
+FixScheduler scheduler(desktop, windowEvents, rules);
+ProcConnector processEvents(rules, OnProcessStarted);
+uint64_t handledOverruns = 0;
+thread recovery;
+
+
+// ============
+//     MAIN
+// ============
+
+int main(const int argc, char* argv[]) // NOLINT
+{
+    // Parse arguments
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-rules") == 0 && i + 1 < argc)
+            rulesPath = argv[++i];
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc)
+            logPath = argv[++i];
+        else if (strcmp(argv[i], "-display") == 0 && i + 1 < argc)
+            displayName = argv[++i];
+        else if (strcmp(argv[i], "-watch") == 0)
+            watch = true;
+    }
+
+    latencyPath = DataDirectory() + "SpotifyTaskbarFix.latency";
+    latencyModel.Load(latencyPath);
+    windowHintsPath = DataDirectory() + "SpotifyTaskbarFix.hints";
+    windowHints.Load(windowHintsPath);
+
+    try
+    {
+        return Run();
+    }
+    catch (const std::exception& e)
+    {
+        cout << "ERROR: Unhandled exception\n    " << e.what() << endl;
+        return 1;
+    }
+}
+
+int Run()
+{
+    // One instance per user; a second one would only fight the first over the windows
+    if (!Lock())
+    {
+        cout << "ERROR: Program is already running!" << endl;
+        return 1;
+    }
+
+    if (!StartLogging())
+        Log(LogLevel::Warning, "Could not open the log file; logging to the console only.");
+
+    if (!LoadRules(rulesPath))
+        return 1;
+
+    // The socket is subscribed first and keeps whatever execs come in until the
+    // event loop drains it, so nothing is missed while the display and the fix
+    // engine come up alongside; see the Windows version.
+    StartupPipeline startup;
+    const StartupPipeline::StepId events = startup.Add("process events", []
+    {
+        if (processEvents.Start())
+            return true;
+        Log(LogLevel::Error, "Could not subscribe to process events (%s); the program needs CAP_NET_ADMIN, see the README.", strerror(errno));
+        return false;
+    });
+    const StartupPipeline::StepId display = startup.Add("X display", []
+    {
+        if (desktop.Open(displayName))
+            return true;
+        Log(LogLevel::Error, "Could not open the X display %s.", displayName != nullptr ? displayName : "$DISPLAY");
+        return false;
+    });
+    const StartupPipeline::StepId search = startup.Add("window search", [] { windowSearch.Start(); return true; });
+    const StartupPipeline::StepId engine = startup.Add("fix engine", []
+    {
+        scheduler.SetCompletionCallback(OnFixCompleted);
+        scheduler.SetLatencyModel(&latencyModel);
+        scheduler.SetWatchMode(watch);
+        scheduler.SetWindowSearchPool(&windowSearch);
+        scheduler.SetWindowHintCache(&windowHints);
+        scheduler.Start();
+        return true;
+    }, { display, search });
+
+    // Nothing to do until the kernel says something
+    startup.AddOnCallingThread("event loop", []
+    {
+        eventLoop.Watch(processEvents.Handle(), OnProcessEventsReadable);
+        eventLoop.On(SystemNotification::Shutdown, [] { eventLoop.Quit(); });
+        return true;
+    }, { events });
+
+    // Apps that started before we did; see the Windows version for why only now, and not on the startup path
+    thread reconciliation;
+    startup.Add("reconciliation", [&reconciliation]
+    {
+        reconciliation = thread([] { scheduler.Reconcile(SystemSnapshot::Take(desktop)); });
+        return true;
+    }, { events, engine });
+
+    const bool started = startup.Run();
+    startup.LogSummary();
+    if (!started)
+    {
+        processEvents.Stop();
+        scheduler.Stop();
+        SaveFixData();
+        windowSearch.Stop();
+        desktop.Close();
+        Logger::Instance().Stop();
+        return 1;
+    }
+
+    Log(LogLevel::Info, "READY! (%.1f ms)", static_cast<double>(startup.ElapsedUs()) / 1000);
+    eventLoop.Run();
+    Log(LogLevel::Info, "Shutting down...");
+
+    // No more process events, then no more fixes
+    processEvents.Stop();
+    if (reconciliation.joinable())
+        reconciliation.join();
+    if (recovery.joinable())
+        recovery.join();
+    scheduler.Stop();
+    SaveFixData();
+    windowSearch.Stop();
+    desktop.Close();
+
+    Log(LogLevel::Info, "Received %llu exec(s), %llu of which matched; the socket overflowed %llu time(s).",
+        static_cast<unsigned long long>(processEvents.Execs()), static_cast<unsigned long long>(processEvents.Matches()),
+        static_cast<unsigned long long>(processEvents.Overruns()));
+    Log(LogLevel::Info, "Event loop woke up %llu times, %llu of which for nothing.",
+        static_cast<unsigned long long>(eventLoop.Wakeups()), static_cast<unsigned long long>(eventLoop.IdleWakeups()));
+    Logger::Instance().Stop();
+
+    close(lockFd);
+    return 0;
+}
+
+bool Lock()
+{
+    const string path = DataDirectory() + "SpotifyTaskbarFix.lock";
+    lockFd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    // Without a lock file there's no telling: better two instances than none
+    if (lockFd < 0)
+        return true;
+    return flock(lockFd, LOCK_EX | LOCK_NB) == 0;
+}
+
+void OnProcessEventsReadable()
+{
+    processEvents.Drain();
+
+    // The kernel dropped events: whatever started meanwhile is only in /proc now
+    const uint64_t overruns = processEvents.Overruns();
+    if (overruns == handledOverruns)
+        return;
+
+    handledOverruns = overruns;
+    Log(LogLevel::Warning, "Missed some process events; looking for apps that started meanwhile.");
+    if (recovery.joinable())
+        recovery.join();
+    recovery = thread([] { scheduler.Reconcile(SystemSnapshot::Take(desktop)); });
+}
+
+
+// ===============
+//     HELPERS
+// ===============
+
+string ExecutableDirectory()
+{
+    char path[PATH_MAX];
+    const ssize_t length = readlink("/proc/self/exe", path, sizeof path - 1);
+    if (length <= 0)
+        return string();
+
+    const string executable(path, static_cast<size_t>(length));
+    return executable.substr(0, executable.find_last_of('/') + 1);
+}
+
+string DataDirectory()
+{
+    // $XDG_STATE_HOME/SpotifyTaskbarFix/: unlike the executable's, it's always ours to write to
+    static const string directory = []
+    {
+        string base;
+        if (const char* stateHome = getenv("XDG_STATE_HOME"); stateHome != nullptr && stateHome[0] == '/')
+            base = stateHome;
+        else if (const char* home = getenv("HOME"); home != nullptr && home[0] == '/')
+            base = string(home) + "/.local/state";
+        else
+            return ExecutableDirectory();
+
+        // ~/.local/state itself may not exist yet
+        mkdir(base.substr(0, base.find_last_of('/')).c_str(), 0700);
+        mkdir(base.c_str(), 0700);
+        const string path = base + "/SpotifyTaskbarFix";
+        if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST)
+            return ExecutableDirectory();
+        return path + "/";
+    }();
+    return directory;
+}
+
+bool StartLogging()
+{
+    // Always to the console too: the program runs in a terminal, or under a
+    // user service whose output goes to the journal.
+    LogConfig config;
+    config.path = logPath != nullptr ? logPath : DataDirectory() + "SpotifyTaskbarFix.log";
+    config.maxFileBytes = 1024 * 1024;
+    config.maxRotatedFiles = 3;
+    config.console = true;
+    if (Logger::Instance().Start(config))
+        return true;
+
+    config.path.clear();
+    Logger::Instance().Start(config);
+    return false;
+}
+
+bool LoadRules(const char* path)
+{
+    // Without -rules, use SpotifyTaskbarFix.rules next to the executable if there is one
+    string defaultPath;
+    if (path == nullptr)
+    {
+        defaultPath = ExecutableDirectory() + "SpotifyTaskbarFix.rules";
+        if (access(defaultPath.c_str(), R_OK) == 0)
+            path = defaultPath.c_str();
+    }
+
+    string error;
+    if (path == nullptr)
+        return rules.Parse(LINUX_DEFAULT_RULES, error);
+
+    if (!rules.LoadFile(path, error))
+    {
+        cout << "ERROR: Invalid rules file " << path << "\n    " << error << endl;
+        return false;
+    }
+
+    Log(LogLevel::Info, "Loaded %zu app(s) from %s", rules.Apps().size(), path);
+    return true;
+}
+
+void OnProcessStarted(const ProcessStartEvent& event)
+{
+    // Called on the event loop's thread, with more execs queued behind: nothing here may block
+    if (!scheduler.Submit(event))
+        Log(LogLevel::Warning, "Too many pending process events; dropped process %lu", static_cast<unsigned long>(event.processId));
+}
+
+void OnFixCompleted(const FixJob& job)
+{
+    // Helpers rejected by their windows would only drown the numbers of actual fixes
+    if (job.Result() == FixResult::NotMainProcess || job.Result() == FixResult::Cancelled)
+        return;
+
+    // Called on the scheduler's worker, which has the next fix to get to: the files get
+    // written on the event loop's thread, once for however many fixes finish meanwhile
+    if (!fixDataDirty.exchange(true))
+        eventLoop.Post(SaveFixData);
+}
+
+void SaveFixData()
+{
+    if (!fixDataDirty.exchange(false))
+        return;
+
+    if (!latencyModel.Save(latencyPath))
+        Log(LogLevel::Warning, "Could not save the latency model to %s", latencyPath.c_str());
+    if (!windowHints.Save(windowHintsPath))
+        Log(LogLevel::Warning, "Could not save the window hints to %s", windowHintsPath.c_str());
+
+    Tracer::Instance().LogSummary();
+    if (tracePath != nullptr && !Tracer::Instance().WriteChromeTrace(tracePath))
+        Log(LogLevel::Warning, "Could not write the trace to %s", tracePath);
+}
@@ -0,0 +1,261 @@
+// Brings the program up against a stand-in event source, the old way (every
+// step one after the other, the subscription last) and through StartupPipeline
+// (the event source first, the fix engine alongside, early events buffered),
+// while Spotify is launched at various times into the startup. Reports the time
+// to READY broken down by step, when the subscription was in place, and which
+// launches the fix engine got to see. The stand-in steps sleep for about as long
+// as their WMI counterparts take on a cold login; the fix engine is the real one.
+// Builds and runs anywhere.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EarlyEventBuffer.h"
+#include "FixScheduler.h"
+#include "Log.h"
+#include "SimulatedDesktopBackend.h"
+#include "StartupPipeline.h"
+#include "Trace.h"
+#include "WindowSearchPool.h"
+
+using namespace std;
+
+namespace
+{
+    // Stand-in step costs, in ms. ConnectServer dominates: at login, it waits for the WMI service to start.
+    constexpr uint32_t COM_MS = 2;
+    constexpr uint32_t LOCATOR_MS = 5;
+    constexpr uint32_t CONNECTION_MS = 80;
+    constexpr uint32_t SINK_STUB_MS = 20;
+    constexpr uint32_t SUBSCRIPTION_MS = 10;
+    constexpr uint32_t WINDOW_HOOKS_MS = 15;
+    constexpr uint32_t STATISTICS_MS = 1;
+    constexpr uint32_t EVENT_LOOP_MS = 2;
+
+    // When Spotify is launched, from the start of the startup
+    constexpr uint32_t LAUNCH_STEP_MS = 20;
+    constexpr uint32_t LAST_LAUNCH_MS = 200;
+    constexpr ProcessId MAIN_PROCESS_ID = 1000;
+    constexpr size_t HELPERS = 4;
+
+    void SleepMs(const uint32_t ms)
+    {
+        this_thread::sleep_for(chrono::milliseconds(ms));
+    }
+
+    ProcessStartEvent SpotifyStartEvent(const ProcessId processId, const ProcessId parentProcessId)
+    {
+        ProcessStartEvent event = {};
+        event.processId = processId;
+        event.parentProcessId = parentProcessId;
+        const wchar_t name[] = L"Spotify.exe";
+        for (size_t i = 0; i < sizeof name / sizeof name[0]; i++)
+            event.processName[i] = name[i];
+        event.sessionId = 1;
+        return event;
+    }
+
+    // WMI, as far as startup is concerned: nothing is delivered until the subscription is in place
+    class StandInEventSource
+    {
+    public:
+        explicit StandInEventSource(EarlyEventBuffer& buffer) : buffer(buffer) {}
+
+        bool Subscribe()
+        {
+            SleepMs(SUBSCRIPTION_MS);
+            subscribedAtUs = Tracer::Now();
+            subscribed = true;
+            return true;
+        }
+
+        // Returns false if it happened before the subscription, and was missed
+        bool Emit(const ProcessStartEvent& event)
+        {
+            if (!subscribed)
+                return false;
+            buffer.Submit(&event, 1);
+            return true;
+        }
+
+        uint64_t SubscribedAtUs() const { return subscribedAtUs; }
+
+    private:
+        EarlyEventBuffer& buffer;
+        std::atomic<bool> subscribed{ false };
+        std::atomic<uint64_t> subscribedAtUs{ 0 };
+    };
+
+    typedef struct {
+        uint64_t readyUs;
+        uint64_t subscribedUs;
+        bool caught;
+        // From the launch to the event reaching the fix engine
+        uint64_t handOverUs;
+        vector<StartupPipeline::StepTiming> timings;
+    } RunResult;
+
+    RunResult Run(const bool pipelined, const uint32_t launchAtMs, const RuleSet& rules)
+    {
+        SimulatedDesktopBackend desktop;
+        WindowSearchPool windowSearch;
+        FixScheduler scheduler(desktop, desktop, rules);
+        EarlyEventBuffer earlyEvents;
+        StandInEventSource source(earlyEvents);
+
+        // The scheduler isn't started: it runs on the simulated desktop's virtual clock, and
+        // what's measured here is when the events reach it
+        std::atomic<uint64_t> firstHandedOverUs{ 0 };
+        const auto sink = [&](const ProcessStartEvent* const events, const size_t count)
+        {
+            uint64_t expected = 0;
+            firstHandedOverUs.compare_exchange_strong(expected, Tracer::Now());
+            return scheduler.Submit(events, count);
+        };
+
+        StartupPipeline startup;
+        const auto add = [&](const char* name, StartupPipeline::Action action, vector<StartupPipeline::StepId> after)
+        {
+            // The old way: all on one thread, each step after the one before
+            if (!pipelined)
+                return startup.AddOnCallingThread(name, std::move(action), startup.Timings().empty() ? vector<StartupPipeline::StepId>() : vector<StartupPipeline::StepId>{ startup.Timings().size() - 1 });
+            return startup.Add(name, std::move(action), std::move(after));
+        };
+        const auto addOnCallingThread = [&](const char* name, StartupPipeline::Action action, vector<StartupPipeline::StepId> after)
+        {
+            if (!pipelined)
+                return add(name, std::move(action), {});
+            return startup.AddOnCallingThread(name, std::move(action), std::move(after));
+        };
+
+        // In the order they used to run
+        vector<StartupPipeline::StepId> engine;
+        engine.push_back(add("window hooks", [] { SleepMs(WINDOW_HOOKS_MS); return true; }, {}));
+        engine.push_back(add("fix engine", [&]
+        {
+            windowSearch.Start();
+            scheduler.SetWindowSearchPool(&windowSearch);
+            return true;
+        }, {}));
+        engine.push_back(addOnCallingThread("statistics", [] { SleepMs(STATISTICS_MS); return true; }, {}));
+        const StartupPipeline::StepId com = addOnCallingThread("COM", [] { SleepMs(COM_MS); return true; }, {});
+        const StartupPipeline::StepId locator = add("WMI locator", [] { SleepMs(LOCATOR_MS); return true; }, { com });
+        const StartupPipeline::StepId connection = add("WMI connection", [] { SleepMs(CONNECTION_MS); return true; }, { locator });
+        const StartupPipeline::StepId sinkStub = add("event sink", [] { SleepMs(SINK_STUB_MS); return true; }, { com });
+        add("subscription", [&] { return source.Subscribe(); }, { connection, sinkStub });
+        engine.push_back(addOnCallingThread("event loop", [] { SleepMs(EVENT_LOOP_MS); return true; }, {}));
+        add("early events", [&] { earlyEvents.Open(sink); return true; }, engine);
+
+        // Spotify, launched by the login at the same time as we are
+        const uint64_t startUs = Tracer::Now();
+        uint64_t launchedUs = 0;
+        bool caught = false;
+        thread launcher([&]
+        {
+            SleepMs(launchAtMs);
+            launchedUs = Tracer::Now();
+            caught = source.Emit(SpotifyStartEvent(MAIN_PROCESS_ID, 1));
+            for (size_t i = 0; i < HELPERS; i++)
+                source.Emit(SpotifyStartEvent(MAIN_PROCESS_ID + 1 + static_cast<ProcessId>(i), MAIN_PROCESS_ID));
+        });
+
+        startup.Run();
+        const uint64_t readyUs = Tracer::Now();
+        launcher.join();
+        windowSearch.Stop();
+
+        RunResult result = {};
+        result.readyUs = readyUs - startUs;
+        result.subscribedUs = source.SubscribedAtUs() - startUs;
+        result.caught = caught;
+        result.handOverUs = caught && firstHandedOverUs > launchedUs ? firstHandedOverUs - launchedUs : 0;
+        result.timings = startup.Timings();
+        return result;
+    }
+
+    void PrintTimings(const char* mode, const vector<StartupPipeline::StepTiming>& timings)
+    {
+        printf("\n%s, step by step:\n", mode);
+        printf("  %-16s %8s %8s\n", "Step (ms)", "at", "took");
+        vector<const StartupPipeline::StepTiming*> byStart;
+        for (const StartupPipeline::StepTiming& timing : timings)
+            byStart.push_back(&timing);
+        stable_sort(byStart.begin(), byStart.end(), [](auto* a, auto* b) { return a->startUs < b->startUs; });
+        for (const StartupPipeline::StepTiming* timing : byStart)
+        {
+            printf("  %-16s %8.1f %8.1f\n", timing->name, static_cast<double>(timing->startUs) / 1000,
+                   static_cast<double>(timing->durationUs) / 1000);
+        }
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 3;
+    if (repetitions <= 0)
+    {
+        fprintf(stderr, "usage: %s [repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    // The fix logic logs every step; none of that is being measured
+    LogConfig quiet = {};
+    Logger::Instance().Start(quiet);
+
+    const RuleSet rules = RuleSet::Default();
+    printf("%-12s %10s %12s %8s %14s\n", "Mode", "READY", "subscribed", "caught", "hand-over p50");
+    uint64_t medianReadyUs[2] = {};
+    vector<StartupPipeline::StepTiming> lastTimings[2];
+    bool ok = true;
+    for (const bool pipelined : { false, true })
+    {
+        vector<uint64_t> readyUs;
+        vector<uint64_t> subscribedUs;
+        vector<uint64_t> handOverUs;
+        size_t launches = 0;
+        size_t caught = 0;
+        for (int i = 0; i < repetitions; i++)
+        {
+            for (uint32_t launchAtMs = 0; launchAtMs <= LAST_LAUNCH_MS; launchAtMs += LAUNCH_STEP_MS)
+            {
+                const RunResult result = Run(pipelined, launchAtMs, rules);
+                readyUs.push_back(result.readyUs);
+                subscribedUs.push_back(result.subscribedUs);
+                launches++;
+                if (result.caught)
+                {
+                    caught++;
+                    handOverUs.push_back(result.handOverUs);
+                }
+                // A launch after the subscription that doesn't reach the engine would be a bug
+                ok &= result.caught || launchAtMs * 1000ull < result.subscribedUs;
+                lastTimings[pipelined ? 1 : 0] = result.timings;
+            }
+        }
+
+        const auto median = [](vector<uint64_t>& values) -> double
+        {
+            if (values.empty())
+                return 0;
+            sort(values.begin(), values.end());
+            return static_cast<double>(values[values.size() / 2]) / 1000;
+        };
+        const double ready = median(readyUs);
+        medianReadyUs[pipelined ? 1 : 0] = static_cast<uint64_t>(ready * 1000);
+        const double subscribed = median(subscribedUs);
+        printf("%-12s %7.1f ms %9.1f ms %3zu/%-4zu %11.1f ms\n", pipelined ? "pipelined" : "sequential", ready, subscribed,
+               caught, launches, median(handOverUs));
+    }
+    PrintTimings("Sequential", lastTimings[0]);
+    PrintTimings("Pipelined", lastTimings[1]);
+
+    Logger::Instance().Stop();
+    ok &= medianReadyUs[1] < medianReadyUs[0];
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "StartupPipeline.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "Log.h"
+#include "Trace.h"
+
+namespace
+{
+    const char* StepStatusName(const StartupPipeline::StepStatus status)
+    {
+        switch (status)
+        {
+            case StartupPipeline::StepStatus::Pending: return "not run";
+            case StartupPipeline::StepStatus::Succeeded: return "";
+            case StartupPipeline::StepStatus::Failed: return "FAILED";
+            case StartupPipeline::StepStatus::Skipped: return "skipped";
+            default: return "?";
+        }
+    }
+}
+
+
+StartupPipeline::StepId StartupPipeline::Add(const char* name, Action action, std::vector<StepId> after)
+{
+    return AddStep(name, std::move(action), std::move(after), false);
+}
+
+StartupPipeline::StepId StartupPipeline::AddOnCallingThread(const char* name, Action action, std::vector<StepId> after)
+{
+    return AddStep(name, std::move(action), std::move(after), true);
+}
+
+StartupPipeline::StepId StartupPipeline::AddStep(const char* name, Action action, std::vector<StepId> after, const bool onCallingThread)
+{
+    // Only steps that already exist: there's no way to make a cycle
+    const StepId id = steps.size();
+    after.erase(std::remove_if(after.begin(), after.end(), [id](const StepId dependency) { return dependency >= id; }), after.end());
+
+    steps.push_back({ std::move(action), std::move(after), false });
+    timings.push_back({ name, 0, 0, StepStatus::Pending, onCallingThread });
+    return id;
+}
+
+void StartupPipeline::SetThreadHooks(std::function<void()> enter, std::function<void()> leave)
+{
+    enterThread = std::move(enter);
+    leaveThread = std::move(leave);
+}
+
+bool StartupPipeline::Run()
+{
+    runStartUs = Tracer::Now();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (finished < steps.size())
+    {
+        StepId inlineStep;
+        if (StartReadySteps(inlineStep))
+        {
+            lock.unlock();
+            RunStep(inlineStep);
+            lock.lock();
+            continue;
+        }
+
+        if (finished < steps.size())
+            stepDone.wait(lock);
+    }
+    lock.unlock();
+
+    for (std::thread& thread : threads)
+        thread.join();
+    threads.clear();
+    elapsedUs = Tracer::Now() - runStartUs;
+    return FailedStep() == nullptr;
+}
+
+bool StartupPipeline::StartReadySteps(StepId& onCallingThread)
+{
+    // A skipped step may make others skippable, hence the loop
+    bool changed = true;
+    bool foundInline = false;
+    while (changed)
+    {
+        changed = false;
+        for (StepId id = 0; id < steps.size(); id++)
+        {
+            Step& step = steps[id];
+            if (step.started)
+                continue;
+
+            bool ready = true;
+            bool blocked = false;
+            for (const StepId dependency : step.after)
+            {
+                const StepStatus status = timings[dependency].status;
+                ready &= status == StepStatus::Succeeded;
+                blocked |= status == StepStatus::Failed || status == StepStatus::Skipped;
+            }
+
+            if (blocked)
+            {
+                step.started = true;
+                timings[id].status = StepStatus::Skipped;
+                timings[id].startUs = Tracer::Now() - runStartUs;
+                finished++;
+                changed = true;
+            }
+            else if (ready && timings[id].onCallingThread)
+            {
+                // One at a time; the rest are picked up once it's done
+                if (!foundInline)
+                {
+                    step.started = true;
+                    onCallingThread = id;
+                    foundInline = true;
+                }
+            }
+            else if (ready)
+            {
+                step.started = true;
+                threads.emplace_back([this, id]
+                {
+                    if (enterThread)
+                        enterThread();
+                    RunStep(id);
+                    if (leaveThread)
+                        leaveThread();
+                });
+            }
+        }
+    }
+    return foundInline;
+}
+
+void StartupPipeline::RunStep(const StepId id)
+{
+    const uint64_t startUs = Tracer::Now();
+    bool succeeded;
+    try
+    {
+        succeeded = steps[id].action();
+    }
+    catch (const std::exception& e)
+    {
+        Log(LogLevel::Error, "Startup step \"%s\" threw: %s", timings[id].name, e.what());
+        succeeded = false;
+    }
+    const uint64_t endUs = Tracer::Now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timings[id].startUs = startUs - runStartUs;
+        timings[id].durationUs = endUs - startUs;
+        timings[id].status = succeeded ? StepStatus::Succeeded : StepStatus::Failed;
+        finished++;
+    }
+    stepDone.notify_one();
+}
+
+const char* StartupPipeline::FailedStep() const
+{
+    for (const StepTiming& timing : timings)
+    {
+        if (timing.status == StepStatus::Failed)
+            return timing.name;
+    }
+    return nullptr;
+}
+
+void StartupPipeline::LogSummary() const
+{
+    std::vector<const StepTiming*> byStart;
+    for (const StepTiming& timing : timings)
+        byStart.push_back(&timing);
+    std::stable_sort(byStart.begin(), byStart.end(), [](const StepTiming* a, const StepTiming* b) { return a->startUs < b->startUs; });
+
+    Log(LogLevel::Info, "Startup took %.1f ms:", static_cast<double>(elapsedUs) / 1000);
+    Log(LogLevel::Info, "  %-20s %10s %10s", "Step (ms)", "at", "took");
+    for (const StepTiming* timing : byStart)
+    {
+        Log(LogLevel::Info, "  %-20s %10.1f %10.1f %s%s", timing->name, static_cast<double>(timing->startUs) / 1000,
+            static_cast<double>(timing->durationUs) / 1000, timing->onCallingThread ? "(main thread) " : "", StepStatusName(timing->status));
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Brings the program up as a graph of steps instead of a straight line: each
+// step runs as soon as the steps it depends on are done, on a thread of its
+// own, so independent ones (connecting to WMI, hooking window events, starting
+// the scheduler...) overlap. Steps that are tied to a thread (COM's apartment,
+// the event loop's window) can be kept on the thread that calls Run.
+// A step that fails skips everything that depends on it; the rest still runs.
+// How long each step took, and when it started, is kept for the summary: the
+// time to READY is Run's, broken down by step.
+class StartupPipeline
+{
+public:
+    typedef size_t StepId;
+    // Returns false if the step failed.
+    typedef std::function<bool()> Action;
+
+    enum class StepStatus : uint8_t
+    {
+        Pending,
+        Succeeded,
+        Failed,
+        // A step it depends on failed
+        Skipped,
+    };
+
+    typedef struct {
+        const char* name;
+        // Since Run was called
+        uint64_t startUs;
+        uint64_t durationUs;
+        StepStatus status;
+        bool onCallingThread;
+    } StepTiming;
+
+    StartupPipeline() = default;
+    StartupPipeline(const StartupPipeline&) = delete;
+    StartupPipeline& operator=(const StartupPipeline&) = delete;
+
+    // `after` are steps added before this one. `name` has to outlive the pipeline.
+    StepId Add(const char* name, Action action, std::vector<StepId> after = {});
+    StepId AddOnCallingThread(const char* name, Action action, std::vector<StepId> after = {});
+    // Run on each of the pipeline's own threads, before its step and after it.
+    void SetThreadHooks(std::function<void()> enter, std::function<void()> leave);
+
+    // Returns once every step has run or been skipped; false if any failed.
+    bool Run();
+
+    const std::vector<StepTiming>& Timings() const { return timings; }
+    uint64_t ElapsedUs() const { return elapsedUs; }
+    // The first step that failed, or nullptr.
+    const char* FailedStep() const;
+    // One line per step, in the order they started.
+    void LogSummary() const;
+
+private:
+    StepId AddStep(const char* name, Action action, std::vector<StepId> after, bool onCallingThread);
+    // Starts every step whose dependencies are done, and skips the ones that can't run;
+    // returns the first step that has to run on the calling thread, if any.
+    bool StartReadySteps(StepId& onCallingThread);
+    void RunStep(StepId id);
+
+    typedef struct {
+        Action action;
+        std::vector<StepId> after;
+        bool started;
+    } Step;
+
+    std::vector<Step> steps;
+    std::vector<StepTiming> timings;
+    std::function<void()> enterThread;
+    std::function<void()> leaveThread;
+
+    std::mutex mutex;
+    std::condition_variable stepDone;
+    std::vector<std::thread> threads;
+    size_t finished = 0;
+    uint64_t runStartUs = 0;
+    uint64_t elapsedUs = 0;
+};
@@ -0,0 +1,180 @@
+#include "StatsBlock.h"
+
+#include <cstring>
+#include <new>
+#include <thread>
+
+static_assert(sizeof(Statistics) % sizeof(uint64_t) == 0, "Statistics must be made of uint64_t only");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The stats block needs lock-free 64-bit atomics");
+
+namespace
+{
+    constexpr unsigned COMMAND_BITS = 8;
+    constexpr uint64_t COMMAND_MASK = (1 << COMMAND_BITS) - 1;
+
+    const char* const COMMAND_NAMES[] = { "none", "reload", "refix", "reset" };
+    static_assert(sizeof COMMAND_NAMES / sizeof COMMAND_NAMES[0] == static_cast<size_t>(ControlCommand::Count), "COMMAND_NAMES");
+}
+
+size_t LatencyBucket(uint64_t ms)
+{
+    size_t bucket = 0;
+    while (ms > 0 && bucket < STATS_LATENCY_BUCKET_COUNT - 1)
+    {
+        ms >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+const char* ControlCommandName(const ControlCommand command)
+{
+    return command < ControlCommand::Count ? COMMAND_NAMES[static_cast<size_t>(command)] : "?";
+}
+
+ControlCommand ParseControlCommand(const char* name)
+{
+    for (size_t i = 1; i < static_cast<size_t>(ControlCommand::Count); i++)
+    {
+        if (strcmp(name, COMMAND_NAMES[i]) == 0)
+            return static_cast<ControlCommand>(i);
+    }
+    return ControlCommand::None;
+}
+
+
+// ==============
+//     WRITER
+// ==============
+
+void StatsWriter::Attach(void* memory, const uint32_t processId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    block = new (memory) StatsBlockLayout();
+    block->version = STATS_BLOCK_VERSION;
+    block->processId = processId;
+    Publish();
+    block->magic.store(STATS_BLOCK_MAGIC, std::memory_order_release);
+}
+
+void StatsWriter::Detach()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (block == nullptr)
+        return;
+
+    block->magic.store(0, std::memory_order_release);
+    block = nullptr;
+}
+
+void StatsWriter::Update(const std::function<void(Statistics&)>& change)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    change(statistics);
+    if (block != nullptr)
+        Publish();
+}
+
+void StatsWriter::Reset()
+{
+    Update([](Statistics& s) { s = {}; });
+}
+
+ControlCommand StatsWriter::TakeCommand()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (block == nullptr)
+        return ControlCommand::None;
+
+    const uint64_t command = block->command.load(std::memory_order_acquire);
+    const uint64_t serial = command >> COMMAND_BITS;
+    if (serial == block->acknowledged.load(std::memory_order_relaxed))
+        return ControlCommand::None;
+
+    block->acknowledged.store(serial, std::memory_order_release);
+    const uint64_t value = command & COMMAND_MASK;
+    return value < static_cast<uint64_t>(ControlCommand::Count) ? static_cast<ControlCommand>(value) : ControlCommand::None;
+}
+
+Statistics StatsWriter::Current()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void StatsWriter::Publish()
+{
+    uint64_t words[STATISTICS_WORDS];
+    memcpy(words, &statistics, sizeof statistics);
+
+    // Only ever written under `mutex`, so nobody else moves the sequence in between
+    const uint32_t sequence = block->sequence.load(std::memory_order_relaxed);
+    block->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < STATISTICS_WORDS; i++)
+        block->statistics[i].store(words[i], std::memory_order_relaxed);
+    block->sequence.store(sequence + 2, std::memory_order_release);
+    publishes++;
+}
+
+
+// ==============
+//     READER
+// ==============
+
+bool StatsReader::Attach(void* memory)
+{
+    StatsBlockLayout* layout = static_cast<StatsBlockLayout*>(memory);
+    if (layout->magic.load(std::memory_order_acquire) != STATS_BLOCK_MAGIC || layout->version != STATS_BLOCK_VERSION)
+        return false;
+
+    block = layout;
+    return true;
+}
+
+bool StatsReader::Read(Statistics* statistics, const uint32_t maxAttempts)
+{
+    uint64_t words[STATISTICS_WORDS];
+    for (uint32_t attempt = 0; attempt < maxAttempts; attempt++)
+    {
+        // Caught in the middle of an update: the writer may well have been preempted
+        // there, and spinning would only keep it from finishing
+        const uint32_t before = block->sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0)
+            std::this_thread::yield();
+        else
+        {
+            for (size_t i = 0; i < STATISTICS_WORDS; i++)
+                words[i] = block->statistics[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (block->sequence.load(std::memory_order_relaxed) == before)
+            {
+                memcpy(statistics, words, sizeof words);
+                return true;
+            }
+        }
+        retries++;
+    }
+    return false;
+}
+
+uint64_t StatsReader::Post(const ControlCommand command)
+{
+    // Another reader may be posting too; only one of them gets the next serial number
+    uint64_t current = block->command.load(std::memory_order_acquire);
+    const uint64_t serial = (current >> COMMAND_BITS) + 1;
+    if (serial - 1 != block->acknowledged.load(std::memory_order_acquire))
+        return 0;
+
+    const uint64_t next = serial << COMMAND_BITS | static_cast<uint64_t>(command);
+    if (!block->command.compare_exchange_strong(current, next, std::memory_order_acq_rel))
+        return 0;
+    return serial;
+}
+
+bool StatsReader::Acknowledged(const uint64_t serial) const
+{
+    return block->acknowledged.load(std::memory_order_acquire) >= serial;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include "WaitSchedule.h"
+
+// Bucket 0 is 0 ms, bucket i covers [2^(i-1), 2^i) ms, and the last one everything from 16 s on.
+constexpr size_t STATS_LATENCY_BUCKET_COUNT = 16;
+
+size_t LatencyBucket(uint64_t ms);
+
+// What a running instance has done since it started, or since its statistics were reset.
+// Nothing but uint64_t, so that it can be published a word at a time.
+typedef struct {
+    uint64_t eventsReceived;
+    uint64_t eventsDropped;
+    // Rejected up front by their command line, or later by their windows
+    uint64_t helpersRejected;
+    uint64_t windowsMoved;
+    uint64_t windowsInPlace;
+    // Main window not found, or never visible
+    uint64_t fixesFailed;
+    uint64_t renudges;
+    // Main windows found where the hint cache said, and the ones that took the full search
+    uint64_t windowHintHits;
+    uint64_t windowHintMisses;
+    uint64_t commandsReceived;
+    // Times WMI dropped the process events subscription, and it had to be made again
+    uint64_t subscriptionFailures;
+    // From the start of the startup pipeline to READY
+    uint64_t timeToReadyUs;
+    // Right now, rather than so far
+    uint64_t activeJobs;
+    uint64_t watchedWindows;
+    uint64_t timeouts[WAIT_PHASE_COUNT];
+    // Time from the process start to the fix, and how long each wait took when it didn't time out
+    uint64_t fixLatency[STATS_LATENCY_BUCKET_COUNT];
+    uint64_t waitLatency[WAIT_PHASE_COUNT][STATS_LATENCY_BUCKET_COUNT];
+} Statistics;
+
+// Sent to a running instance through its stats block.
+enum class ControlCommand : uint8_t
+{
+    None,
+    ReloadRules,
+    // Every running app, as if it had just started
+    Refix,
+    ResetStatistics,
+
+    Count
+};
+
+const char* ControlCommandName(ControlCommand command);
+// None if there's no such command.
+ControlCommand ParseControlCommand(const char* name);
+
+constexpr uint32_t STATS_BLOCK_MAGIC = 0x58464253; // "SBFX"
+// Changes with the layout of StatsBlockLayout or Statistics
+constexpr uint32_t STATS_BLOCK_VERSION = 4;
+constexpr size_t STATISTICS_WORDS = sizeof(Statistics) / sizeof(uint64_t);
+
+// The shared region. The statistics are guarded by a seqlock: the sequence is
+// odd while they're being written, so a reader that saw the same even value
+// before and after copying them has a consistent copy, without ever blocking
+// the writer. The control mailbox holds one command at a time: its serial
+// number above the low 8 bits, which hold the command itself.
+typedef struct {
+    // Set last, once the rest is in place
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint32_t processId;
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> statistics[STATISTICS_WORDS];
+    std::atomic<uint64_t> command;
+    std::atomic<uint64_t> acknowledged;
+} StatsBlockLayout;
+
+// The instance's side of the block. Statistics are kept even while detached,
+// they're just not published.
+class StatsWriter
+{
+public:
+    // `memory` is zero-filled and at least sizeof(StatsBlockLayout).
+    void Attach(void* memory, uint32_t processId);
+    // Before the memory is unmapped; readers then find the block gone.
+    void Detach();
+
+    // Thread-safe. Applies `change` to the statistics and publishes them.
+    void Update(const std::function<void(Statistics&)>& change);
+    void Reset();
+
+    // Thread-safe. The command posted since the last call, if any; each one is taken once.
+    ControlCommand TakeCommand();
+
+    Statistics Current();
+    uint64_t Publishes() const { return publishes; }
+
+private:
+    void Publish();
+
+    std::mutex mutex;
+    Statistics statistics = {};
+    StatsBlockLayout* block = nullptr;
+    std::atomic<uint64_t> publishes{ 0 };
+};
+
+// Another process's side of the block: reading never makes a call into the
+// instance, nor any system call at all.
+class StatsReader
+{
+public:
+    // Fails if the memory isn't a stats block of this version.
+    bool Attach(void* memory);
+
+    uint32_t ProcessId() const { return block->processId; }
+
+    // Retries while the writer is in the middle of an update, up to `maxAttempts` times.
+    bool Read(Statistics* statistics, uint32_t maxAttempts = DEFAULT_MAX_READ_ATTEMPTS);
+
+    // The command's serial number, or 0 if the previous command hasn't been taken yet.
+    uint64_t Post(ControlCommand command);
+    bool Acknowledged(uint64_t serial) const;
+
+    // Copies thrown away because the writer got in the way
+    uint64_t Retries() const { return retries; }
+
+    static constexpr uint32_t DEFAULT_MAX_READ_ATTEMPTS = 1000;
+
+private:
+    StatsBlockLayout* block = nullptr;
+    uint64_t retries = 0;
+};
@@ -0,0 +1,131 @@
+#include "StyleSampler.h"
+
+#include <algorithm>
+
+#include "Trace.h"
+
+StyleSampler::StyleSampler(DesktopBackend& desktop, const uint32_t intervalMs, const uint32_t durationMs)
+    : desktop(desktop), interval(std::chrono::milliseconds(intervalMs)), duration(std::chrono::milliseconds(durationMs))
+{
+}
+
+StyleSampler::~StyleSampler()
+{
+    Stop();
+}
+
+void StyleSampler::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+        return;
+
+    running = true;
+    worker = std::thread(&StyleSampler::SamplerLoop, this);
+}
+
+void StyleSampler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+}
+
+void StyleSampler::Watch(const ProcessId processId)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inbox.push_back(processId);
+    }
+    wake.notify_all();
+}
+
+void StyleSampler::SamplerLoop()
+{
+    // The timeline starts with the sampler
+    const uint64_t startedUs = Tracer::Now();
+    Clock::time_point nextTick = Clock::now();
+    Clock::time_point nextDiscovery = nextTick;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (processes.empty() && inbox.empty())
+                wake.wait(lock, [this] { return !running || !inbox.empty(); });
+            else
+                wake.wait_until(lock, nextTick, [this] { return !running || !inbox.empty(); });
+            if (!running)
+                return;
+
+            const Clock::time_point now = Clock::now();
+            for (const ProcessId processId : inbox)
+                processes.push_back({ processId, now + duration });
+            if (!inbox.empty())
+                nextDiscovery = now;
+            inbox.clear();
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (now > nextTick + interval)
+            overruns++;
+        nextTick = std::max(nextTick + interval, now);
+
+        // Processes whose time is up take their windows with them
+        const auto expired = std::remove_if(processes.begin(), processes.end(), [&](const WatchedProcess& process) { return process.until <= now; });
+        if (expired != processes.end())
+        {
+            processes.erase(expired, processes.end());
+            windows.erase(std::remove_if(windows.begin(), windows.end(), [&](const SampledWindow& window)
+            {
+                return std::none_of(processes.begin(), processes.end(), [&](const WatchedProcess& process) { return process.processId == window.processId; });
+            }), windows.end());
+        }
+
+        const uint64_t timeUs = Tracer::Now() - startedUs;
+        if (now >= nextDiscovery)
+        {
+            Discover(timeUs);
+            nextDiscovery = now + std::chrono::milliseconds(DISCOVERY_INTERVAL);
+        }
+
+        for (const SampledWindow& window : windows)
+            timeline.Sample(timeUs, window.index, desktop.GetStyle(window.hWnd), desktop.GetExStyle(window.hWnd));
+    }
+}
+
+void StyleSampler::Discover(const uint64_t timeUs)
+{
+    for (const WatchedProcess& process : processes)
+    {
+        desktop.EnumWindowThreads(process.processId, [&](const ThreadId threadId)
+        {
+            desktop.EnumThreadWindows(threadId, [&](const WindowHandle hWnd)
+            {
+                AddWindow(hWnd, process.processId, timeUs);
+                desktop.EnumChildWindows(hWnd, [&](const WindowHandle hChild)
+                {
+                    AddWindow(hChild, process.processId, timeUs);
+                    return true;
+                });
+                return true;
+            });
+        });
+    }
+}
+
+void StyleSampler::AddWindow(const WindowHandle hWnd, const ProcessId processId, const uint64_t timeUs)
+{
+    if (!knownWindows.insert(hWnd).second)
+        return;
+
+    wchar_t className[STYLE_TIMELINE_CLASS_LENGTH + 1] = {};
+    desktop.GetWindowClass(hWnd, className, STYLE_TIMELINE_CLASS_LENGTH + 1);
+    const uint16_t index = timeline.AddWindow(hWnd, processId, className, timeUs);
+    if (index != StyleTimeline::NO_WINDOW)
+        windows.push_back({ hWnd, index, processId });
+}
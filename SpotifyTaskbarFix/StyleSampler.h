@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "DesktopBackend.h"
+#include "StyleTimeline.h"
+
+// A diagnostic: samples the style of every window (top-level or child) of the
+// watched processes into a StyleTimeline, every `intervalMs`, for a while after
+// each process is watched. Sampling a known window is two GetWindowLong calls
+// and a compare; looking for new windows is much more expensive, so that's
+// only done every DISCOVERY_INTERVAL. With nothing to watch, its thread sleeps
+// until there is.
+class StyleSampler
+{
+public:
+    explicit StyleSampler(DesktopBackend& desktop, uint32_t intervalMs = DEFAULT_INTERVAL, uint32_t durationMs = DEFAULT_DURATION);
+    ~StyleSampler();
+
+    StyleSampler(const StyleSampler&) = delete;
+    StyleSampler& operator=(const StyleSampler&) = delete;
+
+    void Start();
+    void Stop();
+
+    // Thread-safe.
+    void Watch(ProcessId processId);
+
+    // Only while stopped.
+    const StyleTimeline& Timeline() const { return timeline; }
+    // Ticks that came later than they should have, by more than one interval
+    uint64_t Overruns() const { return overruns; }
+
+    static constexpr uint32_t DEFAULT_INTERVAL = 1;
+    static constexpr uint32_t DEFAULT_DURATION = 30 * 1000;
+    static constexpr uint32_t DISCOVERY_INTERVAL = 50;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    typedef struct {
+        ProcessId processId;
+        Clock::time_point until;
+    } WatchedProcess;
+
+    typedef struct {
+        WindowHandle hWnd;
+        uint16_t index;
+        ProcessId processId;
+    } SampledWindow;
+
+    void SamplerLoop();
+    void Discover(uint64_t timeUs);
+    void AddWindow(WindowHandle hWnd, ProcessId processId, uint64_t timeUs);
+
+    DesktopBackend& desktop;
+    const Clock::duration interval;
+    const Clock::duration duration;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running = false;
+    std::vector<ProcessId> inbox;
+
+    // Owned by the sampler thread
+    std::vector<WatchedProcess> processes;
+    std::vector<SampledWindow> windows;
+    std::unordered_set<WindowHandle> knownWindows;
+    StyleTimeline timeline;
+    uint64_t overruns = 0;
+};
@@ -0,0 +1,251 @@
+#include "StyleTimeline.h"
+
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // Worst case of a change: two 10-byte varints, the count and 64 flipped bits
+    constexpr size_t MAX_CHANGE_BYTES = 10 + 10 + 1 + 64;
+
+    // 32-bit, so that it's a single instruction on x86 too
+    unsigned LowestBit(const uint32_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return index;
+#else
+        return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+    }
+
+    bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint64_t* value)
+    {
+        *value = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7)
+        {
+            const uint8_t byte = *p++;
+            *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    void PrintFlags(FILE* out, const uint32_t bits, const uint32_t set, const char* const (&names)[32], const char* prefix)
+    {
+        for (uint32_t remaining = bits; remaining != 0; remaining &= remaining - 1)
+        {
+            const unsigned bit = LowestBit(remaining);
+            const char sign = (set & (1u << bit)) != 0 ? '+' : '-';
+            if (names[bit] != nullptr)
+                fprintf(out, " %c%s", sign, names[bit]);
+            else
+                fprintf(out, " %c%s0x%08X", sign, prefix, 1u << bit);
+        }
+    }
+}
+
+uint16_t StyleTimeline::AddWindow(const WindowHandle hWnd, const ProcessId processId, const wchar_t* className, const uint64_t timeUs)
+{
+    if (windows.size() >= MAX_WINDOWS)
+        return NO_WINDOW;
+
+    StyleTimelineWindow window = {};
+    window.window = hWnd;
+    window.processId = processId;
+    window.firstSeenMs = static_cast<uint32_t>(timeUs / 1000);
+    for (size_t i = 0; i < STYLE_TIMELINE_CLASS_LENGTH && className[i] != L'\0'; i++)
+        window.className[i] = static_cast<uint16_t>(className[i]);
+
+    windows.push_back(window);
+    states.push_back({ 0, 0 });
+    return static_cast<uint16_t>(windows.size() - 1);
+}
+
+void StyleTimeline::Append(const uint64_t timeUs, const uint16_t window, const uint32_t style, const uint32_t exStyle)
+{
+    State& state = states[window];
+    if (bytes.size() + MAX_CHANGE_BYTES > MAX_BYTES)
+    {
+        // Still the window's state, so that the next change isn't counted twice
+        state = { style, exStyle };
+        droppedChanges++;
+        return;
+    }
+
+    const uint32_t styleFlipped = state.style ^ style;
+    const uint32_t exStyleFlipped = state.exStyle ^ exStyle;
+    state = { style, exStyle };
+
+    AppendVarint(timeUs - lastChangeUs);
+    AppendVarint(window);
+    const size_t countAt = bytes.size();
+    bytes.push_back(0);
+    for (uint32_t remaining = styleFlipped; remaining != 0; remaining &= remaining - 1)
+        bytes.push_back(static_cast<uint8_t>(LowestBit(remaining)));
+    for (uint32_t remaining = exStyleFlipped; remaining != 0; remaining &= remaining - 1)
+        bytes.push_back(static_cast<uint8_t>(32 + LowestBit(remaining)));
+    bytes[countAt] = static_cast<uint8_t>(bytes.size() - countAt - 1);
+
+    lastChangeUs = timeUs;
+    changes++;
+}
+
+void StyleTimeline::AppendVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+bool StyleTimeline::Save(const std::string& path) const
+{
+    StyleTimelineHeader header = {};
+    std::memcpy(header.magic, STYLE_TIMELINE_MAGIC, sizeof header.magic);
+    header.version = STYLE_TIMELINE_VERSION;
+    header.windowCount = static_cast<uint32_t>(windows.size());
+    header.changeBytes = bytes.size();
+    header.sampleCount = samples;
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path.c_str(), "wb") != 0)
+        return false;
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1;
+    if (ok && !windows.empty())
+        ok = fwrite(windows.data(), sizeof(StyleTimelineWindow), windows.size(), file) == windows.size();
+    if (ok && !bytes.empty())
+        ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+
+    return fclose(file) == 0 && ok;
+}
+
+bool StyleTimeline::Load(const std::string& path, std::string& error)
+{
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path.c_str(), "rb") != 0)
+        file = nullptr;
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (file == nullptr)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    StyleTimelineHeader header;
+    bool ok = fread(&header, sizeof header, 1, file) == 1 && std::memcmp(header.magic, STYLE_TIMELINE_MAGIC, sizeof header.magic) == 0;
+    if (!ok)
+        error = "not a style timeline";
+    else if (header.version != STYLE_TIMELINE_VERSION || header.windowCount > MAX_WINDOWS || header.changeBytes > MAX_BYTES)
+    {
+        ok = false;
+        error = "unsupported style timeline version " + std::to_string(header.version);
+    }
+
+    if (ok)
+    {
+        windows.resize(header.windowCount);
+        bytes.resize(static_cast<size_t>(header.changeBytes));
+        ok = (windows.empty() || fread(windows.data(), sizeof(StyleTimelineWindow), windows.size(), file) == windows.size()) &&
+             (bytes.empty() || fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+        if (!ok)
+            error = "truncated style timeline";
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        windows.clear();
+        bytes.clear();
+        return false;
+    }
+
+    states.assign(windows.size(), { 0, 0 });
+    samples = header.sampleCount;
+    changes = 0;
+    Decode([this](const Change& change)
+    {
+        states[change.window] = { change.style, change.exStyle };
+        changes++;
+    });
+    return true;
+}
+
+void StyleTimeline::Decode(const ChangeCallback& callback) const
+{
+    std::vector<State> decoded(windows.size(), { 0, 0 });
+    const uint8_t* p = bytes.data();
+    const uint8_t* end = p + bytes.size();
+
+    uint64_t timeUs = 0;
+    while (p < end)
+    {
+        uint64_t delta;
+        uint64_t window;
+        if (!ReadVarint(p, end, &delta) || !ReadVarint(p, end, &window) || window >= decoded.size() || p >= end)
+            return;
+
+        const uint8_t count = *p++;
+        if (static_cast<size_t>(end - p) < count)
+            return;
+
+        Change change = {};
+        timeUs += delta;
+        change.timeUs = timeUs;
+        change.window = static_cast<uint16_t>(window);
+        for (uint8_t i = 0; i < count; i++, p++)
+        {
+            if (*p < 32)
+                change.styleChanged |= 1u << *p;
+            else if (*p < 64)
+                change.exStyleChanged |= 1u << (*p - 32);
+        }
+
+        State& state = decoded[change.window];
+        state.style ^= change.styleChanged;
+        state.exStyle ^= change.exStyleChanged;
+        change.style = state.style;
+        change.exStyle = state.exStyle;
+        callback(change);
+    }
+}
+
+void PrintStyleTimeline(const StyleTimeline& timeline, FILE* out)
+{
+    fprintf(out, "%zu window(s), %llu samples, %zu changes\n", timeline.WindowCount(),
+            static_cast<unsigned long long>(timeline.Samples()), timeline.Changes());
+    for (size_t i = 0; i < timeline.WindowCount(); i++)
+    {
+        const StyleTimelineWindow& window = timeline.Window(i);
+        std::wstring className;
+        for (size_t c = 0; c < STYLE_TIMELINE_CLASS_LENGTH && window.className[c] != 0; c++)
+            className += static_cast<wchar_t>(window.className[c]);
+        fprintf(out, "  [%zu] 0x%08llX %ls (process 0x%08lX), first seen at %lu ms\n", i, static_cast<unsigned long long>(window.window),
+                className.c_str(), static_cast<unsigned long>(window.processId), static_cast<unsigned long>(window.firstSeenMs));
+    }
+
+    timeline.Decode([out](const StyleTimeline::Change& change)
+    {
+        fprintf(out, "%10.3f ms [%u] 0x%08X 0x%08X", static_cast<double>(change.timeUs) / 1000.0, change.window, change.style, change.exStyle);
+        PrintFlags(out, change.styleChanged, change.style, STYLE_FLAG_NAMES, "");
+        PrintFlags(out, change.exStyleChanged, change.exStyle, EX_STYLE_FLAG_NAMES, "WS_EX_");
+        fprintf(out, "\n");
+    });
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+
+// The style and extended style of a few windows over time, sampled far more
+// often than they change. A sample that changed nothing costs a compare; one
+// that did appends a few bytes: the time since the previous change, the
+// window, and which bits flipped. Bits get their names only when the timeline
+// is decoded, offline.
+//
+//   StyleTimelineHeader
+//   StyleTimelineWindow[windowCount]
+//   uint8_t changes[changeBytes]
+//
+// A change is a varint time delta in microseconds, a varint window index, a
+// byte with the number of flipped bits and one byte per flipped bit: 0-31
+// for the style, 32-63 for the extended style. A window starts out at 0.
+
+constexpr char STYLE_TIMELINE_MAGIC[8] = { 'S', 'T', 'F', 'S', 'T', 'Y', 'L', 'E' };
+constexpr uint32_t STYLE_TIMELINE_VERSION = 1;
+constexpr size_t STYLE_TIMELINE_CLASS_LENGTH = 64;
+
+// What each bit of a style means, from WinUser.h. The low 16 bits of WS_* are
+// the window class's own; multi-bit styles (WS_CAPTION, WS_OVERLAPPEDWINDOW...)
+// are just their bits.
+constexpr const char* STYLE_FLAG_NAMES[32] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    "WS_MAXIMIZEBOX", "WS_MINIMIZEBOX", "WS_THICKFRAME", "WS_SYSMENU",
+    "WS_HSCROLL", "WS_VSCROLL", "WS_DLGFRAME", "WS_BORDER",
+    "WS_MAXIMIZE", "WS_CLIPCHILDREN", "WS_CLIPSIBLINGS", "WS_DISABLED",
+    "WS_VISIBLE", "WS_MINIMIZE", "WS_CHILD", "WS_POPUP",
+};
+
+constexpr const char* EX_STYLE_FLAG_NAMES[32] = {
+    "WS_EX_DLGMODALFRAME", nullptr, "WS_EX_NOPARENTNOTIFY", "WS_EX_TOPMOST",
+    "WS_EX_ACCEPTFILES", "WS_EX_TRANSPARENT", "WS_EX_MDICHILD", "WS_EX_TOOLWINDOW",
+    "WS_EX_WINDOWEDGE", "WS_EX_CLIENTEDGE", "WS_EX_CONTEXTHELP", nullptr,
+    "WS_EX_RIGHT", "WS_EX_RTLREADING", "WS_EX_LEFTSCROLLBAR", nullptr,
+    "WS_EX_CONTROLPARENT", "WS_EX_STATICEDGE", "WS_EX_APPWINDOW", "WS_EX_LAYERED",
+    "WS_EX_NOINHERITLAYOUT", "WS_EX_NOREDIRECTIONBITMAP", "WS_EX_LAYOUTRTL", nullptr,
+    nullptr, "WS_EX_COMPOSITED", nullptr, "WS_EX_NOACTIVATE",
+    nullptr, nullptr, nullptr, nullptr,
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t windowCount;
+    uint64_t changeBytes;
+    // Including those that changed nothing
+    uint64_t sampleCount;
+} StyleTimelineHeader;
+
+typedef struct {
+    uint64_t window;
+    uint32_t processId;
+    // When it was first seen; the first change's time delta counts from 0, not from here
+    uint32_t firstSeenMs;
+    // UTF-16, NUL-terminated unless it's that long
+    uint16_t className[STYLE_TIMELINE_CLASS_LENGTH];
+} StyleTimelineWindow;
+
+static_assert(sizeof(StyleTimelineHeader) == 32, "StyleTimelineHeader layout");
+static_assert(sizeof(StyleTimelineWindow) == 144, "StyleTimelineWindow layout");
+
+class StyleTimeline
+{
+public:
+    // One decoded change: the window's styles after it, and the bits that flipped.
+    typedef struct {
+        uint64_t timeUs;
+        uint16_t window;
+        uint32_t style;
+        uint32_t exStyle;
+        uint32_t styleChanged;
+        uint32_t exStyleChanged;
+    } Change;
+
+    typedef std::function<void(const Change&)> ChangeCallback;
+
+    // Returns the window's index for Sample; NO_WINDOW once there are too many.
+    uint16_t AddWindow(WindowHandle hWnd, ProcessId processId, const wchar_t* className, uint64_t timeUs);
+
+    // `timeUs` never goes backwards.
+    void Sample(const uint64_t timeUs, const uint16_t window, const uint32_t style, const uint32_t exStyle)
+    {
+        samples++;
+        const State& state = states[window];
+        if (style != state.style || exStyle != state.exStyle)
+            Append(timeUs, window, style, exStyle);
+    }
+
+    size_t WindowCount() const { return windows.size(); }
+    const StyleTimelineWindow& Window(const size_t index) const { return windows[index]; }
+    uint64_t Samples() const { return samples; }
+    size_t Changes() const { return changes; }
+    size_t EncodedBytes() const { return bytes.size(); }
+    // Changes that didn't fit in MAX_BYTES
+    uint64_t DroppedChanges() const { return droppedChanges; }
+
+    bool Save(const std::string& path) const;
+    // Returns false, and describes the problem in `error`, if the file is not a valid timeline.
+    bool Load(const std::string& path, std::string& error);
+
+    // Every change, in order.
+    void Decode(const ChangeCallback& callback) const;
+
+    static constexpr uint16_t NO_WINDOW = UINT16_MAX;
+    static constexpr size_t MAX_WINDOWS = 4096;
+    static constexpr size_t MAX_BYTES = 16 * 1024 * 1024;
+
+private:
+    typedef struct {
+        uint32_t style;
+        uint32_t exStyle;
+    } State;
+
+    void Append(uint64_t timeUs, uint16_t window, uint32_t style, uint32_t exStyle);
+    void AppendVarint(uint64_t value);
+
+    std::vector<StyleTimelineWindow> windows;
+    std::vector<State> states;
+    std::vector<uint8_t> bytes;
+    uint64_t lastChangeUs = 0;
+    uint64_t samples = 0;
+    size_t changes = 0;
+    uint64_t droppedChanges = 0;
+};
+
+// One line per change, with the names of the flags that were set (+) or cleared (-).
+void PrintStyleTimeline(const StyleTimeline& timeline, FILE* out);
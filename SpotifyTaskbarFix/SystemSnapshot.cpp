@@ -0,0 +1,30 @@
+#include "SystemSnapshot.h"
+
+#include <algorithm>
+
+std::shared_ptr<const SystemSnapshot> SystemSnapshot::Take(DesktopBackend& desktop)
+{
+    auto snapshot = std::make_shared<SystemSnapshot>();
+    desktop.EnumSystemProcesses([&](const ProcessId processId, const ProcessId parentProcessId, const wchar_t* imageName)
+    {
+        snapshot->processes.push_back({ processId, parentProcessId, imageName });
+    }, [&](const ProcessId processId, const ThreadId threadId)
+    {
+        snapshot->threads.Add(processId, threadId);
+    });
+
+    std::sort(snapshot->processes.begin(), snapshot->processes.end(), [](const Process& a, const Process& b)
+    {
+        return a.processId < b.processId;
+    });
+    return snapshot;
+}
+
+const SystemSnapshot::Process* SystemSnapshot::Find(const ProcessId processId) const
+{
+    const auto it = std::lower_bound(processes.begin(), processes.end(), processId, [](const Process& process, const ProcessId id)
+    {
+        return process.processId < id;
+    });
+    return it != processes.end() && it->processId == processId ? &*it : nullptr;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DesktopBackend.h"
+#include "ProcessThreadIndex.h"
+
+// Every process on the system and the threads they own, from one snapshot.
+// Taken once at startup to find the apps that were already running before
+// us; every job started from it shares it instead of taking its own.
+// Immutable once taken, so it can be handed between threads as is.
+class SystemSnapshot
+{
+public:
+    typedef struct {
+        ProcessId processId;
+        ProcessId parentProcessId;
+        std::wstring imageName;
+    } Process;
+
+    static std::shared_ptr<const SystemSnapshot> Take(DesktopBackend& desktop);
+
+    // Sorted by process ID.
+    const std::vector<Process>& Processes() const { return processes; }
+    const ProcessThreadIndex& Threads() const { return threads; }
+
+    const Process* Find(ProcessId processId) const;
+
+private:
+    std::vector<Process> processes;
+    ProcessThreadIndex threads;
+};
@@ -0,0 +1,65 @@
+#include "TaskbarNudge.h"
+
+const char* NudgeDecisionName(const NudgeDecision decision)
+{
+    switch (decision)
+    {
+        case NudgeDecision::Move:
+            return "on a secondary monitor";
+        case NudgeDecision::UnknownTopology:
+            return "on an unknown monitor";
+        case NudgeDecision::SingleMonitor:
+            return "on the only monitor";
+        case NudgeDecision::OnPrimaryMonitor:
+            return "on the primary monitor";
+        case NudgeDecision::NoTaskbarOnMonitor:
+            return "on a monitor without a taskbar";
+    }
+    return "?";
+}
+
+TaskbarNudge PlanTaskbarNudge(const MonitorTopology& topology, const WindowRect& window)
+{
+    TaskbarNudge nudge = {};
+    const int32_t width = window.right - window.left;
+    const int32_t height = window.bottom - window.top;
+
+    const size_t primary = topology.Primary();
+    if (topology.Empty() || primary == MonitorTopology::NO_MONITOR)
+    {
+        nudge.decision = NudgeDecision::UnknownTopology;
+        nudge.moveCount = 2;
+        nudge.moves[0] = { { 0, 0, width, height }, false, false };
+        nudge.moves[1] = { window, false, false };
+        return nudge;
+    }
+
+    if (topology.Monitors().size() == 1)
+    {
+        nudge.decision = NudgeDecision::SingleMonitor;
+        return nudge;
+    }
+
+    const size_t current = topology.MonitorFromRect(window);
+    if (current == primary)
+    {
+        nudge.decision = NudgeDecision::OnPrimaryMonitor;
+        return nudge;
+    }
+    if (topology.Monitor(current).taskbar == TaskbarEdge::None)
+    {
+        nudge.decision = NudgeDecision::NoTaskbarOnMonitor;
+        return nudge;
+    }
+
+    // The top-left corner of the primary work area puts as much of the window
+    // as possible on the primary monitor, and none of it under its taskbar.
+    const WindowRect& workArea = topology.Monitor(primary).workArea;
+    const bool dpiChanges = topology.Monitor(current).dpi != topology.Monitor(primary).dpi;
+
+    nudge.decision = NudgeDecision::Move;
+    nudge.moveCount = 2;
+    nudge.moves[0] = { { workArea.left, workArea.top, workArea.left + width, workArea.top + height }, false, false };
+    nudge.moves[1] = { window, dpiChanges, false };
+    return nudge;
+}
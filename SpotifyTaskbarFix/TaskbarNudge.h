@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+#include "DesktopBackend.h"
+#include "MonitorTopology.h"
+
+enum class NudgeDecision : uint8_t
+{
+    // The window is on a secondary monitor with its own taskbar: round trip through the primary one
+    Move,
+    // No monitor information: do the round trip blindly, through (0, 0)
+    UnknownTopology,
+    // The taskbar button can't be on the wrong taskbar:
+    SingleMonitor,
+    OnPrimaryMonitor,
+    NoTaskbarOnMonitor,
+};
+
+const char* NudgeDecisionName(NudgeDecision decision);
+
+typedef struct {
+    NudgeDecision decision;
+    size_t moveCount;
+    WindowMove moves[2];
+} TaskbarNudge;
+
+// The shell files a window's taskbar button under the taskbar of the monitor
+// the window is on, and moves it when the window changes monitor. Spotify's
+// button can end up on the wrong taskbar when its window opens on another
+// monitor; moving the window to the primary monitor and back re-homes it.
+//
+// The plan is the cheapest such round trip: none at all when the button
+// can't be misplaced, otherwise two moves that don't resize (unless the
+// monitors' DPIs differ, in which case the way back restores the size the
+// app's DPI scaling changed) and don't redraw. The two moves have to be two
+// separate SetWindowPos calls: a DeferWindowPos batch merges the positions
+// of the same window, so the round trip would collapse into a no-op and the
+// shell would never see the window change monitor.
+TaskbarNudge PlanTaskbarNudge(const MonitorTopology& topology, const WindowRect& window);
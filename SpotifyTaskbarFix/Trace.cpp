@@ -0,0 +1,216 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+
+#include "Log.h"
+
+using namespace std::chrono;
+
+namespace
+{
+    constexpr const char* PHASE_NAMES[] = {
+        "WmiDelivery",
+        "ExecDelivery",
+        "Indicate",
+        "WaitInputIdle",
+        "IdentifyMainProcess",
+        "FindMainWindow",
+        "WaitVisible",
+        "WindowSearch",
+        "MoveWindow",
+        "Fix",
+    };
+    static_assert(sizeof PHASE_NAMES / sizeof PHASE_NAMES[0] == static_cast<size_t>(TracePhase::Count), "missing phase name");
+
+    // Small, stable numbers read better than OS thread IDs in the trace viewer
+    uint32_t CurrentThreadTraceId()
+    {
+        static std::atomic<uint32_t> nextId{ 1 };
+        thread_local const uint32_t id = nextId++;
+        return id;
+    }
+
+    unsigned HighestBit(uint64_t value)
+    {
+        unsigned bit = 0;
+        while (value >>= 1)
+            bit++;
+        return bit;
+    }
+}
+
+
+const char* TracePhaseName(const TracePhase phase)
+{
+    return phase < TracePhase::Count ? PHASE_NAMES[static_cast<size_t>(phase)] : "?";
+}
+
+
+// ========================
+//     LatencyHistogram
+// ========================
+
+void LatencyHistogram::Record(const uint64_t us)
+{
+    buckets[BucketOf(us)]++;
+    count++;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+        buckets[i] += other.buckets[i];
+    count += other.count;
+}
+
+void LatencyHistogram::Clear()
+{
+    buckets.fill(0);
+    count = 0;
+}
+
+uint64_t LatencyHistogram::Percentile(const double q) const
+{
+    if (count == 0)
+        return 0;
+
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return UpperBoundOf(i);
+    }
+    return UpperBoundOf(BUCKETS - 1);
+}
+
+size_t LatencyHistogram::BucketOf(const uint64_t us)
+{
+    if (us < SUB_BUCKETS)
+        return static_cast<size_t>(us);
+
+    const unsigned shift = HighestBit(us) - SUB_BUCKET_BITS;
+    const size_t subBucket = static_cast<size_t>(us >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + subBucket;
+}
+
+uint64_t LatencyHistogram::UpperBoundOf(const size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    const size_t shift = bucket / SUB_BUCKETS - 1;
+    const uint64_t lowerBound = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lowerBound + ((1ull << shift) - 1);
+}
+
+
+// ==============
+//     Tracer
+// ==============
+
+Tracer::Tracer() : ring(CAPACITY), windowStartUs(Now())
+{
+}
+
+Tracer& Tracer::Instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+uint64_t Tracer::Now()
+{
+    return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void Tracer::Record(const TracePhase phase, const ProcessId processId, const uint64_t startUs, const uint64_t endUs)
+{
+    const uint64_t durationUs = endUs > startUs ? endUs - startUs : 0;
+    const uint32_t threadId = CurrentThreadTraceId();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Event& event = ring[written % CAPACITY];
+    event.startUs = startUs;
+    event.durationUs = static_cast<uint32_t>(durationUs < UINT32_MAX ? durationUs : UINT32_MAX);
+    event.threadId = threadId;
+    event.processId = processId;
+    event.phase = phase;
+    written++;
+
+    if (endUs > windowStartUs && endUs - windowStartUs >= ROLLING_WINDOW_US)
+    {
+        previous = current;
+        for (LatencyHistogram& histogram : current)
+            histogram.Clear();
+        windowStartUs = endUs;
+    }
+    current[static_cast<size_t>(phase)].Record(durationUs);
+}
+
+bool Tracer::WriteChromeTrace(const char* const path) const
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const size_t count = written < CAPACITY ? written : CAPACITY;
+        events.reserve(count);
+        for (size_t i = written - count; i < written; i++)
+            events.push_back(ring[i % CAPACITY]);
+    }
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    if (fopen_s(&file, path, "w") != 0)
+        return false;
+#else
+    file = fopen(path, "w");
+#endif
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const Event& event = events[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"fix\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%lu,\"pid\":%lu,\"tid\":%lu}",
+                i == 0 ? "" : ",", TracePhaseName(event.phase),
+                static_cast<unsigned long long>(event.startUs), static_cast<unsigned long>(event.durationUs),
+                static_cast<unsigned long>(event.processId), static_cast<unsigned long>(event.threadId));
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
+
+PhaseStats Tracer::Stats(const TracePhase phase) const
+{
+    LatencyHistogram histogram;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        histogram = current[static_cast<size_t>(phase)];
+        histogram.Merge(previous[static_cast<size_t>(phase)]);
+    }
+    return { histogram.Count(), histogram.Percentile(0.50), histogram.Percentile(0.95), histogram.Percentile(0.99) };
+}
+
+void Tracer::LogSummary() const
+{
+    Log(LogLevel::Info, "  %-20s %8s %10s %10s %10s", "Phase (ms)", "count", "p50", "p95", "p99");
+    for (size_t i = 0; i < static_cast<size_t>(TracePhase::Count); i++)
+    {
+        const auto phase = static_cast<TracePhase>(i);
+        const PhaseStats stats = Stats(phase);
+        if (stats.count == 0)
+            continue;
+
+        Log(LogLevel::Info, "  %-20s %8llu %10.3f %10.3f %10.3f", TracePhaseName(phase), static_cast<unsigned long long>(stats.count),
+                static_cast<double>(stats.p50) / 1000, static_cast<double>(stats.p95) / 1000, static_cast<double>(stats.p99) / 1000);
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "Platform.h"
+
+// Where the time of a fix goes. Every phase of a FixJob is recorded as one
+// span, plus the synchronous pieces of work inside them, plus how long WMI
+// (or, on Linux, the kernel's process connector) took to deliver the start
+// event in the first place.
+enum class TracePhase : uint8_t
+{
+    WmiDelivery,
+    ExecDelivery,
+    Indicate,
+    WaitInputIdle,
+    IdentifyMainProcess,
+    FindMainWindow,
+    WaitVisible,
+    WindowSearch,
+    MoveWindow,
+    Fix,
+
+    Count
+};
+
+const char* TracePhaseName(TracePhase phase);
+
+// Log-linear latency histogram over microseconds: 8 sub-buckets per power of
+// two, i.e. at most 12.5% relative error, in a fixed 2 KiB.
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t us);
+    void Merge(const LatencyHistogram& other);
+    void Clear();
+
+    uint64_t Count() const { return count; }
+    // Upper bound of the bucket holding the q-th quantile (0 < q <= 1); 0 if empty.
+    uint64_t Percentile(double q) const;
+
+private:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t BucketOf(uint64_t us);
+    static uint64_t UpperBoundOf(size_t bucket);
+
+    std::array<uint32_t, BUCKETS> buckets = {};
+    uint64_t count = 0;
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+} PhaseStats;
+
+// Process-wide trace recorder. Spans go into a ring buffer preallocated at
+// startup (the oldest are overwritten) and into per-phase histograms that
+// roll over every ROLLING_WINDOW, so percentiles cover between one and two
+// windows of recent fixes. Recording takes one uncontended lock and never
+// allocates.
+class Tracer
+{
+public:
+    typedef struct {
+        uint64_t startUs;
+        uint32_t durationUs;
+        uint32_t threadId;
+        ProcessId processId;
+        TracePhase phase;
+    } Event;
+
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr uint64_t ROLLING_WINDOW_US = 30ull * 60 * 1000 * 1000;
+
+    static Tracer& Instance();
+
+    // Monotonic microseconds, for span timestamps.
+    static uint64_t Now();
+
+    void Record(TracePhase phase, ProcessId processId, uint64_t startUs, uint64_t endUs);
+
+    // Writes every buffered span as Chrome trace-event JSON (chrome://tracing, Perfetto).
+    // Spans are grouped by the target process they belong to.
+    bool WriteChromeTrace(const char* path) const;
+
+    PhaseStats Stats(TracePhase phase) const;
+    // One log line per phase that has any samples.
+    void LogSummary() const;
+
+private:
+    Tracer();
+
+    mutable std::mutex mutex;
+    std::vector<Event> ring;
+    size_t written = 0;
+
+    std::array<LatencyHistogram, static_cast<size_t>(TracePhase::Count)> current;
+    std::array<LatencyHistogram, static_cast<size_t>(TracePhase::Count)> previous;
+    uint64_t windowStartUs;
+};
+
+// Records the lifetime of the scope as one span.
+class TraceSpan
+{
+public:
+    TraceSpan(const TracePhase phase, const ProcessId processId) : phase(phase), processId(processId), startUs(Tracer::Now()) {}
+    ~TraceSpan() { Tracer::Instance().Record(phase, processId, startUs, Tracer::Now()); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const TracePhase phase;
+    const ProcessId processId;
+    const uint64_t startUs;
+};
@@ -0,0 +1,70 @@
+#include "Utf8.h"
+
+#include <cstdint>
+
+
+std::string WideToUtf8(const std::wstring& text)
+{
+    std::string result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t codePoint = static_cast<uint32_t>(text[i]);
+        if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint < 0xDC00 && i + 1 < text.size())
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (static_cast<uint32_t>(text[++i]) - 0xDC00);
+
+        if (codePoint < 0x80)
+        {
+            result.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800)
+        {
+            result.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000)
+        {
+            result.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            result.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            result.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+    return result;
+}
+
+std::wstring Utf8ToWide(const std::string& text)
+{
+    std::wstring result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size();)
+    {
+        const auto c = static_cast<unsigned char>(text[i]);
+        const size_t length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+
+        uint32_t codePoint = length == 1 ? c : length == 2 ? c & 0x1F : length == 3 ? c & 0x0F : c & 0x07;
+        for (size_t j = 1; j < length && i + j < text.size(); j++)
+            codePoint = (codePoint << 6) | (static_cast<unsigned char>(text[i + j]) & 0x3F);
+        i += length;
+
+        if (sizeof(wchar_t) == 2 && codePoint > 0xFFFF)
+        {
+            codePoint -= 0x10000;
+            result.push_back(static_cast<wchar_t>(0xD800 + (codePoint >> 10)));
+            result.push_back(static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF)));
+        }
+        else
+        {
+            result.push_back(static_cast<wchar_t>(codePoint));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// For the text files the program reads and writes, which are all UTF-8.
+// Invalid sequences are not rejected, just decoded as best as possible.
+std::string WideToUtf8(const std::wstring& text);
+std::wstring Utf8ToWide(const std::string& text);
@@ -0,0 +1,110 @@
+#include "WaitSchedule.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace
+{
+    PhaseSchedule FixedPhase(const uint32_t timeoutMs, const uint32_t intervalMs)
+    {
+        PhaseSchedule schedule = {};
+        schedule.timeoutMs = timeoutMs;
+        schedule.stepCount = 1;
+        schedule.steps[0] = { timeoutMs, intervalMs };
+        return schedule;
+    }
+}
+
+const char* WaitPhaseName(const WaitPhase phase)
+{
+    switch (phase)
+    {
+        case WaitPhase::InputIdle:
+            return "InputIdle";
+        case WaitPhase::MainProcess:
+            return "MainProcess";
+        case WaitPhase::MainWindow:
+            return "MainWindow";
+        case WaitPhase::Visible:
+            return "Visible";
+        case WaitPhase::Count:
+            break;
+    }
+    return "?";
+}
+
+WaitSchedule FixedWaitSchedule()
+{
+    WaitSchedule schedule;
+    schedule.phases[static_cast<size_t>(WaitPhase::InputIdle)] = FixedPhase(WAIT_FOR_INPUT_IDLE_TIMEOUT, INPUT_IDLE_POLL_INTERVAL);
+    schedule.phases[static_cast<size_t>(WaitPhase::MainProcess)] = FixedPhase(MAIN_PROCESS_IDENTIFICATION_TIMEOUT, FIND_SPOTIFY_WINDOW_POLL_INTERVAL);
+    schedule.phases[static_cast<size_t>(WaitPhase::MainWindow)] = FixedPhase(FIND_SPOTIFY_WINDOW_RETRY_TIMEOUT, FIND_SPOTIFY_WINDOW_POLL_INTERVAL);
+    schedule.phases[static_cast<size_t>(WaitPhase::Visible)] = FixedPhase(WINDOW_VISIBLE_TIMEOUT, WINDOW_VISIBLE_POLL_INTERVAL);
+    return schedule;
+}
+
+uint32_t PollInterval(const PhaseSchedule& schedule, const uint32_t elapsedMs)
+{
+    if (schedule.stepCount == 0)
+        return schedule.timeoutMs;
+
+    for (uint32_t i = 0; i < schedule.stepCount; i++)
+    {
+        if (elapsedMs < schedule.steps[i].untilMs)
+            return schedule.steps[i].intervalMs;
+    }
+    return schedule.steps[schedule.stepCount - 1].intervalMs;
+}
+
+
+// ==========================
+//     SCHEDULE SIMULATION
+// ==========================
+
+ScheduleScore ScoreSchedule(const PhaseSchedule& schedule, const std::vector<uint32_t>& latenciesMs)
+{
+    ScheduleScore score = { 0.0, 0.0, 0.0 };
+    if (latenciesMs.empty())
+        return score;
+
+    uint64_t totalDelay = 0;
+    uint64_t totalWakeups = 0;
+    size_t successes = 0;
+    for (const uint32_t latency : latenciesMs)
+    {
+        uint32_t t = 0;
+        while (true)
+        {
+            totalWakeups++;
+            if (latency <= t)
+            {
+                totalDelay += t - latency;
+                successes++;
+                break;
+            }
+            if (t >= schedule.timeoutMs)
+                break;
+
+            t = std::min(t + std::max<uint32_t>(PollInterval(schedule, t), 1), schedule.timeoutMs);
+        }
+    }
+
+    const double count = static_cast<double>(latenciesMs.size());
+    score.meanDelayMs = successes > 0 ? static_cast<double>(totalDelay) / static_cast<double>(successes) : 0.0;
+    score.meanWakeups = static_cast<double>(totalWakeups) / count;
+    score.failureRate = static_cast<double>(latenciesMs.size() - successes) / count;
+    return score;
+}
+
+std::vector<uint32_t> SyntheticLatencies(const uint32_t medianMs, const double sigma, const size_t count, const uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::lognormal_distribution<double> distribution(std::log(static_cast<double>(std::max<uint32_t>(medianMs, 1))), sigma);
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        latencies.push_back(static_cast<uint32_t>(std::min(distribution(random), 3600.0 * 1000.0)));
+    return latencies;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The waits of a fix, in the order a FixJob goes through them.
+enum class WaitPhase : uint8_t
+{
+    InputIdle,
+    MainProcess,
+    MainWindow,
+    Visible,
+
+    Count
+};
+
+constexpr size_t WAIT_PHASE_COUNT = static_cast<size_t>(WaitPhase::Count);
+
+const char* WaitPhaseName(WaitPhase phase);
+
+
+// The fixed schedule, used until the latency model knows better.
+constexpr auto WAIT_FOR_INPUT_IDLE_TIMEOUT = 1 * 1000;
+constexpr auto MAIN_PROCESS_IDENTIFICATION_TIMEOUT = 500;
+constexpr auto FIND_SPOTIFY_WINDOW_RETRY_TIMEOUT = 5 * 1000;
+constexpr auto WINDOW_VISIBLE_TIMEOUT = 10 * 1000;
+
+// With an event source these are only upper bounds between re-checks.
+constexpr auto INPUT_IDLE_POLL_INTERVAL = 50;
+constexpr auto FIND_SPOTIFY_WINDOW_POLL_INTERVAL = 250;
+constexpr auto WINDOW_VISIBLE_POLL_INTERVAL = 100;
+
+
+constexpr size_t MAX_POLL_STEPS = 32;
+
+// Poll every `intervalMs` until `untilMs` into the phase.
+typedef struct {
+    uint32_t untilMs;
+    uint32_t intervalMs;
+} PollStep;
+
+// How long to wait for one phase, and how often to look while waiting.
+// Past the last step, the last interval applies.
+typedef struct {
+    uint32_t timeoutMs;
+    uint32_t stepCount;
+    PollStep steps[MAX_POLL_STEPS];
+} PhaseSchedule;
+
+typedef struct {
+    PhaseSchedule phases[WAIT_PHASE_COUNT];
+} WaitSchedule;
+
+WaitSchedule FixedWaitSchedule();
+
+// The interval before the next check, `elapsedMs` into the phase.
+uint32_t PollInterval(const PhaseSchedule& schedule, uint32_t elapsedMs);
+
+
+// ==========================
+//     SCHEDULE SIMULATION
+// ==========================
+
+typedef struct {
+    // Between the moment the awaited state is reached and the check that notices it
+    double meanDelayMs;
+    // Checks per wait, including the one made when entering the phase
+    double meanWakeups;
+    // Waits that timed out before the state was reached
+    double failureRate;
+} ScheduleScore;
+
+// Plays `schedule` against each latency, as if nothing but polling noticed
+// the awaited state (no window events): the worst case a schedule must handle.
+ScheduleScore ScoreSchedule(const PhaseSchedule& schedule, const std::vector<uint32_t>& latenciesMs);
+
+// Log-normally distributed latencies around `medianMs`; `sigma` is the
+// standard deviation of their logarithm. Deterministic for a given seed
+// (and standard library).
+std::vector<uint32_t> SyntheticLatencies(uint32_t medianMs, double sigma, size_t count, uint32_t seed);
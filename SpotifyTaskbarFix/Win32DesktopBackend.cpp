@@ -0,0 +1,422 @@
+#include "Win32DesktopBackend.h"
+
+#include <tlhelp32.h>
+#include <winternl.h>
+#include <cwchar>
+#include <utility>
+#include <vector>
+
+#pragma comment(lib, "Version.lib")
+
+namespace
+{
+    // Not in the SDK headers; available since Windows 8.1.
+    constexpr ULONG PROCESS_COMMAND_LINE_INFORMATION = 60;
+
+    typedef NTSTATUS (NTAPI* NtQueryInformationProcessFn)(HANDLE, ULONG, PVOID, ULONG, PULONG);
+
+    // From ShellScalingApi.h, which would also require linking Shcore.lib
+    constexpr int MDT_EFFECTIVE_DPI_VALUE = 0;
+    typedef HRESULT (WINAPI* GetDpiForMonitorFn)(HMONITOR, int, UINT*, UINT*);
+
+    BOOL CALLBACK EnumWindowsThunk(const HWND hWnd, const LPARAM lparam)
+    {
+        if (hWnd == INVALID_HANDLE_VALUE)
+            return TRUE;
+
+        const auto callback = reinterpret_cast<const DesktopBackend::WindowCallback*>(lparam);
+        return (*callback)(FromHWND(hWnd)) ? TRUE : FALSE;
+    }
+
+    BOOL CALLBACK EnumMonitorsThunk(const HMONITOR hMonitor, HDC, LPRECT, const LPARAM lparam)
+    {
+        reinterpret_cast<std::vector<HMONITOR>*>(lparam)->push_back(hMonitor);
+        return TRUE;
+    }
+
+    // A taskbar is docked along the monitor's edge it is closest to
+    TaskbarEdge TaskbarEdgeOf(const RECT& taskbar, const RECT& monitor)
+    {
+        const bool horizontal = taskbar.right - taskbar.left >= taskbar.bottom - taskbar.top;
+        if (horizontal)
+            return taskbar.top - monitor.top < monitor.bottom - taskbar.bottom ? TaskbarEdge::Top : TaskbarEdge::Bottom;
+        return taskbar.left - monitor.left < monitor.right - taskbar.right ? TaskbarEdge::Left : TaskbarEdge::Right;
+    }
+}
+
+
+uint64_t Win32DesktopBackend::Now()
+{
+    return GetTickCount64();
+}
+
+void Win32DesktopBackend::Sleep(const uint32_t ms)
+{
+    Count(1);
+    ::Sleep(ms);
+}
+
+bool Win32DesktopBackend::GetProcessImageName(const ProcessId processId, std::wstring& imageName)
+{
+    Count(1);
+    const HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == nullptr)
+        return false;
+
+    Count(2);
+    WCHAR path[MAX_PATH];
+    DWORD length = MAX_PATH;
+    const BOOL ok = QueryFullProcessImageNameW(hProcess, 0, path, &length);
+    CloseHandle(hProcess);
+    if (!ok)
+        return false;
+
+    const WCHAR* name = path + length;
+    while (name > path && name[-1] != L'\\')
+        name--;
+    imageName.assign(name, path + length);
+    return true;
+}
+
+bool Win32DesktopBackend::GetProcessCommandLine(const ProcessId processId, std::wstring& commandLine)
+{
+    static const auto NtQueryInformationProcess = reinterpret_cast<NtQueryInformationProcessFn>(
+        GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQueryInformationProcess"));
+    if (NtQueryInformationProcess == nullptr)
+        return false;
+
+    Count(1);
+    const HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == nullptr)
+        return false;
+
+    // The result is a UNICODE_STRING immediately followed by the characters it points to.
+    ULONG length = 0;
+    Count(2);
+    NtQueryInformationProcess(hProcess, PROCESS_COMMAND_LINE_INFORMATION, nullptr, 0, &length);
+
+    bool ok = false;
+    if (length >= sizeof(UNICODE_STRING))
+    {
+        std::vector<BYTE> buffer(length);
+        Count(1);
+        if (NtQueryInformationProcess(hProcess, PROCESS_COMMAND_LINE_INFORMATION, buffer.data(), length, &length) >= 0)
+        {
+            const auto* str = reinterpret_cast<const UNICODE_STRING*>(buffer.data());
+            commandLine.assign(str->Buffer, str->Length / sizeof(WCHAR));
+            ok = true;
+        }
+    }
+
+    CloseHandle(hProcess);
+    return ok;
+}
+
+bool Win32DesktopBackend::GetProcessImageVersion(const ProcessId processId, std::wstring& version)
+{
+    Count(1);
+    const HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (hProcess == nullptr)
+        return false;
+
+    Count(2);
+    WCHAR path[MAX_PATH];
+    DWORD length = MAX_PATH;
+    const BOOL ok = QueryFullProcessImageNameW(hProcess, 0, path, &length);
+    CloseHandle(hProcess);
+    if (!ok)
+        return false;
+
+    Count(1);
+    DWORD handle = 0;
+    const DWORD size = GetFileVersionInfoSizeW(path, &handle);
+    if (size == 0)
+        return false;
+
+    std::vector<BYTE> info(size);
+    VS_FIXEDFILEINFO* fixed = nullptr;
+    UINT fixedLength = 0;
+    Count(2);
+    if (!GetFileVersionInfoW(path, 0, size, info.data()) ||
+        !VerQueryValueW(info.data(), L"\\", reinterpret_cast<LPVOID*>(&fixed), &fixedLength) || fixedLength < sizeof *fixed)
+        return false;
+
+    WCHAR text[48];
+    swprintf_s(text, L"%u.%u.%u.%u", HIWORD(fixed->dwFileVersionMS), LOWORD(fixed->dwFileVersionMS),
+               HIWORD(fixed->dwFileVersionLS), LOWORD(fixed->dwFileVersionLS));
+    version = text;
+    return true;
+}
+
+Win32DesktopBackend::~Win32DesktopBackend()
+{
+    for (const auto& process : processHandles)
+        CloseHandle(process.second);
+}
+
+bool Win32DesktopBackend::WaitForInputIdle(const ProcessId processId, const uint32_t timeoutMs)
+{
+    // An open handle also keeps the process ID from being reused while it's polled
+    HANDLE hProcess;
+    {
+        std::lock_guard<std::mutex> lock(processHandlesMutex);
+        const auto it = processHandles.find(processId);
+        if (it != processHandles.end())
+        {
+            hProcess = it->second;
+        }
+        else
+        {
+            Count(1);
+            hProcess = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+            if (hProcess == nullptr)
+                return false;
+            processHandles.emplace(processId, hProcess);
+        }
+    }
+
+    // Only the job that waits on it releases it: it can't be closed under the wait
+    Count(1);
+    return ::WaitForInputIdle(hProcess, timeoutMs) == 0;
+}
+
+void Win32DesktopBackend::ReleaseProcess(const ProcessId processId)
+{
+    std::lock_guard<std::mutex> lock(processHandlesMutex);
+    const auto it = processHandles.find(processId);
+    if (it == processHandles.end())
+        return;
+
+    Count(1);
+    CloseHandle(it->second);
+    processHandles.erase(it);
+}
+
+void Win32DesktopBackend::EnumSystemThreads(const SystemThreadCallback& callback)
+{
+    Count(1);
+    const HANDLE hSnapshotThread = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, NULL);
+    if (hSnapshotThread == INVALID_HANDLE_VALUE)
+        return;
+
+    THREADENTRY32 thread;
+    thread.dwSize = sizeof thread;
+
+    if (Thread32First(hSnapshotThread, &thread))
+    {
+        do
+        {
+            if (thread.dwSize < FIELD_OFFSET(THREADENTRY32, th32OwnerProcessID) + sizeof thread.th32OwnerProcessID)
+                continue;
+
+            callback(thread.th32OwnerProcessID, thread.th32ThreadID);
+        } while (Thread32Next(hSnapshotThread, &thread));
+    }
+    Count(1);
+    CloseHandle(hSnapshotThread);
+}
+
+void Win32DesktopBackend::EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback)
+{
+    Count(1);
+    const HANDLE hSnapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS | TH32CS_SNAPTHREAD, NULL);
+    if (hSnapshot == INVALID_HANDLE_VALUE)
+        return;
+
+    PROCESSENTRY32W process;
+    process.dwSize = sizeof process;
+    if (Process32FirstW(hSnapshot, &process))
+    {
+        do
+        {
+            processCallback(process.th32ProcessID, process.th32ParentProcessID, process.szExeFile);
+        } while (Process32NextW(hSnapshot, &process));
+    }
+
+    THREADENTRY32 thread;
+    thread.dwSize = sizeof thread;
+    if (Thread32First(hSnapshot, &thread))
+    {
+        do
+        {
+            if (thread.dwSize < FIELD_OFFSET(THREADENTRY32, th32OwnerProcessID) + sizeof thread.th32OwnerProcessID)
+                continue;
+
+            threadCallback(thread.th32OwnerProcessID, thread.th32ThreadID);
+        } while (Thread32Next(hSnapshot, &thread));
+    }
+    Count(1);
+    CloseHandle(hSnapshot);
+}
+
+void Win32DesktopBackend::EnumWindowThreads(const ProcessId processId, const ThreadCallback& callback)
+{
+    // Top-level windows are orders of magnitude fewer than threads, and the
+    // threads that own them are exactly the ones EnumThreadWindows can find.
+    const auto visit = [&](const WindowHandle hWnd)
+    {
+        DWORD ownerProcessId = 0;
+        Count(1);
+        const DWORD threadId = GetWindowThreadProcessId(ToHWND(hWnd), &ownerProcessId);
+        if (ownerProcessId == processId && threadId != 0)
+            callback(threadId);
+        return true;
+    };
+    const WindowCallback windowCallback = visit;
+    Count(1);
+    ::EnumWindows(EnumWindowsThunk, reinterpret_cast<LPARAM>(&windowCallback));
+}
+
+void Win32DesktopBackend::EnumThreadWindows(const ThreadId threadId, const WindowCallback& callback)
+{
+    Count(1);
+    ::EnumThreadWindows(threadId, EnumWindowsThunk, reinterpret_cast<LPARAM>(&callback));
+}
+
+void Win32DesktopBackend::EnumChildWindows(const WindowHandle hWnd, const WindowCallback& callback)
+{
+    Count(1);
+    ::EnumChildWindows(ToHWND(hWnd), EnumWindowsThunk, reinterpret_cast<LPARAM>(&callback));
+}
+
+WindowHandle Win32DesktopBackend::FindChildWindow(const WindowHandle hParent, const wchar_t* const className)
+{
+    Count(1);
+    return FromHWND(FindWindowExW(ToHWND(hParent), nullptr, className, nullptr));
+}
+
+WindowHandle Win32DesktopBackend::GetParentWindow(const WindowHandle hWnd)
+{
+    // The parent of a top-level window is the desktop window
+    Count(1);
+    const HWND hParent = GetAncestor(ToHWND(hWnd), GA_PARENT);
+    return hParent != nullptr && hParent != GetDesktopWindow() ? FromHWND(hParent) : NULL_WINDOW;
+}
+
+ClassAtom Win32DesktopBackend::GetClassAtom(const WindowHandle hWnd)
+{
+    Count(1);
+    return static_cast<ClassAtom>(GetClassWord(ToHWND(hWnd), GCW_ATOM));
+}
+
+size_t Win32DesktopBackend::GetWindowClass(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    Count(1);
+    const int length = GetClassNameW(ToHWND(hWnd), buffer, static_cast<int>(bufferLength));
+    if (length <= 0 && bufferLength > 0)
+        buffer[0] = L'\0';
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
+
+size_t Win32DesktopBackend::GetWindowTitle(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    // Sends WM_GETTEXT to windows of other processes, and waits for their UI thread to answer
+    Count(1, 1);
+    const int length = GetWindowTextW(ToHWND(hWnd), buffer, static_cast<int>(bufferLength));
+    if (length <= 0 && bufferLength > 0)
+        buffer[0] = L'\0';
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
+
+uint32_t Win32DesktopBackend::GetStyle(const WindowHandle hWnd)
+{
+    Count(1);
+    return static_cast<uint32_t>(GetWindowLongA(ToHWND(hWnd), GWL_STYLE));
+}
+
+uint32_t Win32DesktopBackend::GetExStyle(const WindowHandle hWnd)
+{
+    Count(1);
+    return static_cast<uint32_t>(GetWindowLongA(ToHWND(hWnd), GWL_EXSTYLE));
+}
+
+WindowRect Win32DesktopBackend::GetWindowPosition(const WindowHandle hWnd)
+{
+    RECT rect;
+    Count(3);
+    GetWindowRect(ToHWND(hWnd), &rect);
+    MapWindowPoints(HWND_DESKTOP, GetParent(ToHWND(hWnd)), reinterpret_cast<LPPOINT>(&rect), 2);
+    return { rect.left, rect.top, rect.right, rect.bottom };
+}
+
+bool Win32DesktopBackend::SetWindowPosition(const WindowHandle hWnd, const WindowMove& move)
+{
+    UINT flags = SWP_NOZORDER | SWP_NOOWNERZORDER | SWP_NOACTIVATE;
+    if (!move.resize)
+        flags |= SWP_NOSIZE;
+    if (!move.redraw)
+        flags |= SWP_NOREDRAW;
+
+    // WM_WINDOWPOSCHANGING & co. are sent to the owner's thread
+    Count(1, 1);
+    const WindowRect& rect = move.rect;
+    return SetWindowPos(ToHWND(hWnd), nullptr, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, flags) != FALSE;
+}
+
+void Win32DesktopBackend::EnumMonitors(const MonitorCallback& callback)
+{
+    // Per-monitor DPI needs Windows 8.1; before that, every monitor has the system DPI.
+    static const auto GetDpiForMonitor = reinterpret_cast<GetDpiForMonitorFn>(
+        GetProcAddress(LoadLibraryW(L"shcore.dll"), "GetDpiForMonitor"));
+
+    // The primary taskbar is a Shell_TrayWnd; with the taskbar shown on all
+    // displays, every other monitor gets a Shell_SecondaryTrayWnd.
+    std::vector<std::pair<HMONITOR, TaskbarEdge>> taskbars;
+    for (const wchar_t* className : { L"Shell_TrayWnd", L"Shell_SecondaryTrayWnd" })
+    {
+        HWND hTaskbar = nullptr;
+        while ((hTaskbar = FindWindowExW(nullptr, hTaskbar, className, nullptr)) != nullptr)
+        {
+            RECT taskbar;
+            MONITORINFO info = { sizeof info };
+            const HMONITOR hMonitor = MonitorFromWindow(hTaskbar, MONITOR_DEFAULTTONEAREST);
+            Count(4);
+            if (GetWindowRect(hTaskbar, &taskbar) && GetMonitorInfoW(hMonitor, &info))
+                taskbars.emplace_back(hMonitor, TaskbarEdgeOf(taskbar, info.rcMonitor));
+        }
+        Count(1);
+    }
+
+    std::vector<HMONITOR> monitors;
+    Count(1);
+    EnumDisplayMonitors(nullptr, nullptr, EnumMonitorsThunk, reinterpret_cast<LPARAM>(&monitors));
+
+    for (const HMONITOR hMonitor : monitors)
+    {
+        MONITORINFO info = { sizeof info };
+        Count(1);
+        if (!GetMonitorInfoW(hMonitor, &info))
+            continue;
+
+        MonitorInfo monitor;
+        monitor.bounds = { info.rcMonitor.left, info.rcMonitor.top, info.rcMonitor.right, info.rcMonitor.bottom };
+        monitor.workArea = { info.rcWork.left, info.rcWork.top, info.rcWork.right, info.rcWork.bottom };
+        monitor.dpi = USER_DEFAULT_SCREEN_DPI;
+        monitor.primary = HasFlag(info.dwFlags, MONITORINFOF_PRIMARY);
+        monitor.taskbar = TaskbarEdge::None;
+
+        UINT dpiX, dpiY;
+        Count(1);
+        if (GetDpiForMonitor != nullptr && SUCCEEDED(GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI_VALUE, &dpiX, &dpiY)))
+            monitor.dpi = dpiX;
+
+        for (const auto& taskbar : taskbars)
+        {
+            if (taskbar.first == hMonitor)
+                monitor.taskbar = taskbar.second;
+        }
+
+        callback(monitor);
+    }
+}
+
+BackendCounters Win32DesktopBackend::Counters() const
+{
+    return { syscalls.load(), messages.load() };
+}
+
+void Win32DesktopBackend::ResetCounters()
+{
+    syscalls = 0;
+    messages = 0;
+}
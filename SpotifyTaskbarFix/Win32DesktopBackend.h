@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <Windows.h>
+
+#include "DesktopBackend.h"
+
+class Win32DesktopBackend final : public DesktopBackend
+{
+public:
+    Win32DesktopBackend() = default;
+    ~Win32DesktopBackend() override;
+
+    Win32DesktopBackend(const Win32DesktopBackend&) = delete;
+    Win32DesktopBackend& operator=(const Win32DesktopBackend&) = delete;
+
+    uint64_t Now() override;
+    void Sleep(uint32_t ms) override;
+
+    bool GetProcessImageName(ProcessId processId, std::wstring& imageName) override;
+    bool GetProcessCommandLine(ProcessId processId, std::wstring& commandLine) override;
+    bool GetProcessImageVersion(ProcessId processId, std::wstring& version) override;
+
+    // A fix job polls the same process over and over: its handle stays open until ReleaseProcess.
+    bool WaitForInputIdle(ProcessId processId, uint32_t timeoutMs) override;
+    void ReleaseProcess(ProcessId processId) override;
+    void EnumSystemThreads(const SystemThreadCallback& callback) override;
+    void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) override;
+    void EnumWindowThreads(ProcessId processId, const ThreadCallback& callback) override;
+
+    void EnumThreadWindows(ThreadId threadId, const WindowCallback& callback) override;
+    void EnumChildWindows(WindowHandle hWnd, const WindowCallback& callback) override;
+    WindowHandle FindChildWindow(WindowHandle hParent, const wchar_t* className) override;
+    WindowHandle GetParentWindow(WindowHandle hWnd) override;
+
+    ClassAtom GetClassAtom(WindowHandle hWnd) override;
+    size_t GetWindowClass(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+    size_t GetWindowTitle(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+
+    uint32_t GetStyle(WindowHandle hWnd) override;
+    uint32_t GetExStyle(WindowHandle hWnd) override;
+
+    WindowRect GetWindowPosition(WindowHandle hWnd) override;
+    bool SetWindowPosition(WindowHandle hWnd, const WindowMove& move) override;
+
+    void EnumMonitors(const MonitorCallback& callback) override;
+
+    bool Concurrent() const override { return true; }
+
+    BackendCounters Counters() const override;
+    void ResetCounters() override;
+
+private:
+    void Count(const uint64_t calls, const uint64_t crossProcessMessages = 0)
+    {
+        syscalls += calls;
+        messages += crossProcessMessages;
+    }
+
+    std::mutex processHandlesMutex;
+    std::unordered_map<ProcessId, HANDLE> processHandles;
+
+    // The backend is shared by the scheduler's worker and whoever else needs the desktop
+    std::atomic<uint64_t> syscalls{ 0 };
+    std::atomic<uint64_t> messages{ 0 };
+};
+
+inline HWND ToHWND(const WindowHandle hWnd)
+{
+    return reinterpret_cast<HWND>(hWnd);
+}
+
+inline WindowHandle FromHWND(const HWND hWnd)
+{
+    return reinterpret_cast<WindowHandle>(hWnd);
+}
@@ -0,0 +1,190 @@
+#include "Win32EventLoop.h"
+
+#include <WtsApi32.h>
+
+#pragma comment(lib, "Wtsapi32.lib")
+
+namespace
+{
+    constexpr const wchar_t* WINDOW_CLASS = L"SpotifyTaskbarFix-EventLoop";
+
+    // Windows kills the process 5 seconds after a console close event
+    constexpr DWORD CONSOLE_SHUTDOWN_WAIT = 4000;
+}
+
+Win32EventLoop* Win32EventLoop::instance = nullptr;
+
+
+Win32EventLoop::~Win32EventLoop()
+{
+    Close();
+}
+
+bool Win32EventLoop::Open()
+{
+    if (hWnd != nullptr)
+        return true;
+
+    // Console control handlers carry no user data, hence the single instance.
+    instance = this;
+
+    hWake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    hClosed = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (hWake == nullptr || hClosed == nullptr)
+        return false;
+
+    WNDCLASSEXW windowClass = {};
+    windowClass.cbSize = sizeof windowClass;
+    windowClass.lpfnWndProc = WindowProc;
+    windowClass.hInstance = GetModuleHandle(nullptr);
+    windowClass.lpszClassName = WINDOW_CLASS;
+    RegisterClassExW(&windowClass);
+
+    hWnd = CreateWindowExW(WS_EX_TOOLWINDOW, WINDOW_CLASS, L"", WS_POPUP, 0, 0, 0, 0,
+                           nullptr, nullptr, windowClass.hInstance, this);
+    if (hWnd == nullptr)
+        return false;
+
+    sessionNotifications = WTSRegisterSessionNotification(hWnd, NOTIFY_FOR_THIS_SESSION) != FALSE;
+    SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+    return true;
+}
+
+void Win32EventLoop::Close()
+{
+    if (instance == this)
+    {
+        SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+        instance = nullptr;
+    }
+
+    if (hWnd != nullptr)
+    {
+        if (sessionNotifications)
+            WTSUnRegisterSessionNotification(hWnd);
+        DestroyWindow(hWnd);
+        hWnd = nullptr;
+    }
+
+    if (hWake != nullptr)
+    {
+        CloseHandle(hWake);
+        hWake = nullptr;
+    }
+
+    // Lets a console handler that's waiting for us return; the handle stays
+    // open, the handler may not have woken up yet
+    if (hClosed != nullptr)
+        SetEvent(hClosed);
+}
+
+size_t Win32EventLoop::Wait()
+{
+    const std::vector<WatchedHandle>& watched = WatchedHandles();
+    if (handles.size() != watched.size() + 1)
+    {
+        handles.assign(1, hWake);
+        for (const WatchedHandle& handle : watched)
+            handles.push_back(handle.handle);
+    }
+
+    const DWORD count = static_cast<DWORD>(handles.size());
+    const DWORD result = MsgWaitForMultipleObjectsEx(count, handles.data(), INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+    // hWake: whoever woke us up posted something, and that's what gets counted
+    if (result == WAIT_OBJECT_0)
+        return 0;
+
+    if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + count)
+    {
+        watched[result - WAIT_OBJECT_0 - 1].handler();
+        return 1;
+    }
+
+    if (result == WAIT_OBJECT_0 + count)
+    {
+        size_t dispatched = 0;
+        MSG msg;
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+            dispatched++;
+        }
+        return dispatched;
+    }
+
+    return 0;
+}
+
+void Win32EventLoop::Wake()
+{
+    SetEvent(hWake);
+}
+
+LRESULT CALLBACK Win32EventLoop::WindowProc(const HWND hWnd, const UINT uMsg, const WPARAM wParam, const LPARAM lParam)
+{
+    if (uMsg == WM_NCCREATE)
+    {
+        const CREATESTRUCTW* create = reinterpret_cast<const CREATESTRUCTW*>(lParam);
+        SetWindowLongPtrW(hWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(create->lpCreateParams));
+    }
+
+    Win32EventLoop* loop = reinterpret_cast<Win32EventLoop*>(GetWindowLongPtrW(hWnd, GWLP_USERDATA));
+    if (loop == nullptr)
+        return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+
+    switch (uMsg)
+    {
+        case WM_DISPLAYCHANGE:
+            loop->Dispatch(SystemNotification::DisplayChanged);
+            return 0;
+
+        case WM_SETTINGCHANGE:
+            // A taskbar was moved, resized or auto-hidden
+            if (wParam == SPI_SETWORKAREA)
+                loop->Dispatch(SystemNotification::DisplayChanged);
+            return 0;
+
+        case WM_WTSSESSION_CHANGE:
+            loop->Dispatch(SystemNotification::SessionChanged);
+            return 0;
+
+        case WM_QUERYENDSESSION:
+            return TRUE;
+
+        case WM_ENDSESSION:
+            if (wParam != FALSE)
+                loop->Dispatch(SystemNotification::Shutdown);
+            return 0;
+
+        default:
+            return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+    }
+}
+
+BOOL WINAPI Win32EventLoop::ConsoleCtrlHandler(const DWORD ctrlType)
+{
+    // Called on a thread of its own
+    Win32EventLoop* loop = instance;
+    if (loop == nullptr)
+        return FALSE;
+
+    switch (ctrlType)
+    {
+        case CTRL_C_EVENT:
+        case CTRL_BREAK_EVENT:
+        case CTRL_CLOSE_EVENT:
+        case CTRL_LOGOFF_EVENT:
+        case CTRL_SHUTDOWN_EVENT:
+        {
+            const HANDLE hClosed = loop->hClosed;
+            loop->Notify(SystemNotification::Shutdown);
+            WaitForSingleObject(hClosed, CONSOLE_SHUTDOWN_WAIT);
+            return TRUE;
+        }
+
+        default:
+            return FALSE;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include <Windows.h>
+
+#include "EventLoop.h"
+
+// EventLoop on MsgWaitForMultipleObjectsEx. A hidden top-level window gets the
+// broadcasts (message-only windows don't): WM_DISPLAYCHANGE and work area
+// changes become DisplayChanged, WTS session changes SessionChanged, and
+// WM_ENDSESSION, Ctrl+C, Ctrl+Break and closing the console Shutdown.
+//
+// The process can be terminated as soon as WM_ENDSESSION returns, so Shutdown
+// is dispatched from inside it; the console handler instead gives the loop a
+// few seconds to run and reach Close.
+class Win32EventLoop final : public EventLoop
+{
+public:
+    ~Win32EventLoop() override;
+
+    // On the thread that will call Run.
+    bool Open();
+    // After Run returned and everything has been torn down.
+    void Close();
+
+protected:
+    size_t Wait() override;
+    void Wake() override;
+
+private:
+    static LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+    static BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType);
+
+    static Win32EventLoop* instance;
+
+    HWND hWnd = nullptr;
+    HANDLE hWake = nullptr;
+    HANDLE hClosed = nullptr;
+    bool sessionNotifications = false;
+    // hWake, then the watched handles
+    std::vector<HANDLE> handles;
+};
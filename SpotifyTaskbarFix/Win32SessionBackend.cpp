@@ -0,0 +1,98 @@
+#include "Win32SessionBackend.h"
+
+#include <Windows.h>
+#include <UserEnv.h>
+#include <WtsApi32.h>
+
+#pragma comment(lib, "Userenv.lib")
+#pragma comment(lib, "Wtsapi32.lib")
+
+namespace
+{
+    // A worker gets this long to wind down once its pipe is closed
+    constexpr DWORD WORKER_EXIT_WAIT = 5000;
+
+    class Win32SessionWorker final : public SessionWorker
+    {
+    public:
+        Win32SessionWorker(const HANDLE hProcess, const HANDLE hPipe) : hProcess(hProcess), hPipe(hPipe) {}
+
+        ~Win32SessionWorker() override
+        {
+            CloseHandle(hPipe);
+            WaitForSingleObject(hProcess, WORKER_EXIT_WAIT);
+            CloseHandle(hProcess);
+        }
+
+        Win32SessionWorker(const Win32SessionWorker&) = delete;
+        Win32SessionWorker& operator=(const Win32SessionWorker&) = delete;
+
+        bool Deliver(const ProcessStartEvent& event) override
+        {
+            // A few hundred bytes never fill the pipe's buffer unless the worker is stuck
+            DWORD written = 0;
+            return WriteFile(hPipe, &event, sizeof event, &written, nullptr) && written == sizeof event;
+        }
+
+    private:
+        const HANDLE hProcess;
+        const HANDLE hPipe;
+    };
+}
+
+
+SessionId Win32SessionBackend::SessionOf(const ProcessId processId)
+{
+    DWORD sessionId = 0;
+    return ProcessIdToSessionId(processId, &sessionId) ? sessionId : 0;
+}
+
+std::unique_ptr<SessionWorker> Win32SessionBackend::StartWorker(const SessionId sessionId)
+{
+    HANDLE hToken = nullptr;
+    if (!WTSQueryUserToken(sessionId, &hToken))
+        return nullptr;
+
+    // Only the read end is inherited
+    SECURITY_ATTRIBUTES inheritable = { sizeof inheritable, nullptr, TRUE };
+    HANDLE hRead = nullptr;
+    HANDLE hWrite = nullptr;
+    if (!CreatePipe(&hRead, &hWrite, &inheritable, 0))
+    {
+        CloseHandle(hToken);
+        return nullptr;
+    }
+    SetHandleInformation(hWrite, HANDLE_FLAG_INHERIT, 0);
+
+    void* environment = nullptr;
+    if (!CreateEnvironmentBlock(&environment, hToken, FALSE))
+        environment = nullptr;
+
+    STARTUPINFOW startupInfo = {};
+    startupInfo.cb = sizeof startupInfo;
+    startupInfo.lpDesktop = const_cast<LPWSTR>(L"winsta0\\default");
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdInput = hRead;
+    startupInfo.hStdOutput = INVALID_HANDLE_VALUE;
+    startupInfo.hStdError = INVALID_HANDLE_VALUE;
+
+    PROCESS_INFORMATION processInfo = {};
+    std::wstring commandLine = workerCommandLine;
+    const BOOL started = CreateProcessAsUserW(hToken, nullptr, &commandLine[0], nullptr, nullptr, TRUE,
+                                              CREATE_UNICODE_ENVIRONMENT | CREATE_NO_WINDOW, environment, nullptr,
+                                              &startupInfo, &processInfo);
+
+    if (environment != nullptr)
+        DestroyEnvironmentBlock(environment);
+    CloseHandle(hRead);
+    CloseHandle(hToken);
+
+    if (!started)
+    {
+        CloseHandle(hWrite);
+        return nullptr;
+    }
+
+    CloseHandle(processInfo.hThread);
+    return std::make_unique<Win32SessionWorker>(processInfo.hProcess, hWrite);
+}
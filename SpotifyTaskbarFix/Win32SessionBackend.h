@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "SessionRouter.h"
+
+// Workers are copies of this program started in the session as its logged-on
+// user (WTSQueryUserToken, so the service has to run as LocalSystem), on the
+// session's interactive desktop. Events go down an anonymous pipe that is the
+// worker's standard input; closing it tells the worker to quit.
+class Win32SessionBackend final : public SessionBackend
+{
+public:
+    // The worker's command line, executable path included.
+    void SetWorkerCommandLine(const std::wstring& commandLine) { workerCommandLine = commandLine; }
+
+    SessionId SessionOf(ProcessId processId) override;
+    std::unique_ptr<SessionWorker> StartWorker(SessionId sessionId) override;
+
+private:
+    std::wstring workerCommandLine;
+};
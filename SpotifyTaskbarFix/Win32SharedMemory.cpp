@@ -0,0 +1,65 @@
+#include "Win32SharedMemory.h"
+
+Win32SharedMemory::~Win32SharedMemory()
+{
+    Close();
+}
+
+bool Win32SharedMemory::Create(const char* name, const size_t size)
+{
+    Close();
+
+    const ULONGLONG size64 = size;
+    hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                  static_cast<DWORD>(size64 >> 32), static_cast<DWORD>(size64), name);
+    if (hMapping != nullptr && GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(hMapping);
+        hMapping = nullptr;
+        return false;
+    }
+    return hMapping != nullptr && Map(size);
+}
+
+bool Win32SharedMemory::Open(const char* name, const size_t size)
+{
+    Close();
+
+    hMapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name);
+    if (hMapping == nullptr || !Map(size))
+        return false;
+
+    // The view is rounded up to whole pages, so that's all this can tell
+    MEMORY_BASIC_INFORMATION info;
+    if (VirtualQuery(data, &info, sizeof info) == 0 || info.RegionSize < size)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void Win32SharedMemory::Close()
+{
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (hMapping != nullptr)
+        CloseHandle(hMapping);
+
+    data = nullptr;
+    size = 0;
+    hMapping = nullptr;
+}
+
+bool Win32SharedMemory::Map(const size_t mapSize)
+{
+    data = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, mapSize);
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    size = mapSize;
+    return true;
+}
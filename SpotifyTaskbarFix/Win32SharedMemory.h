@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "SharedMemory.h"
+
+// SharedMemory on a pagefile-backed file mapping. Names without a "Global\"
+// or "Local\" prefix end up in the caller's session, like "Local\".
+class Win32SharedMemory final : public SharedMemory
+{
+public:
+    Win32SharedMemory() = default;
+    ~Win32SharedMemory() override;
+
+    Win32SharedMemory(const Win32SharedMemory&) = delete;
+    Win32SharedMemory& operator=(const Win32SharedMemory&) = delete;
+
+    bool Create(const char* name, size_t size) override;
+    bool Open(const char* name, size_t size) override;
+    void Close() override;
+
+private:
+    bool Map(size_t size);
+
+    HANDLE hMapping = nullptr;
+};
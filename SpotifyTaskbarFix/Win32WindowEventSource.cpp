@@ -0,0 +1,92 @@
+#include "Win32WindowEventSource.h"
+
+Win32WindowEventSource* Win32WindowEventSource::instance = nullptr;
+
+
+Win32WindowEventSource::~Win32WindowEventSource()
+{
+    Stop();
+}
+
+bool Win32WindowEventSource::Start()
+{
+    if (thread.joinable())
+        return true;
+
+    // WinEvent callbacks carry no user data, hence the single instance.
+    instance = this;
+
+    const HANDLE hReady = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (hReady == nullptr)
+        return false;
+
+    thread = std::thread(&Win32WindowEventSource::MessageLoop, this, hReady);
+    WaitForSingleObject(hReady, INFINITE);
+    CloseHandle(hReady);
+
+    // Without a hook, the thread is already on its way out: left joinable, the next Start would think it's running
+    if (threadId == 0)
+    {
+        thread.join();
+        thread = std::thread();
+        instance = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Win32WindowEventSource::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    PostThreadMessage(threadId, WM_QUIT, 0, 0);
+    thread.join();
+    threadId = 0;
+    instance = nullptr;
+}
+
+void Win32WindowEventSource::MessageLoop(const HANDLE hReady)
+{
+    // Make sure the thread has a message queue before anyone can post to it.
+    MSG msg;
+    PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+
+    const HWINEVENTHOOK hCreateShowHook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_SHOW, nullptr, WinEventProc,
+                                                          0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    const HWINEVENTHOOK hNameChangeHook = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, nullptr, WinEventProc,
+                                                          0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+
+    if (hCreateShowHook != nullptr || hNameChangeHook != nullptr)
+        threadId = GetCurrentThreadId();
+    SetEvent(hReady);
+
+    if (threadId != 0)
+    {
+        while (GetMessage(&msg, nullptr, 0, 0) > 0)
+        {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+    }
+
+    if (hCreateShowHook != nullptr)
+        UnhookWinEvent(hCreateShowHook);
+    if (hNameChangeHook != nullptr)
+        UnhookWinEvent(hNameChangeHook);
+}
+
+void CALLBACK Win32WindowEventSource::WinEventProc(HWINEVENTHOOK, const DWORD event, const HWND hWnd, const LONG idObject, const LONG idChild, DWORD, DWORD)
+{
+    if (hWnd == nullptr || idObject != OBJID_WINDOW || idChild != CHILDID_SELF)
+        return;
+    if (event == EVENT_OBJECT_DESTROY)
+        return;
+
+    if (instance == nullptr)
+        return;
+
+    DWORD processId = 0;
+    GetWindowThreadProcessId(hWnd, &processId);
+    instance->Raise(processId);
+}
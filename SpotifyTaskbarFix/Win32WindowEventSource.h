@@ -0,0 +1,27 @@
+#pragma once
+
+#include <thread>
+
+#include <Windows.h>
+
+#include "WindowEventHub.h"
+
+// Out-of-context WinEvent hooks (EVENT_OBJECT_CREATE/SHOW/NAMECHANGE) serviced
+// by a dedicated message-loop thread.
+class Win32WindowEventSource final : public WindowEventHub
+{
+public:
+    ~Win32WindowEventSource() override;
+
+    bool Start();
+    void Stop();
+
+private:
+    static void CALLBACK WinEventProc(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD);
+    void MessageLoop(HANDLE hReady);
+
+    static Win32WindowEventSource* instance;
+
+    std::thread thread;
+    DWORD threadId = 0;
+};
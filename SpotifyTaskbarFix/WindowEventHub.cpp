@@ -0,0 +1,69 @@
+#include "WindowEventHub.h"
+
+#include <chrono>
+
+void WindowEventHub::Watch(const ProcessId processId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    watched[processId].watchers++;
+}
+
+void WindowEventHub::Unwatch(const ProcessId processId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = watched.find(processId);
+    if (it != watched.end() && --it->second.watchers == 0)
+        watched.erase(it);
+}
+
+uint64_t WindowEventHub::Sequence(const ProcessId processId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = watched.find(processId);
+    return it != watched.end() ? it->second.sequence : 0;
+}
+
+uint64_t WindowEventHub::GlobalSequence()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return globalSequence;
+}
+
+bool WindowEventHub::WaitForWindowEvent(const ProcessId processId, const uint64_t sequence, const uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]
+    {
+        const auto it = watched.find(processId);
+        return it != watched.end() && it->second.sequence != sequence;
+    });
+}
+
+bool WindowEventHub::WaitForAnyWindowEvent(const uint64_t sequence, const uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return globalSequence != sequence; });
+}
+
+void WindowEventHub::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        globalSequence++;
+    }
+    cv.notify_all();
+}
+
+void WindowEventHub::Raise(const ProcessId processId)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = watched.find(processId);
+        if (it == watched.end())
+            return;
+
+        it->second.sequence++;
+        globalSequence++;
+    }
+    cv.notify_all();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+#include "WindowEventSource.h"
+
+// Thread-safe bookkeeping shared by real-time event sources: watched
+// processes, sequence numbers and the waits on them. Platform sources only
+// have to call Raise; on its own, nothing ever raises and every wait simply
+// times out, which is the polling fallback.
+class WindowEventHub : public WindowEventSource
+{
+public:
+    void Watch(ProcessId processId) override;
+    void Unwatch(ProcessId processId) override;
+
+    uint64_t Sequence(ProcessId processId) override;
+    uint64_t GlobalSequence() override;
+
+    bool WaitForWindowEvent(ProcessId processId, uint64_t sequence, uint32_t timeoutMs) override;
+    bool WaitForAnyWindowEvent(uint64_t sequence, uint32_t timeoutMs) override;
+
+    void Interrupt() override;
+
+protected:
+    // Ignored unless the process is being watched.
+    void Raise(ProcessId processId);
+
+private:
+    typedef struct {
+        unsigned watchers;
+        uint64_t sequence;
+    } WatchedProcess;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::unordered_map<ProcessId, WatchedProcess> watched;
+    uint64_t globalSequence = 0;
+};
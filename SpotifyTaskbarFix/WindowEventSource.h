@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Platform.h"
+
+// Notifies about window activity (creation, visibility, title changes) of
+// watched processes, so the fix can react as soon as a window becomes ready
+// instead of sleeping for fixed intervals.
+//
+// Every event for a watched process bumps that process's sequence number, as
+// well as a global one; read the sequence *before* checking a condition and
+// pass it to the wait so that an event arriving in between is not lost.
+class WindowEventSource
+{
+public:
+    virtual ~WindowEventSource() = default;
+
+    virtual void Watch(ProcessId processId) = 0;
+    virtual void Unwatch(ProcessId processId) = 0;
+
+    virtual uint64_t Sequence(ProcessId processId) = 0;
+    virtual uint64_t GlobalSequence() = 0;
+
+    // Both return true if the sequence moved past `sequence` before the timeout.
+    virtual bool WaitForWindowEvent(ProcessId processId, uint64_t sequence, uint32_t timeoutMs) = 0;
+    virtual bool WaitForAnyWindowEvent(uint64_t sequence, uint32_t timeoutMs) = 0;
+
+    // Bumps the global sequence without a window event, to wake WaitForAnyWindowEvent.
+    virtual void Interrupt() = 0;
+};
+
+class WindowEventWatch final
+{
+    WindowEventSource* source;
+    ProcessId processId;
+
+public:
+    WindowEventWatch(WindowEventSource* source, const ProcessId processId) : source(source), processId(processId)
+    {
+        if (source != nullptr)
+            source->Watch(processId);
+    }
+
+    ~WindowEventWatch()
+    {
+        if (source != nullptr)
+            source->Unwatch(processId);
+    }
+
+    WindowEventWatch(const WindowEventWatch&) = delete;
+    WindowEventWatch& operator=(const WindowEventWatch&) = delete;
+};
@@ -0,0 +1,160 @@
+#include "WindowHintCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "Utf8.h"
+
+namespace
+{
+    std::vector<std::string> SplitFields(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        size_t begin = 0;
+        while (true)
+        {
+            const size_t end = line.find('\t', begin);
+            fields.push_back(line.substr(begin, end - begin));
+            if (end == std::string::npos)
+                return fields;
+            begin = end + 1;
+        }
+    }
+}
+
+
+// =========================
+//     WINDOW HINT CACHE
+// =========================
+
+bool WindowHintCache::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        // <app> <version> <thread ordinal> <class>...
+        const std::vector<std::string> fields = SplitFields(line);
+        if (fields.size() < 3 || fields.size() - 3 > MAX_HINT_DEPTH || fields[2].empty() || fields[2].size() > 9 ||
+            fields[2].find_first_not_of("0123456789") != std::string::npos)
+            continue;
+
+        Entry entry;
+        entry.app = Utf8ToWide(fields[0]);
+        entry.version = Utf8ToWide(fields[1]);
+        entry.hint.threadOrdinal = static_cast<uint32_t>(std::stoul(fields[2]));
+        for (size_t i = 3; i < fields.size(); i++)
+            entry.hint.classPath.push_back(Utf8ToWide(fields[i]));
+
+        // The file is in the same order as the cache: anything past the limit is the least recently used
+        const auto sameApp = [&](const Entry& other) { return other.app == entry.app; };
+        if (IndexOf(entry.app, entry.version) == entries.size() &&
+            static_cast<size_t>(std::count_if(entries.begin(), entries.end(), sameApp)) < MAX_HINT_VERSIONS)
+            entries.push_back(entry);
+    }
+    return true;
+}
+
+bool WindowHintCache::Save(const std::string& path) const
+{
+    std::ostringstream text;
+    text << "# Where each app's main window was, per version of its executable, tab-separated:\n"
+            "# app, version, ordinal of the window's thread, classes from the window down to its content\n";
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Entry& entry : entries)
+        {
+            text << WideToUtf8(entry.app) << "\t" << WideToUtf8(entry.version) << "\t" << entry.hint.threadOrdinal;
+            for (const std::wstring& className : entry.hint.classPath)
+                text << "\t" << WideToUtf8(className);
+            text << "\n";
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    file << text.str();
+    return static_cast<bool>(file);
+}
+
+bool WindowHintCache::Find(const std::wstring& app, const std::wstring& version, WindowHint& hint) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t index = IndexOf(app, version);
+    if (index == entries.size())
+        return false;
+
+    hint = entries[index].hint;
+    return true;
+}
+
+void WindowHintCache::Hit(const std::wstring& app, const std::wstring& version)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    hits++;
+
+    const size_t index = IndexOf(app, version);
+    if (index < entries.size())
+        Touch(index);
+}
+
+void WindowHintCache::Miss(const std::wstring& app, const std::wstring& version, const WindowHint& hint)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    misses++;
+
+    size_t index = IndexOf(app, version);
+    if (index == entries.size())
+        entries.push_back({ app, version, {} });
+    entries[index].hint = hint;
+    Touch(index);
+
+    // Older versions of the app are most likely gone for good
+    size_t versions = 0;
+    for (size_t i = 0; i < entries.size();)
+    {
+        if (entries[i].app == app && ++versions > MAX_HINT_VERSIONS)
+            entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(i));
+        else
+            i++;
+    }
+}
+
+uint64_t WindowHintCache::Hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t WindowHintCache::Misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+size_t WindowHintCache::IndexOf(const std::wstring& app, const std::wstring& version) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].app == app && entries[i].version == version)
+            return i;
+    }
+    return entries.size();
+}
+
+void WindowHintCache::Touch(const size_t index)
+{
+    std::rotate(entries.begin(), entries.begin() + static_cast<std::ptrdiff_t>(index), entries.begin() + static_cast<std::ptrdiff_t>(index) + 1);
+}
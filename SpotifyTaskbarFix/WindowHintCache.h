@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Versions of an app remembered at once; the least recently used one goes first.
+constexpr size_t MAX_HINT_VERSIONS = 4;
+// Deeper content windows are searched for the long way every time.
+constexpr size_t MAX_HINT_DEPTH = 16;
+
+// Where the main window was the last time it was found.
+typedef struct {
+    // Of the thread that owned the main window, among the process's threads in ProcessThreadIndex order
+    uint32_t threadOrdinal;
+    // Classes from the main window's child down to the content window; empty if the app has
+    // no content rule. Its length is the content window's depth.
+    std::vector<std::wstring> classPath;
+} WindowHint;
+
+// Window hints per app and version of its executable, persisted between runs.
+// A build of an app creates the same threads in the same order and the same
+// window tree every time it starts, so where its main window was is where it
+// will be; a new version may move it, and gets hints of its own. Thread-safe.
+class WindowHintCache
+{
+public:
+    // Returns false if the file could not be read. Lines it doesn't understand are skipped.
+    bool Load(const std::string& path);
+    bool Save(const std::string& path) const;
+
+    // Copies the hint for that version of the app into `hint`; false if there's none.
+    bool Find(const std::wstring& app, const std::wstring& version, WindowHint& hint) const;
+
+    // The main window was where the hint said.
+    void Hit(const std::wstring& app, const std::wstring& version);
+    // It took the full search; `hint` is where the window was instead.
+    void Miss(const std::wstring& app, const std::wstring& version, const WindowHint& hint);
+
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+
+private:
+    typedef struct {
+        std::wstring app;
+        std::wstring version;
+        WindowHint hint;
+    } Entry;
+
+    // The entry for that version of the app, or entries.size(). Expects the mutex to be held.
+    size_t IndexOf(const std::wstring& app, const std::wstring& version) const;
+    // Moves the entry to the front. Expects the mutex to be held.
+    void Touch(size_t index);
+
+    mutable std::mutex mutex;
+    // Most recently used first
+    std::vector<Entry> entries;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
@@ -0,0 +1,183 @@
+#include "WindowSearchPool.h"
+
+WindowSearchPool::~WindowSearchPool()
+{
+    Stop();
+}
+
+void WindowSearchPool::Start(const size_t workerCount)
+{
+    if (!workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = true;
+    }
+
+    for (size_t i = 0; i <= workerCount; i++)
+        queues.push_back(std::make_unique<TaskQueue>());
+    for (size_t i = 0; i < workerCount; i++)
+        workers.emplace_back(&WindowSearchPool::WorkerLoop, this, i);
+}
+
+void WindowSearchPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    queues.clear();
+}
+
+void WindowSearchPool::FindAppMainWindow(DesktopBackend& desktopBackend, ClassAtomCache& classes, const size_t searchedApp,
+                                         const std::vector<ThreadId>& searchedThreads, FindMainWindowResult* const result)
+{
+    if (workers.empty() || searchedThreads.size() < 2 || !desktopBackend.Concurrent())
+    {
+        ::FindAppMainWindow(desktopBackend, classes, searchedApp, searchedThreads, result);
+        return;
+    }
+
+    std::lock_guard<std::mutex> searchLock(searchMutex);
+    searches++;
+
+    const size_t taskCount = searchedThreads.size();
+    desktop = &desktopBackend;
+    threads = &searchedThreads;
+    app = searchedApp;
+    results.assign(taskCount, ThreadWindowsResult{});
+    found = taskCount;
+
+    // The class cache isn't thread-safe: every worker gets a copy, merged back at the end
+    workerClasses.clear();
+    for (size_t i = 0; i < workers.size(); i++)
+        workerClasses.push_back(std::make_unique<ClassAtomCache>(classes));
+
+    // Round-robin, so that every queue starts with the lowest threads it has
+    for (size_t task = 0; task < taskCount; task++)
+    {
+        TaskQueue& queue = *queues[task % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(task);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        busyWorkers = workers.size();
+    }
+    wake.notify_all();
+
+    RunTasks(queues.size() - 1, classes);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return busyWorkers == 0; });
+    }
+
+    for (const std::unique_ptr<ClassAtomCache>& cache : workerClasses)
+        classes.Merge(*cache);
+
+    // Same as the sequential search: the first thread with the window, and whatever came before it
+    const size_t last = found < taskCount ? found.load() : taskCount - 1;
+    result->hPWnd = NULL_WINDOW;
+    result->hWnd = NULL_WINDOW;
+    result->isMainProcess = false;
+    result->threadId = 0;
+    for (size_t task = 0; task <= last; task++)
+        result->isMainProcess |= results[task].isMainProcess;
+    if (found < taskCount)
+    {
+        result->hPWnd = results[found].hPWnd;
+        result->hWnd = results[found].hWnd;
+        result->threadId = searchedThreads[found];
+    }
+}
+
+void WindowSearchPool::WorkerLoop(const size_t queue)
+{
+    uint64_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return !running || generation != seenGeneration; });
+            if (!running)
+                return;
+            seenGeneration = generation;
+        }
+        RunTasks(queue, *workerClasses[queue]);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0)
+            done.notify_all();
+    }
+}
+
+void WindowSearchPool::RunTasks(const size_t queue, ClassAtomCache& classes)
+{
+    size_t task;
+    while (TakeTask(queue, &task))
+    {
+        // Past the first match, a thread can only be skipped
+        if (task > found)
+            cancelledTasks++;
+        else
+            Search(task, classes);
+    }
+}
+
+bool WindowSearchPool::TakeTask(const size_t queue, size_t* const task)
+{
+    {
+        TaskQueue& own = *queues[queue];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            *task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        TaskQueue& victim = *queues[(queue + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            *task = victim.tasks.back();
+            victim.tasks.pop_back();
+            stolenTasks++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WindowSearchPool::Search(const size_t task, ClassAtomCache& classes)
+{
+    const std::function<bool()> abandon = [this, task] { return found < task; };
+
+    ThreadWindowsResult& result = results[task];
+    FindAppMainWindowOfThread(*desktop, classes, app, (*threads)[task], nullptr, &abandon, &result);
+    if (result.abandoned)
+    {
+        cancelledTasks++;
+        return;
+    }
+
+    // Keep the lowest match
+    if (result.hPWnd != NULL_WINDOW)
+    {
+        size_t current = found;
+        while (task < current && !found.compare_exchange_weak(current, task))
+        {
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ClassAtomCache.h"
+#include "DesktopBackend.h"
+#include "SpotifyFix.h"
+
+// FindAppMainWindow spread over a few threads. Every thread of the searched
+// process is a task; each worker starts on its own queue, lowest thread
+// first, and steals from the back of the others' once it runs out. The
+// first match cancels every task that comes after it in thread order, while
+// those before it run to completion, so the result is always the one the
+// sequential search would have found. The caller works too, and idle
+// workers wait without any timeout.
+//
+// Windows of other processes are mostly cross-process calls that spend their
+// time waiting on the owner, which is what makes this worth it for apps
+// with dozens of threads. Backends that aren't Concurrent, and processes
+// with a single thread, are searched sequentially on the calling thread.
+class WindowSearchPool
+{
+public:
+    WindowSearchPool() = default;
+    ~WindowSearchPool();
+
+    WindowSearchPool(const WindowSearchPool&) = delete;
+    WindowSearchPool& operator=(const WindowSearchPool&) = delete;
+
+    void Start(size_t workers = DEFAULT_WORKERS);
+    void Stop();
+
+    // Same contract as FindAppMainWindow. `classes` learns the classes the workers saw.
+    // One search at a time; concurrent callers take turns.
+    void FindAppMainWindow(DesktopBackend& desktop, ClassAtomCache& classes, size_t app,
+                           const std::vector<ThreadId>& threads, FindMainWindowResult* result);
+
+    size_t Workers() const { return workers.size(); }
+    uint64_t Searches() const { return searches; }
+    uint64_t StolenTasks() const { return stolenTasks; }
+    // Threads that were never searched, or only partly, because an earlier one had the window
+    uint64_t CancelledTasks() const { return cancelledTasks; }
+
+    static constexpr size_t DEFAULT_WORKERS = 3;
+
+private:
+    typedef struct {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    } TaskQueue;
+
+    void WorkerLoop(size_t queue);
+    void RunTasks(size_t queue, ClassAtomCache& classes);
+    bool TakeTask(size_t queue, size_t* task);
+    void Search(size_t task, ClassAtomCache& classes);
+
+    std::vector<std::thread> workers;
+    // One per worker, plus the caller's (the last one)
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+
+    std::mutex searchMutex;
+
+    // Workers start on a new search when the generation changes, and the search
+    // isn't over until every one of them is done with it
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    size_t busyWorkers = 0;
+    bool running = false;
+
+    // The current search; only valid while it's running
+    DesktopBackend* desktop = nullptr;
+    const std::vector<ThreadId>* threads = nullptr;
+    size_t app = 0;
+    std::vector<std::unique_ptr<ClassAtomCache>> workerClasses;
+    std::vector<ThreadWindowsResult> results;
+    std::atomic<size_t> found{ 0 };
+
+    std::atomic<uint64_t> searches{ 0 };
+    std::atomic<uint64_t> stolenTasks{ 0 };
+    std::atomic<uint64_t> cancelledTasks{ 0 };
+};
@@ -0,0 +1,566 @@
+#include "X11DesktopBackend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <dlfcn.h>
+
+#include "ProcFs.h"
+#include "Utf8.h"
+
+// Before Xlib.h turns None into 0L
+constexpr TaskbarEdge NO_TASKBAR = TaskbarEdge::None;
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+namespace
+{
+    constexpr ClassAtom FIRST_CLASS_ATOM = 0xC000;
+    constexpr uint32_t INPUT_IDLE_POLL_MS = 10;
+    // Every Xinerama screen has the same DPI as far as X is concerned
+    constexpr uint32_t DEFAULT_DPI = 96;
+
+    // Straight out of the EWMH spec
+    constexpr long MOVERESIZE_X = 1L << 8;
+    constexpr long MOVERESIZE_Y = 1L << 9;
+    constexpr long MOVERESIZE_WIDTH = 1L << 10;
+    constexpr long MOVERESIZE_HEIGHT = 1L << 11;
+    constexpr long SOURCE_PAGER = 2L << 12;
+    constexpr long WM_STATE_NORMAL = 1;
+
+    // libXinerama is loaded at run time, so that its headers aren't needed to build
+    typedef struct {
+        int screen_number;
+        short x_org;
+        short y_org;
+        short width;
+        short height;
+    } XineramaScreenInfo;
+
+    typedef Bool (*XineramaIsActiveFn)(Display*);
+    typedef XineramaScreenInfo* (*XineramaQueryScreensFn)(Display*, int*);
+
+    // Requests on windows that are already gone fail asynchronously; that's expected
+    // here all the time, and Xlib's default handler would exit the program.
+    int IgnoreErrors(Display*, XErrorEvent*)
+    {
+        return 0;
+    }
+
+    Display* ToDisplay(_XDisplay* const display)
+    {
+        return reinterpret_cast<Display*>(display);
+    }
+
+    // A dock is docked along the monitor's edge it is closest to
+    TaskbarEdge TaskbarEdgeOf(const WindowRect& dock, const WindowRect& monitor)
+    {
+        const bool horizontal = dock.right - dock.left >= dock.bottom - dock.top;
+        if (horizontal)
+            return dock.top - monitor.top < monitor.bottom - dock.bottom ? TaskbarEdge::Top : TaskbarEdge::Bottom;
+        return dock.left - monitor.left < monitor.right - dock.right ? TaskbarEdge::Left : TaskbarEdge::Right;
+    }
+
+    size_t CopyText(const std::string& text, wchar_t* const buffer, const size_t bufferLength)
+    {
+        if (bufferLength == 0)
+            return 0;
+
+        const std::wstring wide = Utf8ToWide(text);
+        const size_t length = wide.copy(buffer, bufferLength - 1);
+        buffer[length] = L'\0';
+        return length;
+    }
+}
+
+
+X11DesktopBackend::~X11DesktopBackend()
+{
+    Close();
+}
+
+bool X11DesktopBackend::Open(const char* const displayName)
+{
+    // The scheduler's worker and the reconciliation share the connection
+    XInitThreads();
+    display = reinterpret_cast<_XDisplay*>(XOpenDisplay(displayName));
+    if (display == nullptr)
+        return false;
+
+    XSetErrorHandler(IgnoreErrors);
+    Display* const x = ToDisplay(display);
+    root = DefaultRootWindow(x);
+
+    atomClientList = XInternAtom(x, "_NET_CLIENT_LIST", False);
+    atomWmPid = XInternAtom(x, "_NET_WM_PID", False);
+    atomWmName = XInternAtom(x, "_NET_WM_NAME", False);
+    atomWmState = XInternAtom(x, "WM_STATE", False);
+    atomWindowType = XInternAtom(x, "_NET_WM_WINDOW_TYPE", False);
+    atomWindowTypeDock = XInternAtom(x, "_NET_WM_WINDOW_TYPE_DOCK", False);
+    atomMoveResize = XInternAtom(x, "_NET_MOVERESIZE_WINDOW", False);
+    atomUtf8String = XInternAtom(x, "UTF8_STRING", False);
+    return true;
+}
+
+void X11DesktopBackend::Close()
+{
+    if (display == nullptr)
+        return;
+
+    XCloseDisplay(ToDisplay(display));
+    display = nullptr;
+}
+
+uint64_t X11DesktopBackend::Now()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void X11DesktopBackend::Sleep(const uint32_t ms)
+{
+    Count(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+bool X11DesktopBackend::GetProcessImageName(const ProcessId processId, std::wstring& imageName)
+{
+    Count(1);
+    std::string name;
+    if (!ReadProcessImageName(processId, name))
+        return false;
+    imageName = Utf8ToWide(name);
+    return true;
+}
+
+bool X11DesktopBackend::GetProcessCommandLine(const ProcessId processId, std::wstring& commandLine)
+{
+    Count(3);
+    std::string arguments;
+    if (!ReadProcessCommandLine(processId, arguments))
+        return false;
+    commandLine = Utf8ToWide(arguments);
+    return true;
+}
+
+bool X11DesktopBackend::GetProcessImageVersion(const ProcessId processId, std::wstring& version)
+{
+    Count(1);
+    std::string text;
+    if (!ReadProcessImageVersion(processId, text))
+        return false;
+    version = Utf8ToWide(text);
+    return true;
+}
+
+bool X11DesktopBackend::WaitForInputIdle(const ProcessId processId, const uint32_t timeoutMs)
+{
+    const uint64_t deadline = Now() + timeoutMs;
+    while (true)
+    {
+        const std::vector<Client> clients = Clients();
+        if (std::any_of(clients.begin(), clients.end(), [&](const Client& client) { return client.processId == processId; }))
+            return true;
+        if (Now() >= deadline)
+            return false;
+        Sleep(INPUT_IDLE_POLL_MS);
+    }
+}
+
+void X11DesktopBackend::EnumSystemThreads(const SystemThreadCallback& callback)
+{
+    std::vector<ProcessId> owners;
+    for (const Client& client : Clients())
+    {
+        if (client.processId != 0 && std::find(owners.begin(), owners.end(), client.processId) == owners.end())
+            owners.push_back(client.processId);
+    }
+    for (const ProcessId processId : owners)
+        callback(processId, processId);
+}
+
+void X11DesktopBackend::EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback)
+{
+    Count(1);
+    EnumProcesses([&](const ProcessId processId, const ProcessId parentProcessId, const std::string& imageName)
+    {
+        Count(1);
+        processCallback(processId, parentProcessId, Utf8ToWide(imageName).c_str());
+    });
+    EnumSystemThreads(threadCallback);
+}
+
+void X11DesktopBackend::EnumWindowThreads(const ProcessId processId, const ThreadCallback& callback)
+{
+    const std::vector<Client> clients = Clients();
+    if (std::any_of(clients.begin(), clients.end(), [&](const Client& client) { return client.processId == processId; }))
+        callback(processId);
+}
+
+void X11DesktopBackend::EnumThreadWindows(const ThreadId threadId, const WindowCallback& callback)
+{
+    for (const Client& client : Clients())
+    {
+        if (client.processId == threadId && !callback(client.window))
+            return;
+    }
+}
+
+void X11DesktopBackend::EnumChildWindows(const WindowHandle hWnd, const WindowCallback& callback)
+{
+    EnumChildWindowsRecursive(hWnd, callback);
+}
+
+bool X11DesktopBackend::EnumChildWindowsRecursive(const unsigned long window, const WindowCallback& callback)
+{
+    Window rootReturn;
+    Window parent;
+    Window* children = nullptr;
+    unsigned int count = 0;
+    Count(1);
+    if (!XQueryTree(ToDisplay(display), window, &rootReturn, &parent, &children, &count))
+        return true;
+
+    // Depth first, like EnumChildWindows
+    bool proceed = true;
+    for (unsigned int i = 0; i < count && proceed; i++)
+        proceed = callback(children[i]) && EnumChildWindowsRecursive(children[i], callback);
+    if (children != nullptr)
+        XFree(children);
+    return proceed;
+}
+
+WindowHandle X11DesktopBackend::FindChildWindow(const WindowHandle hParent, const wchar_t* const className)
+{
+    Window rootReturn;
+    Window parent;
+    Window* children = nullptr;
+    unsigned int count = 0;
+    Count(1);
+    if (!XQueryTree(ToDisplay(display), hParent, &rootReturn, &parent, &children, &count))
+        return NULL_WINDOW;
+
+    const std::wstring wanted = className;
+    WindowHandle found = NULL_WINDOW;
+    std::string childClass;
+    for (unsigned int i = 0; i < count && found == NULL_WINDOW; i++)
+    {
+        if (ReadClass(children[i], childClass) && WStrICmp(Utf8ToWide(childClass).c_str(), wanted.c_str()) == 0)
+            found = children[i];
+    }
+    if (children != nullptr)
+        XFree(children);
+    return found;
+}
+
+WindowHandle X11DesktopBackend::GetParentWindow(const WindowHandle hWnd)
+{
+    // A client is top-level, however many frames the window manager wrapped it in
+    if (IsClient(hWnd))
+        return NULL_WINDOW;
+
+    Window rootReturn;
+    Window parent = 0;
+    Window* children = nullptr;
+    unsigned int count = 0;
+    Count(1);
+    if (!XQueryTree(ToDisplay(display), hWnd, &rootReturn, &parent, &children, &count))
+        return NULL_WINDOW;
+    if (children != nullptr)
+        XFree(children);
+    return parent == root ? NULL_WINDOW : parent;
+}
+
+ClassAtom X11DesktopBackend::GetClassAtom(const WindowHandle hWnd)
+{
+    std::string className;
+    if (!ReadClass(hWnd, className))
+        return NULL_ATOM;
+
+    std::transform(className.begin(), className.end(), className.begin(), [](const unsigned char c) { return static_cast<char>(tolower(c)); });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = classAtoms.find(className);
+    if (it != classAtoms.end())
+        return it->second;
+
+    // Like the system's atom table, it never shrinks; it's just a lot bigger than the classes of one desktop
+    if (classAtoms.size() > static_cast<size_t>(UINT16_MAX - FIRST_CLASS_ATOM))
+        return NULL_ATOM;
+    const ClassAtom atom = static_cast<ClassAtom>(FIRST_CLASS_ATOM + classAtoms.size());
+    classAtoms.emplace(className, atom);
+    return atom;
+}
+
+size_t X11DesktopBackend::GetWindowClass(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    std::string className;
+    if (!ReadClass(hWnd, className))
+        className.clear();
+    return CopyText(className, buffer, bufferLength);
+}
+
+size_t X11DesktopBackend::GetWindowTitle(const WindowHandle hWnd, wchar_t* const buffer, const size_t bufferLength)
+{
+    Display* const x = ToDisplay(display);
+    std::string title;
+
+    Atom type;
+    int format;
+    unsigned long count;
+    unsigned long remaining;
+    unsigned char* data = nullptr;
+    Count(1);
+    if (XGetWindowProperty(x, hWnd, atomWmName, 0, 1024, False, atomUtf8String, &type, &format, &count, &remaining, &data) == Success &&
+        data != nullptr && type == atomUtf8String && format == 8)
+    {
+        title.assign(reinterpret_cast<const char*>(data), count);
+    }
+    else
+    {
+        // Only in the legacy property: Latin-1, which is good enough for a title match
+        char* name = nullptr;
+        Count(1);
+        if (XFetchName(x, hWnd, &name) && name != nullptr)
+        {
+            title = name;
+            XFree(name);
+        }
+    }
+    if (data != nullptr)
+        XFree(data);
+    return CopyText(title, buffer, bufferLength);
+}
+
+uint32_t X11DesktopBackend::GetStyle(const WindowHandle hWnd)
+{
+    XWindowAttributes attributes;
+    Count(1);
+    if (!XGetWindowAttributes(ToDisplay(display), hWnd, &attributes))
+        return 0;
+
+    uint32_t style = attributes.map_state == IsViewable ? STYLE_VISIBLE : 0;
+    std::vector<unsigned long> state;
+    if (ReadCardinals(hWnd, atomWmState, state) && !state.empty() && static_cast<long>(state[0]) == WM_STATE_NORMAL)
+        style |= STYLE_SYSMENU;
+    return style;
+}
+
+uint32_t X11DesktopBackend::GetExStyle(const WindowHandle)
+{
+    return 0;
+}
+
+WindowRect X11DesktopBackend::GetWindowPosition(const WindowHandle hWnd)
+{
+    Display* const x = ToDisplay(display);
+    XWindowAttributes attributes;
+    Count(1);
+    if (!XGetWindowAttributes(x, hWnd, &attributes))
+        return WindowRect{ 0, 0, 0, 0 };
+
+    int left = attributes.x;
+    int top = attributes.y;
+    Window child;
+    if (IsClient(hWnd))
+    {
+        Count(1);
+        XTranslateCoordinates(x, hWnd, root, 0, 0, &left, &top, &child);
+    }
+    return WindowRect{ left, top, left + attributes.width, top + attributes.height };
+}
+
+bool X11DesktopBackend::SetWindowPosition(const WindowHandle hWnd, const WindowMove& move)
+{
+    // The window manager owns the frame: asking it is the only way the move sticks.
+    // X has no redraw to skip, a composited window is never invalidated by a move anyway.
+    XEvent event = {};
+    event.xclient.type = ClientMessage;
+    event.xclient.window = hWnd;
+    event.xclient.message_type = atomMoveResize;
+    event.xclient.format = 32;
+    event.xclient.data.l[0] = StaticGravity | MOVERESIZE_X | MOVERESIZE_Y | SOURCE_PAGER;
+    event.xclient.data.l[1] = move.rect.left;
+    event.xclient.data.l[2] = move.rect.top;
+    if (move.resize)
+    {
+        event.xclient.data.l[0] |= MOVERESIZE_WIDTH | MOVERESIZE_HEIGHT;
+        event.xclient.data.l[3] = move.rect.right - move.rect.left;
+        event.xclient.data.l[4] = move.rect.bottom - move.rect.top;
+    }
+
+    Display* const x = ToDisplay(display);
+    Count(2, 1);
+    const bool sent = XSendEvent(x, root, False, SubstructureRedirectMask | SubstructureNotifyMask, &event) != 0;
+    XFlush(x);
+    return sent;
+}
+
+void X11DesktopBackend::EnumMonitors(const MonitorCallback& callback)
+{
+    static void* const xinerama = dlopen("libXinerama.so.1", RTLD_NOW | RTLD_LOCAL);
+    static const auto XineramaIsActive = xinerama != nullptr ? reinterpret_cast<XineramaIsActiveFn>(dlsym(xinerama, "XineramaIsActive")) : nullptr;
+    static const auto XineramaQueryScreens = xinerama != nullptr ? reinterpret_cast<XineramaQueryScreensFn>(dlsym(xinerama, "XineramaQueryScreens")) : nullptr;
+
+    Display* const x = ToDisplay(display);
+    std::vector<MonitorInfo> monitors;
+    Count(1);
+    if (XineramaIsActive != nullptr && XineramaQueryScreens != nullptr && XineramaIsActive(x))
+    {
+        int count = 0;
+        Count(1);
+        XineramaScreenInfo* const screens = XineramaQueryScreens(x, &count);
+        for (int i = 0; i < count; i++)
+        {
+            const WindowRect bounds = { screens[i].x_org, screens[i].y_org, screens[i].x_org + screens[i].width, screens[i].y_org + screens[i].height };
+            monitors.push_back({ bounds, bounds, DEFAULT_DPI, i == 0, NO_TASKBAR });
+        }
+        if (screens != nullptr)
+            XFree(screens);
+    }
+    if (monitors.empty())
+    {
+        const int screen = DefaultScreen(x);
+        const WindowRect bounds = { 0, 0, DisplayWidth(x, screen), DisplayHeight(x, screen) };
+        monitors.push_back({ bounds, bounds, DEFAULT_DPI, true, NO_TASKBAR });
+    }
+
+    // Panels and docks are clients too; each one takes its share of its monitor's work area
+    for (const Client& client : Clients())
+    {
+        std::vector<unsigned long> types;
+        if (!ReadCardinals(client.window, atomWindowType, types) || std::find(types.begin(), types.end(), atomWindowTypeDock) == types.end())
+            continue;
+
+        const WindowRect dock = GetWindowPosition(client.window);
+        const int32_t centerX = (dock.left + dock.right) / 2;
+        const int32_t centerY = (dock.top + dock.bottom) / 2;
+        for (MonitorInfo& monitor : monitors)
+        {
+            const WindowRect& bounds = monitor.bounds;
+            if (centerX < bounds.left || centerX >= bounds.right || centerY < bounds.top || centerY >= bounds.bottom)
+                continue;
+
+            const TaskbarEdge edge = TaskbarEdgeOf(dock, bounds);
+            switch (edge)
+            {
+                case TaskbarEdge::Top:
+                    monitor.workArea.top = std::max(monitor.workArea.top, dock.bottom);
+                    break;
+                case TaskbarEdge::Bottom:
+                    monitor.workArea.bottom = std::min(monitor.workArea.bottom, dock.top);
+                    break;
+                case TaskbarEdge::Left:
+                    monitor.workArea.left = std::max(monitor.workArea.left, dock.right);
+                    break;
+                case TaskbarEdge::Right:
+                    monitor.workArea.right = std::min(monitor.workArea.right, dock.left);
+                    break;
+                default:
+                    break;
+            }
+            // The first dock is the taskbar; the others are just app bars
+            if (monitor.taskbar == NO_TASKBAR)
+                monitor.taskbar = edge;
+            break;
+        }
+    }
+
+    for (const MonitorInfo& monitor : monitors)
+        callback(monitor);
+}
+
+BackendCounters X11DesktopBackend::Counters() const
+{
+    return { syscalls, messages };
+}
+
+void X11DesktopBackend::ResetCounters()
+{
+    syscalls = 0;
+    messages = 0;
+}
+
+std::vector<X11DesktopBackend::Client> X11DesktopBackend::Clients()
+{
+    std::vector<unsigned long> windows;
+    ReadCardinals(root, atomClientList, windows);
+
+    std::vector<Client> clients;
+    clients.reserve(windows.size());
+    std::unordered_map<unsigned long, ProcessId> owners;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        owners.swap(clientOwners);
+    }
+
+    // A window's owner never changes: only new clients cost a round trip
+    std::unordered_map<unsigned long, ProcessId> stillThere;
+    for (const unsigned long window : windows)
+    {
+        const auto it = owners.find(window);
+        ProcessId processId = 0;
+        std::vector<unsigned long> pid;
+        if (it != owners.end())
+            processId = it->second;
+        else if (ReadCardinals(window, atomWmPid, pid) && !pid.empty())
+            processId = static_cast<ProcessId>(pid[0]);
+
+        clients.push_back({ window, processId });
+        stillThere.emplace(window, processId);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    clientOwners.swap(stillThere);
+    return clients;
+}
+
+bool X11DesktopBackend::IsClient(const unsigned long window)
+{
+    std::vector<unsigned long> windows;
+    return ReadCardinals(root, atomClientList, windows) && std::find(windows.begin(), windows.end(), window) != windows.end();
+}
+
+bool X11DesktopBackend::ReadClass(const unsigned long window, std::string& className)
+{
+    XClassHint hint = {};
+    Count(1);
+    if (!XGetClassHint(ToDisplay(display), window, &hint))
+        return false;
+
+    const bool found = hint.res_class != nullptr;
+    if (found)
+        className = hint.res_class;
+    if (hint.res_name != nullptr)
+        XFree(hint.res_name);
+    if (hint.res_class != nullptr)
+        XFree(hint.res_class);
+    return found;
+}
+
+bool X11DesktopBackend::ReadCardinals(const unsigned long window, const unsigned long property, std::vector<unsigned long>& values)
+{
+    Atom type;
+    int format;
+    unsigned long count;
+    unsigned long remaining;
+    unsigned char* data = nullptr;
+    Count(1);
+    if (XGetWindowProperty(ToDisplay(display), window, property, 0, 65536, False, AnyPropertyType, &type, &format, &count, &remaining, &data) != Success)
+        return false;
+
+    // Format-32 properties come back as longs, whatever their size on the wire
+    const bool found = data != nullptr && format == 32;
+    if (found)
+    {
+        const unsigned long* const items = reinterpret_cast<const unsigned long*>(data);
+        values.assign(items, items + count);
+    }
+    if (data != nullptr)
+        XFree(data);
+    return found;
+}
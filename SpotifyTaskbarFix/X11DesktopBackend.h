@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DesktopBackend.h"
+
+// Xlib.h defines None, Bool, Status and friends as macros, which would break
+// every header included after this one: only the .cpp includes it.
+struct _XDisplay;
+
+// DesktopBackend on an X11 display with an EWMH window manager (every current
+// one is). The window manager's _NET_CLIENT_LIST stands in for the top-level
+// windows, _NET_WM_PID for their owners and WM_CLASS for their class names;
+// windows are moved by asking the window manager with _NET_MOVERESIZE_WINDOW.
+//
+// X has no notion of threads owning windows: every process is a single
+// pseudo-thread, whose ThreadId is its process ID. Processes come from /proc.
+//
+// Experimental: its test stands in for the window manager, and has yet to be
+// run against a real one; nothing vouches for it the way the tests do for the core.
+class X11DesktopBackend final : public DesktopBackend
+{
+public:
+    X11DesktopBackend() = default;
+    ~X11DesktopBackend() override;
+
+    X11DesktopBackend(const X11DesktopBackend&) = delete;
+    X11DesktopBackend& operator=(const X11DesktopBackend&) = delete;
+
+    // `displayName` as in XOpenDisplay; nullptr for $DISPLAY.
+    bool Open(const char* displayName);
+    void Close();
+
+    uint64_t Now() override;
+    void Sleep(uint32_t ms) override;
+
+    bool GetProcessImageName(ProcessId processId, std::wstring& imageName) override;
+    bool GetProcessCommandLine(ProcessId processId, std::wstring& commandLine) override;
+    // See ReadProcessImageVersion: not a file version, but it changes with every update all the same.
+    bool GetProcessImageVersion(ProcessId processId, std::wstring& version) override;
+
+    // There's no input-idle state on X: a process is idle once it has mapped a client window.
+    bool WaitForInputIdle(ProcessId processId, uint32_t timeoutMs) override;
+    // Only the processes that own client windows have a (pseudo-)thread.
+    void EnumSystemThreads(const SystemThreadCallback& callback) override;
+    void EnumSystemProcesses(const SystemProcessCallback& processCallback, const SystemThreadCallback& threadCallback) override;
+    void EnumWindowThreads(ProcessId processId, const ThreadCallback& callback) override;
+
+    void EnumThreadWindows(ThreadId threadId, const WindowCallback& callback) override;
+    void EnumChildWindows(WindowHandle hWnd, const WindowCallback& callback) override;
+    WindowHandle FindChildWindow(WindowHandle hParent, const wchar_t* className) override;
+    WindowHandle GetParentWindow(WindowHandle hWnd) override;
+
+    // Atoms are handed out per (case-insensitive) WM_CLASS, the first time it's seen.
+    ClassAtom GetClassAtom(WindowHandle hWnd) override;
+    size_t GetWindowClass(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+    size_t GetWindowTitle(WindowHandle hWnd, wchar_t* buffer, size_t bufferLength) override;
+
+    // Mapped and viewable: STYLE_VISIBLE. A client in the normal state (i.e. managed and
+    // not iconified, with its decorations): STYLE_SYSMENU. No extended style.
+    uint32_t GetStyle(WindowHandle hWnd) override;
+    uint32_t GetExStyle(WindowHandle hWnd) override;
+
+    // A client's position is its root coordinates, frame excluded, which is what
+    // _NET_MOVERESIZE_WINDOW with static gravity expects back.
+    WindowRect GetWindowPosition(WindowHandle hWnd) override;
+    bool SetWindowPosition(WindowHandle hWnd, const WindowMove& move) override;
+
+    // One monitor per Xinerama screen (RandR maintains those too); the work area
+    // and the taskbar edge come from the dock windows on each.
+    void EnumMonitors(const MonitorCallback& callback) override;
+
+    // The connection is thread-safe, but it serializes every request anyway
+    bool Concurrent() const override { return false; }
+
+    // Round trips to the X server count as system calls; requests the window
+    // manager has to act on count as cross-process messages.
+    BackendCounters Counters() const override;
+    void ResetCounters() override;
+
+private:
+    typedef struct {
+        unsigned long window;
+        ProcessId processId;
+    } Client;
+
+    void Count(const uint64_t calls, const uint64_t crossProcessMessages = 0)
+    {
+        syscalls += calls;
+        messages += crossProcessMessages;
+    }
+
+    // _NET_CLIENT_LIST, with the owner of each client; owners are cached per window.
+    std::vector<Client> Clients();
+    bool IsClient(unsigned long window);
+    bool ReadClass(unsigned long window, std::string& className);
+    bool ReadCardinals(unsigned long window, unsigned long property, std::vector<unsigned long>& values);
+    bool EnumChildWindowsRecursive(unsigned long window, const WindowCallback& callback);
+
+    _XDisplay* display = nullptr;
+    unsigned long root = 0;
+
+    unsigned long atomClientList = 0;
+    unsigned long atomWmPid = 0;
+    unsigned long atomWmName = 0;
+    unsigned long atomWmState = 0;
+    unsigned long atomWindowType = 0;
+    unsigned long atomWindowTypeDock = 0;
+    unsigned long atomMoveResize = 0;
+    unsigned long atomUtf8String = 0;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, ClassAtom> classAtoms;
+    std::unordered_map<unsigned long, ProcessId> clientOwners;
+
+    std::atomic<uint64_t> syscalls{ 0 };
+    std::atomic<uint64_t> messages{ 0 };
+};
@@ -0,0 +1,39 @@
+#include "Debouncer.h"
+#include "Test.h"
+
+TEST(Debouncer, FiresOnceItQuietsDown)
+{
+    Debouncer debouncer(750, 5000);
+    CHECK(!debouncer.Pending());
+    CHECK(debouncer.Deadline() == Debouncer::NEVER);
+    CHECK(!debouncer.Fire(10000));
+
+    debouncer.Trigger(1000);
+    debouncer.Trigger(1100);
+    debouncer.Trigger(1200);
+    CHECK(debouncer.Pending());
+    CHECK(debouncer.Deadline() == 1950);
+    CHECK(!debouncer.Fire(1949));
+    CHECK(debouncer.Fire(1950));
+
+    // Once per burst
+    CHECK(!debouncer.Pending());
+    CHECK(!debouncer.Fire(3000));
+    CHECK(debouncer.Triggers() == 3);
+    CHECK(debouncer.Fired() == 1);
+}
+
+TEST(Debouncer, FiresAtTheMaxDelayIfItNeverQuietsDown)
+{
+    Debouncer debouncer(750, 5000);
+    uint64_t fired = 0;
+    for (uint64_t time = 1000; time < 8000; time += 500)
+    {
+        if (debouncer.Fire(time))
+            fired = time;
+        debouncer.Trigger(time);
+    }
+    CHECK(fired == 6000);
+    CHECK(debouncer.Pending());
+    CHECK(debouncer.Fired() == 1);
+}
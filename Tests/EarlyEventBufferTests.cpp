@@ -0,0 +1,129 @@
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EarlyEventBuffer.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    // What reached the sink, in order; it takes everything
+    class RecordingSink
+    {
+    public:
+        EarlyEventBuffer::Sink Sink()
+        {
+            return [this](const ProcessStartEvent* const events, const size_t count)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                calls++;
+                for (size_t i = 0; i < count; i++)
+                    processIds.push_back(events[i].processId);
+                return count;
+            };
+        }
+
+        std::vector<ProcessId> ProcessIds()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return processIds;
+        }
+
+        size_t Calls()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return calls;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<ProcessId> processIds;
+        size_t calls = 0;
+    };
+}
+
+TEST(EarlyEventBuffer, KeepsEventsUntilOpen)
+{
+    EarlyEventBuffer buffer;
+    RecordingSink sink;
+
+    const ProcessStartEvent early[] = { TestStartEvent(1000, 1), TestStartEvent(1001, 1000) };
+    CHECK(buffer.Submit(early, 2) == 2);
+    CHECK(buffer.Submit(&early[0], 0) == 0);
+    const ProcessStartEvent third = TestStartEvent(1002, 1000);
+    CHECK(buffer.Submit(&third, 1) == 1);
+    CHECK(!buffer.IsOpen());
+    CHECK(buffer.Buffered() == 3);
+
+    // Handed over at once, in the order they came in
+    CHECK(buffer.Open(sink.Sink()) == 3);
+    CHECK(buffer.IsOpen());
+    CHECK(sink.Calls() == 1);
+    CHECK(sink.ProcessIds() == std::vector<ProcessId>({ 1000, 1001, 1002 }));
+
+    // Then straight through; opening again changes nothing
+    const ProcessStartEvent late = TestStartEvent(1003, 1000);
+    CHECK(buffer.Submit(&late, 1) == 1);
+    CHECK(sink.Calls() == 2);
+    CHECK(buffer.Open(sink.Sink()) == 0);
+    CHECK(sink.ProcessIds().size() == 4);
+    CHECK(buffer.Buffered() == 3 && buffer.Dropped() == 0);
+}
+
+TEST(EarlyEventBuffer, NothingToHandOver)
+{
+    EarlyEventBuffer buffer;
+    RecordingSink sink;
+    CHECK(buffer.Open(sink.Sink()) == 0);
+    CHECK(sink.Calls() == 0);
+}
+
+TEST(EarlyEventBuffer, DropsWhatDoesNotFit)
+{
+    EarlyEventBuffer buffer(2);
+    RecordingSink sink;
+
+    std::vector<ProcessStartEvent> events;
+    for (ProcessId i = 0; i < 5; i++)
+        events.push_back(TestStartEvent(1000 + i, 1));
+    CHECK(buffer.Submit(events.data(), 3) == 2);
+    CHECK(buffer.Submit(&events[3], 2) == 0);
+    CHECK(buffer.Buffered() == 2 && buffer.Dropped() == 3);
+
+    // The first ones are kept, not the last
+    CHECK(buffer.Open(sink.Sink()) == 2);
+    CHECK(sink.ProcessIds() == std::vector<ProcessId>({ 1000, 1001 }));
+
+    // Once open, there's no limit
+    CHECK(buffer.Submit(events.data(), 5) == 5);
+}
+
+TEST(EarlyEventBuffer, OpenWhileEventsKeepComing)
+{
+    constexpr ProcessId EVENTS = 20000;
+    EarlyEventBuffer buffer(EVENTS);
+    RecordingSink sink;
+
+    std::thread source([&]
+    {
+        for (ProcessId i = 0; i < EVENTS; i++)
+        {
+            const ProcessStartEvent event = TestStartEvent(1000 + i, 1);
+            buffer.Submit(&event, 1);
+        }
+    });
+    while (buffer.Buffered() == 0)
+        std::this_thread::yield();
+    buffer.Open(sink.Sink());
+    source.join();
+
+    // Every one of them, once, in order: none slipped past the ones being handed over
+    const std::vector<ProcessId> processIds = sink.ProcessIds();
+    REQUIRE(processIds.size() == EVENTS);
+    bool ordered = true;
+    for (ProcessId i = 0; i < EVENTS; i++)
+        ordered &= processIds[i] == 1000 + i;
+    CHECK(ordered);
+    CHECK(buffer.Dropped() == 0);
+}
@@ -0,0 +1,51 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <unistd.h>
+
+#include "EpollEventLoop.h"
+#include "Test.h"
+
+namespace
+{
+    constexpr auto IDLE_TIME = std::chrono::milliseconds(200);
+
+    // Gives the loop's thread up to a second to get there
+    template <typename Condition>
+    bool Eventually(Condition condition)
+    {
+        for (int i = 0; i < 1000 && !condition(); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return condition();
+    }
+}
+
+TEST(EpollEventLoop, SleepsUntilThereIsSomethingToDo)
+{
+    // A pipe nobody writes to: watched, but never readable
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    EpollEventLoop loop;
+    loop.Watch(fds[0], [] {});
+    std::thread runner([&] { loop.Run(); });
+
+    std::this_thread::sleep_for(IDLE_TIME);
+    CHECK(loop.Wakeups() == 0);
+    CHECK(loop.IdleWakeups() == 0);
+
+    // One task, one wakeup, and it wasn't for nothing
+    std::atomic<bool> ran{ false };
+    loop.Post([&] { ran = true; });
+    CHECK(Eventually([&] { return loop.Wakeups() == 1; }));
+    CHECK(ran);
+    std::this_thread::sleep_for(IDLE_TIME);
+    CHECK(loop.Wakeups() == 1);
+    CHECK(loop.IdleWakeups() == 0);
+
+    loop.Quit();
+    runner.join();
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,207 @@
+#include <vector>
+
+#include "FixJob.h"
+#include "WindowHintCache.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    // Steps the job whenever it asks to be, and returns the phases it went through, in order.
+    std::vector<FixJob::Phase> RunJob(SimulatedDesktopBackend& desktop, FixJob& job)
+    {
+        std::vector<FixJob::Phase> phases = { job.CurrentPhase() };
+        while (!job.Step())
+        {
+            if (job.CurrentPhase() != phases.back())
+                phases.push_back(job.CurrentPhase());
+            desktop.AdvanceTo(job.WakeAt());
+        }
+        phases.push_back(job.CurrentPhase());
+        return phases;
+    }
+
+    // In the order of FixJob::Phase, none skipped
+    bool InOrder(const std::vector<FixJob::Phase>& phases)
+    {
+        for (size_t i = 1; i < phases.size(); i++)
+        {
+            if (static_cast<int>(phases[i]) < static_cast<int>(phases[i - 1]))
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(FixJob, PhasesOfAWarmLaunch)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    const WindowHandle hWnd = AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    const std::vector<FixJob::Phase> phases = RunJob(desktop, job);
+
+    // The phases it waited in; the main window is found in the same step as the main process
+    const std::vector<FixJob::Phase> expected = {
+        FixJob::Phase::WaitInputIdle,
+        FixJob::Phase::IdentifyMainProcess,
+        FixJob::Phase::WaitVisible,
+        FixJob::Phase::Done,
+    };
+    CHECK(phases == expected);
+    CHECK(job.Result() == FixResult::WindowMoved);
+    CHECK(job.MainProcessId() == 1000);
+    CHECK(job.MainWindow() == hWnd);
+
+    // Once idle, and once the main window shows; the window's found as soon as it's created
+    CHECK(job.Waited(WaitPhase::InputIdle).observed && !job.Waited(WaitPhase::InputIdle).timedOut);
+    CHECK(job.Waited(WaitPhase::InputIdle).ms == 150);
+    CHECK(!job.Waited(WaitPhase::MainProcess).timedOut);
+    CHECK(!job.Waited(WaitPhase::Visible).timedOut);
+}
+
+TEST(FixJob, RoundTripThroughThePrimaryMonitor)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    const WindowHandle hWnd = AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    RunJob(desktop, job);
+
+    // Away and back, without a repaint, and not before the window was shown
+    const std::vector<SimulatedDesktopBackend::MoveRecord>& moves = desktop.Moves();
+    REQUIRE(moves.size() == 2);
+    CHECK(moves[0].hWnd == hWnd && moves[1].hWnd == hWnd);
+    CHECK(moves[0].rect.left < TEST_SECONDARY_MONITOR_LEFT);
+    CHECK(moves[1].rect.left == TEST_SECONDARY_MONITOR_LEFT);
+    CHECK(!moves[0].redraw && !moves[1].redraw);
+    CHECK(moves[0].time >= 450);
+}
+
+TEST(FixJob, LeavesTheWindowOnThePrimaryMonitorAlone)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    TestLaunch launch = WarmLaunch();
+    launch.windowLeft = 100;
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, launch, 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    RunJob(desktop, job);
+
+    CHECK(job.Result() == FixResult::WindowInPlace);
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixJob, HelperIsNotTheMainProcess)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1001, FixedWaitSchedule());
+    const std::vector<FixJob::Phase> phases = RunJob(desktop, job);
+
+    CHECK(InOrder(phases));
+    CHECK(job.Result() == FixResult::NotMainProcess);
+    CHECK(job.Waited(WaitPhase::MainProcess).timedOut);
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixJob, TimesOutWhenTheWindowIsNeverShown)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    TestLaunch launch = WarmLaunch();
+    launch.visibleMs = 60 * 1000;
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, launch, 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    const std::vector<FixJob::Phase> phases = RunJob(desktop, job);
+
+    CHECK(InOrder(phases));
+    CHECK(job.Result() == FixResult::WindowNotVisible);
+    CHECK(job.Waited(WaitPhase::Visible).timedOut);
+    CHECK(desktop.Now() < launch.visibleMs);
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixJob, MainWindowNotFound)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    // Identified by its marker, but no main window ever comes
+    desktop.AddProcess(1000, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+    desktop.AddThread(1000, 16001);
+    desktop.SetInputIdleAt(100, 1000);
+    desktop.CreateWindowAt(200, 16001, NULL_WINDOW, L"GDI+ Hook Window Class", L"G", 0, { 0, 0, 0, 0 });
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    RunJob(desktop, job);
+
+    CHECK(job.Result() == FixResult::MainWindowNotFound);
+    CHECK(job.MainProcessId() == 1000);
+    CHECK(job.MainWindow() == NULL_WINDOW);
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixJob, Cancel)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixJob job(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    CHECK(!job.Step());
+    job.Cancel();
+
+    CHECK(job.CurrentPhase() == FixJob::Phase::Done);
+    CHECK(job.Result() == FixResult::Cancelled);
+    CHECK(job.Step());
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixJob, OneHintLookupResultPerLaunch)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    AddTestLaunch(desktop, WarmLaunch(10 * 1000), 2000, events);
+    desktop.SetProcessVersion(1000, L"1.2.3.4");
+    desktop.SetProcessVersion(2000, L"1.2.3.4");
+    const RuleSet rules = RuleSet::Default();
+    WindowHintCache windowHints;
+
+    // The first launch of a version searches the long way, however many times it has to
+    FixJob first(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 1000, FixedWaitSchedule());
+    first.SetWindowHintCache(&windowHints);
+    RunJob(desktop, first);
+    CHECK(first.Result() == FixResult::WindowMoved);
+    CHECK(windowHints.Misses() == 1);
+    CHECK(windowHints.Hits() == 0);
+
+    // And the next one finds its window where the first one's was
+    desktop.AdvanceTo(10 * 1000);
+    FixJob second(desktop, &desktop, rules, rules.FindApp(L"Spotify.exe"), 2000, FixedWaitSchedule());
+    second.SetWindowHintCache(&windowHints);
+    RunJob(desktop, second);
+    CHECK(second.Result() == FixResult::WindowMoved);
+    CHECK(windowHints.Misses() == 1);
+    CHECK(windowHints.Hits() == 1);
+}
@@ -0,0 +1,472 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FixScheduler.h"
+#include "WindowEventHub.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    // The secondary monitor, unplugged and plugged back in at a higher resolution
+    void ChangeSecondaryMonitor(SimulatedDesktopBackend& desktop)
+    {
+        desktop.RemoveMonitors();
+        desktop.AddMonitor({ { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom });
+        desktop.AddMonitor({ { 1920, 0, 4480, 1440 }, { 1920, 0, 4480, 1400 }, 96, false, TaskbarEdge::Bottom });
+    }
+
+    // Waits like the real thing, and counts how often it's asked to
+    class CountingEventSource final : public WindowEventHub
+    {
+    public:
+        bool WaitForAnyWindowEvent(const uint64_t sequence, const uint32_t timeoutMs) override
+        {
+            waits++;
+            return WindowEventHub::WaitForAnyWindowEvent(sequence, timeoutMs);
+        }
+
+        std::atomic<size_t> waits{ 0 };
+    };
+
+    // Gives the worker thread up to a second to get there
+    template <typename Condition>
+    bool Eventually(Condition condition)
+    {
+        for (int i = 0; i < 1000 && !condition(); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return condition();
+    }
+}
+
+TEST(FixScheduler, CoalescesATreeIntoOneJob)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, events);
+
+    CHECK(results.Count() == 1);
+    CHECK(results.Count(FixResult::WindowMoved) == 1);
+    // Every helper is told apart by its command line, and joins the tree's job
+    CHECK(scheduler.RejectedHelpers() == 6);
+    CHECK(scheduler.CoalescedEvents() == 6);
+    CHECK(scheduler.DroppedEvents() == 0);
+    CHECK(scheduler.ActiveJobs() == 0);
+    CHECK(desktop.Moves().size() == 2);
+}
+
+TEST(FixScheduler, LateChildrenOfASettledTree)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, events);
+    const uint64_t coalesced = scheduler.CoalescedEvents();
+
+    // A renderer for a new tab, and a child of that one, long after the fix
+    desktop.AddProcess(1100, 1000, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer");
+    desktop.AddProcess(1101, 1100, L"Spotify.exe", L"\"Spotify.exe\" --type=utility");
+    SubmitAndRun(scheduler, { { desktop.Now() + 10000, TestStartEvent(1100, 1000) }, { desktop.Now() + 10010, TestStartEvent(1101, 1100) } });
+
+    CHECK(results.Count() == 1);
+    CHECK(scheduler.CoalescedEvents() == coalesced + 2);
+    CHECK(desktop.Moves().size() == 2);
+}
+
+TEST(FixScheduler, IgnoresOtherProcesses)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    desktop.AddProcess(500, 1, L"notepad.exe");
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, { { 0, TestStartEvent(500, 1, L"notepad.exe") } });
+
+    CHECK(results.Count() == 0);
+    CHECK(scheduler.IgnoredProcesses() == 1);
+}
+
+TEST(FixScheduler, OverlappingLaunches)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    for (ProcessId i = 1; i <= 8; i++)
+        AddTestLaunch(desktop, WarmLaunch(i * 40), i * 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, events);
+
+    CHECK(results.Count() == 8);
+    CHECK(results.Count(FixResult::WindowMoved) == 8);
+    CHECK(desktop.Moves().size() == 16);
+}
+
+TEST(FixScheduler, MoreLaunchesThanJobSlots)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    for (ProcessId i = 1; i <= 12; i++)
+        AddTestLaunch(desktop, WarmLaunch(i * 10), i * 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    // Four at a time: the other trees wait for a slot, and their helpers join them once they get one
+    FixScheduler scheduler(desktop, desktop, rules, 4);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, events);
+
+    CHECK(results.Count() == 12);
+    CHECK(results.Count(FixResult::WindowMoved) == 12);
+    CHECK(desktop.Moves().size() == 24);
+    CHECK(scheduler.DroppedEvents() == 0);
+    CHECK(scheduler.ActiveJobs() == 0);
+}
+
+TEST(FixScheduler, BurstOfSettledTrees)
+{
+    constexpr ProcessId TREES = 20;
+
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    for (ProcessId i = 1; i <= TREES; i++)
+        AddTestLaunch(desktop, WarmLaunch(i * 5), i * 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    scheduler.SetWatchMode(true);
+    TestResults results(scheduler);
+    SubmitAndRun(scheduler, events);
+    REQUIRE(results.Fixed() == TREES);
+    REQUIRE(scheduler.WatchedWindows() == TREES);
+    const uint64_t coalesced = scheduler.CoalescedEvents();
+    const size_t moves = desktop.Moves().size();
+
+    // A new renderer in every tree at once, then docking: each tree is left alone, and nudged once
+    std::vector<ProcessStartEvent> renderers;
+    for (ProcessId i = 1; i <= TREES; i++)
+    {
+        desktop.AddProcess(i * 1000 + 100, i * 1000, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer");
+        renderers.push_back(TestStartEvent(i * 1000 + 100, i * 1000));
+    }
+    scheduler.RunUntil(desktop.Now() + 1000);
+    CHECK(scheduler.Submit(renderers.data(), renderers.size()) == TREES);
+    ChangeSecondaryMonitor(desktop);
+    for (int i = 0; i < 10; i++)
+    {
+        scheduler.NotifyDisplayChanged();
+        scheduler.RunUntil(desktop.Now() + 50);
+    }
+    scheduler.RunUntilIdle();
+
+    CHECK(results.Count() == TREES);
+    CHECK(scheduler.CoalescedEvents() == coalesced + TREES);
+    CHECK(scheduler.DisplayPasses() == 1);
+    CHECK(scheduler.Renudges() == TREES);
+    CHECK(desktop.Moves().size() == moves + 2 * TREES);
+}
+
+TEST(FixScheduler, DropsWhatDoesNotFitInTheQueue)
+{
+    SimulatedDesktopBackend desktop;
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(desktop, desktop, rules, FixScheduler::DEFAULT_MAX_JOBS, 4);
+
+    std::vector<ProcessStartEvent> batch;
+    for (ProcessId i = 0; i < 10; i++)
+        batch.push_back(TestStartEvent(500 + i, 1, L"notepad.exe"));
+
+    CHECK(scheduler.Submit(batch.data(), batch.size()) == 4);
+    CHECK(!scheduler.Submit(batch[0]));
+    CHECK(scheduler.DroppedEvents() == 7);
+
+    // Once the queue is drained, there's room again
+    scheduler.RunUntilIdle();
+    CHECK(scheduler.IgnoredProcesses() == 4);
+    CHECK(scheduler.Submit(batch.data(), 2) == 2);
+}
+
+TEST(FixScheduler, QueuesNoMoreThanItCanHoldWhileEveryJobIsBusy)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> launches;
+    for (ProcessId i = 1; i <= 12; i++)
+    {
+        TestLaunch launch = WarmLaunch();
+        launch.helpers = 0;
+        AddTestLaunch(desktop, launch, i * 1000, launches);
+    }
+    std::vector<ProcessStartEvent> batch;
+    for (const ReplayStartEvent& launch : launches)
+        batch.push_back(launch.event);
+    const RuleSet rules = RuleSet::Default();
+
+    // One job at a time, four events waiting for it, four more in the inbox: nothing else fits
+    FixScheduler scheduler(desktop, desktop, rules, 1, 4);
+    TestResults results(scheduler);
+    CHECK(scheduler.Submit(batch.data(), 4) == 4);
+    scheduler.RunUntil(1);
+    CHECK(scheduler.ActiveJobs() == 1);
+    CHECK(scheduler.Submit(batch.data() + 4, 4) == 4);
+    scheduler.RunUntil(2);
+    CHECK(scheduler.Submit(batch.data() + 8, 4) == 1);
+    CHECK(scheduler.DroppedEvents() == 3);
+
+    // Every one that was queued gets its turn, including those left with no job running
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 9);
+    CHECK(results.Fixed() == 9);
+    CHECK(scheduler.ActiveJobs() == 0);
+}
+
+TEST(FixScheduler, AlreadyRunningApps)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    desktop.AdvanceTo(1000);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    scheduler.Reconcile(SystemSnapshot::Take(desktop));
+    scheduler.RunUntilIdle();
+
+    // The whole tree was found, and fixed once
+    CHECK(scheduler.RunningProcesses() == 7);
+    CHECK(results.Count() == 1);
+    CHECK(results.Count(FixResult::WindowMoved) == 1);
+
+    // Reconciling again changes nothing; a refix does it all over again
+    scheduler.Reconcile(SystemSnapshot::Take(desktop));
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 1);
+    scheduler.Refix(SystemSnapshot::Take(desktop));
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 2);
+    CHECK(desktop.Moves().size() == 4);
+}
+
+TEST(FixScheduler, PicksUpReloadedRules)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    desktop.AdvanceTo(1000);
+
+    // Rules that know nothing of Spotify
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse("[Notepad]\nprocess = notepad.exe\nwindow = Notepad\n", error));
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    scheduler.Refix(SystemSnapshot::Take(desktop));
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 0);
+
+    // Reloaded the way the program does it: swapped in while nothing runs, then a refix
+    rules = RuleSet::Default();
+    scheduler.Refix(SystemSnapshot::Take(desktop));
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 1);
+    CHECK(results.Count(FixResult::WindowMoved) == 1);
+}
+
+TEST(FixScheduler, Cancel)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    scheduler.Submit(events.front().event);
+    scheduler.RunUntil(100);
+    CHECK(scheduler.ActiveJobs() == 1);
+
+    scheduler.Cancel(1000);
+    scheduler.RunUntilIdle();
+    CHECK(results.Count(FixResult::Cancelled) == 1);
+    CHECK(scheduler.ActiveJobs() == 0);
+    CHECK(desktop.Moves().empty());
+}
+
+TEST(FixScheduler, DebouncesDisplayChanges)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    scheduler.SetWatchMode(true);
+    SubmitAndRun(scheduler, events);
+    REQUIRE(scheduler.WatchedWindows() == 1);
+    const size_t moves = desktop.Moves().size();
+
+    // Docking: a burst of changes, 100 ms apart
+    uint64_t time = desktop.Now() + 1000;
+    ChangeSecondaryMonitor(desktop);
+    for (int i = 0; i < 10; i++)
+    {
+        scheduler.RunUntil(time);
+        scheduler.NotifyDisplayChanged();
+        time += 100;
+    }
+    const uint64_t lastChange = time - 100;
+
+    // Nothing happens until it's been quiet for a while, and then only once
+    scheduler.RunUntil(lastChange + FixScheduler::DISPLAY_CHANGE_QUIET_PERIOD - 1);
+    CHECK(scheduler.DisplayPasses() == 0);
+    CHECK(desktop.Moves().size() == moves);
+
+    scheduler.RunUntilIdle();
+    CHECK(scheduler.DisplayPasses() == 1);
+    CHECK(scheduler.Renudges() == 1);
+    CHECK(desktop.Moves().size() == moves + 2);
+    CHECK(desktop.Now() >= lastChange + FixScheduler::DISPLAY_CHANGE_QUIET_PERIOD);
+}
+
+TEST(FixScheduler, DisplayChangesThatNeverQuietDown)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    scheduler.SetWatchMode(true);
+    SubmitAndRun(scheduler, events);
+
+    // Closer together than the quiet period, for longer than the max delay
+    const uint64_t firstChange = desktop.Now() + 1000;
+    ChangeSecondaryMonitor(desktop);
+    for (uint64_t time = firstChange; time < firstChange + 2 * FixScheduler::DISPLAY_CHANGE_MAX_DELAY; time += 500)
+    {
+        scheduler.RunUntil(time);
+        scheduler.NotifyDisplayChanged();
+        if (time < firstChange + FixScheduler::DISPLAY_CHANGE_MAX_DELAY)
+            CHECK(scheduler.DisplayPasses() == 0);
+    }
+    scheduler.RunUntilIdle();
+
+    // Once when the max delay was up, once after the rest of the burst; by then it's all the same topology
+    CHECK(scheduler.DisplayPasses() == 2);
+    CHECK(scheduler.Renudges() == 1);
+}
+
+TEST(FixScheduler, DisplayChangedBack)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    scheduler.SetWatchMode(true);
+    SubmitAndRun(scheduler, events);
+    const size_t moves = desktop.Moves().size();
+
+    // Unplugged and plugged back in as it was
+    scheduler.RunUntil(desktop.Now() + 1000);
+    desktop.RemoveMonitors();
+    scheduler.NotifyDisplayChanged();
+    AddTestMonitors(desktop);
+    scheduler.NotifyDisplayChanged();
+    scheduler.RunUntilIdle();
+
+    CHECK(scheduler.DisplayPasses() == 1);
+    CHECK(scheduler.Renudges() == 0);
+    CHECK(desktop.Moves().size() == moves);
+}
+
+TEST(FixScheduler, DisplayChangesAreIgnoredOutsideWatchMode)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+
+    FixScheduler scheduler(desktop, desktop, rules);
+    SubmitAndRun(scheduler, events);
+    ChangeSecondaryMonitor(desktop);
+    scheduler.NotifyDisplayChanged();
+    scheduler.RunUntilIdle();
+
+    CHECK(scheduler.WatchedWindows() == 0);
+    CHECK(scheduler.DisplayPasses() == 0);
+}
+
+TEST(FixScheduler, IdleWorkerNeverWakesUp)
+{
+    SimulatedDesktopBackend desktop;
+    CountingEventSource events;
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(desktop, events, rules);
+    scheduler.Start();
+
+    // With nothing to do, the worker waits once, for as long as it takes
+    REQUIRE(Eventually([&] { return events.waits == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(events.waits == 1);
+
+    // An event wakes it up, once, and it goes back to waiting
+    CHECK(scheduler.Submit(TestStartEvent(500, 1, L"notepad.exe")));
+    CHECK(Eventually([&] { return scheduler.IgnoredProcesses() == 1 && events.waits == 2; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(events.waits == 2);
+
+    scheduler.Stop();
+}
+
+TEST(FixScheduler, RestartForgetsWhatCameBefore)
+{
+    SimulatedDesktopBackend desktop;
+    CountingEventSource events;
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(desktop, events, rules);
+    scheduler.Start();
+    REQUIRE(Eventually([&] { return events.waits == 1; }));
+    scheduler.Stop();
+
+    // Left over from the scheduler that was stopped, e.g. before the rules changed
+    CHECK(scheduler.Submit(TestStartEvent(500, 1, L"notepad.exe")));
+
+    // Waiting again means the new worker went through its queue, empty
+    scheduler.Start();
+    REQUIRE(Eventually([&] { return events.waits == 2; }));
+    CHECK(scheduler.IgnoredProcesses() == 0);
+
+    // What comes in after the restart is handled as usual
+    CHECK(scheduler.Submit(TestStartEvent(501, 1, L"notepad.exe")));
+    CHECK(Eventually([&] { return scheduler.IgnoredProcesses() == 1; }));
+    scheduler.Stop();
+}
@@ -0,0 +1,118 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "FixScheduler.h"
+#include "LaunchTrace.h"
+#include "RecordingDesktopBackend.h"
+#include "Replay.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    std::string TempPath(const char* name)
+    {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+}
+
+TEST(LaunchTrace, RoundTrip)
+{
+    LaunchTraceWriter writer;
+    const uint32_t name = writer.AddString(L"Spotify.exe");
+    CHECK(writer.AddString(L"Spotify.exe") == name);
+    const uint32_t title = writer.AddString(L"Spotify Premium \u266B");
+
+    LaunchTraceRecord& start = writer.Add(0, LaunchTraceRecordType::StartEvent);
+    start.processId = 1000;
+    start.value = 1;
+    start.text = name;
+    LaunchTraceRecord& window = writer.Add(300, LaunchTraceRecordType::WindowTitle);
+    window.window = 0x123456789AULL;
+    window.text = title;
+    LaunchTraceRecord& move = writer.Add(450, LaunchTraceRecordType::Move);
+    move.rect[0] = -1920;
+    move.rect[3] = 900;
+    move.value = LAUNCH_TRACE_MOVE_REDRAW;
+
+    const std::string path = TempPath("SpotifyTaskbarFixTests-RoundTrip.trace");
+    REQUIRE(writer.Save(path));
+
+    {
+        LaunchTraceReader reader;
+        std::string error;
+        REQUIRE(reader.Open(path, error));
+        REQUIRE(reader.RecordCount() == 3);
+
+        CHECK(reader.Record(0).type == LaunchTraceRecordType::StartEvent);
+        CHECK(reader.Record(0).processId == 1000 && reader.Record(0).value == 1);
+        CHECK(reader.String(reader.Record(0).text) == L"Spotify.exe");
+        CHECK(reader.Record(1).time == 300);
+        CHECK(reader.Record(1).window == 0x123456789AULL);
+        CHECK(reader.String(reader.Record(1).text) == L"Spotify Premium \u266B");
+        CHECK(reader.Record(2).rect[0] == -1920 && reader.Record(2).rect[3] == 900);
+        CHECK(reader.Record(2).value == LAUNCH_TRACE_MOVE_REDRAW);
+        CHECK(reader.Record(2).text == LAUNCH_TRACE_NO_STRING);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(LaunchTrace, RejectsWhatIsNotATrace)
+{
+    const std::string path = TempPath("SpotifyTaskbarFixTests-NotATrace.trace");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "definitely not a launch trace, though long enough to hold a header";
+    }
+
+    LaunchTraceReader reader;
+    std::string error;
+    CHECK(!reader.Open(path, error));
+    CHECK(!error.empty());
+    CHECK(reader.RecordCount() == 0);
+    std::filesystem::remove(path);
+
+    CHECK(!reader.Open(TempPath("SpotifyTaskbarFixTests-Missing.trace"), error));
+}
+
+TEST(LaunchTrace, RecordedLaunchReplaysTheSame)
+{
+    // A launch, recorded as the fix logic saw it
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+
+    RecordingDesktopBackend recorder(desktop);
+    recorder.StartRecording();
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(recorder, desktop, rules);
+    TestResults results(scheduler);
+    for (const ReplayStartEvent& event : events)
+    {
+        scheduler.RunUntil(event.time);
+        recorder.RecordStartEvent(event.event);
+        scheduler.Submit(event.event);
+    }
+    scheduler.RunUntilIdle();
+    REQUIRE(results.Count(FixResult::WindowMoved) == 1);
+
+    const std::string path = TempPath("SpotifyTaskbarFixTests-Recorded.trace");
+    REQUIRE(recorder.Save(path));
+
+    {
+        LaunchTraceReader trace;
+        std::string error;
+        REQUIRE(trace.Open(path, error));
+
+        // Played back, it comes to the same fix, with the same moves
+        const ReplayResult replay = ReplayLaunchTrace(trace, rules);
+        REQUIRE(replay.fixes.size() == 1);
+        CHECK(replay.fixes[0].processId == 1000);
+        CHECK(replay.fixes[0].result == FixResult::WindowMoved);
+        CHECK(replay.moves == desktop.Moves().size());
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,95 @@
+#include <cstdio>
+
+#include "ProcessClassifier.h"
+#include "SimulatedDesktopBackend.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    typedef struct {
+        ProcessId processId;
+        ProcessId parentProcessId;
+        const wchar_t* imageName;
+        // Null if it can't be read: the process is gone, or isn't ours to look at
+        const wchar_t* commandLine;
+        ProcessRole expected;
+    } CorpusProcess;
+
+    // Process trees as they show up on real desktops: Spotify's own, started by
+    // hand, at login and by its updater, the odd install path, and processes
+    // whose command line couldn't be read.
+    const CorpusProcess CORPUS[] = {
+        { 4, 1, L"explorer.exe", L"C:\\Windows\\Explorer.EXE", ProcessRole::Unknown },
+
+        // Started by hand
+        { 1000, 4, L"Spotify.exe", L"\"C:\\Users\\me\\AppData\\Roaming\\Spotify\\Spotify.exe\"", ProcessRole::Main },
+        { 1001, 1000, L"Spotify.exe", L"\"C:\\Users\\me\\AppData\\Roaming\\Spotify\\Spotify.exe\" --type=gpu-process --field-trial-handle=1712,i,5", ProcessRole::Helper },
+        { 1002, 1000, L"Spotify.exe", L"\"C:\\Users\\me\\AppData\\Roaming\\Spotify\\Spotify.exe\" --type=utility --utility-sub-type=network.mojom.NetworkService", ProcessRole::Helper },
+        { 1003, 1000, L"Spotify.exe", L"\"C:\\Users\\me\\AppData\\Roaming\\Spotify\\Spotify.exe\" --type=renderer --renderer-client-id=5", ProcessRole::Helper },
+        { 1004, 1000, L"Spotify.exe", L"\"C:\\Users\\me\\AppData\\Roaming\\Spotify\\Spotify.exe\" --type=crashpad-handler /prefetch:7", ProcessRole::Helper },
+        // A renderer's own child
+        { 1005, 1003, L"Spotify.exe", L"Spotify.exe\t--type=utility", ProcessRole::Helper },
+
+        // At login, and from the Microsoft Store
+        { 2000, 4, L"Spotify.exe", L"\"Spotify.exe\" --autostart --minimized", ProcessRole::Main },
+        { 2001, 2000, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer", ProcessRole::Helper },
+        { 2100, 4, L"Spotify.exe", L"\"C:\\Program Files\\WindowsApps\\SpotifyAB.SpotifyMusic_1.2.3.4_x86__zpdnekdrzrea0\\Spotify.exe\" --protocol-uri=spotify:", ProcessRole::Main },
+
+        // Relaunched by its updater: its parent is Spotify, but its command line says it's the main process
+        { 3000, 4, L"Spotify.exe", L"\"Spotify.exe\"", ProcessRole::Main },
+        { 3001, 3000, L"Spotify.exe", L"\"Spotify.exe\" --relaunched-after-update", ProcessRole::Main },
+
+        // Installed somewhere that looks like a switch, but isn't one
+        { 4000, 4, L"Spotify.exe", L"\"D:\\apps\\build--type=release\\Spotify.exe\"", ProcessRole::Main },
+        { 4001, 4000, L"Spotify.exe", L"\"D:\\apps\\build--type=release\\Spotify.exe\" --type=renderer", ProcessRole::Helper },
+
+        // No command line: the parent is all there is to go by
+        { 5001, 1000, L"Spotify.exe", nullptr, ProcessRole::Helper },
+        { 5002, 4, L"Spotify.exe", nullptr, ProcessRole::Unknown },
+        { 5003, 9999, L"Spotify.exe", nullptr, ProcessRole::Unknown },
+        { 5004, 0, L"Spotify.exe", nullptr, ProcessRole::Unknown },
+    };
+
+    void AddCorpus(SimulatedDesktopBackend& desktop)
+    {
+        for (const CorpusProcess& process : CORPUS)
+        {
+            if (process.commandLine != nullptr)
+                desktop.AddProcess(process.processId, process.parentProcessId, process.imageName, process.commandLine);
+        }
+    }
+}
+
+TEST(ProcessClassifier, Corpus)
+{
+    SimulatedDesktopBackend desktop;
+    AddCorpus(desktop);
+    const RuleSet rules = RuleSet::Default();
+    const AppRule& spotify = rules.App(rules.FindApp(L"Spotify.exe"));
+
+    for (const CorpusProcess& process : CORPUS)
+    {
+        if (WStrICmp(process.imageName, L"Spotify.exe") != 0)
+            continue;
+
+        const ProcessRole role = ClassifyProcess(desktop, TestStartEvent(process.processId, process.parentProcessId, process.imageName), spotify);
+        if (!CHECK(role == process.expected))
+            fprintf(stderr, "  process %u: %ls\n", static_cast<unsigned>(process.processId), process.commandLine != nullptr ? process.commandLine : L"(no command line)");
+    }
+}
+
+TEST(ProcessClassifier, ProcessTypeSwitch)
+{
+    CHECK(HasProcessTypeSwitch(L"--type=renderer"));
+    CHECK(HasProcessTypeSwitch(L"a.exe --type=gpu-process"));
+    CHECK(HasProcessTypeSwitch(L"a.exe\t--type=utility"));
+    // A later switch counts even if an earlier "--type=" was part of something else
+    CHECK(HasProcessTypeSwitch(L"\"C:\\x--type=y\\a.exe\" --type=renderer"));
+
+    CHECK(!HasProcessTypeSwitch(L""));
+    CHECK(!HasProcessTypeSwitch(L"a.exe"));
+    CHECK(!HasProcessTypeSwitch(L"\"C:\\x--type=y\\a.exe\""));
+    CHECK(!HasProcessTypeSwitch(L"a.exe --process-type=renderer"));
+    CHECK(!HasProcessTypeSwitch(L"a.exe --type"));
+}
@@ -0,0 +1,160 @@
+#include <atomic>
+#include <chrono>
+#include <cwchar>
+#include <thread>
+#include <vector>
+
+#include "FixScheduler.h"
+#include "ProcessEventBatcher.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    // The i-th object of a delivery; odd ones can't be read when `skipOdd` is set
+    bool Extract(const size_t i, ProcessStartEvent& record, const bool skipOdd)
+    {
+        if (skipOdd && i % 2 == 1)
+            return false;
+        record.processId = static_cast<ProcessId>(1000 + i);
+        record.parentProcessId = 1;
+        wcscpy(record.processName, L"Spotify.exe");
+        return true;
+    }
+}
+
+TEST(ProcessEventBatcher, HandsOnWholeBatches)
+{
+    std::vector<size_t> batches;
+    std::vector<ProcessId> processIds;
+    ProcessEventBatcher batcher([&](const ProcessStartEvent* events, const size_t count)
+    {
+        batches.push_back(count);
+        for (size_t i = 0; i < count; i++)
+            processIds.push_back(events[i].processId);
+        return count;
+    });
+
+    CHECK(batcher.Ingest(5, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }) == 5);
+    REQUIRE(batches.size() == 1);
+    CHECK(batches[0] == 5);
+
+    // More than the pool holds: in pool-sized batches, in order
+    const size_t count = 2 * ProcessEventBatcher::POOL_SIZE + 3;
+    CHECK(batcher.Ingest(count, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }) == count);
+    REQUIRE(batches.size() == 4);
+    CHECK(batches[1] == ProcessEventBatcher::POOL_SIZE && batches[2] == ProcessEventBatcher::POOL_SIZE && batches[3] == 3);
+    bool ordered = true;
+    for (size_t i = 0; i < count; i++)
+        ordered &= processIds[5 + i] == 1000 + i;
+    CHECK(ordered);
+
+    CHECK(batcher.Received() == 5 + count);
+    CHECK(batcher.Batches() == 4);
+    CHECK(batcher.Skipped() == 0 && batcher.Dropped() == 0);
+}
+
+TEST(ProcessEventBatcher, SkipsUnreadableObjects)
+{
+    std::vector<ProcessStartEvent> delivered;
+    ProcessEventBatcher batcher([&](const ProcessStartEvent* events, const size_t count)
+    {
+        delivered.insert(delivered.end(), events, events + count);
+        return count;
+    });
+
+    CHECK(batcher.Ingest(10, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, true); }) == 5);
+    CHECK(batcher.Skipped() == 5);
+    REQUIRE(delivered.size() == 5);
+    CHECK(delivered[1].processId == 1002);
+    CHECK(wcscmp(delivered[1].processName, L"Spotify.exe") == 0);
+
+    // Records start out cleared: nothing leaks from one object into the next
+    batcher.Ingest(1, [](size_t, ProcessStartEvent& record) { record.processId = 7; return true; });
+    REQUIRE(delivered.size() == 6);
+    CHECK(delivered[5].processName[0] == L'\0' && delivered[5].parentProcessId == 0);
+
+    // Nothing readable, nothing handed on
+    CHECK(batcher.Ingest(3, [](size_t, ProcessStartEvent&) { return false; }) == 0);
+    CHECK(delivered.size() == 6);
+}
+
+TEST(ProcessEventBatcher, CountsWhatTheCallbackRefuses)
+{
+    ProcessEventBatcher batcher([](const ProcessStartEvent*, const size_t count) { return count > 4 ? count - 4 : 0; });
+
+    CHECK(batcher.Ingest(10, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }) == 6);
+    CHECK(batcher.Dropped() == 4);
+    CHECK(batcher.Received() == 10);
+}
+
+TEST(ProcessEventBatcher, FeedsTheScheduler)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    ProcessEventBatcher batcher([&](const ProcessStartEvent* batch, const size_t count) { return scheduler.Submit(batch, count); });
+
+    // The whole tree in one delivery, the way WMI batches a burst, with an unreadable object after each event
+    const size_t delivered = batcher.Ingest(2 * events.size(), [&](const size_t i, ProcessStartEvent& record)
+    {
+        if (i % 2 == 1)
+            return false;
+        record = events[i / 2].event;
+        return true;
+    });
+    CHECK(delivered == events.size());
+    CHECK(batcher.Skipped() == events.size() && batcher.Dropped() == 0);
+    CHECK(batcher.Batches() == 1);
+
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 1);
+    CHECK(results.Count(FixResult::WindowMoved) == 1);
+}
+
+TEST(ProcessEventBatcher, CloseWaitsForTheDeliveryInProgress)
+{
+    std::atomic<bool> inCallback{ false };
+    std::atomic<bool> release{ false };
+    std::atomic<size_t> delivered{ 0 };
+    ProcessEventBatcher batcher([&](const ProcessStartEvent*, const size_t count)
+    {
+        inCallback = true;
+        while (!release)
+            std::this_thread::yield();
+        delivered += count;
+        inCallback = false;
+        return count;
+    });
+
+    // A delivery stuck in the callback, on the event source's thread
+    std::thread source([&] { batcher.Ingest(3, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }); });
+    while (!inCallback)
+        std::this_thread::yield();
+
+    std::atomic<bool> closed{ false };
+    std::thread closer([&] { batcher.Close(); closed = true; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!closed);
+
+    release = true;
+    closer.join();
+    CHECK(closed && !inCallback);
+    CHECK(delivered == 3);
+    source.join();
+
+    // Closed: dropped, and the callback isn't called
+    release = false;
+    CHECK(batcher.Ingest(2, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }) == 0);
+    CHECK(!batcher.IsOpen());
+    CHECK(batcher.Dropped() == 2 && batcher.Received() == 5);
+
+    batcher.Open();
+    release = true;
+    CHECK(batcher.Ingest(2, [](const size_t i, ProcessStartEvent& record) { return Extract(i, record, false); }) == 2);
+    CHECK(delivered == 5);
+}
@@ -0,0 +1,147 @@
+#include <string>
+
+#include "Rules.h"
+#include "Test.h"
+
+namespace
+{
+    constexpr char TWO_APPS[] =
+        "# Two apps\n"
+        "[Spotify]\n"
+        "process = Spotify.exe\n"
+        "marker  = GDI+ Hook Window Class | G\n"
+        "window  = Chrome_WidgetWin_0 | *   ; any non-empty title\n"
+        "content = Chrome_RenderWidgetHostHWND\n"
+        "\n"
+        "[Discord]\r\n"
+        "process = Discord.exe\r\n"
+        "process = DiscordPTB.exe\r\n"
+        "window  = Chrome_WidgetWin_1 | \"\"\r\n"
+        "window  = Chrome_WidgetWin_0 | Discord\r\n";
+
+    // Parses a rule set made of `text`, and returns the error, if any
+    std::string ParseError(const std::string& text)
+    {
+        RuleSet rules;
+        std::string error;
+        if (rules.Parse(text, error))
+            return std::string();
+        return error.empty() ? "?" : error;
+    }
+
+    const WindowRule* FindRule(const RuleSet& rules, const wchar_t* className, const size_t app, const WindowRole role)
+    {
+        const std::vector<WindowRule>* matches = rules.MatchClass(className);
+        if (matches == nullptr)
+            return nullptr;
+        for (const WindowRule& rule : *matches)
+        {
+            if (rule.app == app && rule.role == role)
+                return &rule;
+        }
+        return nullptr;
+    }
+}
+
+TEST(Rules, Default)
+{
+    const RuleSet rules = RuleSet::Default();
+    REQUIRE(rules.Apps().size() == 1);
+    CHECK(rules.App(0).name == L"Spotify");
+    CHECK(rules.App(0).hasContentRule);
+    CHECK(rules.FindApp(L"Spotify.exe") == 0);
+    CHECK(rules.FindApp(L"SPOTIFY.EXE") == 0);
+    CHECK(rules.FindApp(L"Spotify") == RuleSet::NO_APP);
+    CHECK(rules.BuildWqlQuery() == L"SELECT * FROM Win32_ProcessStartTrace WHERE ProcessName = \"Spotify.exe\"");
+}
+
+TEST(Rules, ParsesSeveralApps)
+{
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse(TWO_APPS, error));
+
+    REQUIRE(rules.Apps().size() == 2);
+    CHECK(rules.App(1).name == L"Discord");
+    CHECK(rules.App(1).processNames.size() == 2);
+    CHECK(!rules.App(1).hasContentRule);
+    CHECK(rules.FindApp(L"discordptb.exe") == 1);
+
+    // Same class, different apps and roles
+    CHECK(FindRule(rules, L"Chrome_WidgetWin_0", 0, WindowRole::MainWindow) != nullptr);
+    CHECK(FindRule(rules, L"chrome_widgetwin_0", 1, WindowRole::MainWindow) != nullptr);
+    CHECK(FindRule(rules, L"Chrome_WidgetWin_1", 0, WindowRole::MainWindow) == nullptr);
+    CHECK(rules.MatchClass(L"Chrome_WidgetWin_2") == nullptr);
+}
+
+TEST(Rules, InlineComments)
+{
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse("[A]\nprocess = a.exe ; a space\nprocess = b.exe\t; a tab\nprocess = c;d.exe\nwindow = W\t\t;\n", error));
+    CHECK(rules.FindApp(L"a.exe") == 0);
+    CHECK(rules.FindApp(L"b.exe") == 0);
+    // Without whitespace before it, it's part of the name
+    CHECK(rules.FindApp(L"c;d.exe") == 0);
+    CHECK(rules.MatchClass(L"W") != nullptr);
+}
+
+TEST(Rules, BuildsOneWqlQueryForAllApps)
+{
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse(TWO_APPS, error));
+    CHECK(rules.BuildWqlQuery() == L"SELECT * FROM Win32_ProcessStartTrace WHERE ProcessName = \"Spotify.exe\" OR "
+                                   L"ProcessName = \"Discord.exe\" OR ProcessName = \"DiscordPTB.exe\"");
+
+    // Quotes and backslashes can't break out of the string
+    REQUIRE(rules.Parse("[Odd]\nprocess = a\"b\\c.exe\nwindow = W\n", error));
+    CHECK(rules.BuildWqlQuery() == L"SELECT * FROM Win32_ProcessStartTrace WHERE ProcessName = \"a\\\"b\\\\c.exe\"");
+}
+
+TEST(Rules, MatchesTitles)
+{
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse(TWO_APPS, error));
+
+    const WindowRule* nonEmpty = FindRule(rules, L"Chrome_WidgetWin_0", 0, WindowRole::MainWindow);
+    const WindowRule* empty = FindRule(rules, L"Chrome_WidgetWin_1", 1, WindowRole::MainWindow);
+    const WindowRule* exact = FindRule(rules, L"Chrome_WidgetWin_0", 1, WindowRole::MainWindow);
+    const WindowRule* any = FindRule(rules, L"Chrome_RenderWidgetHostHWND", 0, WindowRole::Content);
+    REQUIRE(nonEmpty != nullptr && empty != nullptr && exact != nullptr && any != nullptr);
+
+    CHECK(RuleSet::MatchTitle(*nonEmpty, L"Spotify Free"));
+    CHECK(!RuleSet::MatchTitle(*nonEmpty, L""));
+    CHECK(RuleSet::MatchTitle(*empty, L""));
+    CHECK(!RuleSet::MatchTitle(*empty, L"Discord"));
+    CHECK(RuleSet::MatchTitle(*exact, L"discord"));
+    CHECK(!RuleSet::MatchTitle(*exact, L"Discord Canary"));
+    CHECK(RuleSet::MatchTitle(*any, L""));
+    CHECK(RuleSet::MatchTitle(*any, L"anything"));
+}
+
+TEST(Rules, RejectsMalformedRules)
+{
+    CHECK(ParseError("[Spotify\nprocess = Spotify.exe\nwindow = W\n") == "line 1: malformed section header");
+    CHECK(ParseError("process = Spotify.exe\n") == "line 1: rule outside of an [App] section");
+    CHECK(ParseError("[Spotify]\nprocess Spotify.exe\n") == "line 2: expected 'key = value'");
+    CHECK(ParseError("[Spotify]\nprocess =\n") == "line 2: empty value");
+    CHECK(ParseError("[Spotify]\nprocess = Spotify.exe\nwindows = W\n") == "line 3: unknown key");
+    CHECK(ParseError("[Spotify]\nprocess = Spotify.exe\nwindow = | *\n") == "line 3: empty class name");
+    CHECK(ParseError("[Spotify]\nprocess = Spotify.exe\nmarker = G\n") == "[Spotify]: needs at least one 'process' and one 'window' rule");
+    CHECK(ParseError("[Spotify]\nwindow = W\n") == "[Spotify]: needs at least one 'process' and one 'window' rule");
+    CHECK(ParseError("") == "no [App] sections");
+    CHECK(ParseError("# Nothing but comments\n; and blank lines\n\n") == "no [App] sections");
+}
+
+TEST(Rules, FailedParseLeavesTheRulesAlone)
+{
+    RuleSet rules = RuleSet::Default();
+    std::string error;
+    CHECK(!rules.Parse("[Broken]\nwindow = W\n", error));
+    CHECK(!rules.Parse("", error));
+    CHECK(rules.Apps().size() == 1);
+    CHECK(rules.FindApp(L"Spotify.exe") == 0);
+    CHECK(rules.MatchClass(L"Chrome_WidgetWin_0") != nullptr);
+}
@@ -0,0 +1,177 @@
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EarlyEventBuffer.h"
+#include "FixScheduler.h"
+#include "StartupPipeline.h"
+#include "TestDesktop.h"
+#include "Test.h"
+
+namespace
+{
+    // The order steps ran in, by name
+    class StepLog
+    {
+    public:
+        StartupPipeline::Action Step(const char* name, const bool succeeds = true)
+        {
+            return [this, name, succeeds]
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                names.push_back(name);
+                return succeeds;
+            };
+        }
+
+        // Where `name` ran among the steps; -1 if it didn't
+        int IndexOf(const char* name)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (names[i] == name)
+                    return static_cast<int>(i);
+            }
+            return -1;
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return names.size();
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<std::string> names;
+    };
+}
+
+TEST(StartupPipeline, RunsStepsAfterWhatTheyDependOn)
+{
+    StartupPipeline startup;
+    StepLog log;
+    const StartupPipeline::StepId com = startup.AddOnCallingThread("COM", log.Step("COM"));
+    const StartupPipeline::StepId locator = startup.Add("locator", log.Step("locator"), { com });
+    const StartupPipeline::StepId connection = startup.Add("connection", log.Step("connection"), { locator });
+    const StartupPipeline::StepId sink = startup.Add("sink", log.Step("sink"), { com });
+    startup.Add("subscription", log.Step("subscription"), { connection, sink });
+    startup.Add("hooks", log.Step("hooks"));
+
+    CHECK(startup.Run());
+    CHECK(startup.FailedStep() == nullptr);
+    CHECK(log.Count() == 6);
+    CHECK(log.IndexOf("COM") < log.IndexOf("locator"));
+    CHECK(log.IndexOf("locator") < log.IndexOf("connection"));
+    CHECK(log.IndexOf("COM") < log.IndexOf("sink"));
+    CHECK(log.IndexOf("connection") < log.IndexOf("subscription"));
+    CHECK(log.IndexOf("sink") < log.IndexOf("subscription"));
+    for (const StartupPipeline::StepTiming& timing : startup.Timings())
+        CHECK(timing.status == StartupPipeline::StepStatus::Succeeded);
+}
+
+TEST(StartupPipeline, FailedStepSkipsWhatDependsOnIt)
+{
+    StartupPipeline startup;
+    StepLog log;
+    const StartupPipeline::StepId com = startup.AddOnCallingThread("COM", log.Step("COM"));
+    const StartupPipeline::StepId connection = startup.Add("connection", log.Step("connection", false), { com });
+    const StartupPipeline::StepId subscription = startup.Add("subscription", log.Step("subscription"), { connection });
+    startup.Add("event loop", log.Step("event loop"), { subscription });
+    startup.Add("hooks", log.Step("hooks"));
+
+    CHECK(!startup.Run());
+    REQUIRE(startup.FailedStep() != nullptr);
+    CHECK(strcmp(startup.FailedStep(), "connection") == 0);
+
+    // Skipped all the way down; the independent step still ran
+    const std::vector<StartupPipeline::StepTiming>& timings = startup.Timings();
+    CHECK(timings[0].status == StartupPipeline::StepStatus::Succeeded);
+    CHECK(timings[1].status == StartupPipeline::StepStatus::Failed);
+    CHECK(timings[2].status == StartupPipeline::StepStatus::Skipped);
+    CHECK(timings[3].status == StartupPipeline::StepStatus::Skipped);
+    CHECK(timings[4].status == StartupPipeline::StepStatus::Succeeded);
+    CHECK(log.IndexOf("subscription") == -1 && log.IndexOf("event loop") == -1);
+    CHECK(log.IndexOf("hooks") >= 0);
+}
+
+TEST(StartupPipeline, StepThatThrowsFails)
+{
+    StartupPipeline startup;
+    StepLog log;
+    const StartupPipeline::StepId locator = startup.Add("locator", []() -> bool { throw std::runtime_error("no WMI"); });
+    startup.Add("connection", log.Step("connection"), { locator });
+
+    CHECK(!startup.Run());
+    CHECK(startup.Timings()[0].status == StartupPipeline::StepStatus::Failed);
+    CHECK(startup.Timings()[1].status == StartupPipeline::StepStatus::Skipped);
+    CHECK(log.Count() == 0);
+}
+
+TEST(StartupPipeline, ThreadsOfItsOwnAndTheCallingOne)
+{
+    StartupPipeline startup;
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<bool> onCaller{ false };
+    std::atomic<bool> elsewhere{ false };
+    std::atomic<int> entered{ 0 };
+    std::atomic<int> left{ 0 };
+    startup.SetThreadHooks([&] { entered++; }, [&] { left++; });
+    startup.AddOnCallingThread("event loop", [&] { onCaller = std::this_thread::get_id() == caller; return true; });
+    startup.Add("hooks", [&] { elsewhere = std::this_thread::get_id() != caller; return true; });
+
+    CHECK(startup.Run());
+    CHECK(onCaller && elsewhere);
+    CHECK(startup.Timings()[0].onCallingThread && !startup.Timings()[1].onCallingThread);
+    // Only around the steps on threads of its own
+    CHECK(entered == 1 && left == 1);
+}
+
+TEST(StartupPipeline, EarlyEventsReachTheEngineOnceItIsReady)
+{
+    SimulatedDesktopBackend desktop;
+    AddTestMonitors(desktop);
+    std::vector<ReplayStartEvent> events;
+    AddTestLaunch(desktop, WarmLaunch(), 1000, events);
+    const RuleSet rules = RuleSet::Default();
+    FixScheduler scheduler(desktop, desktop, rules);
+    TestResults results(scheduler);
+    EarlyEventBuffer earlyEvents;
+
+    // The way the program comes up: the subscription doesn't wait for the engine, and
+    // Spotify starts in between
+    StartupPipeline startup;
+    std::atomic<size_t> handedOver{ 0 };
+    std::atomic<size_t> handedOverBeforeReady{ 0 };
+    const StartupPipeline::StepId subscription = startup.Add("subscription", [&]
+    {
+        for (const ReplayStartEvent& event : events)
+            earlyEvents.Submit(&event.event, 1);
+        handedOverBeforeReady = handedOver.load();
+        return true;
+    });
+    const StartupPipeline::StepId engine = startup.Add("fix engine", [] { return true; }, { subscription });
+    startup.Add("early events", [&]
+    {
+        earlyEvents.Open([&](const ProcessStartEvent* batch, const size_t count)
+        {
+            handedOver += count;
+            return scheduler.Submit(batch, count);
+        });
+        return true;
+    }, { engine });
+
+    CHECK(startup.Run());
+    // None of them reached the scheduler before it was ready, and all of them did after
+    CHECK(handedOverBeforeReady == 0);
+    CHECK(handedOver == events.size());
+    CHECK(earlyEvents.Buffered() == events.size() && earlyEvents.Dropped() == 0);
+    scheduler.RunUntilIdle();
+    CHECK(results.Count() == 1);
+    CHECK(results.Count(FixResult::WindowMoved) == 1);
+}
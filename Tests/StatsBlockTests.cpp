@@ -0,0 +1,141 @@
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "StatsBlock.h"
+#include "Test.h"
+
+namespace
+{
+    // Zero-filled, like a freshly created shared region
+    std::unique_ptr<StatsBlockLayout> NewBlockMemory()
+    {
+        void* memory = ::operator new(sizeof(StatsBlockLayout));
+        memset(memory, 0, sizeof(StatsBlockLayout));
+        return std::unique_ptr<StatsBlockLayout>(static_cast<StatsBlockLayout*>(memory));
+    }
+
+    void Fill(Statistics& statistics, const uint64_t value)
+    {
+        uint64_t words[STATISTICS_WORDS];
+        for (uint64_t& word : words)
+            word = value;
+        memcpy(&statistics, words, sizeof words);
+    }
+
+    // Every word the same, as Fill left them
+    bool Consistent(const Statistics& statistics)
+    {
+        uint64_t words[STATISTICS_WORDS];
+        memcpy(words, &statistics, sizeof words);
+        for (const uint64_t word : words)
+        {
+            if (word != words[0])
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(StatsBlock, PublishesUpdates)
+{
+    const std::unique_ptr<StatsBlockLayout> memory = NewBlockMemory();
+    StatsReader reader;
+    CHECK(!reader.Attach(memory.get()));
+
+    StatsWriter writer;
+    writer.Update([](Statistics& s) { s.eventsReceived = 3; });
+    writer.Attach(memory.get(), 42);
+    REQUIRE(reader.Attach(memory.get()));
+    CHECK(reader.ProcessId() == 42);
+
+    // Including what happened before it was attached
+    Statistics statistics;
+    REQUIRE(reader.Read(&statistics));
+    CHECK(statistics.eventsReceived == 3);
+
+    writer.Update([](Statistics& s) { s.windowsMoved++; s.fixLatency[LatencyBucket(300)]++; });
+    REQUIRE(reader.Read(&statistics));
+    CHECK(statistics.windowsMoved == 1);
+    CHECK(statistics.fixLatency[9] == 1);
+
+    writer.Reset();
+    REQUIRE(reader.Read(&statistics));
+    CHECK(statistics.eventsReceived == 0 && statistics.windowsMoved == 0);
+
+    writer.Detach();
+    StatsReader late;
+    CHECK(!late.Attach(memory.get()));
+}
+
+TEST(StatsBlock, ReadsAreNeverTorn)
+{
+    const std::unique_ptr<StatsBlockLayout> memory = NewBlockMemory();
+    StatsWriter writer;
+    writer.Attach(memory.get(), 1);
+    StatsReader reader;
+    REQUIRE(reader.Attach(memory.get()));
+
+    constexpr uint64_t UPDATES = 200000;
+    std::atomic<bool> done{ false };
+    std::thread updates([&]
+    {
+        for (uint64_t i = 1; i <= UPDATES; i++)
+            writer.Update([i](Statistics& s) { Fill(s, i); });
+        done = true;
+    });
+
+    size_t reads = 0;
+    size_t torn = 0;
+    uint64_t last = 0;
+    bool ordered = true;
+    while (!done)
+    {
+        Statistics statistics;
+        if (!reader.Read(&statistics))
+            continue;
+        reads++;
+        if (!Consistent(statistics))
+            torn++;
+        ordered &= statistics.eventsReceived >= last;
+        last = statistics.eventsReceived;
+    }
+    updates.join();
+
+    CHECK(reads > 0);
+    CHECK(torn == 0);
+    CHECK(ordered);
+    Statistics statistics;
+    REQUIRE(reader.Read(&statistics));
+    CHECK(statistics.eventsReceived == UPDATES && Consistent(statistics));
+}
+
+TEST(StatsBlock, CommandMailbox)
+{
+    const std::unique_ptr<StatsBlockLayout> memory = NewBlockMemory();
+    StatsWriter writer;
+    writer.Attach(memory.get(), 1);
+    StatsReader reader;
+    REQUIRE(reader.Attach(memory.get()));
+
+    CHECK(writer.TakeCommand() == ControlCommand::None);
+    const uint64_t serial = reader.Post(ControlCommand::Refix);
+    CHECK(serial != 0);
+    CHECK(!reader.Acknowledged(serial));
+
+    // One at a time
+    CHECK(reader.Post(ControlCommand::ReloadRules) == 0);
+
+    CHECK(writer.TakeCommand() == ControlCommand::Refix);
+    CHECK(reader.Acknowledged(serial));
+    CHECK(writer.TakeCommand() == ControlCommand::None);
+
+    const uint64_t next = reader.Post(ControlCommand::ResetStatistics);
+    CHECK(next == serial + 1);
+    CHECK(writer.TakeCommand() == ControlCommand::ResetStatistics);
+
+    CHECK(ParseControlCommand("reload") == ControlCommand::ReloadRules);
+    CHECK(ParseControlCommand("none") == ControlCommand::None);
+    CHECK(ParseControlCommand("bogus") == ControlCommand::None);
+}
@@ -0,0 +1,124 @@
+#include "MonitorTopology.h"
+#include "SimulatedDesktopBackend.h"
+#include "TaskbarNudge.h"
+#include "Test.h"
+
+namespace
+{
+    const MonitorInfo PRIMARY = { { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom };
+    const MonitorInfo RIGHT = { { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1040 }, 96, false, TaskbarEdge::Bottom };
+    // Left of the primary, at 150%, with its taskbar on top
+    const MonitorInfo LEFT_HIGH_DPI = { { -2560, 0, 0, 1440 }, { -2560, 40, 0, 1440 }, 144, false, TaskbarEdge::Top };
+    const MonitorInfo RIGHT_NO_TASKBAR = { { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1080 }, 96, false, TaskbarEdge::None };
+
+    MonitorTopology Topology(std::initializer_list<MonitorInfo> monitors)
+    {
+        MonitorTopology topology;
+        for (const MonitorInfo& monitor : monitors)
+            topology.Add(monitor);
+        return topology;
+    }
+
+    bool SameRect(const WindowRect& a, const WindowRect& b)
+    {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    }
+}
+
+TEST(MonitorTopology, MonitorFromRect)
+{
+    const MonitorTopology topology = Topology({ PRIMARY, RIGHT, LEFT_HIGH_DPI });
+    CHECK(topology.Primary() == 0);
+    CHECK(topology.MonitorFromRect({ 100, 100, 900, 700 }) == 0);
+    CHECK(topology.MonitorFromRect({ 2000, 100, 3000, 700 }) == 1);
+    CHECK(topology.MonitorFromRect({ -1000, 100, -200, 700 }) == 2);
+
+    // Straddling: wherever most of it is
+    CHECK(topology.MonitorFromRect({ 1800, 100, 2600, 700 }) == 1);
+    CHECK(topology.MonitorFromRect({ -100, 100, 500, 700 }) == 0);
+
+    // Off every monitor: the nearest one
+    CHECK(topology.MonitorFromRect({ 5000, 100, 5400, 700 }) == 1);
+    CHECK(topology.MonitorFromRect({ 500, 1200, 900, 1600 }) == 0);
+
+    CHECK(MonitorTopology().MonitorFromRect({ 0, 0, 10, 10 }) == MonitorTopology::NO_MONITOR);
+    CHECK(Topology({ RIGHT }).Primary() == MonitorTopology::NO_MONITOR);
+}
+
+TEST(MonitorTopology, SameAs)
+{
+    CHECK(Topology({ PRIMARY, RIGHT }).SameAs(Topology({ PRIMARY, RIGHT })));
+    CHECK(!Topology({ PRIMARY, RIGHT }).SameAs(Topology({ RIGHT, PRIMARY })));
+    CHECK(!Topology({ PRIMARY, RIGHT }).SameAs(Topology({ PRIMARY })));
+    CHECK(!Topology({ PRIMARY, RIGHT }).SameAs(Topology({ PRIMARY, RIGHT_NO_TASKBAR })));
+
+    MonitorInfo scaled = RIGHT;
+    scaled.dpi = 120;
+    CHECK(!SameMonitor(RIGHT, scaled));
+}
+
+TEST(MonitorTopology, Query)
+{
+    SimulatedDesktopBackend desktop;
+    CHECK(MonitorTopology::Query(desktop).Empty());
+
+    desktop.AddMonitor(PRIMARY);
+    desktop.AddMonitor(LEFT_HIGH_DPI);
+    CHECK(MonitorTopology::Query(desktop).SameAs(Topology({ PRIMARY, LEFT_HIGH_DPI })));
+}
+
+TEST(TaskbarNudge, RoundTripThroughThePrimaryWorkArea)
+{
+    const WindowRect window = { 2000, 100, 3200, 900 };
+    const TaskbarNudge nudge = PlanTaskbarNudge(Topology({ PRIMARY, RIGHT }), window);
+
+    CHECK(nudge.decision == NudgeDecision::Move);
+    REQUIRE(nudge.moveCount == 2);
+    CHECK(SameRect(nudge.moves[0].rect, { 0, 0, 1200, 800 }));
+    CHECK(SameRect(nudge.moves[1].rect, window));
+    // Same DPI: the size never changes, and there's nothing to repaint
+    CHECK(!nudge.moves[0].resize && !nudge.moves[1].resize);
+    CHECK(!nudge.moves[0].redraw && !nudge.moves[1].redraw);
+}
+
+TEST(TaskbarNudge, RestoresTheSizeAcrossDpis)
+{
+    const WindowRect window = { -2000, 200, -800, 1000 };
+    const TaskbarNudge nudge = PlanTaskbarNudge(Topology({ PRIMARY, LEFT_HIGH_DPI }), window);
+
+    CHECK(nudge.decision == NudgeDecision::Move);
+    REQUIRE(nudge.moveCount == 2);
+    CHECK(!nudge.moves[0].resize);
+    CHECK(nudge.moves[1].resize);
+    CHECK(SameRect(nudge.moves[1].rect, window));
+    CHECK(!nudge.moves[0].redraw && !nudge.moves[1].redraw);
+}
+
+TEST(TaskbarNudge, NoMoveWhenTheButtonCantBeMisplaced)
+{
+    const WindowRect onPrimary = { 100, 100, 1300, 900 };
+    const WindowRect onRight = { 2000, 100, 3200, 900 };
+
+    const TaskbarNudge single = PlanTaskbarNudge(Topology({ PRIMARY }), onRight);
+    CHECK(single.decision == NudgeDecision::SingleMonitor && single.moveCount == 0);
+
+    const TaskbarNudge primary = PlanTaskbarNudge(Topology({ PRIMARY, RIGHT }), onPrimary);
+    CHECK(primary.decision == NudgeDecision::OnPrimaryMonitor && primary.moveCount == 0);
+
+    const TaskbarNudge noTaskbar = PlanTaskbarNudge(Topology({ PRIMARY, RIGHT_NO_TASKBAR }), onRight);
+    CHECK(noTaskbar.decision == NudgeDecision::NoTaskbarOnMonitor && noTaskbar.moveCount == 0);
+}
+
+TEST(TaskbarNudge, BlindRoundTripWithoutTopology)
+{
+    const WindowRect window = { 2000, 100, 3200, 900 };
+    const TaskbarNudge nudge = PlanTaskbarNudge(MonitorTopology(), window);
+
+    CHECK(nudge.decision == NudgeDecision::UnknownTopology);
+    REQUIRE(nudge.moveCount == 2);
+    CHECK(SameRect(nudge.moves[0].rect, { 0, 0, 1200, 800 }));
+    CHECK(SameRect(nudge.moves[1].rect, window));
+
+    // No primary monitor is as good as no monitor at all
+    CHECK(PlanTaskbarNudge(Topology({ RIGHT }), window).decision == NudgeDecision::UnknownTopology);
+}
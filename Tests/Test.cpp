@@ -0,0 +1,73 @@
+#include "Test.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Log.h"
+
+namespace
+{
+    typedef struct {
+        const char* suite;
+        const char* name;
+        TestFunction function;
+    } TestCase;
+
+    // Filled in by static initializers, hence a function rather than a global
+    std::vector<TestCase>& Registry()
+    {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    const TestCase* currentTest = nullptr;
+    size_t currentFailures = 0;
+}
+
+bool RegisterTest(const char* const suite, const char* const name, const TestFunction function)
+{
+    Registry().push_back({ suite, name, function });
+    return true;
+}
+
+bool CheckTest(const bool condition, const char* const expression, const char* const file, const int line)
+{
+    if (!condition)
+    {
+        currentFailures++;
+        printf("%s:%d: %s.%s: CHECK(%s) failed\n", file, line, currentTest->suite, currentTest->name, expression);
+    }
+    return condition;
+}
+
+int main(const int argc, char* argv[])
+{
+    // The fix logic logs every step; only the failures are of interest
+    LogConfig quiet = {};
+    Logger::Instance().Start(quiet);
+
+    size_t run = 0;
+    size_t failed = 0;
+    for (const TestCase& test : Registry())
+    {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; i++)
+            selected |= strcmp(argv[i], test.suite) == 0;
+        if (!selected)
+            continue;
+
+        currentTest = &test;
+        currentFailures = 0;
+        test.function();
+        run++;
+        if (currentFailures > 0)
+            failed++;
+        printf("%-6s %s.%s\n", currentFailures > 0 ? "FAILED" : "ok", test.suite, test.name);
+    }
+
+    Logger::Instance().Stop();
+    printf("%zu tests, %zu failed\n", run, failed);
+    // Asking for a suite that doesn't exist is a mistake too
+    return failed == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// Just enough of a test framework: TEST(Suite, Name) defines and registers a
+// test, CHECK records a failure and carries on, REQUIRE gives up on the test.
+// The runner takes the suites to run on its command line (all of them
+// without any), so that each one can be its own ctest test.
+
+typedef void (*TestFunction)();
+
+bool RegisterTest(const char* suite, const char* name, TestFunction function);
+bool CheckTest(bool condition, const char* expression, const char* file, int line);
+
+#define TEST(suite, name) \
+    static void suite##_##name(); \
+    static const bool suite##_##name##_registered = RegisterTest(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(condition) CheckTest(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+#define REQUIRE(condition) \
+    do { if (!CheckTest(static_cast<bool>(condition), #condition, __FILE__, __LINE__)) return; } while (false)
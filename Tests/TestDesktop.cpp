@@ -0,0 +1,76 @@
+#include "TestDesktop.h"
+
+#include <algorithm>
+#include <string>
+
+TestLaunch WarmLaunch(const uint64_t startAt)
+{
+    return { startAt, 150, 300, 450, 6, TEST_SECONDARY_MONITOR_LEFT };
+}
+
+void AddTestMonitors(SimulatedDesktopBackend& desktop)
+{
+    desktop.AddMonitor({ { 0, 0, 1920, 1080 }, { 0, 0, 1920, 1040 }, 96, true, TaskbarEdge::Bottom });
+    desktop.AddMonitor({ { 1920, 0, 3840, 1080 }, { 1920, 0, 3840, 1040 }, 96, false, TaskbarEdge::Bottom });
+}
+
+WindowHandle AddTestLaunch(SimulatedDesktopBackend& desktop, const TestLaunch& launch, const ProcessId rootProcessId, std::vector<ReplayStartEvent>& events)
+{
+    const uint64_t start = launch.startAt;
+    const ThreadId uiThread = rootProcessId * 16 + 1;
+    const ThreadId gpuThread = rootProcessId * 16 + 2;
+
+    desktop.AddProcess(rootProcessId, 1, L"Spotify.exe", L"\"Spotify.exe\"");
+    desktop.AddThread(rootProcessId, uiThread);
+    desktop.AddThread(rootProcessId, gpuThread);
+    desktop.SetInputIdleAt(start + launch.inputIdleMs, rootProcessId);
+
+    const uint64_t windowAt = start + launch.windowMs;
+    const WindowRect rect = { launch.windowLeft, 100, launch.windowLeft + 1200, 900 };
+    desktop.CreateWindowAt(windowAt, uiThread, NULL_WINDOW, L"GDI+ Hook Window Class", L"G", 0, { 0, 0, 0, 0 });
+    const WindowHandle hWnd = desktop.CreateWindowAt(windowAt, uiThread, NULL_WINDOW, L"Chrome_WidgetWin_0", L"Spotify Free", 0, rect);
+    desktop.CreateWindowAt(windowAt + 20, uiThread, hWnd, L"Chrome_RenderWidgetHostHWND", L"", STYLE_VISIBLE, rect);
+    desktop.SetStyleAt(start + launch.visibleMs, hWnd, STYLE_VISIBLE | STYLE_SYSMENU);
+
+    events.push_back({ start, TestStartEvent(rootProcessId, 1) });
+    for (size_t i = 0; i < launch.helpers; i++)
+    {
+        const ProcessId helperId = rootProcessId + 1 + static_cast<ProcessId>(i);
+        desktop.AddProcess(helperId, rootProcessId, L"Spotify.exe", L"\"Spotify.exe\" --type=renderer");
+        desktop.AddThread(helperId, helperId * 16);
+        desktop.SetInputIdleAt(start + 10, helperId);
+        events.push_back({ start + 5 + 3 * i, TestStartEvent(helperId, rootProcessId) });
+    }
+    return hWnd;
+}
+
+ProcessStartEvent TestStartEvent(const ProcessId processId, const ProcessId parentProcessId, const wchar_t* const processName)
+{
+    ProcessStartEvent event = {};
+    event.processId = processId;
+    event.parentProcessId = parentProcessId;
+    std::wstring(processName).copy(event.processName, PROCESS_NAME_LENGTH - 1);
+    event.sessionId = 1;
+    return event;
+}
+
+void SubmitAndRun(FixScheduler& scheduler, std::vector<ReplayStartEvent> events)
+{
+    std::stable_sort(events.begin(), events.end(), [](const ReplayStartEvent& a, const ReplayStartEvent& b) { return a.time < b.time; });
+    for (const ReplayStartEvent& event : events)
+    {
+        scheduler.RunUntil(event.time);
+        scheduler.Submit(event.event);
+    }
+    scheduler.RunUntilIdle();
+}
+
+TestResults::TestResults(FixScheduler& scheduler)
+{
+    scheduler.SetCompletionCallback([this](const FixJob& job) { results.push_back(job.Result()); });
+}
+
+size_t TestResults::Count(const FixResult result) const
+{
+    return static_cast<size_t>(std::count(results.begin(), results.end(), result));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FixScheduler.h"
+#include "Replay.h"
+#include "SimulatedDesktopBackend.h"
+
+// Spotify on the simulated desktop, launched the way the benchmark launches it.
+
+constexpr int32_t TEST_SECONDARY_MONITOR_LEFT = 1920;
+
+typedef struct {
+    uint64_t startAt;
+    uint32_t inputIdleMs;
+    uint32_t windowMs;
+    uint32_t visibleMs;
+    size_t helpers;
+    int32_t windowLeft;
+} TestLaunch;
+
+// Idle after 150 ms, windows at 300, shown at 450, on the secondary monitor, with six helpers
+TestLaunch WarmLaunch(uint64_t startAt = 0);
+
+// A primary monitor with a secondary one to its right, each with a taskbar at the bottom.
+void AddTestMonitors(SimulatedDesktopBackend& desktop);
+
+// Scripts the process tree and its windows, and appends its start events to `events`.
+// Helpers are `rootProcessId` + 1, + 2... Returns the main window.
+WindowHandle AddTestLaunch(SimulatedDesktopBackend& desktop, const TestLaunch& launch, ProcessId rootProcessId, std::vector<ReplayStartEvent>& events);
+
+ProcessStartEvent TestStartEvent(ProcessId processId, ProcessId parentProcessId, const wchar_t* processName = L"Spotify.exe");
+
+// Submits each event at its time (they're sorted first), then runs until there's nothing left to do.
+void SubmitAndRun(FixScheduler& scheduler, std::vector<ReplayStartEvent> events);
+
+// What a scheduler's jobs ended with, through its completion callback
+class TestResults
+{
+public:
+    explicit TestResults(FixScheduler& scheduler);
+
+    size_t Count() const { return results.size(); }
+    size_t Count(FixResult result) const;
+    // WindowMoved or WindowInPlace
+    size_t Fixed() const { return Count(FixResult::WindowMoved) + Count(FixResult::WindowInPlace); }
+
+private:
+    std::vector<FixResult> results;
+};
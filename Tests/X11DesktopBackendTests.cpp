@@ -0,0 +1,278 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "SpotifyFix.h"
+#include "X11DesktopBackend.h"
+#include "Test.h"
+
+// After our own headers: Xlib.h defines None, Bool and friends as macros
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+// X11DesktopBackend against a real X server: Xvfb with two screens side by side,
+// this test standing in for the window manager. Only built where Xvfb was found.
+
+namespace
+{
+    constexpr int SCREEN_WIDTH = 1280;
+    constexpr int SCREEN_HEIGHT = 720;
+    constexpr int DOCK_HEIGHT = 40;
+    constexpr uint32_t XVFB_TIMEOUT_MS = 10 * 1000;
+
+    // Gives the window manager's thread up to a second to get there
+    template <typename Condition>
+    bool Eventually(Condition condition)
+    {
+        for (int i = 0; i < 1000 && !condition(); i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return condition();
+    }
+
+    // Xvfb on a display of its choosing, for as long as it's in scope
+    class VirtualDisplay
+    {
+    public:
+        VirtualDisplay()
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+                return;
+
+            serverProcessId = fork();
+            if (serverProcessId == 0)
+            {
+                close(fds[0]);
+                const std::string displayFd = std::to_string(fds[1]);
+                const std::string screen = std::to_string(SCREEN_WIDTH) + "x" + std::to_string(SCREEN_HEIGHT) + "x24";
+                execl(XVFB_PATH, XVFB_PATH, "-displayfd", displayFd.c_str(), "-screen", "0", screen.c_str(), "-screen", "1", screen.c_str(),
+                      "+xinerama", "-nolisten", "tcp", static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            close(fds[1]);
+
+            // It writes the display number once it's ready for connections
+            std::string number;
+            pollfd readable = { fds[0], POLLIN, 0 };
+            char c;
+            while (serverProcessId > 0 && poll(&readable, 1, XVFB_TIMEOUT_MS) == 1 && read(fds[0], &c, 1) == 1 && c != '\n')
+                number += c;
+            close(fds[0]);
+            if (!number.empty())
+                name = ":" + number;
+        }
+
+        ~VirtualDisplay()
+        {
+            if (serverProcessId <= 0)
+                return;
+            kill(serverProcessId, SIGTERM);
+            waitpid(serverProcessId, nullptr, 0);
+        }
+
+        VirtualDisplay(const VirtualDisplay&) = delete;
+        VirtualDisplay& operator=(const VirtualDisplay&) = delete;
+
+        // Empty if it didn't start
+        const std::string& Name() const { return name; }
+
+    private:
+        pid_t serverProcessId = -1;
+        std::string name;
+    };
+
+    // Just enough of an EWMH window manager: it lists its clients in _NET_CLIENT_LIST,
+    // marks them normal in WM_STATE, and carries out _NET_MOVERESIZE_WINDOW on its
+    // own thread. It doesn't reparent: a client's position is its position on the root.
+    class TestWindowManager
+    {
+    public:
+        bool Open(const std::string& displayName)
+        {
+            x = XOpenDisplay(displayName.c_str());
+            if (x == nullptr)
+                return false;
+            root = DefaultRootWindow(x);
+            atomClientList = XInternAtom(x, "_NET_CLIENT_LIST", False);
+            atomWmState = XInternAtom(x, "WM_STATE", False);
+            atomMoveResize = XInternAtom(x, "_NET_MOVERESIZE_WINDOW", False);
+            XSelectInput(x, root, SubstructureRedirectMask | SubstructureNotifyMask);
+            XSync(x, False);
+            return true;
+        }
+
+        ~TestWindowManager()
+        {
+            Stop();
+            if (x != nullptr)
+                XCloseDisplay(x);
+        }
+
+        // Maps a client with WM_CLASS; a dock, or one of this process's windows
+        Window Map(const int left, const int top, const int width, const int height, const char* className, const bool dock)
+        {
+            XSetWindowAttributes attributes = {};
+            const Window window = XCreateWindow(x, root, left, top, static_cast<unsigned>(width), static_cast<unsigned>(height), 0, CopyFromParent,
+                                                InputOutput, CopyFromParent, 0, &attributes);
+
+            XClassHint hint = {};
+            std::string name = className;
+            hint.res_name = &name[0];
+            hint.res_class = &name[0];
+            XSetClassHint(x, window, &hint);
+
+            if (dock)
+            {
+                const long type = static_cast<long>(XInternAtom(x, "_NET_WM_WINDOW_TYPE_DOCK", False));
+                XChangeProperty(x, window, XInternAtom(x, "_NET_WM_WINDOW_TYPE", False), XA_ATOM, 32, PropModeReplace,
+                                reinterpret_cast<const unsigned char*>(&type), 1);
+            }
+            else
+            {
+                const long processId = getpid();
+                XChangeProperty(x, window, XInternAtom(x, "_NET_WM_PID", False), XA_CARDINAL, 32, PropModeReplace,
+                                reinterpret_cast<const unsigned char*>(&processId), 1);
+            }
+            const long state[2] = { NormalState, 0 };
+            XChangeProperty(x, window, atomWmState, atomWmState, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(state), 2);
+
+            XMapWindow(x, window);
+            clients.push_back(static_cast<long>(window));
+            XChangeProperty(x, root, atomClientList, XA_WINDOW, 32, PropModeReplace, reinterpret_cast<const unsigned char*>(clients.data()),
+                            static_cast<int>(clients.size()));
+            XSync(x, False);
+            return window;
+        }
+
+        void Start()
+        {
+            worker = std::thread([this] { Run(); });
+        }
+
+        void Stop()
+        {
+            done = true;
+            if (worker.joinable())
+                worker.join();
+        }
+
+        // Where each _NET_MOVERESIZE_WINDOW put its window, in order
+        std::vector<XRectangle> Moves()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return moves;
+        }
+
+    private:
+        void Run()
+        {
+            while (!done)
+            {
+                while (XPending(x) > 0)
+                {
+                    XEvent event;
+                    XNextEvent(x, &event);
+                    if (event.type == ClientMessage && event.xclient.message_type == atomMoveResize)
+                        MoveResize(event.xclient);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        void MoveResize(const XClientMessageEvent& message)
+        {
+            XWindowAttributes attributes;
+            if (!XGetWindowAttributes(x, message.window, &attributes))
+                return;
+
+            const long flags = message.data.l[0];
+            XRectangle rect = { static_cast<short>(attributes.x), static_cast<short>(attributes.y), static_cast<unsigned short>(attributes.width),
+                                static_cast<unsigned short>(attributes.height) };
+            if ((flags & (1L << 8)) != 0)
+                rect.x = static_cast<short>(message.data.l[1]);
+            if ((flags & (1L << 9)) != 0)
+                rect.y = static_cast<short>(message.data.l[2]);
+            if ((flags & (1L << 10)) != 0)
+                rect.width = static_cast<unsigned short>(message.data.l[3]);
+            if ((flags & (1L << 11)) != 0)
+                rect.height = static_cast<unsigned short>(message.data.l[4]);
+            XMoveResizeWindow(x, message.window, rect.x, rect.y, rect.width, rect.height);
+            XSync(x, False);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            moves.push_back(rect);
+        }
+
+        Display* x = nullptr;
+        Window root = 0;
+        Atom atomClientList = 0;
+        Atom atomWmState = 0;
+        Atom atomMoveResize = 0;
+        std::vector<long> clients;
+
+        std::thread worker;
+        std::atomic<bool> done{ false };
+        std::mutex mutex;
+        std::vector<XRectangle> moves;
+    };
+}
+
+TEST(X11DesktopBackend, FixesAWindowOnTheSecondScreen)
+{
+    XInitThreads();
+    VirtualDisplay display;
+    REQUIRE(!display.Name().empty());
+
+    TestWindowManager windowManager;
+    REQUIRE(windowManager.Open(display.Name()));
+    // A taskbar on each screen, and the app's window on the second one
+    windowManager.Map(0, SCREEN_HEIGHT - DOCK_HEIGHT, SCREEN_WIDTH, DOCK_HEIGHT, "Panel", true);
+    windowManager.Map(SCREEN_WIDTH, SCREEN_HEIGHT - DOCK_HEIGHT, SCREEN_WIDTH, DOCK_HEIGHT, "Panel", true);
+    const Window window = windowManager.Map(SCREEN_WIDTH + 100, 100, 800, 500, "TestApp", false);
+    windowManager.Start();
+
+    X11DesktopBackend desktop;
+    REQUIRE(desktop.Open(display.Name().c_str()));
+
+    // What the backend makes of the display before it's asked to fix anything
+    size_t monitors = 0;
+    desktop.EnumMonitors([&](const MonitorInfo& monitor)
+    {
+        monitors++;
+        CHECK(monitor.taskbar == TaskbarEdge::Bottom);
+        CHECK(monitor.workArea.bottom == SCREEN_HEIGHT - DOCK_HEIGHT);
+    });
+    CHECK(monitors == 2);
+    CHECK((desktop.GetStyle(window) & (STYLE_VISIBLE | STYLE_SYSMENU)) == (STYLE_VISIBLE | STYLE_SYSMENU));
+    wchar_t className[32];
+    desktop.GetWindowClass(window, className, 32);
+    CHECK(std::wstring(className) == L"TestApp");
+
+    RuleSet rules;
+    std::string error;
+    REQUIRE(rules.Parse("[TestApp]\nprocess = testapp\nwindow = TestApp\n", error));
+    // Nothing tells the backend about window events: every wait polls
+    const FixResult result = FixTaskbarIssue(desktop, nullptr, rules, 0, static_cast<ProcessId>(getpid()));
+    CHECK(result == FixResult::WindowMoved);
+
+    // Through the first screen, and back where it was. The moves are only requests, carried out
+    // by the window manager when it gets to them.
+    REQUIRE(Eventually([&] { return windowManager.Moves().size() >= 2; }));
+    windowManager.Stop();
+    const std::vector<XRectangle> moves = windowManager.Moves();
+    REQUIRE(moves.size() == 2);
+    CHECK(moves[0].x < SCREEN_WIDTH);
+    CHECK(moves[1].x == SCREEN_WIDTH + 100);
+    const WindowRect position = desktop.GetWindowPosition(window);
+    CHECK(position.left == SCREEN_WIDTH + 100 && position.top == 100);
+}